@@ -56,6 +56,11 @@ public:
                  std::vector<Inst *> *ModelVars, Inst *Precondition,  bool Negate=false,
                  bool DropUB = false) = 0;
 
+  // The declarations and the assertion of the i1 Constraint, with variables
+  // named as in the queries this builder has built before, so that they can
+  // be added to a solver session that holds one of those queries
+  virtual std::string BuildAssertion(Inst *Constraint) = 0;
+
   Inst *getDataflowConditions(Inst *I);
   Inst *getUBInstCondition(Inst *Root);
 
@@ -112,6 +117,9 @@ std::string BuildQuery(InstContext &IC, const BlockPCs &BPCs,
        std::vector<Inst *> *ModelVars, Inst *Precondition, bool Negate=false,
        bool DropUB=false);
 
+// A builder of the configured kind, for callers that build several related
+// queries and assertions
+std::unique_ptr<ExprBuilder> createExprBuilder(InstContext &IC);
 std::unique_ptr<ExprBuilder> createKLEEBuilder(InstContext &IC);
 Inst *getUBInstCondition(InstContext &IC, Inst *Root);
 }
@@ -0,0 +1,46 @@
+// Copyright 2014 The Souper Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SOUPER_EXTRACTOR_QUERYPREPROCESSOR_H
+#define SOUPER_EXTRACTOR_QUERYPREPROCESSOR_H
+
+#include "souper/Inst/Inst.h"
+#include <vector>
+
+namespace souper {
+
+/// A validity query (BPCs && PCs => LHS == RHS) reduced to what a solver
+/// has to see. The query holds iff TriviallyValid is set, or the residual
+/// query over PCs holds, or one of the IndependentPCs groups can't be
+/// satisfied.
+struct PreprocessedQuery {
+  bool TriviallyValid = false;
+  /// Constant folded path conditions that share a variable with the
+  /// mapping or the precondition, directly or through other path conditions
+  std::vector<InstMapping> PCs;
+  /// The other path conditions, in groups that share no variable
+  std::vector<std::vector<InstMapping>> IndependentPCs;
+};
+
+/// Drops path conditions that always hold, folds constants in the others,
+/// and splits off the ones the mapping doesn't depend on. Queries with
+/// block path conditions or phis keep all of their path conditions.
+PreprocessedQuery preprocessQuery(InstContext &IC, const BlockPCs &BPCs,
+                                  const std::vector<InstMapping> &PCs,
+                                  InstMapping Mapping,
+                                  Inst *Precondition = nullptr);
+
+}
+
+#endif  // SOUPER_EXTRACTOR_QUERYPREPROCESSOR_H
@@ -103,6 +103,10 @@ std::unique_ptr<Solver> createMemCachingSolver(
     std::unique_ptr<Solver> UnderlyingSolver);
 std::unique_ptr<Solver> createExternalCachingSolver(
     std::unique_ptr<Solver> UnderlyingSolver, KVStore *KV);
+// A BaseSolver on SMTSolver whose queries are raced against in-process Z3
+// sessions using other tactics, and against Alive for validity
+std::unique_ptr<Solver> createPortfolioSolver(
+    std::unique_ptr<SMTLIBSolver> SMTSolver, unsigned Timeout);
 
 }
 
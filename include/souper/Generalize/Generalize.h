@@ -73,11 +73,6 @@ std::vector<Inst *> AllSubExprs(Inst *I, size_t W);
 std::vector<Inst *> ExtractSketchesSimple(InstContext &IC, ParsedReplacement Input,
                                           const std::map<Inst *, Inst *> &SymConstMap,
                                           size_t Width);
-std::optional<llvm::APInt> Fold(Inst *I);
-bool OpsConstP(Inst *I);
-
-Inst *ConstantFoldingLiteImpl(InstContext &IC, Inst *I, std::set<Inst *> &Visited);
-Inst *ConstantFoldingLite(InstContext &IC, Inst *I);
 
 
 std::vector<std::vector<Inst *>> InferSketchExprs(std::vector<Inst *> RHS,
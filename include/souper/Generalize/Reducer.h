@@ -12,9 +12,22 @@
 
 namespace souper {
 //extern Solver *S;
-class Reducer {
+// Listens to IC so that its caches keyed by Inst pointers forget the Insts
+// a scope frees.
+class Reducer : public InstContextListener {
 public:
-  Reducer(InstContext &IC_) : IC(IC_), varnum(0), numSolverCalls(0) {}
+  Reducer(InstContext &IC_) : IC(IC_), varnum(0), numSolverCalls(0) {
+    IC.addListener(this);
+  }
+  Reducer(const Reducer &) = delete;
+  Reducer &operator=(const Reducer &) = delete;
+  ~Reducer() override {
+    if (Listening)
+      IC.removeListener(this);
+  }
+
+  void reclaimed(const llvm::DenseSet<Inst *> &Dead) override;
+  void destroyed() override;
 
   ParsedReplacement ReduceGreedy(ParsedReplacement Input);
 
@@ -63,6 +76,9 @@ private:
   int varnum;
   int numSolverCalls;
   std::unordered_set<std::string> DNR;
+  // Insts that safeToRemove() has turned down
+  std::set<Inst *> Unsafe;
+  bool Listening = true;
 };
 
 }
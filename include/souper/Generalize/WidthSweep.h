@@ -0,0 +1,59 @@
+// Copyright 2014 The Souper Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SOUPER_GENERALIZE_WIDTHSWEEP_H
+#define SOUPER_GENERALIZE_WIDTHSWEEP_H
+
+#include "souper/Parser/Parser.h"
+#include "souper/SMTLIB2/Solver.h"
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace souper {
+
+enum class WidthVerdict { Valid, Invalid, Unknown };
+
+struct WidthSweepResult {
+  // Every swept width with its verdict, in the order they were requested.
+  // Widths left unchecked after a counterexample are Unknown.
+  std::vector<std::pair<unsigned, WidthVerdict>> Verdicts;
+  // A width at which the rewrite is wrong, 0 if none was found
+  unsigned Counterexample = 0;
+
+  bool allValid() const;
+};
+
+// Rebuilds a width-uniform rewrite, one whose Insts are all either i1 or of
+// the width of the LHS, at another width. Only the constants 0, 1 and -1 and
+// extensions of i1 values are allowed, since they mean the same thing at
+// every width, and no kind that is only valid at some widths, such as bswap.
+// Returns std::nullopt if Input is not of that form. The instance has Vars
+// of its own, so callers that don't keep it should build it in a scope.
+std::optional<ParsedReplacement> instantiateAtWidth(ParsedReplacement Input,
+                                                    unsigned Width);
+
+// Checks a width-uniform rewrite at each of Widths (by default at every
+// width up to 64), several widths at a time on clones of SMTSolver. Once a
+// width fails no further widths are started. Verdicts are cached for the
+// rewrite with its width erased, so the same pattern found at another width
+// isn't checked again. Returns std::nullopt if Input can't be instantiated
+// at other widths.
+std::optional<WidthSweepResult>
+sweepWidths(ParsedReplacement Input, SMTLIBSolver *SMTSolver,
+            std::vector<unsigned> Widths = {}, unsigned Timeout = 10);
+
+}
+
+#endif
@@ -15,6 +15,7 @@
 #ifndef SOUPER_ABSTRACT_INTERPRTER_H
 #define SOUPER_ABSTRACT_INTERPRTER_H
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/Support/KnownBits.h"
 #include "llvm/IR/ConstantRange.h"
 
@@ -57,14 +58,81 @@ namespace souper {
                   bool ConsiderConsts = true,
                   bool ConsiderHoles = true);
 
+  // Abstract values that stay valid for a whole synthesis session. Insts are
+  // hash-consed, so a (Inst, input set) pair always denotes the same value;
+  // analyses of different RHS guesses can then share the results for common
+  // subtrees of the LHS and for the input variables.
+  class AbstractValueCache {
+    using Key = std::pair<Inst *, unsigned>;
+    llvm::DenseMap<Key, llvm::KnownBits> KB;
+    llvm::DenseMap<Key, llvm::ConstantRange> CR;
+    // Restricted bits do not depend on an input set, but only results of
+    // subtrees without variables are independent of the traversal order.
+    llvm::DenseMap<Inst *, llvm::APInt> RB;
+
+  public:
+    unsigned Hits = 0;
+    unsigned Misses = 0;
+
+    const llvm::KnownBits *lookupKB(Inst *I, unsigned InputSet) {
+      auto It = KB.find({I, InputSet});
+      if (It == KB.end()) {
+        ++Misses;
+        return nullptr;
+      }
+      ++Hits;
+      return &It->second;
+    }
+    const llvm::ConstantRange *lookupCR(Inst *I, unsigned InputSet) {
+      auto It = CR.find({I, InputSet});
+      if (It == CR.end()) {
+        ++Misses;
+        return nullptr;
+      }
+      ++Hits;
+      return &It->second;
+    }
+    const llvm::APInt *lookupRB(Inst *I) {
+      auto It = RB.find(I);
+      return It == RB.end() ? nullptr : &It->second;
+    }
+
+    void insertKB(Inst *I, unsigned InputSet, const llvm::KnownBits &V) {
+      KB.try_emplace({I, InputSet}, V);
+    }
+    void insertCR(Inst *I, unsigned InputSet, const llvm::ConstantRange &V) {
+      CR.try_emplace({I, InputSet}, V);
+    }
+    void insertRB(Inst *I, const llvm::APInt &V) {
+      RB.try_emplace(I, V);
+    }
+
+    // Drops the results for an input set that is gone
+    void eraseInputSet(unsigned InputSet) {
+      // erasing from a DenseMap doesn't move the other entries
+      for (auto It = KB.begin(), E = KB.end(); It != E; ++It)
+        if (It->first.second == InputSet)
+          KB.erase(It);
+      for (auto It = CR.begin(), E = CR.end(); It != E; ++It)
+        if (It->first.second == InputSet)
+          CR.erase(It);
+    }
+  };
+
   class KnownBitsAnalysis {
     std::unordered_map<Inst*, llvm::KnownBits> KBCache;
+    AbstractValueCache *Shared = nullptr;
+    unsigned InputSet = 0;
 
     // Checks the cache or instruction metadata for knonwbits information
     bool cacheHasValue(Inst *I);
 
   public:
     KnownBitsAnalysis() {}
+    // Results computed with partial evaluation are shared through @Shared,
+    // @InputSet identifies the input values held by the interpreter
+    KnownBitsAnalysis(AbstractValueCache &Shared, unsigned InputSet)
+      : Shared(&Shared), InputSet(InputSet) {}
     KnownBitsAnalysis(std::unordered_map<Inst*, llvm::KnownBits> &Assumptions) {
       for (auto &P : Assumptions) {
         if (KBCache.find(P.first) != KBCache.end()) {
@@ -98,12 +166,16 @@ namespace souper {
 
   class ConstantRangeAnalysis {
     std::unordered_map<Inst*, llvm::ConstantRange> CRCache;
+    AbstractValueCache *Shared = nullptr;
+    unsigned InputSet = 0;
 
     // checks the cache or instruction metadata for cr information
     bool cacheHasValue(Inst *I);
 
   public:
     ConstantRangeAnalysis() {}
+    ConstantRangeAnalysis(AbstractValueCache &Shared, unsigned InputSet)
+      : Shared(&Shared), InputSet(InputSet) {}
     ConstantRangeAnalysis(std::unordered_map<Inst*, llvm::ConstantRange> &Assumptions) {
       for (auto &P : Assumptions) {
         if (CRCache.find(P.first) != CRCache.end()) {
@@ -168,6 +240,10 @@ namespace souper {
 
   struct RestrictedBitsAnalysis {
     std::unordered_map<Inst *, llvm::APInt> RBCache;
+    AbstractValueCache *Shared = nullptr;
+    // Counts visits of variables, a subtree whose computation doesn't change
+    // this has a result that doesn't depend on the rest of the traversal
+    unsigned VarVisits = 0;
     llvm::APInt findRestrictedBits(souper::Inst *I);
   };
 
@@ -20,6 +20,7 @@
 #include "alive2/ir/function.h"
 #include "alive2/smt/smt.h"
 
+#include <memory>
 #include <unordered_map>
 #include <optional>
 
@@ -32,6 +33,21 @@ public:
   AliveDriver(Inst *LHS_, Inst *PreCondition_, InstContext &IC_,
                const std::vector<Inst *> &ExtraInputs = {}, bool WidthIndep = false);
 
+  // Returns a driver for these arguments, reusing a recently returned one if
+  // it was made for the same ones, so that many RHSs can be checked against
+  // a LHS that is translated once. The driver stays valid until the next
+  // call evicts it.
+  static AliveDriver &get(Inst *LHS, Inst *PreCondition, InstContext &IC,
+                          const std::vector<Inst *> &ExtraInputs = {},
+                          bool WidthIndep = false);
+  // The number of drivers get() keeps for reuse. A driver is dropped when
+  // the Insts it was made for are freed, or when their context is destroyed.
+  static size_t getNumCached();
+
+  // Drops what the driver knows about these Insts, which are being freed
+  // and aren't part of its LHS
+  void forget(const llvm::DenseSet<Inst *> &Dead);
+
   std::map<Inst *, llvm::APInt> synthesizeConstants(souper::Inst *RHS);
   std::map<Inst *, llvm::APInt> synthesizeConstantsWithCegis(souper::Inst *RHS, InstContext &IC);
 
@@ -81,7 +97,8 @@ private:
   std::vector<std::map<const Inst *, size_t>> ValidTypings, InvalidTypings;
 
   InstContext &IC;
-  smt::smt_initializer smt_init;
+  // Alive2's solver state is global, so all live drivers share it
+  std::shared_ptr<smt::smt_initializer> SMTInit;
 };
 
 bool isTransformationValid(Inst* LHS, Inst* RHS, const std::vector<InstMapping> &PCs,
@@ -19,6 +19,7 @@
 #include "souper/SMTLIB2/Solver.h"
 
 #include <map>
+#include <memory>
 #include <queue>
 #include <set>
 #include <vector>
@@ -34,6 +35,8 @@
 
 namespace souper {
 
+class ExprBuilder;
+
 /// A location variable identifies an input variable, the output variable, or
 /// input/output of a library component. The encoding has the following
 /// semantics: If the first integer is 0, it's an input var or a constant
@@ -144,6 +147,35 @@ public:
                              InstContext &IC, unsigned Timeout);
 
 private:
+  /// The search for programs with a given number of components, kept across
+  /// refinement rounds
+  struct SynthesisLane {
+    std::vector<InstMapping> LoopPCs;
+    /// Solver used by this lane only: a session in incremental mode, or a
+    /// clone when lanes are solved in parallel
+    std::unique_ptr<SMTLIBSolver> OwnedSolver;
+    SMTLIBSolver *Solver = nullptr;
+    unsigned Refinements = 0;
+    /// Set once OwnedSolver holds the wiring query, with the builder that
+    /// named its variables, its check-sat and get-value commands and its
+    /// model variables
+    std::unique_ptr<ExprBuilder> EB;
+    std::string Check;
+    std::vector<Inst *> SessionModelInsts;
+    /// Input wiring copies and loop PCs that OwnedSolver already holds
+    size_t NumWirings = 0;
+    size_t NumPCs = 0;
+    /// Wiring query of the current round and its answer
+    std::string QueryStr;
+    std::vector<Inst *> ModelInsts;
+    std::vector<llvm::APInt> ModelVals;
+    bool IsSat = false;
+    std::error_code EC;
+    /// Set once the lane found a program or ran out of wirings
+    bool Done = false;
+    Inst *Result = nullptr;
+  };
+
   /// Local references
   SMTLIBSolver *LSMTSolver;
   const BlockPCs *LBPCs;
@@ -192,6 +224,10 @@ private:
   std::map<std::string, LocInst> LocInstMap;
   /// Invalid wirings
   std::set<std::pair<LocVar, LocVar>> InvalidWirings;
+  /// Copies of the connectivity constraint, one per concrete input set
+  std::vector<Inst *> InputWirings;
+  /// Whether every lane has a solver of its own
+  bool ParallelLanes = false;
 
   /// Initialize components to be used during synthesis
   void setCompLibrary();
@@ -314,9 +350,15 @@ private:
   bool hasConst(Inst *I);
   std::error_code getInitialConcreteInputs(std::vector<std::map<Inst *, Inst *>> &S,
                                            unsigned NumInputs);
-  Inst *initConcreteInputWirings(Inst *Query, Inst *WiringQuery,
-                                 unsigned Refinements,
+  Inst *initConcreteInputWirings(Inst *WiringQuery,
                                  std::vector<std::map<Inst *, Inst *>> &S);
+  std::error_code buildWiringQuery(SynthesisLane &Lane, Inst *Query);
+  void solveLanes(const std::vector<SynthesisLane *> &Round);
+  std::error_code refineLane(SynthesisLane &Lane,
+                             std::vector<std::map<Inst *, Inst *>> &S,
+                             std::map<ProgramWiring, unsigned> &NotWorkingConstWirings,
+                             std::vector<InstMapping> &WiringPCs,
+                             int LHSCost);
   void constrainConstWiring(const Inst *Cand,
                             const ProgramWiring &CandWiring,
                             std::map<ProgramWiring, unsigned> &NotWorkingConstWirings,
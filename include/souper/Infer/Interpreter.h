@@ -21,6 +21,7 @@
 
 #include "souper/Inst/Inst.h"
 
+#include <memory>
 #include <unordered_map>
 
 namespace souper {
@@ -89,7 +90,83 @@ struct EvalValue {
   }
 };
 
-using ValueCache = std::unordered_map<souper::Inst *, EvalValue>;
+/// Concrete values for Insts, stored in a flat array indexed by an
+/// InstNumbering. The numbering is shared between copies and is only cloned
+/// when a copy needs to number an Inst the others haven't seen, so copying a
+/// ValueCache costs one array copy and no hashing.
+class ValueCache {
+  std::shared_ptr<InstNumbering> Numbering;
+  std::vector<EvalValue> Values;
+  std::vector<bool> Present;
+  unsigned NumPresent = 0;
+
+  InstNumbering &getMutableNumbering();
+  void grow() {
+    Values.resize(Numbering->size());
+    Present.resize(Numbering->size());
+  }
+
+public:
+  ValueCache() : Numbering(std::make_shared<InstNumbering>()) {}
+  explicit ValueCache(std::shared_ptr<InstNumbering> N)
+    : Numbering(std::move(N)) { grow(); }
+  ValueCache(std::initializer_list<std::pair<Inst *, EvalValue>> Init)
+    : ValueCache() {
+    for (auto &P : Init)
+      (*this)[P.first] = P.second;
+  }
+
+  const InstNumbering &getNumbering() const { return *Numbering; }
+  // Number everything reachable from Root so that it can be cached by index.
+  void addDAG(Inst *Root);
+
+  // Returns nullptr when I has no value in this cache.
+  EvalValue *lookup(Inst *I) {
+    unsigned Idx = Numbering->lookup(I);
+    return Idx == InstNumbering::NotFound ? nullptr : lookupIndex(Idx);
+  }
+  EvalValue *lookupIndex(unsigned Idx) {
+    return Idx < Present.size() && Present[Idx] ? &Values[Idx] : nullptr;
+  }
+  const EvalValue *lookupIndex(unsigned Idx) const {
+    return Idx < Present.size() && Present[Idx] ? &Values[Idx] : nullptr;
+  }
+  void setIndex(unsigned Idx, EvalValue V) {
+    if (Idx >= Present.size())
+      grow();
+    if (!Present[Idx]) {
+      Present[Idx] = true;
+      ++NumPresent;
+    }
+    Values[Idx] = std::move(V);
+  }
+  EvalValue &operator[](Inst *I);
+
+  bool count(Inst *I) { return lookup(I) != nullptr; }
+  bool empty() const { return NumPresent == 0; }
+  unsigned size() const { return NumPresent; }
+
+  // Iterates over the (Inst, value) pairs that have a value, in index order.
+  class iterator {
+    ValueCache *VC;
+    unsigned Idx;
+    void skip() {
+      while (Idx < VC->Present.size() && !VC->Present[Idx])
+        ++Idx;
+    }
+  public:
+    iterator(ValueCache *VC, unsigned Idx) : VC(VC), Idx(Idx) { skip(); }
+    std::pair<Inst *, EvalValue &> operator*() const {
+      return {VC->Numbering->getInst(Idx), VC->Values[Idx]};
+    }
+    iterator &operator++() { ++Idx; skip(); return *this; }
+    bool operator==(const iterator &Other) const { return Idx == Other.Idx; }
+    bool operator!=(const iterator &Other) const { return Idx != Other.Idx; }
+  };
+  iterator begin() { return iterator(this, 0); }
+  iterator end() { return iterator(this, Present.size()); }
+};
+
 using BlockCache = std::unordered_set<souper::Block *>;
 
 EvalValue evaluateAddNSW(llvm::APInt A, llvm::APInt B);
@@ -108,27 +185,54 @@ EvalValue evaluateShl(llvm::APInt A, llvm::APInt B);
 EvalValue evaluateLShr(llvm::APInt A, llvm::APInt B);
 EvalValue evaluateAShr(llvm::APInt A, llvm::APInt B);
 
+  class LaneInterpreter;
+
   class ConcreteInterpreter {
+    friend class LaneInterpreter;
     ValueCache Cache;
     bool CacheWritable = false;
     bool EvalPhiFirstBranch = false;
     EvalValue evaluateSingleInst(Inst *I, std::vector<EvalValue> &Args);
+    EvalValue evaluateIndex(unsigned Idx);
 
   public:
     ConcreteInterpreter() : Cache() {}
-    ConcreteInterpreter(ValueCache Input) : Cache(Input) {}
-    ConcreteInterpreter(Inst *I, ValueCache Input) : Cache(Input) {
+    ConcreteInterpreter(ValueCache Input) : Cache(std::move(Input)) {}
+    ConcreteInterpreter(Inst *I, ValueCache Input) : Cache(std::move(Input)) {
       CacheWritable = true;
+      Cache.addDAG(I);
       evaluateInst(I);
       CacheWritable = false;
     }
     void setEvalPhiFirstBranch() {EvalPhiFirstBranch = true;};
     EvalValue evaluateInst(Inst *Root);
+    const ValueCache &getCache() const { return Cache; }
 
     void printCache(llvm::raw_ostream &Out);
 
   };
 
+  /// Evaluates an Inst on a batch of input sets at once, one lane per
+  /// ConcreteInterpreter. Values are computed a column at a time, so the
+  /// traversal and the lookups in the shared numbering happen once per Inst
+  /// instead of once per Inst and input set. Interpreters whose cache is no
+  /// longer writable are only read, so several LaneInterpreters may share
+  /// them across threads.
+  class LaneInterpreter {
+    std::vector<ConcreteInterpreter> &Lanes;
+    // Numbering shared by all lanes, nullptr if they don't share one
+    const InstNumbering *Numbering = nullptr;
+    using ColumnMap = std::unordered_map<Inst *, std::vector<EvalValue>>;
+
+    const std::vector<EvalValue> &evaluateColumn(Inst *I, unsigned NumLanes,
+                                                 ColumnMap &Columns);
+
+  public:
+    LaneInterpreter(std::vector<ConcreteInterpreter> &Lanes);
+    // Values of Root in the first NumLanes input sets
+    std::vector<EvalValue> evaluateInst(Inst *Root, unsigned NumLanes);
+  };
+
 }
 
 
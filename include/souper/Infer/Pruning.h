@@ -27,6 +27,8 @@
 namespace souper {
 
 typedef std::function<bool(Inst *, std::vector<Inst *>&)> PruneFunc;
+// Returns, for each guess, whether it survived pruning
+typedef std::function<std::vector<bool>(const std::vector<Inst *> &)> BatchPruneFunc;
 
 struct ExprInfo {
   bool HasHole;
@@ -36,28 +38,66 @@ struct ExprInfo {
   static void analyze(Inst *Root, std::unordered_map<Inst *, ExprInfo> &Result);
 };
 
+// Whether the values in Cache agree with the dataflow facts of their Insts
+bool isDataflowConsistent(ValueCache &Cache);
+
 class PruningManager {
 public:
   PruningManager(SynthesisContext &SC_, std::vector< souper::Inst *> &Inputs_,
                  unsigned int StatsLevel_);
   PruneFunc getPruneFunc() {return DataflowPrune;}
+  BatchPruneFunc getBatchPruneFunc();
   void printStats(llvm::raw_ostream &out) {
+    unsigned Hits = 0, Lookups = 0;
+    for (auto &W : Workers) {
+      Hits += W.AVCache.Hits;
+      Lookups += W.AVCache.Hits + W.AVCache.Misses;
+    }
     out << "Dataflow Pruned " << NumPruned << "/" << TotalGuesses << "\n";
+    out << "Abstract value cache hits " << Hits << "/" << Lookups << "\n";
+    out << "Counterexample input sets " << NumCounterexamples << "\n";
   }
 
-  bool isInfeasible(Inst *RHS, unsigned StatsLevel);
+  bool isInfeasible(Inst *RHS, unsigned StatsLevel) {
+    return pruneWith(RHS, StatsLevel, Workers[0]);
+  }
+  // Prunes a whole generation of guesses, spreading them over threads.
+  // Guesses that need the InstContext are pruned on the calling thread.
+  std::vector<bool> isInfeasibleBatch(const std::vector<Inst *> &Guesses,
+                                      unsigned StatsLevel);
   bool isInfeasibleWithSolver(Inst *RHS, unsigned StatsLevel);
   void init();
   // double init antipattern, required because init should
   // not be called when pruning is disabled
 
   auto &getInputVals() {return InputVals;}
+
+  // Adds the model of a failed verification as an input set, so that
+  // guesses it refutes are pruned from now on. Input sets that pruned
+  // guesses move to the front, and when there are too many the one that
+  // pruned the fewest is dropped. The new input set goes first, so it is
+  // among those that are always evaluated. Must not be called during a
+  // batch.
+  void addCounterexample(const std::vector<Inst *> &ModelInsts,
+                         const std::vector<llvm::APInt> &ModelVals);
 private:
+  // State that a pruning thread doesn't share with the others
+  struct WorkerState {
+    HoleAnalysis HA;
+    // Abstract values of subtrees shared by the guesses, keyed by input set
+    // id
+    AbstractValueCache AVCache;
+    // Guesses pruned by each input set since the last ranking
+    std::vector<unsigned> InputPrunes;
+    // Input set isInfeasible was looking at, -1 if none
+    int CurrentInput = -1;
+  };
+
   SynthesisContext &SC;
   std::vector<ConcreteInterpreter> ConcreteInterpreters;
   std::vector<llvm::KnownBits> LHSKnownBits;
   std::vector<llvm::ConstantRange> LHSConstantRange;
-  HoleAnalysis HA;
+  std::vector<WorkerState> Workers;
   llvm::KnownBits LHSKnownBitsNoSpec;
   InputVarInfo LHSMustDemandedBits;
   bool EnableDemandedBitsPruning = false;
@@ -69,7 +109,29 @@ private:
   unsigned TotalGuesses;
   int StatsLevel;
   std::vector<ValueCache> InputVals;
+  // Guesses pruned by each input set, indexed like InputVals; halved with
+  // every counterexample, so that old input sets don't keep the front
+  std::vector<unsigned> InputPrunes;
+  // Ids of the input sets, indexed like InputVals. The abstract values are
+  // cached by id, so reordering the input sets keeps them.
+  std::vector<unsigned> InputIds;
+  unsigned NextInputId = 0;
+  unsigned NumCounterexamples = 0;
+  // Shared by all input sets, numbers the LHS and the PC antecedent
+  std::shared_ptr<InstNumbering> InputNumbering;
+  // Names the variables standing for holes in solver queries
+  unsigned DummyVarCount = 0;
   std::vector<Inst *> &InputVars;
+  bool isInfeasible(Inst *RHS, unsigned StatsLevel, WorkerState &W);
+  // isInfeasible, crediting the input set that pruned RHS
+  bool pruneWith(Inst *RHS, unsigned StatsLevel, WorkerState &W);
+  // Checks a RHS without holes or symbolic constants on all input sets at once
+  bool isInfeasibleConcrete(Inst *RHS, unsigned StatsLevel, WorkerState &W);
+  // Collects the prune counts of the workers and puts the input sets that
+  // pruned the most first
+  void rankInputSets();
+  // Puts Input first, ahead of the input set that pruned the most
+  void addInputSet(ValueCache Input);
   std::vector<ValueCache> generateInputSets(std::vector<Inst *> &Inputs);
   void setPhiConcretePreds(Inst *Root);
   // For the LHS contained in @SC, check if the given input in @Cache is valid.
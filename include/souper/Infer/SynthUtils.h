@@ -140,6 +140,9 @@ InstMapping Clone(InstMapping In);
 
 ParsedReplacement Clone(ParsedReplacement In);
 
+// Keeps every Inst of P alive past the end of Scope
+void Keep(InstContext::Scope &Scope, const ParsedReplacement &P);
+
 // Also Synthesizes given constants
 // Returns clone if verified, nullptrs if not
 std::optional<ParsedReplacement> Verify(ParsedReplacement Input);
@@ -191,29 +194,29 @@ struct GoPrinter {
   std::string printInst(Inst *I) {
     std::string Result = "";
     if (I->K == Inst::Var) {
-      if (I->Name.starts_with("symconst_")) {
-        auto Name = "C" + I->Name.substr(9);
+      if (I->attrs().Name.starts_with("symconst_")) {
+        auto Name = "C" + I->attrs().Name.substr(9);
         Result += Name;
       } else {
-        Result += I->Name;
+        Result += I->attrs().Name;
       }
       std::ostringstream Out;
-      if (I->KnownZeros.getBoolValue() || I->KnownOnes.getBoolValue())
-        Out << " (knownBits=" << Inst::getKnownBitsString(I->KnownZeros, I->KnownOnes)
+      if (I->attrs().KnownZeros.getBoolValue() || I->attrs().KnownOnes.getBoolValue())
+        Out << " (knownBits=" << Inst::getKnownBitsString(I->attrs().KnownZeros, I->attrs().KnownOnes)
             << ")";
-      if (I->NonNegative)
+      if (I->attrs().NonNegative)
         Out << " (nonNegative)";
-      if (I->Negative)
+      if (I->attrs().Negative)
         Out << " (negative)";
-      if (I->NonZero)
+      if (I->attrs().NonZero)
         Out << " (nonZero)";
-      if (I->PowOfTwo)
+      if (I->attrs().PowOfTwo)
         Out << " (powerOfTwo)";
-      if (I->NumSignBits > 1)
-        Out << " (signBits=" << I->NumSignBits << ")";
-      if (!I->Range.isFullSet())
-        Out << " (range=[" << llvm::toString(I->Range.getLower(), 10, false)
-            << "," << llvm::toString(I->Range.getUpper(), 10, false) << "))";
+      if (I->attrs().NumSignBits > 1)
+        Out << " (signBits=" << I->attrs().NumSignBits << ")";
+      if (!I->attrs().Range.isFullSet())
+        Out << " (range=[" << llvm::toString(I->attrs().Range.getLower(), 10, false)
+            << "," << llvm::toString(I->attrs().Range.getUpper(), 10, false) << "))";
 
       Result += Out.str();
     } else if (I->K == Inst::Const) {
@@ -221,7 +224,7 @@ struct GoPrinter {
     } else {
       Result = "(";
       if (I->K == Inst::Custom) {
-        Result += I->Name;
+        Result += I->attrs().Name;
       } else {
         Result += Inst::getKindName(I->K);
       }
@@ -298,38 +301,38 @@ struct InfixPrinter {
         return "0x" + llvm::toString(I->Val, 16, false);
       }
     } else if (I->K == Inst::Var) {
-      auto Name = I->Name;
+      auto Name = I->attrs().Name;
       if (isdigit(Name[0])) {
         Name = "x" + Name;
       }
-      if (I->Name.starts_with("symconst_")) {
-        Name = "C" + I->Name.substr(9);
+      if (I->attrs().Name.starts_with("symconst_")) {
+        Name = "C" + I->attrs().Name.substr(9);
       }
-      if (VisitedVars.count(I->Name)) {
+      if (VisitedVars.count(I->attrs().Name)) {
         return Name;
       } else {
-        VisitedVars.insert(I->Name);
-        Inst::getKnownBitsString(I->KnownZeros, I->KnownOnes);
+        VisitedVars.insert(I->attrs().Name);
+        Inst::getKnownBitsString(I->attrs().KnownZeros, I->attrs().KnownOnes);
 
         std::string Buf;
         llvm::raw_string_ostream Out(Buf);
 
-        if (I->KnownZeros.getBoolValue() || I->KnownOnes.getBoolValue())
-          Out << " (knownBits=" << Inst::getKnownBitsString(I->KnownZeros, I->KnownOnes)
+        if (I->attrs().KnownZeros.getBoolValue() || I->attrs().KnownOnes.getBoolValue())
+          Out << " (knownBits=" << Inst::getKnownBitsString(I->attrs().KnownZeros, I->attrs().KnownOnes)
               << ")";
-        if (I->NonNegative)
+        if (I->attrs().NonNegative)
           Out << " (nonNegative)";
-        if (I->Negative)
+        if (I->attrs().Negative)
           Out << " (negative)";
-        if (I->NonZero)
+        if (I->attrs().NonZero)
           Out << " (nonZero)";
-        if (I->PowOfTwo)
+        if (I->attrs().PowOfTwo)
           Out << " (powerOfTwo)";
-        if (I->NumSignBits > 1)
-          Out << " (signBits=" << I->NumSignBits << ")";
-        if (!I->Range.isFullSet())
-          Out << " (range=[" << I->Range.getLower()
-              << "," << I->Range.getUpper() << "))";
+        if (I->attrs().NumSignBits > 1)
+          Out << " (signBits=" << I->attrs().NumSignBits << ")";
+        if (!I->attrs().Range.isFullSet())
+          Out << " (range=[" << I->attrs().Range.getLower()
+              << "," << I->attrs().Range.getUpper() << "))";
 
         std::string W = ShowImplicitWidths ? ":i" + std::to_string(I->Width) : "";
 
@@ -375,7 +378,7 @@ struct InfixPrinter {
       case Inst::Sle: Op = "<=s"; break;
       case Inst::KnownOnesP : Op = "<<=1"; break;
       case Inst::KnownZerosP : Op = "<<=0"; break;
-      case Inst::Custom: Op = I->Name; break;
+      case Inst::Custom: Op = I->attrs().Name; break;
       default: Op = Inst::getKindName(I->K); break;
       }
 
@@ -394,7 +397,7 @@ struct InfixPrinter {
           } else if (A->K != Inst::Var && B->K == Inst::Var) {
             return false; // expr OP var
           } else if (A->K == Inst::Var && B->K == Inst::Var) {
-            return A->Name > B->Name; // Tends to put vars before symconsts
+            return A->attrs().Name > B->attrs().Name; // Tends to put vars before symconsts
           } else {
             return A->K < B->K; // expr OP expr
           }
@@ -526,38 +529,38 @@ struct LatexPrinter : public InfixPrinter {
         return "\\text{0x" + llvm::toString(I->Val, 16, false)+ "}";
       }
     } else if (I->K == Inst::Var) {
-      auto Name = I->Name;
+      auto Name = I->attrs().Name;
       if (isdigit(Name[0])) {
         Name = "x" + Name;
       }
-      if (I->Name.starts_with("symconst_")) {
-        Name = "C" + I->Name.substr(9);
+      if (I->attrs().Name.starts_with("symconst_")) {
+        Name = "C" + I->attrs().Name.substr(9);
       }
-      if (VisitedVars.count(I->Name)) {
+      if (VisitedVars.count(I->attrs().Name)) {
         return Name;
       } else {
-        VisitedVars.insert(I->Name);
-        Inst::getKnownBitsString(I->KnownZeros, I->KnownOnes);
+        VisitedVars.insert(I->attrs().Name);
+        Inst::getKnownBitsString(I->attrs().KnownZeros, I->attrs().KnownOnes);
 
         std::string Buf;
         llvm::raw_string_ostream Out(Buf);
 
-        if (I->KnownZeros.getBoolValue() || I->KnownOnes.getBoolValue())
-          Out << " (knownBits=" << Inst::getKnownBitsString(I->KnownZeros, I->KnownOnes)
+        if (I->attrs().KnownZeros.getBoolValue() || I->attrs().KnownOnes.getBoolValue())
+          Out << " (knownBits=" << Inst::getKnownBitsString(I->attrs().KnownZeros, I->attrs().KnownOnes)
               << ")";
-        if (I->NonNegative)
+        if (I->attrs().NonNegative)
           Out << " (nonNegative)";
-        if (I->Negative)
+        if (I->attrs().Negative)
           Out << " (negative)";
-        if (I->NonZero)
+        if (I->attrs().NonZero)
           Out << " (nonZero)";
-        if (I->PowOfTwo)
+        if (I->attrs().PowOfTwo)
           Out << " (powerOfTwo)";
-        if (I->NumSignBits > 1)
-          Out << " (signBits=" << I->NumSignBits << ")";
-        if (!I->Range.isFullSet())
-          Out << " (range=[" << I->Range.getLower()
-              << "," << I->Range.getUpper() << "))";
+        if (I->attrs().NumSignBits > 1)
+          Out << " (signBits=" << I->attrs().NumSignBits << ")";
+        if (!I->attrs().Range.isFullSet())
+          Out << " (range=[" << I->attrs().Range.getLower()
+              << "," << I->attrs().Range.getUpper() << "))";
 
         std::string W = ShowImplicitWidths ? "\\iN{" + std::to_string(I->Width) + "}" : "";
 
@@ -608,7 +611,7 @@ struct LatexPrinter : public InfixPrinter {
       case Inst::AShrExact: Op = "\\gg_\\text{s}^\\text{exact}"; break;
       default: {
         if (I->K == Inst::Custom) {
-          Op = "\\text{" + I->Name + "}";
+          Op = "\\text{" + I->attrs().Name + "}";
         } else {
           Op = std::string("\\text{") + Inst::getKindName(I->K) + "}";
         }
@@ -631,7 +634,7 @@ struct LatexPrinter : public InfixPrinter {
           } else if (A->K != Inst::Var && B->K == Inst::Var) {
             return false; // expr OP var
           } else if (A->K == Inst::Var && B->K == Inst::Var) {
-            return A->Name > B->Name; // Tends to put vars before symconsts
+            return A->attrs().Name > B->attrs().Name; // Tends to put vars before symconsts
           } else {
             return A->K < B->K; // expr OP expr
           }
@@ -16,8 +16,13 @@
 #define SOUPER_INST_INST_H
 
 #include "llvm/ADT/APInt.h"
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/FoldingSet.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/IR/ConstantRange.h"
 #include "llvm/IR/Value.h"
 
@@ -25,6 +30,7 @@
 
 #include <map>
 #include <memory>
+#include <optional>
 #include <set>
 #include <string>
 #include <unordered_set>
@@ -46,7 +52,7 @@ struct InstContext;
 using CustomInstructionCreator =
   std::function<Inst *(
     InstContext *IC,
-    const std::vector<Inst *> &Ops)>;
+    llvm::ArrayRef<Inst *> Ops)>;
 extern std::unordered_map<std::string, CustomInstructionCreator> CustomInstructionMap;
 
 
@@ -58,6 +64,34 @@ struct Block {
   std::vector<Inst *> PredVars;
 };
 
+/// The parts of an Inst that most Insts don't have: names, the dataflow
+/// facts of Vars and where harvested Insts came from. An Inst only allocates
+/// them when one is set, which keeps the nodes that DAG walks touch small.
+struct InstAttrs {
+  std::string Name;
+
+  // Dataflow facts, only meaningful for Vars
+  llvm::APInt KnownZeros;
+  llvm::APInt KnownOnes;
+  bool NonZero = false;
+  bool NonNegative = false;
+  bool PowOfTwo = false;
+  bool Negative = false;
+  unsigned NumSignBits = 1;
+  llvm::ConstantRange Range = llvm::ConstantRange(1, true);
+  std::vector<llvm::ConstantRange> RangeRefinement;
+
+  // Harvest metadata
+  HarvestType HarvestKind = HarvestType::HarvestedFromDef;
+  llvm::BasicBlock *HarvestFrom = nullptr;
+  std::vector<llvm::Value *> Origins;
+  std::unordered_set<Inst *> DepsWithExternalUses;
+
+  Inst *Aux = nullptr;
+  // Ops of a commutative Inst in canonical order, see Inst::orderedOps()
+  std::vector<Inst *> OrderedOps;
+};
+
 struct Inst : llvm::FoldingSetNode {
   typedef enum {
     Const,
@@ -148,20 +182,64 @@ struct Inst : llvm::FoldingSetNode {
 } Kind;
 
   Kind K;
-  unsigned Number;
   unsigned Width;
-  Block *B;
+  unsigned Number;
+  unsigned SynthesisConstID;
   bool Available = true;
+  int nReservedConsts = -1;
+  int nHoles = -1;
+  Block *B;
+  InstContext *IC;
+  // Most Insts have at most three operands, keep those inline
+  llvm::SmallVector<Inst *, 3> Ops;
   llvm::APInt Val;
-  std::string Name;
-  std::unordered_set<Inst *> DepsWithExternalUses;
-  std::vector<Inst *> Ops;
-  mutable std::vector<Inst *> OrderedOps;
-  std::vector<llvm::Value *> Origins;
-  Inst *Aux;
+  llvm::APInt DemandedBits;
+
+  // What the DAG rooted at an Inst contains, see has()
+  enum SummaryFlag : uint8_t {
+    HasVar = 1 << 0,            // Vars that aren't synthesis constants
+    HasSynthesisConst = 1 << 1, // Vars with a SynthesisConstID
+    HasReservedVar = 1 << 2,    // other Vars named reserved*
+    HasReserved = 1 << 3,       // ReservedConst and ReservedInst
+    HasPhi = 1 << 4,
+    HasMultiArgPhi = 1 << 5,
+    HasHole = 1 << 6,
+    HasCustom = 1 << 7,
+  };
+  // Summaries of the DAG rooted at this Inst. They are computed from the
+  // summaries of Ops when the Inst is created, so code that rewrites Ops in
+  // place must call summarize() afterwards.
+  uint8_t Summary = 0;
+  // Number of Insts and cost of the DAG unfolded into a tree, saturating at
+  // UINT_MAX. An Inst reached along several paths counts once per path, so
+  // TreeCost is an upper bound of cost() that is exact for trees; cost()
+  // itself counts shared Insts once and can't be composed from the Ops.
+  unsigned TreeSize = 1;
+  unsigned TreeCost = 0;
+
+private:
+  mutable std::unique_ptr<InstAttrs> Attrs;
+  static const InstAttrs DefaultAttrs;
+
+public:
+  Inst() = default;
+  Inst(const Inst &Other) { *this = Other; }
+  Inst &operator=(const Inst &Other);
+
+  // The defaults if none were set
+  const InstAttrs &attrs() const { return Attrs ? *Attrs : DefaultAttrs; }
+  InstAttrs &mutableAttrs() {
+    if (!Attrs)
+      Attrs = std::make_unique<InstAttrs>();
+    return *Attrs;
+  }
+
+  // True if the DAG contains any of the given SummaryFlags
+  bool has(unsigned Flags) const { return Summary & Flags; }
+  void summarize();
 
   bool operator<(const Inst &I) const;
-  const std::vector<Inst *> &orderedOps() const;
+  llvm::ArrayRef<Inst *> orderedOps() const;
   bool hasOrigin(llvm::Value *V) const;
 
   void Profile(llvm::FoldingSetNodeID &ID) const;
@@ -175,7 +253,7 @@ struct Inst : llvm::FoldingSetNode {
   static std::string getMoreKnownBitsString(bool NonZero, bool NonNegative,
                                             bool PowOfTwo, bool Negative);
   static std::string getDemandedBitsString(llvm::APInt DBVal);
-  static Kind getKind(std::string Name);
+  static Kind getKind(llvm::StringRef Name);
 
   static bool isAssociative(Kind K);
   static bool isCmp(Kind K);
@@ -190,22 +268,6 @@ struct Inst : llvm::FoldingSetNode {
   static bool isShift(Kind K);
   static bool isDivRem(Kind K);
   static int getCost(Kind K);
-  llvm::APInt KnownZeros;
-  llvm::APInt KnownOnes;
-  bool NonZero;
-  bool NonNegative;
-  bool PowOfTwo;
-  bool Negative;
-  unsigned NumSignBits;
-  llvm::APInt DemandedBits;
-  unsigned SynthesisConstID;
-  HarvestType HarvestKind;
-  llvm::BasicBlock* HarvestFrom;
-  llvm::ConstantRange Range=llvm::ConstantRange(1, true);
-  std::vector<llvm::ConstantRange> RangeRefinement;
-  int nReservedConsts = -1;
-  int nHoles = -1;
-  InstContext *IC;
 };
 
 /// A mapping from an Inst to a replacement. This may either represent a
@@ -233,8 +295,8 @@ typedef std::vector<BlockPCMapping> BlockPCs;
 class ReplacementContext {
   llvm::DenseMap<Inst *, std::string> InstNames;
   llvm::DenseMap<Block *, std::string> BlockNames;
-  std::map<std::string, Inst *> NameToInst;
-  std::map<std::string, Block *> NameToBlock;
+  llvm::StringMap<Inst *> NameToInst;
+  llvm::StringMap<Block *> NameToBlock;
   std::string printInstImpl(Inst *I, llvm::raw_ostream &Out, bool printNames, Inst *OrigI);
 
 public:
@@ -248,10 +310,68 @@ public:
   void setInst(llvm::StringRef Name, Inst *I);
   Block *getBlock(llvm::StringRef Name);
   void setBlock(llvm::StringRef Name, Block *B);
+  // Names given to I and B, empty if they have none
+  llvm::StringRef getName(Inst *I) const;
+  llvm::StringRef getName(Block *B) const;
   void clear();
   bool empty();
 };
 
+/// Prints replacements exactly like PrintReplacement and its LHS and RHS
+/// variants. Values are numbered in one walk over each DAG instead of one
+/// recursive call per use, and the text goes to a buffer that, like the
+/// numbering, is kept from one call to the next, so a printer that is reused
+/// for many replacements, as for cache keys, stops allocating once it has
+/// grown.
+class ReplacementPrinter {
+  llvm::DenseMap<Inst *, unsigned> InstNums;
+  llvm::DenseMap<Block *, unsigned> BlockNums;
+  std::vector<std::pair<Inst *, unsigned>> Stack;
+  llvm::SmallString<1024> Buf;
+  bool PrintNames = false;
+
+  void reset(bool printNames);
+  bool hasName(Inst *I) const {
+    return PrintNames && !I->attrs().Name.empty() && I->K != Inst::Custom;
+  }
+  llvm::ArrayRef<Inst *> operands(Inst *I) const;
+  void append(llvm::StringRef S) { Buf.append(S.begin(), S.end()); }
+  void appendNum(uint64_t N);
+  void printPCs(const BlockPCs &BPCs, const std::vector<InstMapping> &PCs);
+  void printBlock(Block *B);
+  void printInst(Inst *Root);
+  void printInstLine(Inst *I, Inst *Root);
+  void printRef(Inst *I);
+  void printRootAttributes(Inst *LHS);
+
+public:
+  // The returned text is overwritten by the next call
+  llvm::StringRef print(const BlockPCs &BPCs,
+                        const std::vector<InstMapping> &PCs,
+                        InstMapping Mapping, bool printNames = false);
+  llvm::StringRef printLHS(const BlockPCs &BPCs,
+                           const std::vector<InstMapping> &PCs, Inst *LHS,
+                           bool printNames = false);
+  // Prints the 'result' part for the LHS printed last, reusing its names
+  llvm::StringRef printRHS(Inst *RHS);
+
+  // Gives every value printed since the last print() or printLHS() the name
+  // that a ReplacementContext would have given it
+  void getContext(ReplacementContext &Context) const;
+};
+
+/// Told what an InstContext frees, so that a cache keyed by Inst pointers
+/// can drop what refers to them before the memory is reused.
+class InstContextListener {
+public:
+  virtual ~InstContextListener() = default;
+  // Called with the Insts a scope is about to free
+  virtual void reclaimed(const llvm::DenseSet<Inst *> &Dead) = 0;
+  // Called when the context is about to be destroyed. The listener may
+  // delete itself.
+  virtual void destroyed() = 0;
+};
+
 class InstContext {
   typedef llvm::DenseMap<unsigned, std::vector<std::unique_ptr<Block>>>
       BlockMap;
@@ -263,8 +383,33 @@ class InstContext {
   std::vector<std::unique_ptr<Inst>> Insts;
   llvm::FoldingSet<Inst> InstSet;
   unsigned ReservedConstCounter = 0;
+  // Unique among all the contexts of the process, so that caches keyed by
+  // Inst pointers can tell a context from one that reuses its memory. A
+  // scope that frees Insts tells the listeners which ones instead, so the
+  // ID doesn't change.
+  uint64_t ID;
+  unsigned OpenScopes = 0;
+  std::vector<InstContextListener *> Listeners;
 
 public:
+  class Scope;
+
+  InstContext();
+  InstContext(const InstContext &) = delete;
+  InstContext &operator=(const InstContext &) = delete;
+  ~InstContext();
+  uint64_t getID() const { return ID; }
+
+  /// The listener isn't owned, and has to stay alive until it is removed or
+  /// told that the context is destroyed.
+  void addListener(InstContextListener *L) { Listeners.push_back(L); }
+  void removeListener(InstContextListener *L);
+
+  /// Starts a region whose Insts and Blocks are freed when it is rolled back
+  /// or destroyed, except for what was passed to Scope::keep() and what that
+  /// was built from. Scopes nest and must be closed in reverse order.
+  Scope beginScope();
+
   Inst *getConst(const llvm::APInt &I);
   Inst *getUntypedConst(const llvm::APInt &I);
   Inst *getReservedConst();
@@ -281,16 +426,167 @@ public:
                   llvm::APInt Demandedbits, unsigned SynthesisConstID);
   Block *createBlock(unsigned Preds);
 
-  Inst *getPhi(Block *B, const std::vector<Inst *> &Ops);
-  Inst *getPhi(Block *B, const std::vector<Inst *> &Ops, llvm::APInt Demandedbits);
+  Inst *getPhi(Block *B, llvm::ArrayRef<Inst *> Ops);
+  Inst *getPhi(Block *B, llvm::ArrayRef<Inst *> Ops, llvm::APInt Demandedbits);
 
-  Inst *getInst(Inst::Kind K, unsigned Width, const std::vector<Inst *> &Ops,
+  Inst *getInst(Inst::Kind K, unsigned Width, llvm::ArrayRef<Inst *> Ops,
                 bool Available=true);
-  Inst *getInst(Inst::Kind K, unsigned Width, const std::vector<Inst *> &Ops,
+  Inst *getInst(Inst::Kind K, unsigned Width, llvm::ArrayRef<Inst *> Ops,
                 llvm::APInt DemandedBits, bool Available);
 
   std::vector<Inst *> getVariables() const;
   std::vector<Inst *> getVariablesFor(Inst *Root) const;
+
+private:
+  void reclaim(Scope &S);
+};
+
+/// A checkpoint of an InstContext. Speculative work, such as building and
+/// verifying candidates that are mostly rejected, runs inside a scope so that
+/// the context doesn't keep the Insts of every rejected candidate. Nothing
+/// outside the scope may point to a freed Inst afterwards, so results have to
+/// be kept explicitly; kept Insts become part of the enclosing scope.
+class InstContext::Scope {
+  friend class InstContext;
+
+  InstContext *IC;
+  unsigned Depth;
+  size_t NumInsts;
+  llvm::DenseMap<unsigned, size_t> NumVars, NumBlocks;
+  std::vector<Inst *> Kept;
+  std::vector<Block *> KeptBlocks;
+
+  explicit Scope(InstContext &IC);
+
+public:
+  Scope(Scope &&Other);
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+  Scope &operator=(Scope &&) = delete;
+  ~Scope() { commitOrRollback(false); }
+
+  Inst *keep(Inst *I) {
+    Kept.push_back(I);
+    return I;
+  }
+  Block *keep(Block *B) {
+    KeptBlocks.push_back(B);
+    return B;
+  }
+  void keep(const InstMapping &M) {
+    keep(M.LHS);
+    keep(M.RHS);
+  }
+
+  // Frees what was created since the scope began and isn't kept. The scope
+  // stays open.
+  void rollback();
+  // Closes the scope without freeing anything.
+  void commit() { commitOrRollback(true); }
+
+private:
+  void commitOrRollback(bool Commit);
+};
+
+/// Assigns a dense index to every Inst reachable from a set of roots.
+/// Operands are always numbered before their users, so visiting indices in
+/// increasing order walks the DAG bottom-up. Operand indices are kept in a
+/// flat array, so a numbered DAG can be traversed without any hashing.
+class InstNumbering {
+  llvm::DenseMap<Inst *, unsigned> Index;
+  std::vector<Inst *> Insts;
+  std::vector<unsigned> OpBegin;
+  std::vector<unsigned> OpIndices;
+
+  unsigned addNode(Inst *I);
+
+public:
+  static constexpr unsigned NotFound = ~0U;
+
+  InstNumbering() : OpBegin{0} {}
+  explicit InstNumbering(Inst *Root) : OpBegin{0} { addDAG(Root); }
+
+  // Number Root and everything reachable from it, returns the index of Root.
+  unsigned addDAG(Inst *Root);
+  // Number I without looking at its operands. Nodes added this way have no
+  // operand indices and are treated as leaves.
+  unsigned add(Inst *I);
+
+  unsigned lookup(Inst *I) const {
+    auto It = Index.find(I);
+    return It == Index.end() ? NotFound : It->second;
+  }
+  bool contains(Inst *I) const { return Index.count(I); }
+  Inst *getInst(unsigned Idx) const { return Insts[Idx]; }
+  unsigned size() const { return Insts.size(); }
+  const std::vector<Inst *> &insts() const { return Insts; }
+
+  // Indices of the operands of the node numbered Idx, in operand order.
+  const unsigned *op_begin(unsigned Idx) const {
+    return OpIndices.data() + OpBegin[Idx];
+  }
+  const unsigned *op_end(unsigned Idx) const {
+    return OpIndices.data() + OpBegin[Idx + 1];
+  }
+};
+
+/// Rebuilds DAGs bottom-up with some of their Insts substituted. Vars can be
+/// replaced by constants, cloned or left alone, and Phis can be moved to
+/// fresh Blocks. Results are memoized per rewriter, so roots rewritten by the
+/// same rewriter share their copies and every Inst is rebuilt at most once.
+/// The walk is iterative, so deep DAGs don't exhaust the stack.
+class InstRewriter {
+  InstContext &IC;
+  llvm::DenseMap<Inst *, Inst *> Insts;
+  llvm::DenseMap<Block *, Block *> Blocks;
+  // The caller's caches, used instead of Insts and Blocks if set
+  std::map<Inst *, Inst *> *InstCache = nullptr;
+  std::map<Block *, Block *> *BlockCache = nullptr;
+  const std::map<Inst *, llvm::APInt> *ConstMap = nullptr;
+  bool CloneVars;
+  bool CloneBlocks;
+
+  Inst *lookup(Inst *I) const;
+  Block *lookup(Block *B) const;
+  Inst *rebuild(Inst *I, llvm::ArrayRef<Inst *> Ops);
+
+public:
+  InstRewriter(InstContext &IC, bool CloneVars = false,
+               bool CloneBlocks = true)
+    : IC(IC), CloneVars(CloneVars), CloneBlocks(CloneBlocks) {}
+  // Reads the rewritten Insts and Blocks from the given caches and records
+  // new ones there, so rewriters made one after another on the same caches
+  // share their copies. The caches must outlive the rewriter.
+  InstRewriter(InstContext &IC, std::map<Inst *, Inst *> &InstCache,
+               std::map<Block *, Block *> &BlockCache, bool CloneVars = false,
+               bool CloneBlocks = true)
+    : IC(IC), InstCache(&InstCache), BlockCache(&BlockCache),
+      CloneVars(CloneVars), CloneBlocks(CloneBlocks) {}
+
+  // Every use of From is rewritten to To, which is left as it is.
+  void substitute(Inst *From, Inst *To) {
+    if (InstCache)
+      (*InstCache)[From] = To;
+    else
+      Insts[From] = To;
+  }
+  void substitute(Block *From, Block *To) {
+    if (BlockCache)
+      (*BlockCache)[From] = To;
+    else
+      Blocks[From] = To;
+  }
+  // Vars found in ConstMap are rewritten to their constant. The map must
+  // outlive the rewriter.
+  void setConstMap(const std::map<Inst *, llvm::APInt> *M) { ConstMap = M; }
+  // Only affects Insts that haven't been rewritten yet.
+  void setCloneVars(bool B) { CloneVars = B; }
+  void setCloneBlocks(bool B) { CloneBlocks = B; }
+
+  Inst *rewrite(Inst *Root);
+  // Rewrites all roots in place in one walk.
+  void rewrite(llvm::MutableArrayRef<Inst *> Roots);
+  void rewrite(InstMapping &M);
 };
 
 struct SynthesisContext {
@@ -334,6 +630,8 @@ std::string GetReplacementRHSString(Inst *RHS, ReplacementContext &Context,
 void findCands(Inst *Root, std::set<Inst *> &Guesses,
                bool WidthMustMatch, bool FilterVars, int Max);
 
+// Compatibility wrapper around an InstRewriter that works on the given
+// caches.
 Inst *getInstCopy(Inst *I, InstContext &IC,
                   std::map<Inst *, Inst *> &InstCache,
                   std::map<Block *, Block *> &BlockCache,
@@ -369,8 +667,17 @@ void separatePCs(const std::vector<InstMapping> &PCs,
 
 std::vector<Block *> getBlocksFromPhis(Inst *I);
 
+// Replaces the custom instructions in I with what they stand for. I is left
+// as it is; the result shares the parts of it that have none.
 Inst *lowerCustomInst(InstContext &IC, Inst *I);
 
+// Value of I if it's a foldable operator whose operands are all constants
+std::optional<llvm::APInt> Fold(Inst *I);
+bool OpsConstP(Inst *I);
+// Folds constant subexpressions and identities such as x + 0 into a new
+// Inst; I itself is left alone
+Inst *ConstantFoldingLite(InstContext &IC, Inst *I);
+
 }
 
 #endif  // SOUPER_INST_INST_H
@@ -31,7 +31,7 @@ template<> struct llvm::GraphTraits<souper::Inst*> {
 
   static NodeRef getEntryNode(souper::Inst* instr) { return instr; }
 
-  using ChildIteratorType = std::vector<NodeRef>::iterator;
+  using ChildIteratorType = llvm::SmallVectorImpl<NodeRef>::iterator;
 
   static ChildIteratorType child_begin(NodeRef N) {
     return N->Ops.begin();
@@ -64,7 +64,7 @@ template<> struct llvm::DOTGraphTraits<souper::Inst*> : public llvm::DefaultDOTG
     case souper::Inst::Kind::ReservedInst:
       return "ReservedInst";
     case souper::Inst::Kind::Var:
-      return "Var " + instr->Name;
+      return "Var " + instr->attrs().Name;
     case souper::Inst::Kind::Const: {
       llvm::SmallString<64> S;
       instr->Val.toStringUnsigned(S);
@@ -0,0 +1,90 @@
+// Copyright 2014 The Souper Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SOUPER_PARSER_BINARYFORMAT_H
+#define SOUPER_PARSER_BINARYFORMAT_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "souper/Inst/Inst.h"
+#include "souper/Parser/Parser.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace souper {
+
+/// A compact binary encoding of replacements. A corpus is a header, a table
+/// with the offset of every replacement and the replacements themselves, so
+/// a reader can materialize any replacement without looking at the others.
+/// Each replacement is a numbered DAG: blocks, then Insts in post-order with
+/// operands referring to earlier Insts by number, then the mapping, the PCs
+/// and the block PCs. Operands of commutative Insts are written in their
+/// printed order, so the encoding doesn't depend on where Insts live.
+
+// True if Data starts like a binary corpus
+bool isBinaryCorpus(llvm::StringRef Data);
+
+class BinaryCorpusWriter {
+  std::string Records;
+  std::vector<uint64_t> Offsets;
+
+public:
+  void add(const ParsedReplacement &Rep);
+  // Records can be encoded ahead of time, on any thread, and added later
+  static std::string encode(const ParsedReplacement &Rep);
+  void addEncoded(llvm::StringRef Record);
+  size_t size() const { return Offsets.size(); }
+  void write(llvm::raw_ostream &OS) const;
+};
+
+/// Reads a corpus in place: only the header is checked up front, and each
+/// replacement is decoded into an InstContext when it is asked for.
+class BinaryCorpusReader {
+  std::unique_ptr<llvm::MemoryBuffer> Buffer;
+  llvm::StringRef Data;
+  uint64_t NumRecords = 0;
+
+  BinaryCorpusReader() = default;
+
+public:
+  // The reader refers to Data, which must outlive it. Returns nullptr and
+  // sets ErrStr if Data isn't a well formed corpus.
+  static std::unique_ptr<BinaryCorpusReader> create(llvm::StringRef Data,
+                                                    std::string &ErrStr);
+  // Maps the file into memory instead of reading it
+  static std::unique_ptr<BinaryCorpusReader> open(llvm::StringRef Filename,
+                                                  std::string &ErrStr);
+
+  size_t size() const { return NumRecords; }
+  ParsedReplacement get(size_t Idx, InstContext &IC,
+                        std::string &ErrStr) const;
+  std::vector<ParsedReplacement> getAll(InstContext &IC,
+                                        std::string &ErrStr) const;
+};
+
+/// Encodes an RHS found for an LHS that was printed using Context. Insts and
+/// blocks that Context has names for are written as references to those
+/// names, so the result is only meaningful next to the printed LHS, which
+/// is how the solver caches use it.
+std::string EncodeReplacementRHS(Inst *RHS, ReplacementContext &Context);
+bool isBinaryRHS(llvm::StringRef Data);
+Inst *DecodeReplacementRHS(InstContext &IC, llvm::StringRef Data,
+                           ReplacementContext &Context, std::string &ErrStr);
+
+}
+
+#endif  // SOUPER_PARSER_BINARYFORMAT_H
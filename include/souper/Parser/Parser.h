@@ -17,18 +17,25 @@
 
 #include "llvm/ADT/StringRef.h"
 #include "souper/Extractor/Candidates.h"
+#include "souper/Util/SharedVector.h"
+
+#include <memory>
+#include <string>
+#include <vector>
 
 namespace souper {
 
+/// A replacement is a cheap value to copy: its condition lists are shared
+/// between copies until one of them is changed.
 struct ParsedReplacement {
   /// The replacement mapping.
   InstMapping Mapping;
 
   /// The path conditions relevant to this replacement.
-  std::vector<InstMapping> PCs;
+  SharedVector<InstMapping> PCs;
 
   /// The blockpc condtions relevant to this replacement.
-  BlockPCs BPCs;
+  SharedVector<BlockPCMapping> BPCs;
 
   void print(llvm::raw_ostream &OS, bool printNames = false) const {
     PrintReplacement(OS, BPCs, PCs, Mapping, printNames);
@@ -76,6 +83,55 @@ std::vector<ParsedReplacement> ParseReplacementRHSs(InstContext &IC,
     llvm::StringRef Filename, llvm::StringRef Str,
     std::vector<ReplacementContext> &Contexts, std::string &ErrStr);
 
+/// Checks the number and the widths of the operands of an instruction of kind
+/// IK that isn't a constant, variable or phi, as the parser does for every
+/// instruction line. Untyped constants in Ops get the width of the other
+/// operands, and a Width of 0 becomes the width the instruction must have.
+bool typeCheckInst(InstContext &IC, Inst::Kind IK, unsigned &Width,
+                   std::vector<Inst *> &Ops, std::string &ErrStr);
+
+/// Parses replacements one at a time, so that a large corpus never has to be
+/// held in memory as a whole. Binary corpora are read as well. Names are
+/// only looked up in the input, never copied, so the input must outlive the
+/// stream.
+class ReplacementStream {
+  struct Impl;
+  std::unique_ptr<Impl> P;
+
+public:
+  // FirstLine is the line of Filename that Str starts at, which is used for
+  // error messages about a shard of a file.
+  ReplacementStream(InstContext &IC, llvm::StringRef Filename,
+                    llvm::StringRef Str, unsigned FirstLine = 1);
+  ~ReplacementStream();
+
+  // Maps the file into memory instead of reading it. Returns nullptr and sets
+  // ErrStr if it can't be opened.
+  static std::unique_ptr<ReplacementStream> open(InstContext &IC,
+                                                 llvm::StringRef Filename,
+                                                 std::string &ErrStr);
+
+  // True if the input is a binary corpus
+  bool isBinary() const;
+
+  // Parses the next replacement into Rep. Returns false at the end of the
+  // input or on an error, in which case ErrStr is set.
+  bool next(ParsedReplacement &Rep, std::string &ErrStr);
+};
+
+struct ReplacementShard {
+  llvm::StringRef Str;
+  unsigned FirstLine;
+};
+
+/// Splits the text of a replacement file into at most N shards of about the
+/// same size that each end at the end of a replacement, so that they can be
+/// parsed independently. A replacement ends with its 'cand' or 'result'
+/// line, or with its 'infer' line if it has no RHS. Binary corpora are
+/// returned as a single shard.
+std::vector<ReplacementShard> SplitReplacements(llvm::StringRef Str,
+                                                unsigned N);
+
 }
 
 #endif  // SOUPER_PARSER_PARSER_H
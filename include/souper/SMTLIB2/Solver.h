@@ -37,12 +37,39 @@ public:
                                         unsigned NumModels,
                                         std::vector<llvm::APInt> *Models,
                                         unsigned Timeout = 0) = 0;
+  // An independent instance that another thread can query while this one
+  // is in use, or null if the solver can't be duplicated
+  virtual std::unique_ptr<SMTLIBSolver> clone() const { return nullptr; }
+  // A solver that stays alive between queries, for callers that issue a
+  // sequence of related queries; each query runs in its own scope, so its
+  // declarations and assertions don't leak into the next one. Null if the
+  // solver has no persistent mode.
+  virtual std::unique_ptr<SMTLIBSolver> startSession() const {
+    return nullptr;
+  }
+  // For a session: keeps the declarations and assertions of Query for good,
+  // so that every later query is checked together with them and may refer to
+  // what they declare. This lets a sequence of queries that share a formula
+  // send only what each one adds to it. Returns false, leaving the session
+  // as it was, if the solver isn't a session or rejects them.
+  virtual bool addAssertions(llvm::StringRef Query) { return false; }
+  // Makes a query that another thread runs on this solver give up with
+  // timed_out, and so do later queries until resume() is called. Solvers
+  // that can't be interrupted ignore both.
+  virtual void interrupt() {}
+  virtual void resume() {}
 };
 
 SolverProgram makeExternalSolverProgram(llvm::StringRef Path);
 SolverProgram makeInternalSolverProgram(int MainPtr(int argc, char **argv));
 
-std::unique_ptr<SMTLIBSolver> createZ3Solver(SolverProgram Prog, bool Keep);
+// Z3 run as Prog. If Sessions is set, startSession() hands out in-process
+// sessions of the linked Z3 library rather than runs of Prog.
+std::unique_ptr<SMTLIBSolver> createZ3Solver(SolverProgram Prog, bool Keep,
+                                             bool Sessions = false);
+// An in-process Z3 session that checks queries with the given tactic, or
+// with Z3's default strategy if Tactic is empty
+std::unique_ptr<SMTLIBSolver> createZ3SessionSolver(llvm::StringRef Tactic = "");
 
 }
 
@@ -0,0 +1,101 @@
+// Copyright 2014 The Souper Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SOUPER_UTIL_SHAREDVECTOR_H
+#define SOUPER_UTIL_SHAREDVECTOR_H
+
+#include <cassert>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+namespace souper {
+
+/// A vector with value semantics whose elements are shared between copies.
+/// Copying one costs a reference count increment. Elements can only be read
+/// in place; a change makes a private copy first if the elements are shared,
+/// so it is never seen through other copies. A copy that owns its elements,
+/// like one that has been changed before, appends and pops in place.
+///
+/// It converts to a const std::vector, so it can be handed to the solver
+/// and printing interfaces as it is.
+template <typename T> class SharedVector {
+  std::shared_ptr<std::vector<T>> Elts;
+
+  static const std::vector<T> &none() {
+    static const std::vector<T> Empty;
+    return Empty;
+  }
+
+public:
+  using value_type = T;
+  using size_type = typename std::vector<T>::size_type;
+  using const_iterator = typename std::vector<T>::const_iterator;
+  using iterator = const_iterator;
+
+  SharedVector() = default;
+  SharedVector(std::vector<T> V) {
+    if (!V.empty())
+      Elts = std::make_shared<std::vector<T>>(std::move(V));
+  }
+  SharedVector(std::initializer_list<T> L)
+      : SharedVector(std::vector<T>(L)) {}
+
+  const std::vector<T> &get() const { return Elts ? *Elts : none(); }
+  operator const std::vector<T> &() const { return get(); }
+
+  size_type size() const { return get().size(); }
+  bool empty() const { return get().empty(); }
+  const_iterator begin() const { return get().begin(); }
+  const_iterator end() const { return get().end(); }
+  const T &operator[](size_type I) const { return get()[I]; }
+  const T &front() const { return get().front(); }
+  const T &back() const { return get().back(); }
+
+  // True if the elements are not shared with another copy, so changing them
+  // doesn't copy them
+  bool unique() const { return !Elts || Elts.use_count() == 1; }
+
+  // The elements, made private to this copy first if they are shared
+  std::vector<T> &mutate() {
+    if (!Elts)
+      Elts = std::make_shared<std::vector<T>>();
+    else if (Elts.use_count() > 1)
+      Elts = std::make_shared<std::vector<T>>(*Elts);
+    return *Elts;
+  }
+
+  void push_back(T X) { mutate().push_back(std::move(X)); }
+  template <typename... Args> void emplace_back(Args &&...A) {
+    mutate().emplace_back(std::forward<Args>(A)...);
+  }
+  void pop_back() {
+    assert(!empty());
+    if (unique())
+      Elts->pop_back();
+    else
+      Elts = std::make_shared<std::vector<T>>(begin(), end() - 1);
+  }
+  void set(size_type I, T X) { mutate()[I] = std::move(X); }
+  void clear() {
+    if (unique() && Elts)
+      Elts->clear();
+    else
+      Elts.reset();
+  }
+};
+
+}
+
+#endif
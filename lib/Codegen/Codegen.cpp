@@ -50,7 +50,7 @@ llvm::Type *Codegen::GetInstReturnType(llvm::LLVMContext &Context, Inst *I) {
 }
 
 llvm::Value *Codegen::getValue(Inst *I) {
-  const std::vector<Inst *> &Ops = I->orderedOps();
+  llvm::ArrayRef<Inst *> Ops = I->orderedOps();
   if (I->K == Inst::UntypedConst) {
     // FIXME: We only get here because it is the second argument of
     // extractvalue instrs. This is not otherwise reachable.
@@ -68,9 +68,9 @@ llvm::Value *Codegen::getValue(Inst *I) {
   if (ReplacedValues.find(I) != ReplacedValues.end())
     return ReplacedValues.at(I);
 
-  if (I->Origins.size() > 0) {
+  if (I->attrs().Origins.size() > 0) {
     // if there's an Origin, we're connecting to existing code
-    for (auto V : I->Origins) {
+    for (auto V : I->attrs().Origins) {
       if (V->getType() != T)
         continue; // TODO: can we assert this doesn't happen?
       if (isa<Argument>(V) || isa<Constant>(V))
@@ -351,7 +351,7 @@ void ExprBuilder::markExternalUses (Inst *I) {
   for (auto U : UsesCount)
     for (auto R : EBC.InstMap)
       if (R.second == U.first && R.first->getNumUses() != U.second)
-        I->DepsWithExternalUses.insert(U.first);
+        I->mutableAttrs().DepsWithExternalUses.insert(U.first);
 }
 
 Inst *ExprBuilder::build(Value *V, APInt DemandedBits) {
@@ -683,7 +683,7 @@ Inst *ExprBuilder::get(Value *V, APInt DemandedBits) {
   if (!E)
     E = build(V, DemandedBits);
   if (E->K != Inst::Const && !E->hasOrigin(V))
-    E->Origins.push_back(V);
+    E->mutableAttrs().Origins.push_back(V);
   return E;
 }
 
@@ -693,7 +693,7 @@ Inst *ExprBuilder::getFromUse(Value *V) {
   APInt DemandedBits = APInt::getAllOnes(Width);
   Inst *E = build(V, DemandedBits);
   if (E->K != Inst::Const && !E->hasOrigin(V))
-    E->Origins.push_back(V);
+    E->mutableAttrs().Origins.push_back(V);
   return E;
 }
 
@@ -706,7 +706,7 @@ Inst *ExprBuilder::get(Value *V) {
     E = build(V, DemandedBits);
   }
   if (E->K != Inst::Const && !E->hasOrigin(V))
-    E->Origins.push_back(V);
+    E->mutableAttrs().Origins.push_back(V);
   return E;
 }
 
@@ -1030,8 +1030,8 @@ void ExtractExprCandidates(Function &F, const LoopInfo &LI, DemandedBits &DB,
             if (U->getType()->isIntegerTy()) {
               if(Visited.insert(U).second) {
                 Inst *In = EB.getFromUse(U);
-                In->HarvestKind = HarvestType::HarvestedFromUse;
-                In->HarvestFrom = &BB;
+                In->mutableAttrs().HarvestKind = HarvestType::HarvestedFromUse;
+                In->mutableAttrs().HarvestFrom = &BB;
                 if (MarkExternalUses)
                   EB.markExternalUses(In);
                 BCS->Replacements.emplace_back(U, InstMapping(In, 0));
@@ -1054,8 +1054,8 @@ void ExtractExprCandidates(Function &F, const LoopInfo &LI, DemandedBits &DB,
       } else {
         In = EB.get(&I);
       }
-      In->HarvestKind = HarvestType::HarvestedFromDef;
-      In->HarvestFrom = nullptr;
+      In->mutableAttrs().HarvestKind = HarvestType::HarvestedFromDef;
+      In->mutableAttrs().HarvestFrom = nullptr;
       if (MarkExternalUses)
         EB.markExternalUses(In);
       BCS->Replacements.emplace_back(&I, InstMapping(In, 0));
@@ -65,7 +65,7 @@ bool ExprBuilder::getUBPaths(Inst *I, UBPath *Current,
       break;
   }
 
-  const std::vector<Inst *> &Ops = I->orderedOps();
+  llvm::ArrayRef<Inst *> Ops = I->orderedOps();
   if (I->K == Inst::Phi) {
     // Early terminate because this phi has been processed.
     // We will use its cached predicates.
@@ -131,7 +131,7 @@ void ExprBuilder::getBlockPCPhiPaths(
     std::vector<std::unique_ptr<BlockPCPhiPath>> &Paths,
     UBPathInstMap &CachedPhis) {
 
-  const std::vector<Inst *> &Ops = I->orderedOps();
+  llvm::ArrayRef<Inst *> Ops = I->orderedOps();
   if (I->K != Inst::Phi) {
     for (unsigned J = 0; J < Ops.size(); ++J)
       getBlockPCPhiPaths(Ops[J], Current, Paths, CachedPhis);
@@ -331,29 +331,29 @@ Inst *ExprBuilder::getDataflowConditions(Inst *I) {
   Inst *Zero = LIC->getConst(llvm::APInt(Width, 0));
   Inst *One = LIC->getConst(llvm::APInt(Width, 1));
 
-  if (I->KnownZeros.getBoolValue()) {
+  if (I->attrs().KnownZeros.getBoolValue()) {
     Inst *AllOnes = LIC->getConst(llvm::APInt::getAllOnes(Width));
     Inst *NotZeros = LIC->getInst(Inst::Xor, Width,
-                                  {LIC->getConst(I->KnownZeros), AllOnes});
+                                  {LIC->getConst(I->attrs().KnownZeros), AllOnes});
     Inst *VarNotZero = LIC->getInst(Inst::Or, Width, {I, NotZeros});
     Inst *ZeroBits = LIC->getInst(Inst::Eq, 1, {VarNotZero, NotZeros});
     Result = LIC->getInst(Inst::And, 1, {Result, ZeroBits});
   }
-  if (I->KnownOnes.getBoolValue()) {
-    Inst *Ones = LIC->getConst(I->KnownOnes);
+  if (I->attrs().KnownOnes.getBoolValue()) {
+    Inst *Ones = LIC->getConst(I->attrs().KnownOnes);
     Inst *VarAndOnes = LIC->getInst(Inst::And, Width, {I, Ones});
     Inst *OneBits = LIC->getInst(Inst::Eq, 1, {VarAndOnes, Ones});
     Result = LIC->getInst(Inst::And, 1, {Result, OneBits});
   }
-  if (I->NonZero) {
+  if (I->attrs().NonZero) {
     Inst *NonZeroBits = LIC->getInst(Inst::Ne, 1, {I, Zero});
     Result = LIC->getInst(Inst::And, 1, {Result, NonZeroBits});
   }
-  if (I->NonNegative) {
+  if (I->attrs().NonNegative) {
     Inst *NonNegBits = LIC->getInst(Inst::Sle, 1, {Zero, I});
     Result = LIC->getInst(Inst::And, 1, {Result, NonNegBits});
   }
-  if (I->PowOfTwo) {
+  if (I->attrs().PowOfTwo) {
     Inst *And = LIC->getInst(Inst::And, Width,
                              {I, LIC->getInst(Inst::Sub, Width, {I, One})});
     Inst *PowerTwoBits = LIC->getInst(Inst::And, 1,
@@ -361,12 +361,12 @@ Inst *ExprBuilder::getDataflowConditions(Inst *I) {
                                        LIC->getInst(Inst::Eq, 1, {And, Zero})});
     Result = LIC->getInst(Inst::And, 1, {Result, PowerTwoBits});
   }
-  if (I->Negative) {
+  if (I->attrs().Negative) {
     Inst *NegBits = LIC->getInst(Inst::Slt, 1, {I, Zero});
     Result = LIC->getInst(Inst::And, 1, {Result, NegBits});
   }
-  if (I->NumSignBits > 1) {
-    Inst *Diff = LIC->getConst(llvm::APInt(Width, Width - I->NumSignBits));
+  if (I->attrs().NumSignBits > 1) {
+    Inst *Diff = LIC->getConst(llvm::APInt(Width, Width - I->attrs().NumSignBits));
     Inst *Res = LIC->getInst(Inst::AShr, Width, {I, Diff});
     Diff = LIC->getConst(llvm::APInt(Width, Width-1));
     Inst *TestOnes = LIC->getInst(Inst::AShr, Width,
@@ -398,12 +398,12 @@ Inst *ExprBuilder::getDataflowConditions(Inst *I) {
     }
   };
 
-  if (auto Cond = mkCRCond(I->Range)) {
+  if (auto Cond = mkCRCond(I->attrs().Range)) {
     Result = LIC->getInst(Inst::And, 1, {Result, Cond});
   }
 
   std::vector<Inst *> CRConds;
-  for (auto R : I->RangeRefinement) {
+  for (auto R : I->attrs().RangeRefinement) {
     if (auto Cond = mkCRCond(R)) {
       CRConds.push_back(Cond);
     }
@@ -527,7 +527,7 @@ Inst *ExprBuilder::getImpliesInst(Inst *Ante, Inst *I) {
 }
 
 Inst *ExprBuilder::addnswUB(Inst *I) {
-   const std::vector<Inst *> &Ops = I->orderedOps();
+   llvm::ArrayRef<Inst *> Ops = I->orderedOps();
    auto L = Ops[0];
    auto R = Ops[1];
    unsigned Width = L->Width;
@@ -540,7 +540,7 @@ Inst *ExprBuilder::addnswUB(Inst *I) {
 }
 
 Inst *ExprBuilder::addnuwUB(Inst *I) {
-   const std::vector<Inst *> &Ops = I->orderedOps();
+   llvm::ArrayRef<Inst *> Ops = I->orderedOps();
    auto L = Ops[0];
    auto R = Ops[1];
    unsigned Width = L->Width;
@@ -553,7 +553,7 @@ Inst *ExprBuilder::addnuwUB(Inst *I) {
 }
 
 Inst *ExprBuilder::subnswUB(Inst *I) {
-   const std::vector<Inst *> &Ops = I->orderedOps();
+   llvm::ArrayRef<Inst *> Ops = I->orderedOps();
    auto L = Ops[0];
    auto R = Ops[1];
    unsigned Width = L->Width;
@@ -566,7 +566,7 @@ Inst *ExprBuilder::subnswUB(Inst *I) {
 }
 
 Inst *ExprBuilder::subnuwUB(Inst *I) {
-   const std::vector<Inst *> &Ops = I->orderedOps();
+   llvm::ArrayRef<Inst *> Ops = I->orderedOps();
    auto L = Ops[0];
    auto R = Ops[1];
    unsigned Width = L->Width;
@@ -579,7 +579,7 @@ Inst *ExprBuilder::subnuwUB(Inst *I) {
 }
 
 Inst *ExprBuilder::mulnswUB(Inst *I) {
-   const std::vector<Inst *> &Ops = I->orderedOps();
+   llvm::ArrayRef<Inst *> Ops = I->orderedOps();
    // The computation below has to be performed on the operands of
    // multiplication instruction. The instruction using mulnswUB()
    // can be of different width, for instance in SMulO instruction
@@ -596,7 +596,7 @@ Inst *ExprBuilder::mulnswUB(Inst *I) {
 }
 
 Inst *ExprBuilder::mulnuwUB(Inst *I) {
-   const std::vector<Inst *> &Ops = I->orderedOps();
+   llvm::ArrayRef<Inst *> Ops = I->orderedOps();
    auto L = Ops[0];
    auto R = Ops[1];
    unsigned Width = L->Width;
@@ -609,14 +609,14 @@ Inst *ExprBuilder::mulnuwUB(Inst *I) {
 }
 
 Inst *ExprBuilder::udivUB(Inst *I) {
-   const std::vector<Inst *> &Ops = I->orderedOps();
+   llvm::ArrayRef<Inst *> Ops = I->orderedOps();
    auto R = Ops[1];
    return LIC->getInst(Inst::Ne, 1,
                        {R, LIC->getConst(llvm::APInt(R->Width, 0))});
 }
 
 Inst *ExprBuilder::udivExactUB(Inst *I) {
-   const std::vector<Inst *> &Ops = I->orderedOps();
+   llvm::ArrayRef<Inst *> Ops = I->orderedOps();
    auto L = Ops[0];
    auto R = Ops[1];
    unsigned Width = L->Width;
@@ -626,7 +626,7 @@ Inst *ExprBuilder::udivExactUB(Inst *I) {
 }
 
 Inst *ExprBuilder::sdivUB(Inst *I) {
-   const std::vector<Inst *> &Ops = I->orderedOps();
+   llvm::ArrayRef<Inst *> Ops = I->orderedOps();
    auto L = Ops[0];
    auto R = Ops[1];
    unsigned Width = L->Width;
@@ -643,7 +643,7 @@ Inst *ExprBuilder::sdivUB(Inst *I) {
 }
 
 Inst *ExprBuilder::sdivExactUB(Inst *I) {
-   const std::vector<Inst *> &Ops = I->orderedOps();
+   llvm::ArrayRef<Inst *> Ops = I->orderedOps();
    auto L = Ops[0];
    auto R = Ops[1];
    unsigned Width = L->Width;
@@ -653,7 +653,7 @@ Inst *ExprBuilder::sdivExactUB(Inst *I) {
 }
 
 Inst *ExprBuilder::shiftUB(Inst *I) {
-   const std::vector<Inst *> &Ops = I->orderedOps();
+   llvm::ArrayRef<Inst *> Ops = I->orderedOps();
    auto L = Ops[0];
    auto R = Ops[1];
    unsigned Width = L->Width;
@@ -662,7 +662,7 @@ Inst *ExprBuilder::shiftUB(Inst *I) {
 }
 
 Inst *ExprBuilder::shlnswUB(Inst *I) {
-   const std::vector<Inst *> &Ops = I->orderedOps();
+   llvm::ArrayRef<Inst *> Ops = I->orderedOps();
    auto L = Ops[0];
    auto R = Ops[1];
    unsigned Width = L->Width;
@@ -672,7 +672,7 @@ Inst *ExprBuilder::shlnswUB(Inst *I) {
 }
 
 Inst *ExprBuilder::shlnuwUB(Inst *I) {
-   const std::vector<Inst *> &Ops = I->orderedOps();
+   llvm::ArrayRef<Inst *> Ops = I->orderedOps();
    auto L = Ops[0];
    auto R = Ops[1];
    unsigned Width = L->Width;
@@ -682,7 +682,7 @@ Inst *ExprBuilder::shlnuwUB(Inst *I) {
 }
 
 Inst *ExprBuilder::lshrExactUB(Inst *I) {
-   const std::vector<Inst *> &Ops = I->orderedOps();
+   llvm::ArrayRef<Inst *> Ops = I->orderedOps();
    auto L = Ops[0];
    auto R = Ops[1];
    unsigned Width = L->Width;
@@ -692,7 +692,7 @@ Inst *ExprBuilder::lshrExactUB(Inst *I) {
 }
 
 Inst *ExprBuilder::ashrExactUB(Inst *I) {
-   const std::vector<Inst *> &Ops = I->orderedOps();
+   llvm::ArrayRef<Inst *> Ops = I->orderedOps();
    auto L = Ops[0];
    auto R = Ops[1];
    unsigned Width = L->Width;
@@ -979,19 +979,19 @@ Inst *ExprBuilder::GetCandidateExprForReplacement(
   return Result;
 }
 
-std::string BuildQuery(InstContext &IC, const BlockPCs &BPCs,
-    const std::vector<InstMapping> &PCs, InstMapping Mapping,
-    std::vector<Inst *> *ModelVars, Inst *Precondition, bool Negate, bool DropUB) {
-  std::unique_ptr<ExprBuilder> EB;
+std::unique_ptr<ExprBuilder> createExprBuilder(InstContext &IC) {
   switch (SMTExprBuilder) {
   case ExprBuilder::KLEE:
-    EB = createKLEEBuilder(IC);
-    break;
+    return createKLEEBuilder(IC);
   default:
     llvm::report_fatal_error("cannot reach here");
-    break;
   }
+}
 
+std::string BuildQuery(InstContext &IC, const BlockPCs &BPCs,
+    const std::vector<InstMapping> &PCs, InstMapping Mapping,
+    std::vector<Inst *> *ModelVars, Inst *Precondition, bool Negate, bool DropUB) {
+  std::unique_ptr<ExprBuilder> EB = createExprBuilder(IC);
   return EB->BuildQuery(BPCs, PCs, Mapping, ModelVars, Precondition, Negate, DropUB);
 }
 
@@ -1391,6 +1391,23 @@ public:
     return SMTSS.str();
   }
 
+  std::string BuildAssertion(Inst *Constraint) override {
+    assert(Constraint->Width == 1 && "constraints must be i1");
+    std::string SMTStr;
+    llvm::raw_string_ostream SMTSS(SMTStr);
+    ConstraintSet constraints;
+    prepopulateExprMap(Constraint);
+    // the printer asserts the negation of the query expression
+    Query KQuery(constraints, Expr::createIsZero(get(Constraint)));
+    ExprSMTLIBPrinter Printer;
+    Printer.setOutput(SMTSS);
+    Printer.setQuery(KQuery);
+    Printer.generateOutput();
+
+    llvm::StringRef Cmds = SMTSS.str();
+    return Cmds.substr(0, Cmds.find("(check-sat)")).str();
+  }
+
 private:
   ref<Expr> countOnes(ref<Expr> L) {
      Expr::Width Width = L->getWidth();
@@ -1414,7 +1431,7 @@ private:
   }
 
   ref<Expr> build(Inst *I) {
-    const std::vector<Inst *> &Ops = I->orderedOps();
+    llvm::ArrayRef<Inst *> Ops = I->orderedOps();
     switch (I->K) {
     case Inst::UntypedConst:
       assert(0 && "unexpected kind");
@@ -1422,7 +1439,7 @@ private:
       return klee::ConstantExpr::alloc(I->Val);
     case Inst::Hole:
     case Inst::Var:
-      return makeSizedArrayRead(I->Width, I->Name, I);
+      return makeSizedArrayRead(I->Width, I->attrs().Name, I);
     case Inst::Phi: {
       const auto &PredExpr = I->B->PredVars;
       assert((PredExpr.size() || Ops.size() == 1) && "there must be block predicates");
@@ -1768,7 +1785,7 @@ private:
     case Inst::UMulWithOverflow:
 
     case Inst::Custom: {
-      return get(CustomInstructionMap[I->Name](LIC, I->Ops));
+      return get(CustomInstructionMap[I->attrs().Name](LIC, I->Ops));
     }
 
     default:
@@ -1806,7 +1823,7 @@ private:
     // since we will be appending new entries at the end.
     for (size_t InstNum = 0; InstNum < AllInst.size(); InstNum++) {
       Inst *CurrInst = AllInst[InstNum];
-      const std::vector<Inst *> &Ops = CurrInst->orderedOps();
+      llvm::ArrayRef<Inst *> Ops = CurrInst->orderedOps();
       AllInst.insert(AllInst.end(), Ops.rbegin(), Ops.rend());
     }
 
@@ -0,0 +1,108 @@
+// Copyright 2014 The Souper Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "souper/Extractor/QueryPreprocessor.h"
+
+#include "llvm/ADT/EquivalenceClasses.h"
+
+#include <map>
+
+using namespace souper;
+
+namespace {
+
+bool hasPhi(Inst *I) {
+  return I->has(Inst::HasPhi);
+}
+
+std::vector<Inst *> getPCVars(const InstMapping &PC) {
+  std::vector<Inst *> Vars;
+  findVars(PC.LHS, Vars);
+  findVars(PC.RHS, Vars);
+  return Vars;
+}
+
+}
+
+PreprocessedQuery souper::preprocessQuery(InstContext &IC,
+                                          const BlockPCs &BPCs,
+                                          const std::vector<InstMapping> &PCs,
+                                          InstMapping Mapping,
+                                          Inst *Precondition) {
+  PreprocessedQuery Result;
+  if (Mapping.LHS == Mapping.RHS) {
+    Result.TriviallyValid = true;
+    return Result;
+  }
+
+  // Folding only drops UB conditions of path conditions, which can make the
+  // antecedent weaker but never stronger
+  std::vector<InstMapping> Folded;
+  for (const auto &PC : PCs) {
+    InstMapping F(ConstantFoldingLite(IC, PC.LHS),
+                  ConstantFoldingLite(IC, PC.RHS));
+    if (F.LHS == F.RHS)
+      continue;
+    // a path condition that never holds makes the query vacuously true
+    if (F.LHS->K == Inst::Const && F.RHS->K == Inst::Const) {
+      Result.TriviallyValid = true;
+      return Result;
+    }
+    Folded.push_back(F);
+  }
+
+  // Block path conditions are tied to the phis through the block
+  // predicates, don't try to separate those
+  if (!BPCs.empty() || hasPhi(Mapping.LHS) || hasPhi(Mapping.RHS)) {
+    Result.PCs = std::move(Folded);
+    return Result;
+  }
+
+  // Variables that are used together end up in the same class
+  llvm::EquivalenceClasses<Inst *> Classes;
+  std::vector<Inst *> MappingVars;
+  findVars(Mapping.LHS, MappingVars);
+  findVars(Mapping.RHS, MappingVars);
+  if (Precondition)
+    findVars(Precondition, MappingVars);
+  for (auto V : MappingVars)
+    Classes.unionSets(MappingVars.front(), V);
+  std::vector<std::vector<Inst *>> PCVars;
+  for (const auto &PC : Folded) {
+    PCVars.push_back(getPCVars(PC));
+    for (auto V : PCVars.back())
+      Classes.unionSets(PCVars.back().front(), V);
+  }
+
+  Inst *MappingLeader = MappingVars.empty() ? nullptr :
+    Classes.getLeaderValue(MappingVars.front());
+  std::map<Inst *, unsigned> Groups;
+  for (unsigned I = 0; I < Folded.size(); ++I) {
+    if (PCVars[I].empty()) {
+      Result.PCs.push_back(Folded[I]);
+      continue;
+    }
+    Inst *Leader = Classes.getLeaderValue(PCVars[I].front());
+    if (Leader == MappingLeader) {
+      Result.PCs.push_back(Folded[I]);
+      continue;
+    }
+    auto G = Groups.insert({Leader, Result.IndependentPCs.size()});
+    if (G.second)
+      Result.IndependentPCs.emplace_back();
+    Result.IndependentPCs[G.first->second].push_back(Folded[I]);
+  }
+
+  return Result;
+}
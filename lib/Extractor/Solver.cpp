@@ -15,11 +15,13 @@
 #include "llvm/ADT/APInt.h"
 #include "llvm/ADT/SetVector.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/KnownBits.h"
 #include "souper/Codegen/Codegen.h"
+#include "souper/Extractor/QueryPreprocessor.h"
 #include "souper/Extractor/Solver.h"
 #include "souper/Infer/AliveDriver.h"
 #include "souper/Infer/ConstantSynthesis.h"
@@ -28,9 +30,14 @@
 #include "souper/Infer/InstSynthesis.h"
 #include "souper/Infer/Pruning.h"
 #include "souper/KVStore/KVStore.h"
+#include "souper/Parser/BinaryFormat.h"
 #include "souper/Parser/Parser.h"
 
+#include <mutex>
+#include <numeric>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 
 #define DEBUG_TYPE "souper"
 
@@ -40,6 +47,8 @@ STATISTIC(MemHitsIsValid, "Number of internal cache hits for isValid()");
 STATISTIC(MemMissesIsValid, "Number of internal cache misses for isValid()");
 STATISTIC(ExternalHits, "Number of external cache hits");
 STATISTIC(ExternalMisses, "Number of external cache misses");
+STATISTIC(TrivialQueries, "Number of isValid() queries answered without a solver");
+STATISTIC(SlicedPCs, "Number of path conditions sliced off isValid() queries");
 
 using namespace souper;
 using namespace llvm;
@@ -50,10 +59,9 @@ static bool NoInfer = false;
 // static cl::opt<bool> NoInfer("souper-no-infer",
 //     cl::desc("Populate the external cache, but don't infer replacements (default=false)"),
 //     cl::init(false));
-static bool UseCegis = false;
-// static cl::opt<bool> UseCegis("souper-use-cegis",
-//     cl::desc("Infer instructions (default=false)"),
-//     cl::init(false));
+static cl::opt<bool> UseCegis("souper-use-cegis",
+    cl::desc("Infer instructions (default=false)"),
+    cl::init(false));
 static int MaxLHSSize = 1024;
 // static cl::opt<int> MaxLHSSize("souper-max-lhs-size",
 //     cl::desc("Max size of LHS (in bytes) to put in external cache (default=1024)"),
@@ -66,6 +74,29 @@ static bool InferInv = false;
 // static cl::opt<bool> InferInv("souper-infer-invariants",
 //     cl::desc("Infer instructions (default=false)"),
 //     cl::init(false));
+static cl::opt<bool> SliceQueries("souper-slice-queries",
+    cl::desc("Fold and slice path conditions before checking validity "
+             "(default=true)"),
+    cl::init(true));
+static cl::opt<unsigned> PortfolioThreads("souper-portfolio-threads",
+    cl::desc("Number of portfolio backends run at once (default=0, all)"),
+    cl::init(0));
+static cl::opt<bool> PortfolioAlive("souper-portfolio-alive",
+    cl::desc("Include Alive in the solver portfolio (default=true)"),
+    cl::init(true));
+static cl::opt<bool> BinaryCacheValues("souper-binary-cache-values",
+    cl::desc("Store RHSs in the external cache in the binary format "
+             "instead of as text (default=false)"),
+    cl::init(false));
+
+// Z3 tactics raced by the portfolio solver, the empty one being Z3's
+// default strategy
+static const char *PortfolioTactics[] = {
+  "",
+  "(then simplify solve-eqs ackermannize_bv qfbv)",
+  "(then simplify propagate-values ackermannize_bv bit-blast sat)",
+  "(using-params smt :random_seed 7)",
+};
 
 
 class BaseSolver : public Solver {
@@ -81,7 +112,7 @@ public:
     if (!Visited.insert(Node).second)
       return;
     if (Node->K == Inst::Var) {
-      std::string Name = Node->Name;
+      std::string Name = Node->attrs().Name;
       VarsVect.insert(std::pair<std::string, unsigned>(Name, Node->Width));
     }
     for (auto const &Op : Node->Ops) {
@@ -95,7 +126,7 @@ public:
     if (!Visited.insert(Node).second)
       return;
     if (Node->K == Inst::Var) {
-      std::string Name = Node->Name;
+      std::string Name = Node->attrs().Name;
       VarsVect.insert(std::pair<std::string, unsigned>(Name, Node->Width));
     }
     for (auto const &Op : Node->Ops) {
@@ -123,7 +154,7 @@ public:
     }
 
     Inst *Copy = nullptr;
-    if (Node->K == Inst::Var && Node->Name == VarName) {
+    if (Node->K == Inst::Var && Node->attrs().Name == VarName) {
       unsigned VarWidth = Node->Width;
       if (SetBit) {
         APInt SetBit = APInt::getOneBitSet(VarWidth, BitPos);
@@ -136,7 +167,7 @@ public:
                                      {Node, IC.getConst(ClearBit)});
         Copy = ClearMask;
       }
-    } else if (Node->K == Inst::Var && Node->Name != VarName) {
+    } else if (Node->K == Inst::Var && Node->attrs().Name != VarName) {
       Copy = Node;
     } else if (Node->K == Inst::Const || Node->K == Inst::UntypedConst) {
       Copy = Node;
@@ -381,7 +412,7 @@ public:
     std::error_code EC;
 
     // FIXME -- it's a bit messy to have this custom logic here
-    if (LHS->HarvestKind == HarvestType::HarvestedFromUse) {
+    if (LHS->attrs().HarvestKind == HarvestType::HarvestedFromUse) {
       Inst *C = IC.createSynthesisConstant(LHS->Width, /*SynthesisConstID=*/1);
       if (UseAlive) {
         Inst *Ante = IC.getConst(llvm::APInt(1, true));
@@ -390,7 +421,7 @@ public:
           Ante = IC.getInst(Inst::And, 1, {Ante, Eq});
         }
 
-        AliveDriver Synthesizer(LHS, Ante, IC);
+        auto &Synthesizer = AliveDriver::get(LHS, Ante, IC);
         auto ConstantMap = Synthesizer.synthesizeConstantsWithCegis(C, IC);
         if (ConstantMap.find(C) != ConstantMap.end()) {
           RHSs.emplace_back(IC.getConst(ConstantMap[C]));
@@ -479,6 +510,56 @@ public:
       IsValid = isTransformationValid(Mapping.LHS, Mapping.RHS, PCs, BPCs, IC);
       return std::error_code();
     }
+    if (!SliceQueries)
+      return isValidImpl(IC, BPCs, PCs, Mapping, IsValid, Model);
+
+    auto PQ = preprocessQuery(IC, BPCs, PCs, Mapping);
+    if (PQ.TriviallyValid) {
+      ++TrivialQueries;
+      IsValid = true;
+      return std::error_code();
+    }
+    SlicedPCs += PCs.size() - PQ.PCs.size();
+    size_t ModelSize = Model ? Model->size() : 0;
+    std::error_code EC = isValidImpl(IC, BPCs, PQ.PCs, Mapping, IsValid,
+                                     Model);
+    if (EC || IsValid)
+      return EC;
+
+    // The counterexample only refutes the query if the path conditions
+    // that were split off can hold as well
+    Inst *False = IC.getConst(APInt(1, false));
+    Inst *True = IC.getConst(APInt(1, true));
+    for (const auto &Group : PQ.IndependentPCs) {
+      std::vector<Inst *> ModelInsts;
+      std::string Query = BuildQuery(IC, {}, Group, InstMapping(False, True),
+                                     Model ? &ModelInsts : nullptr,
+                                     /*Precondition=*/0);
+      if (Query.empty())
+        return std::make_error_code(std::errc::value_too_large);
+      bool IsSat;
+      std::vector<llvm::APInt> ModelVals;
+      EC = SMTSolver->isSatisfiable(Query, IsSat, ModelInsts.size(),
+                                    &ModelVals, Timeout);
+      if (EC)
+        return EC;
+      if (!IsSat) {
+        IsValid = true;
+        if (Model)
+          Model->erase(Model->begin() + ModelSize, Model->end());
+        return EC;
+      }
+      if (Model)
+        for (unsigned I = 0; I != ModelInsts.size(); ++I)
+          Model->push_back(std::make_pair(ModelInsts[I], ModelVals[I]));
+    }
+    return EC;
+  }
+
+  std::error_code isValidImpl(InstContext &IC, const BlockPCs &BPCs,
+                              const std::vector<InstMapping> &PCs,
+                              InstMapping Mapping, bool &IsValid,
+                              std::vector<std::pair<Inst *, llvm::APInt>> *Model) {
     std::string Query;
     if (Model) {
       std::vector<Inst *> ModelInsts;
@@ -530,9 +611,9 @@ public:
     if (EC || ResultMap.empty())
       return EC;
 
-    std::map<Inst *, Inst *> InstCache;
-    std::map<Block *, Block *> BlockCache;
-    RHS = getInstCopy(RHS, IC, InstCache, BlockCache, &ResultMap, false);
+    InstRewriter R(IC);
+    R.setConstMap(&ResultMap);
+    RHS = R.rewrite(RHS);
     return EC;
   }
 
@@ -644,9 +725,11 @@ public:
 
 class MemCachingSolver : public Solver {
   std::unique_ptr<Solver> UnderlyingSolver;
-  std::unordered_map<std::string, std::pair<std::error_code, bool>> IsValidCache;
-  std::unordered_map<std::string, std::pair<std::error_code, std::string>>
-    InferCache;
+  llvm::StringMap<std::pair<std::error_code, bool>> IsValidCache;
+  llvm::StringMap<std::pair<std::error_code, std::string>> InferCache;
+  // keys are printed into the printer's buffer, which is reused from one
+  // query to the next
+  ReplacementPrinter Printer;
 
 public:
   MemCachingSolver(std::unique_ptr<Solver> UnderlyingSolver)
@@ -656,19 +739,22 @@ public:
                         const std::vector<InstMapping> &PCs,
                         Inst *LHS, std::vector<Inst *> &RHSs,
                         bool AllowMultipleRHSs, InstContext &IC) override {
+    StringRef Repl = Printer.printLHS(BPCs, PCs, LHS);
     ReplacementContext Context;
-    std::string Repl = GetReplacementLHSString(BPCs, PCs, LHS, Context);
     const auto &ent = InferCache.find(Repl);
     if (ent == InferCache.end()) {
       ++MemMissesInfer;
+      // the key and names are taken before the printer is used again
+      std::string Key = Repl.str();
+      Printer.getContext(Context);
       std::error_code EC = UnderlyingSolver->infer(BPCs, PCs, LHS, RHSs,
                                                    AllowMultipleRHSs, IC);
       std::string RHSStr;
       if (!EC && !RHSs.empty()) {
         // TODO: support multi RHSs caching
-        RHSStr = GetReplacementRHSString(RHSs.front(), Context);
+        RHSStr = EncodeReplacementRHS(RHSs.front(), Context);
       }
-      InferCache.emplace(Repl, std::make_pair(EC, RHSStr));
+      InferCache.try_emplace(Key, EC, RHSStr);
       return EC;
     } else {
       ++MemHitsInfer;
@@ -677,10 +763,11 @@ public:
       if (S == "") {
         RHSs.clear();
       } else {
-        ParsedReplacement R = ParseReplacementRHS(IC, "<cache>", S, Context, ES);
+        Printer.getContext(Context);
+        Inst *RHS = DecodeReplacementRHS(IC, S, Context, ES);
         if (ES != "")
           return std::make_error_code(std::errc::protocol_error);
-        RHSs.emplace_back(R.Mapping.RHS);
+        RHSs.emplace_back(RHS);
       }
       return ent->second.first;
     }
@@ -715,13 +802,14 @@ public:
     if (Model)
       return UnderlyingSolver->isValid(IC, BPCs, PCs, Mapping, IsValid, Model);
 
-    std::string Repl = GetReplacementString(BPCs, PCs, Mapping);
+    StringRef Repl = Printer.print(BPCs, PCs, Mapping);
     const auto &ent = IsValidCache.find(Repl);
     if (ent == IsValidCache.end()) {
       ++MemMissesIsValid;
+      std::string Key = Repl.str();
       std::error_code EC = UnderlyingSolver->isValid(IC, BPCs, PCs,
                                                      Mapping, IsValid, 0);
-      IsValidCache.emplace(Repl, std::make_pair(EC, IsValid));
+      IsValidCache.try_emplace(Key, EC, IsValid);
       return EC;
     } else {
       ++MemHitsIsValid;
@@ -830,10 +918,15 @@ public:
         RHSs.clear();
       } else {
         std::string ES;
-        ParsedReplacement R = ParseReplacementRHS(IC, "<cache>", S, Context, ES);
+        Inst *RHS;
+        // entries written before the binary format are still text
+        if (isBinaryRHS(S))
+          RHS = DecodeReplacementRHS(IC, S, Context, ES);
+        else
+          RHS = ParseReplacementRHS(IC, "<cache>", S, Context, ES).Mapping.RHS;
         if (ES != "")
           return std::make_error_code(std::errc::protocol_error);
-        RHSs.emplace_back(R.Mapping.RHS);
+        RHSs.emplace_back(RHS);
       }
       return std::error_code();
     } else {
@@ -850,7 +943,10 @@ public:
       std::string RHSStr;
       if (!EC && !RHSs.empty()) {
         // TODO: support multi RHSs caching
-        RHSStr = GetReplacementRHSString(RHSs.front(), Context);
+        if (BinaryCacheValues)
+          RHSStr = EncodeReplacementRHS(RHSs.front(), Context);
+        else
+          RHSStr = GetReplacementRHSString(RHSs.front(), Context);
       }
       KV->hSet(LHSStr, "rhs", RHSStr);
       return EC;
@@ -941,6 +1037,399 @@ public:
 
 };
 
+
+// How often each backend of a portfolio won, overall and per query shape.
+// A portfolio shares it with its sessions and clones, which other threads
+// query, so it is guarded by a mutex.
+struct PortfolioWins {
+  std::mutex M;
+  std::vector<std::string> Names;
+  std::vector<unsigned> Total;
+  std::unordered_map<std::string, std::vector<unsigned>> PerShape;
+
+  // Backends in the order they are tried for Shape, most wins first
+  std::vector<unsigned> rank(const std::string &Shape) {
+    std::lock_guard<std::mutex> Lock(M);
+    auto &Wins = PerShape[Shape];
+    Wins.resize(Names.size());
+    std::vector<unsigned> Order(Names.size());
+    std::iota(Order.begin(), Order.end(), 0);
+    std::stable_sort(Order.begin(), Order.end(), [&](unsigned A, unsigned B) {
+      return Wins[A] > Wins[B];
+    });
+    return Order;
+  }
+
+  void record(const std::string &Shape, unsigned Winner) {
+    std::lock_guard<std::mutex> Lock(M);
+    ++Total[Winner];
+    auto &Wins = PerShape[Shape];
+    Wins.resize(Names.size());
+    ++Wins[Winner];
+    if (DebugLevel > 2)
+      llvm::errs() << "portfolio: " << Names[Winner] << " won on " << Shape
+                   << "\n";
+  }
+};
+
+// Races in-process Z3 sessions using different tactics on each query and
+// takes the first definitive answer. The configured solver isn't raced,
+// since a solver process can't be interrupted and a race would last until
+// it finished; it only answers the queries on which all tactics failed
+// other than by timing out. Sessions and clones race sessions of their own,
+// so the sequences of queries that synthesis runs are raced as well.
+class PortfolioSMTLIBSolver : public SMTLIBSolver {
+  std::shared_ptr<PortfolioWins> Wins;
+  // one per tactic, in the order of PortfolioTactics; null for a tactic
+  // that a session dropped because it rejected assertions
+  std::vector<std::unique_ptr<SMTLIBSolver>> Backends;
+  std::unique_ptr<SMTLIBSolver> Fallback;
+  unsigned Timeout;
+
+  struct Answer {
+    std::error_code EC;
+    bool IsSat = false;
+    std::vector<llvm::APInt> Models;
+  };
+
+  std::string getShape(StringRef Query) const {
+    return "q" + std::to_string(Log2_64(Query.size()));
+  }
+
+  // Runs Query on the backends in Order, PortfolioThreads at a time, until
+  // one of them gives a definitive answer; the others are then
+  // interrupted. Returns the index of the winner, or -1.
+  int race(StringRef Query, const std::vector<unsigned> &Order,
+           unsigned NumModels, unsigned QueryTimeout, Answer &Result) {
+    std::vector<unsigned> Live;
+    for (auto B : Order)
+      if (B < Backends.size() && Backends[B])
+        Live.push_back(B);
+    unsigned Width = PortfolioThreads ? PortfolioThreads : Live.size();
+    for (size_t Begin = 0; Begin < Live.size(); Begin += Width) {
+      size_t End = std::min(Live.size(), Begin + Width);
+      std::vector<Answer> Answers(End - Begin);
+      std::mutex M;
+      int Winner = -1;
+      auto Run = [&](size_t I) {
+        auto &A = Answers[I - Begin];
+        A.EC = Backends[Live[I]]->isSatisfiable(
+            Query, A.IsSat, NumModels, NumModels ? &A.Models : nullptr,
+            QueryTimeout);
+        if (A.EC)
+          return;
+        std::lock_guard<std::mutex> Lock(M);
+        if (Winner != -1)
+          return;
+        Winner = I;
+        for (size_t J = Begin; J < End; ++J)
+          if (J != I)
+            Backends[Live[J]]->interrupt();
+      };
+      std::vector<std::thread> Threads;
+      for (size_t I = Begin + 1; I < End; ++I)
+        Threads.emplace_back(Run, I);
+      Run(Begin);
+      for (auto &T : Threads)
+        T.join();
+      for (size_t I = Begin; I < End; ++I)
+        Backends[Live[I]]->resume();
+
+      if (Winner != -1) {
+        Result = std::move(Answers[Winner - Begin]);
+        return Live[Winner];
+      }
+      if (Begin == 0)
+        Result.EC = Answers.front().EC;
+    }
+    return -1;
+  }
+
+public:
+  PortfolioSMTLIBSolver(std::shared_ptr<PortfolioWins> Wins,
+                        std::unique_ptr<SMTLIBSolver> Fallback,
+                        unsigned Timeout)
+      : Wins(std::move(Wins)), Fallback(std::move(Fallback)),
+        Timeout(Timeout) {
+    for (auto Tactic : PortfolioTactics)
+      Backends.push_back(createZ3SessionSolver(Tactic));
+    std::lock_guard<std::mutex> Lock(this->Wins->M);
+    if (this->Wins->Names.empty()) {
+      for (auto &B : Backends)
+        this->Wins->Names.push_back(B->getName());
+      this->Wins->Total.resize(this->Wins->Names.size());
+    }
+  }
+
+  std::string getName() const override {
+    return "portfolio";
+  }
+
+  std::unique_ptr<SMTLIBSolver> clone() const override {
+    return std::make_unique<PortfolioSMTLIBSolver>(
+        Wins, Fallback ? Fallback->clone() : nullptr, Timeout);
+  }
+
+  std::unique_ptr<SMTLIBSolver> startSession() const override {
+    // the backends are sessions already, only the fallback may have none
+    return std::make_unique<PortfolioSMTLIBSolver>(
+        Wins, Fallback ? Fallback->startSession() : nullptr, Timeout);
+  }
+
+  bool addAssertions(StringRef Query) override {
+    // a backend that rejects them can't answer this session's queries any
+    // more, and is left out of its races
+    std::vector<bool> Rejected(Backends.size(), true);
+    bool Added = false;
+    for (size_t B = 0; B < Backends.size(); ++B) {
+      if (Backends[B] && Backends[B]->addAssertions(Query)) {
+        Rejected[B] = false;
+        Added = true;
+      }
+    }
+    if (!Added)
+      return false;
+    for (size_t B = 0; B < Backends.size(); ++B)
+      if (Rejected[B])
+        Backends[B].reset();
+    if (Fallback && !Fallback->addAssertions(Query))
+      Fallback.reset();
+    return true;
+  }
+
+  void interrupt() override {
+    for (auto &B : Backends)
+      if (B)
+        B->interrupt();
+    if (Fallback)
+      Fallback->interrupt();
+  }
+
+  void resume() override {
+    for (auto &B : Backends)
+      if (B)
+        B->resume();
+    if (Fallback)
+      Fallback->resume();
+  }
+
+  std::error_code isSatisfiable(llvm::StringRef Query, bool &Result,
+                                unsigned NumModels,
+                                std::vector<llvm::APInt> *Models,
+                                unsigned Timeout = 0) override {
+    std::string Shape = getShape(Query);
+    Answer A;
+    int Winner = race(Query, Wins->rank(Shape), Models ? NumModels : 0,
+                      Timeout ? Timeout : this->Timeout, A);
+    if (Winner == -1 && A.EC != std::errc::timed_out && Fallback)
+      return Fallback->isSatisfiable(Query, Result, NumModels, Models,
+                                     Timeout);
+    if (Winner == -1)
+      return A.EC ? A.EC : std::make_error_code(std::errc::protocol_error);
+    Wins->record(Shape, Winner);
+    Result = A.IsSat;
+    if (Models)
+      *Models = std::move(A.Models);
+    return std::error_code();
+  }
+};
+
+// A BaseSolver whose SMT solver is a PortfolioSMTLIBSolver, so that its
+// queries, including those of synthesis through getSMTLIBSolver(), are all
+// raced. isValid() additionally races Alive against them: Alive shares the
+// InstContext with the caller and can't be interrupted, so it runs on the
+// calling thread, first if it has won most often on queries of the same
+// shape and otherwise after the Z3 race gave up. Only a proof of validity
+// is a definitive answer from Alive.
+class PortfolioSolver : public Solver {
+  std::unique_ptr<Solver> UnderlyingSolver;
+  std::shared_ptr<PortfolioWins> Wins;
+  // index of Alive in Wins, or -1 if Alive isn't raced
+  int Alive = -1;
+  // how often Alive and the Z3 race answered isValid() first, per shape
+  std::unordered_map<std::string, std::pair<unsigned, unsigned>> AliveWins;
+
+  void countInsts(Inst *I, std::unordered_set<Inst *> &Visited,
+                  bool &HasMulDiv) {
+    if (!Visited.insert(I).second)
+      return;
+    switch (I->K) {
+    case Inst::Mul: case Inst::MulNSW: case Inst::MulNUW: case Inst::MulNW:
+    case Inst::UDiv: case Inst::SDiv: case Inst::UDivExact:
+    case Inst::SDivExact: case Inst::URem: case Inst::SRem:
+      HasMulDiv = true;
+      break;
+    default:
+      break;
+    }
+    for (auto Op : I->Ops)
+      countInsts(Op, Visited, HasMulDiv);
+  }
+
+  // Queries of the same shape tend to be won by the same backend. The
+  // shape is made of the width, the rough size, whether there are
+  // multiplications or divisions, which are hard to bit-blast, and whether
+  // there are path conditions.
+  std::string getShape(const std::vector<InstMapping> &PCs,
+                       const InstMapping &Mapping) {
+    std::unordered_set<Inst *> Visited;
+    bool HasMulDiv = false;
+    countInsts(Mapping.LHS, Visited, HasMulDiv);
+    countInsts(Mapping.RHS, Visited, HasMulDiv);
+    return "w" + std::to_string(Mapping.LHS->Width) +
+           ":n" + std::to_string(Log2_64(Visited.size())) +
+           (HasMulDiv ? ":muldiv" : "") + (PCs.empty() ? "" : ":pc");
+  }
+
+public:
+  PortfolioSolver(std::unique_ptr<SMTLIBSolver> SMTSolver, unsigned Timeout)
+      : Wins(std::make_shared<PortfolioWins>()) {
+    auto Race = std::make_unique<PortfolioSMTLIBSolver>(
+        Wins, std::move(SMTSolver), Timeout);
+    if (PortfolioAlive) {
+      Alive = Wins->Names.size();
+      Wins->Names.push_back("Alive");
+      Wins->Total.resize(Wins->Names.size());
+    }
+    UnderlyingSolver = createBaseSolver(std::move(Race), Timeout);
+  }
+
+  ~PortfolioSolver() {
+    if (DebugLevel > 0) {
+      llvm::errs() << "portfolio wins:\n";
+      for (size_t B = 0; B < Wins->Names.size(); ++B)
+        llvm::errs() << "  " << Wins->Names[B] << ": " << Wins->Total[B]
+                     << "\n";
+    }
+  }
+
+  std::error_code isValid(InstContext &IC, const BlockPCs &BPCs,
+                          const std::vector<InstMapping> &PCs,
+                          InstMapping Mapping, bool &IsValid,
+                          std::vector<std::pair<Inst *, llvm::APInt>> *Model)
+  override {
+    if (Alive == -1)
+      return UnderlyingSolver->isValid(IC, BPCs, PCs, Mapping, IsValid, Model);
+
+    // Alive can't produce models, but a valid query has none to give
+    std::string Shape = getShape(PCs, Mapping);
+    auto &[ByAlive, ByRace] = AliveWins[Shape];
+    bool AliveFirst = ByAlive > ByRace;
+    if (AliveFirst &&
+        isTransformationValid(Mapping.LHS, Mapping.RHS, PCs, BPCs, IC)) {
+      ++ByAlive;
+      Wins->record(Shape, Alive);
+      IsValid = true;
+      return std::error_code();
+    }
+
+    std::error_code EC = UnderlyingSolver->isValid(IC, BPCs, PCs, Mapping,
+                                                   IsValid, Model);
+    if (!EC)
+      ++ByRace;
+    if (!EC || AliveFirst)
+      return EC;
+    if (isTransformationValid(Mapping.LHS, Mapping.RHS, PCs, BPCs, IC)) {
+      ++ByAlive;
+      Wins->record(Shape, Alive);
+      IsValid = true;
+      return std::error_code();
+    }
+    return EC;
+  }
+
+  std::error_code isSatisfiable(llvm::StringRef Query, bool &Result,
+                                unsigned NumModels,
+                                std::vector<llvm::APInt> *Models,
+                                unsigned Timeout = 0) override {
+    return UnderlyingSolver->isSatisfiable(Query, Result, NumModels, Models,
+                                           Timeout);
+  }
+
+  std::error_code infer(const BlockPCs &BPCs,
+                        const std::vector<InstMapping> &PCs,
+                        Inst *LHS, std::vector<Inst *> &RHSs,
+                        bool AllowMultipleRHSs, InstContext &IC) override {
+    return UnderlyingSolver->infer(BPCs, PCs, LHS, RHSs, AllowMultipleRHSs,
+                                   IC);
+  }
+
+  std::error_code inferConst(const BlockPCs &BPCs,
+                             const std::vector<InstMapping> &PCs,
+                             Inst *LHS, Inst *&RHS,
+                             std::set<Inst *> &ConstSet,
+                             std::map<Inst *, llvm::APInt> &ResultMap,
+                             InstContext &IC) override {
+    return UnderlyingSolver->inferConst(BPCs, PCs, LHS, RHS, ConstSet, ResultMap, IC);
+  }
+
+  SMTLIBSolver *getSMTLIBSolver() override {
+    return UnderlyingSolver->getSMTLIBSolver();
+  }
+
+  std::string getName() override {
+    return UnderlyingSolver->getName() + " + portfolio";
+  }
+
+  llvm::ConstantRange constantRange(const BlockPCs &BPCs,
+                                    const std::vector<InstMapping> &PCs,
+                                    Inst *LHS,
+                                    InstContext &IC) override {
+    return UnderlyingSolver->constantRange(BPCs, PCs, LHS, IC);
+  }
+
+  std::error_code testDemandedBits(const BlockPCs &BPCs,
+                                   const std::vector<InstMapping> &PCs,
+                                   Inst *LHS,
+                                   std::map<std::string, APInt> &DBitsVect,
+                                   InstContext &IC) override {
+    return UnderlyingSolver->testDemandedBits(BPCs, PCs, LHS, DBitsVect, IC);
+  }
+
+  std::error_code nonNegative(const BlockPCs &BPCs,
+                              const std::vector<InstMapping> &PCs,
+                              Inst *LHS, bool &NonNegative,
+                              InstContext &IC) override {
+    return UnderlyingSolver->nonNegative(BPCs, PCs, LHS, NonNegative, IC);
+  }
+
+  std::error_code negative(const BlockPCs &BPCs,
+                           const std::vector<InstMapping> &PCs,
+                           Inst *LHS, bool &Negative,
+                           InstContext &IC) override {
+    return UnderlyingSolver->negative(BPCs, PCs, LHS, Negative, IC);
+  }
+
+  std::error_code knownBits(const BlockPCs &BPCs,
+                            const std::vector<InstMapping> &PCs,
+                            Inst *LHS, KnownBits &Known,
+                            InstContext &IC) override {
+    return UnderlyingSolver->knownBits(BPCs, PCs, LHS, Known, IC);
+  }
+
+  std::error_code powerTwo(const BlockPCs &BPCs,
+                           const std::vector<InstMapping> &PCs,
+                           Inst *LHS, bool &PowerTwo,
+                           InstContext &IC) override {
+    return UnderlyingSolver->powerTwo(BPCs, PCs, LHS, PowerTwo, IC);
+  }
+
+  std::error_code nonZero(const BlockPCs &BPCs,
+                          const std::vector<InstMapping> &PCs,
+                          Inst *LHS, bool &NonZero,
+                          InstContext &IC) override {
+    return UnderlyingSolver->nonZero(BPCs, PCs, LHS, NonZero, IC);
+  }
+
+  std::error_code signBits(const BlockPCs &BPCs,
+                           const std::vector<InstMapping> &PCs,
+                           Inst *LHS, unsigned &SignBits,
+                           InstContext &IC) override {
+    return UnderlyingSolver->signBits(BPCs, PCs, LHS, SignBits, IC);
+  }
+
+};
+
 }
 
 namespace souper {
@@ -964,4 +1453,10 @@ std::unique_ptr<Solver> createExternalCachingSolver(
       new ExternalCachingSolver(std::move(UnderlyingSolver), KV));
 }
 
+std::unique_ptr<Solver> createPortfolioSolver(
+    std::unique_ptr<SMTLIBSolver> SMTSolver, unsigned Timeout) {
+  return std::unique_ptr<Solver>(
+      new PortfolioSolver(std::move(SMTSolver), Timeout));
+}
+
 }
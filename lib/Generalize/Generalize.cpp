@@ -13,6 +13,7 @@
 #include "souper/Inst/InstGraph.h"
 #include "souper/Parser/Parser.h"
 #include "souper/Generalize/Reducer.h"
+#include "souper/Generalize/WidthSweep.h"
 // #include "souper/Tool/GetSolver.h"
 #include <cstdlib>
 #include <sstream>
@@ -93,6 +94,7 @@ static bool IgnoreCost = false;
 //     cl::init(false));
 
 namespace souper {
+extern Solver *S;
 
 // This can probably be done more efficiently, but likely not the bottleneck anywhere
 std::vector<std::vector<int>> GetCombinations(std::vector<int> Counts) {
@@ -155,8 +157,8 @@ AugmentForSymKBDB(ParsedReplacement Original, InstContext &IC) {
     auto SymDFVar = IC.createVar(DB.getBitWidth(), "symDF_DB");
     // SymDFVar->Name = "symDF_DB";
 
-    SymDFVar->KnownOnes = llvm::APInt(DB.getBitWidth(), 0);
-    SymDFVar->KnownZeros = llvm::APInt(DB.getBitWidth(), 0);
+    SymDFVar->mutableAttrs().KnownOnes = llvm::APInt(DB.getBitWidth(), 0);
+    SymDFVar->mutableAttrs().KnownZeros = llvm::APInt(DB.getBitWidth(), 0);
     // SymDFVar->Val = DB;
 
     Input.Mapping.LHS->DemandedBits.setAllBits();
@@ -175,7 +177,8 @@ AugmentForSymKBDB(ParsedReplacement Original, InstContext &IC) {
 
   for (auto &&I : Inputs) {
     auto Width = I->Width;
-    if (!I->Range.isFullSet() && !I->Range.isEmptySet() && !I->Range.isSingleElement()) {
+    const llvm::ConstantRange &Range = I->attrs().Range;
+    if (!Range.isFullSet() && !Range.isEmptySet() && !Range.isSingleElement()) {
       Inst *LO = IC.createVar(Width, "symDF_LO");
       Inst *HI = IC.createVar(Width, "symDF_HI");
 
@@ -184,20 +187,20 @@ AugmentForSymKBDB(ParsedReplacement Original, InstContext &IC) {
       // larger than LO
       Inst *LargerThanEqLO = IC.getInst(Inst::Ule, 1, {LO, I});
       Input.PCs.push_back({LargerThanEqLO, IC.getConst(llvm::APInt(1, 1))});
-      ConstMap.push_back({LO, I->Range.getLower()});
+      ConstMap.push_back({LO, Range.getLower()});
 
       // smaller than HI
       Inst *SmallerThanHI = IC.getInst(Inst::Ult, 1, {I, HI});
       Input.PCs.push_back({SmallerThanHI, IC.getConst(llvm::APInt(1, 1))});
-      ConstMap.push_back({HI, I->Range.getUpper()});
+      ConstMap.push_back({HI, Range.getUpper()});
 
-      I->Range = llvm::ConstantRange::getFull(Width);
+      I->mutableAttrs().Range = llvm::ConstantRange::getFull(Width);
     }
 
-    if (I->KnownZeros.getBitWidth() == I->Width &&
-        I->KnownOnes.getBitWidth() == I->Width &&
-        !(I->KnownZeros == 0 && I->KnownOnes == 0)) {
-      if (I->KnownZeros != 0) {
+    if (I->attrs().KnownZeros.getBitWidth() == I->Width &&
+        I->attrs().KnownOnes.getBitWidth() == I->Width &&
+        !(I->attrs().KnownZeros == 0 && I->attrs().KnownOnes == 0)) {
+      if (I->attrs().KnownZeros != 0) {
         Inst *Zeros = IC.createVar(Width, "symDF_K0");
 
         // Inst *AllOnes = IC.getConst(llvm::APInt::getAllOnes(Width));
@@ -207,18 +210,18 @@ AugmentForSymKBDB(ParsedReplacement Original, InstContext &IC) {
         // Inst *ZeroBits = IC.getInst(Inst::Eq, 1, {VarNotZero, NotZeros});
         Inst *ZeroBits = IC.getInst(Inst::KnownZerosP, 1, {I, Zeros});
         Input.PCs.push_back({ZeroBits, IC.getConst(llvm::APInt(1, 1))});
-        ConstMap.push_back({Zeros, I->KnownZeros});
-        I->KnownZeros = llvm::APInt(I->Width, 0);
+        ConstMap.push_back({Zeros, I->attrs().KnownZeros});
+        I->mutableAttrs().KnownZeros = llvm::APInt(I->Width, 0);
       }
 
-      if (I->KnownOnes != 0) {
+      if (I->attrs().KnownOnes != 0) {
         Inst *Ones = IC.createVar(Width, "symDF_K1");
         // Inst *VarAndOnes = IC.getInst(Inst::And, Width, {I, Ones});
         // Inst *OneBits = IC.getInst(Inst::Eq, 1, {VarAndOnes, Ones});
         Inst *OneBits = IC.getInst(Inst::KnownOnesP, 1, {I, Ones});
         Input.PCs.push_back({OneBits, IC.getConst(llvm::APInt(1, 1))});
-        ConstMap.push_back({Ones, I->KnownOnes});
-        I->KnownOnes = llvm::APInt(I->Width, 0);
+        ConstMap.push_back({Ones, I->attrs().KnownOnes});
+        I->mutableAttrs().KnownOnes = llvm::APInt(I->Width, 0);
       }
     }
   }
@@ -314,7 +317,7 @@ struct ShrinkWrap {
       if (I->Width == 1) {
         return I;
       }
-      auto V = IC.createVar(ResultWidth, I->Name);
+      auto V = IC.createVar(ResultWidth, I->attrs().Name);
       InstCache[I] = V;
       return V;
     } else if (I->K == Inst::Const) {
@@ -404,7 +407,7 @@ struct ShrinkWrap {
       // llvm::errs() << "Par " << Inst::getKindName(I->K) << " " << I->Width << " " << ResultWidth << '\n';
 
       std::map<Inst *, Inst *> OpMap;
-      std::vector<Inst *> OriginalOps = I->Ops;
+      std::vector<Inst *> OriginalOps(I->Ops.begin(), I->Ops.end());
 
       std::sort(OriginalOps.begin(), OriginalOps.end(), [&](Inst *A, Inst *B) {
         if (InstCache.find(A) != InstCache.end()) {
@@ -436,7 +439,7 @@ struct ShrinkWrap {
       }
 
       auto Result = IC.getInst(I->K, InferWidth(I->K, Ops), Ops);
-      Result->Name = I->Name;
+      Result->mutableAttrs().Name = I->attrs().Name;
       return Result;
     }
   }
@@ -457,7 +460,7 @@ struct ShrinkWrap {
       if (I->Width <= TargetWidth) {
         return {};
       }
-      if (!I->Range.isFullSet()) {
+      if (!I->attrs().Range.isFullSet()) {
         return {};
       }
     }
@@ -525,7 +528,7 @@ struct ShrinkWrap {
 std::vector<Inst *> findConcreteConsts(const ParsedReplacement &Input) {
   std::vector<Inst *> Consts;
   auto Pred = [](Inst *I) {
-    return I->K == Inst::Const && I->Name.find("sym") == std::string::npos;
+    return I->K == Inst::Const && I->attrs().Name.find("sym") == std::string::npos;
   };
 
   findInsts(Input.Mapping.LHS, Consts, Pred);
@@ -543,12 +546,12 @@ std::vector<Inst *> findConcreteConsts(const ParsedReplacement &Input) {
 
 std::vector<Inst *> FilterExprsByValue(const std::vector<Inst *> &Exprs,
   llvm::APInt TargetVal, const std::vector<std::pair<Inst *, llvm::APInt>> &CMap) {
-  std::unordered_map<Inst *, EvalValue> ValueCache;
+  ValueCache Cache;
   for (auto &&[I, V] : CMap) {
-    ValueCache[I] = EvalValue(V);
+    Cache[I] = EvalValue(V);
   }
   std::vector<Inst *> FilteredExprs;
-  ConcreteInterpreter CPos(ValueCache);
+  ConcreteInterpreter CPos(Cache);
   for (auto &&E : Exprs) {
     if (E->Width != TargetVal.getBitWidth()) {
       continue;
@@ -569,12 +572,12 @@ std::vector<Inst *> FilterExprsByValue(const std::vector<Inst *> &Exprs,
 std::vector<Inst *> FilterRelationsByValue(const std::vector<Inst *> &Relations,
                         const std::vector<std::pair<Inst *, llvm::APInt>> &CMap,
                         std::vector<ValueCache> CEXs) {
-  std::unordered_map<Inst *, EvalValue> ValueCache;
+  ValueCache Cache;
   for (auto &&[I, V] : CMap) {
-    ValueCache[I] = EvalValue(V);
+    Cache[I] = EvalValue(V);
   }
 
-  ConcreteInterpreter CPos(ValueCache);
+  ConcreteInterpreter CPos(Cache);
   std::vector<ConcreteInterpreter> CNegs;
   for (auto &&CEX : CEXs) {
     CNegs.push_back(CEX);
@@ -1160,9 +1163,9 @@ std::optional<ParsedReplacement> DFPreconditionsAndVerifyGreedy(
 
   for (auto &&C : SymCS) {
     if (C.first->Width < 4) continue;
-    Restore[C.first] = {C.first->KnownZeros, C.first->KnownOnes};
-    C.first->KnownZeros = ~C.second;
-    C.first->KnownOnes = C.second;
+    Restore[C.first] = {C.first->attrs().KnownZeros, C.first->attrs().KnownOnes};
+    C.first->mutableAttrs().KnownZeros = ~C.second;
+    C.first->mutableAttrs().KnownOnes = C.second;
   }
 
   std::map<Inst *, llvm::APInt> RevertMap;
@@ -1181,27 +1184,27 @@ std::optional<ParsedReplacement> DFPreconditionsAndVerifyGreedy(
     if (C.first->Width < 4) continue;
     BitsWeakened = 0;
     for (size_t i = 0; i < C.first->Width; ++i) {
-      llvm::APInt OriZ = C.first->KnownZeros;
-      llvm::APInt OriO = C.first->KnownOnes;
+      llvm::APInt OriZ = C.first->attrs().KnownZeros;
+      llvm::APInt OriO = C.first->attrs().KnownOnes;
 
       if (OriO[i] == 0 && OriZ[i] == 0) {
         continue;
       }
 
-      if (OriO[i] == 1) C.first->KnownOnes.clearBit(i);
-      if (OriZ[i] == 1) C.first->KnownZeros.clearBit(i);
+      if (OriO[i] == 1) C.first->mutableAttrs().KnownOnes.clearBit(i);
+      if (OriZ[i] == 1) C.first->mutableAttrs().KnownZeros.clearBit(i);
 
       if (!SOLVE()) {
-        C.first->KnownZeros = OriZ;
-        C.first->KnownOnes = OriO;
+        C.first->mutableAttrs().KnownZeros = OriZ;
+        C.first->mutableAttrs().KnownOnes = OriO;
       } else {
         BitsWeakened++;
       }
     }
     // llvm::errs() << "BitsWeakened: " << BitsWeakened << '\n';
     if (BitsWeakened <= C.first->Width / 2) {
-      C.first->KnownZeros = ~SymCS[C.first];
-      C.first->KnownOnes = SymCS[C.first];
+      C.first->mutableAttrs().KnownZeros = ~SymCS[C.first];
+      C.first->mutableAttrs().KnownOnes = SymCS[C.first];
       RevertMap[C.first] = SymCS[C.first];
     } else {
       ConstsWeakened++;
@@ -1211,8 +1214,8 @@ std::optional<ParsedReplacement> DFPreconditionsAndVerifyGreedy(
   if (!ConstsWeakened) {
     // std::swap(Input, Clone);
     for (auto &&P : Restore) {
-      P.first->KnownZeros = P.second.first;
-      P.first->KnownOnes = P.second.second;
+      P.first->mutableAttrs().KnownZeros = P.second.first;
+      P.first->mutableAttrs().KnownOnes = P.second.second;
     }
     // Input.print(llvm::errs(), true);
     // llvm::errs() << "\n<-Input\n";
@@ -1266,23 +1269,30 @@ std::optional<ParsedReplacement> SimplePreconditionsAndVerifyGreedy(
 
   #define DF(Fact, Check)                                       \
   if (All(CVals[C], [](auto Val) { return Check;})) {           \
-  C->Fact = true; auto s = SOLVE(); C->Fact = false;            \
+  C->mutableAttrs().Fact = true; auto s = SOLVE();              \
+  C->mutableAttrs().Fact = false;                               \
   if(s) return Clone;};
 
   #define DF2(C1, C2, Fact1, Check1, Fact2, Check2)             \
   if (All(CVals[C1], [](auto Val) { return Check1;})) {         \
   if (All(CVals[C2], [](auto Val) { return Check2;})) {         \
-  C1->Fact1 = true; C2->Fact2 = true; auto s = SOLVE();         \
-  C1->Fact1 = false; C2->Fact2 = false;                         \
+  C1->mutableAttrs().Fact1 = true;                              \
+  C2->mutableAttrs().Fact2 = true; auto s = SOLVE();            \
+  C1->mutableAttrs().Fact1 = false;                             \
+  C2->mutableAttrs().Fact2 = false;                             \
   if(s) return Clone;}};
 
   #define DF3(C1, C2, C3, Fact1, Check1, Fact2, Check2, Fact3, Check3)\
   if (All(CVals[C1], [](auto Val) { return Check1;})) {         \
   if (All(CVals[C2], [](auto Val) { return Check2;})) {         \
   if (All(CVals[C3], [](auto Val) { return Check3;})) {         \
-  C1->Fact1 = true; C2->Fact2 = true; C3->Fact3 = true;         \
+  C1->mutableAttrs().Fact1 = true;                              \
+  C2->mutableAttrs().Fact2 = true;                              \
+  C3->mutableAttrs().Fact3 = true;                              \
   auto s = SOLVE();                                             \
-  C1->Fact1 = false; C2->Fact2 = false; C3->Fact3 = false;      \
+  C1->mutableAttrs().Fact1 = false;                             \
+  C2->mutableAttrs().Fact2 = false;                             \
+  C3->mutableAttrs().Fact3 = false;                             \
   if(s) return Clone;}}};
 
 
@@ -1478,7 +1488,7 @@ FirstValidCombination(ParsedReplacement Input,
     std::vector<Inst *> Vars;
     findVars(PC.LHS, Vars);
     for (auto &&V : Vars) {
-      if (V->Name.starts_with("sym")) {
+      if (V->attrs().Name.starts_with("sym")) {
         SymConstsInPC.insert(V);
       }
     }
@@ -1491,6 +1501,9 @@ FirstValidCombination(ParsedReplacement Input,
       CurIter++;
     }
 
+    // Most combinations are rejected, don't let their Insts pile up in IC
+    auto Scope = IC.beginScope();
+
     static int SymExprCount = 0;
     auto InstCacheRHS = InstCache;
 
@@ -1500,13 +1513,13 @@ FirstValidCombination(ParsedReplacement Input,
       InstCacheRHS[Targets[i]] = Candidates[i][Comb[i]];
       findVars(Candidates[i][Comb[i]], VarsFound);
       if (Candidates[i][Comb[i]]->K != Inst::Var) {
-        Candidates[i][Comb[i]]->Name = std::string("constexpr_") + std::to_string(SymExprCount++);
+        Candidates[i][Comb[i]]->mutableAttrs().Name = std::string("constexpr_") + std::to_string(SymExprCount++);
       }
     }
 
     std::set<Inst *> SymsInCurrent = SymConstsInPC;
     for (auto &&V : VarsFound) {
-      if (V->Name.starts_with("sym")) {
+      if (V->attrs().Name.starts_with("sym")) {
         SymsInCurrent.insert(V);
       }
     }
@@ -1567,6 +1580,7 @@ FirstValidCombination(ParsedReplacement Input,
 
     // Copy.PCs = Input.PCs;
     if (SOLVE(Copy)) {
+      Keep(Scope, *Clone);
       return Clone;
     }
 
@@ -1575,6 +1589,7 @@ FirstValidCombination(ParsedReplacement Input,
       Copy.Mapping.RHS = Replace(Copy.Mapping.RHS, ReverseMap);
 
       if (SOLVE(Copy)) {
+        Keep(Scope, *Clone);
         return Clone;
       }
     }
@@ -1950,127 +1965,6 @@ std::vector<Inst *> ExtractSketchesSimple(InstContext &IC, ParsedReplacement Inp
   return Sketches;
 }
 
-// precondition: operands are const, won't check here
-std::optional<llvm::APInt> Fold(Inst *I) {
-  switch (I->K) {
-    case Inst::Add:
-      return I->Ops[0]->Val + I->Ops[1]->Val;
-    case Inst::Sub:
-      return I->Ops[0]->Val - I->Ops[1]->Val;
-    case Inst::Mul:
-      return I->Ops[0]->Val * I->Ops[1]->Val;
-    case Inst::And:
-      return I->Ops[0]->Val & I->Ops[1]->Val;
-    case Inst::Or:
-      return I->Ops[0]->Val | I->Ops[1]->Val;
-    case Inst::Xor:{
-      return I->Ops[0]->Val ^ I->Ops[1]->Val;}
-    case Inst::Trunc:
-      return I->Ops[0]->Val.trunc(I->Width);
-    case Inst::SExt:
-     if (I->Ops[0]->Val == 0)
-       return I->Ops[0]->Val.sext(I->Width);
-     else
-       return std::nullopt;
-    case Inst::ZExt:
-      if (I->Ops[0]->Val == 0)
-       return I->Ops[0]->Val.zext(I->Width);
-     else
-       return std::nullopt;
-    default: return std::nullopt;
-  }
-}
-
-bool OpsConstP(Inst *I) {
-  for (auto &&Op : I->Ops) {
-    if (Op->K != Inst::Const) {
-      return false;
-    }
-  }
-  return true;
-}
-
-bool LHSZ(Inst *I) {
-  return I->Ops.size() ==2 && I->Ops[0]->K == Inst::Const && I->Ops[0]->Val == 0;
-}
-bool RHSZ(Inst *I) {
-  return I->Ops.size() ==2 && I->Ops[1]->K == Inst::Const && I->Ops[1]->Val == 0;
-}
-bool LHSM1(Inst *I) {
-  return I->Ops.size() ==2 && I->Ops[0]->K == Inst::Const && I->Ops[0]->Val.isAllOnes();
-}
-bool RHSM1(Inst *I) {
-  return I->Ops.size() ==2 && I->Ops[1]->K == Inst::Const && I->Ops[1]->Val.isAllOnes();
-}
-
-Inst *ConstantFoldingLiteImpl(InstContext &IC, Inst *I, std::set<Inst *> &Visited) {
-  if (I->Ops.empty()) {
-    return I;
-  }
-  if (Visited.find(I) != Visited.end()) {
-    return I;
-  } else {
-    Visited.insert(I);
-  }
-
-  std::vector<Inst *> FoldedOps;
-  for (auto Op : I->Ops) {
-    FoldedOps.push_back(ConstantFoldingLiteImpl(IC, Op, Visited));
-  }
-  I->Ops = FoldedOps;
-
-  if (OpsConstP(I)) {
-    if (auto C = Fold(I)) {
-      return IC.getConst(C.value());
-    }
-  }
-
-  if (LHSZ(I)) {
-    if (I->K == Inst::Add || I->K == Inst::Sub ||
-        I->K == Inst::Xor || I->K == Inst::Or) {
-      return I->Ops[1];
-    }
-    if (I->K == Inst::Mul || I->K == Inst::And) {
-      return IC.getConst(llvm::APInt(I->Width, 0));
-    }
-  }
-
-  if (RHSZ(I)) {
-    if (I->K == Inst::Add || I->K == Inst::Sub ||
-        I->K == Inst::Xor || I->K == Inst::Or) {
-      return I->Ops[0];
-    }
-    if (I->K == Inst::Mul || I->K == Inst::And) {
-      return IC.getConst(llvm::APInt(I->Width, 0));
-    }
-  }
-
-  if (LHSM1(I)) {
-    if (I->K == Inst::Mul || I->K == Inst::And) {
-      return I->Ops[1];
-    }
-    if (I->K == Inst::Or) {
-      return I->Ops[0];
-    }
-  }
-
-  if (RHSM1(I)) {
-    if (I->K == Inst::Mul || I->K == Inst::And) {
-      return I->Ops[0];
-    }
-    if (I->K == Inst::Or) {
-      return I->Ops[1];
-    }
-  }
-
-  return I;
-}
-
-Inst *ConstantFoldingLite(InstContext &IC, Inst *I) {
-  std::set<Inst *> Visited;
-  return ConstantFoldingLiteImpl(IC, I, Visited);
-}
-
 std::vector<std::vector<Inst *>> InferSketchExprs(std::vector<Inst *> RHS,
                                                   ParsedReplacement Input,
                                                   InstContext &IC,
@@ -2234,17 +2128,8 @@ void findDangerousConstants(Inst *I, std::set<Inst *> &Results) {
   }
 }
 
-// TODO: memoize
 bool hasMultiArgumentPhi(Inst *I) {
-  if (I->K == Inst::Phi) {
-    return I->Ops.size() > 1;
-  }
-  for (auto Op : I->Ops) {
-    if (hasMultiArgumentPhi(Op)) {
-      return true;
-    }
-  }
-  return false;
+  return I->has(Inst::HasMultiArgPhi);
 }
 
 ParsedReplacement ReducePoison(ParsedReplacement Input) {
@@ -3057,14 +2942,14 @@ bool hasConcreteDataflowConditions(ParsedReplacement &Input) {
   findVars(Input.Mapping.LHS, Inputs);
 
   for (auto &&V : Inputs) {
-    if (!V->Range.isFullSet()) {
+    if (!V->attrs().Range.isFullSet()) {
       return true;
     }
-    if (V->KnownOnes.getBitWidth() == V->Width && V->KnownOnes != 0) {
+    if (V->attrs().KnownOnes.getBitWidth() == V->Width && V->attrs().KnownOnes != 0) {
       return true;
     }
 
-    if (V->KnownZeros.getBitWidth() == V->Width && V->KnownZeros != 0) {
+    if (V->attrs().KnownZeros.getBitWidth() == V->Width && V->attrs().KnownZeros != 0) {
       return true;
     }
   }
@@ -3107,11 +2992,29 @@ InstantiateWidthChecks(InstContext &IC,
     return {Input, true};
   }
 
-  if (!NoWidth && !hasMultiArgumentPhi(Input.Mapping.LHS) && !hasConcreteDataflowConditions(Input)) {
+  // Rewrites whose Insts all share one width can be checked width by width,
+  // several at once, instead of through Alive's symbolic widths
+  bool SweepRefuted = false;
+  if (!NoWidth && S && !hasConcreteDataflowConditions(Input)) {
+    if (auto Sweep = sweepWidths(Input, S->getSMTLIBSolver())) {
+      if (Sweep->allValid()) {
+        if (DebugLevel > 4) {
+          llvm::errs() << "WIDTH: Generalized opt is valid for all swept widths.\n";
+        }
+        return {Input, true};
+      }
+      // Alive's typings can still bound the valid widths of a single input
+      std::vector<Inst *> Vars;
+      findVars(Input.Mapping.LHS, Vars);
+      SweepRefuted = Sweep->Counterexample && Vars.size() != 1;
+    }
+  }
+
+  if (!NoWidth && !SweepRefuted && !hasMultiArgumentPhi(Input.Mapping.LHS) && !hasConcreteDataflowConditions(Input)) {
     // Instantiate Alive driver with Symbolic width.
-    AliveDriver Alive(Input.Mapping.LHS,
-    Input.PCs.empty() ? nullptr : CombinePCs(Input.PCs, IC),
-    IC, {}, true);
+    auto &Alive = AliveDriver::get(Input.Mapping.LHS,
+      Input.PCs.empty() ? nullptr : CombinePCs(Input.PCs, IC),
+      IC, {}, true);
 
     // Find set of valid widths.
     if (Alive.verify(Input.Mapping.RHS)) {
@@ -3283,9 +3186,10 @@ std::optional<ParsedReplacement> GeneralizeShrinked(
 }
 
 void PrintInputAndResult(ParsedReplacement Input, ParsedReplacement Result) {
-  ReplacementContext RC;
-  Result.printLHS(llvm::outs(), RC, true);
-  Result.printRHS(llvm::outs(), RC, true);
+  ReplacementPrinter P;
+  llvm::outs() << P.printLHS(Result.BPCs, Result.PCs, Result.Mapping.LHS,
+                             /*printNames=*/true);
+  llvm::outs() << P.printRHS(Result.Mapping.RHS);
   llvm::outs() << "\n";
 
   if (DebugLevel > 1) {
@@ -7,7 +7,7 @@
 
 namespace souper {
 extern Solver *S;
-bool hasCommonVars(const std::vector<Inst *> &Ops) {
+bool hasCommonVars(llvm::ArrayRef<Inst *> Ops) {
   if (Ops.size() < 2) {
     return false;
   }
@@ -98,6 +98,7 @@ ParsedReplacement Reducer::ReducePairsGreedy(ParsedReplacement Input) {
             continue;
           }
 
+          auto Scope = IC.beginScope();
           auto Copy = Input;
           Eliminate(Input, I);
           Eliminate(Input, J);
@@ -113,6 +114,7 @@ ParsedReplacement Reducer::ReducePairsGreedy(ParsedReplacement Input) {
             Input = Copy;
             continue;
           }
+          Keep(Scope, Input);
           Changed = true;
 
         }
@@ -151,6 +153,7 @@ ParsedReplacement Reducer::ReduceTriplesGreedy(ParsedReplacement Input) {
             }
             if (I != K && J != K) {
 
+              auto Scope = IC.beginScope();
               auto Copy = Input;
               Eliminate(Input, I);
               Eliminate(Input, J);
@@ -165,6 +168,7 @@ ParsedReplacement Reducer::ReduceTriplesGreedy(ParsedReplacement Input) {
                 Input = Copy;
                 continue;
               }
+              Keep(Scope, Input);
               Changed = true;
             }
           }
@@ -201,6 +205,8 @@ ParsedReplacement Reducer::ReduceGreedy(ParsedReplacement Input) {
     if (!safeToRemove(I, Input)) {
       continue;
     }
+    // Rejected eliminations are freed when Scope goes away
+    auto Scope = IC.beginScope();
     auto Copy = Input;
     Eliminate(Input, I);
 
@@ -221,6 +227,7 @@ ParsedReplacement Reducer::ReduceGreedy(ParsedReplacement Input) {
       }
       continue;
     }
+    Keep(Scope, Input);
     Insts.clear();
     collectInsts(Input.Mapping.LHS, Insts);
   } while (!Insts.empty() && LoopBound--);
@@ -272,23 +279,23 @@ bool Reducer::inferKBPrecondition(ParsedReplacement &Input, std::vector<Inst *>
 
     InstCache[C] = NewVar;
 
-    NewVar->KnownOnes = ConstMap[C];
-    NewVar->KnownZeros = ~ConstMap[C];
+    NewVar->mutableAttrs().KnownOnes = ConstMap[C];
+    NewVar->mutableAttrs().KnownZeros = ~ConstMap[C];
 
     // Give up if can't be weakened 'too much'
     const size_t WeakeningThreshold = NewVar->Width/2;
     size_t BitsWeakened = 0;
 
     for (size_t i = 0; i < NewVar->Width; ++i) {
-      auto SaveZero = NewVar->KnownZeros;
-      auto SaveOne = NewVar->KnownOnes;
+      auto SaveZero = NewVar->attrs().KnownZeros;
+      auto SaveOne = NewVar->attrs().KnownOnes;
 
-      NewVar->KnownZeros.clearBit(i);
-      NewVar->KnownOnes.clearBit(i);
+      NewVar->mutableAttrs().KnownZeros.clearBit(i);
+      NewVar->mutableAttrs().KnownOnes.clearBit(i);
 
       if (!VerifyInput(Input)) {
-        NewVar->KnownZeros = SaveZero;
-        NewVar->KnownOnes = SaveOne;
+        NewVar->mutableAttrs().KnownZeros = SaveZero;
+        NewVar->mutableAttrs().KnownOnes = SaveOne;
       } else {
         BitsWeakened++;
       }
@@ -421,23 +428,23 @@ ParsedReplacement Reducer::ReduceGreedyKBIFY(ParsedReplacement Input) {
       InstCache.clear();
       InstCache[C] = NewVar;
 
-      NewVar->KnownOnes = ConstMap[C];
-      NewVar->KnownZeros = ~ConstMap[C];
+      NewVar->mutableAttrs().KnownOnes = ConstMap[C];
+      NewVar->mutableAttrs().KnownZeros = ~ConstMap[C];
 
       // Give up if can't be weakened 'too much'
       const size_t WeakeningThreshold = NewVar->Width/2;
       size_t BitsWeakened = 0;
 
       for (size_t i = 0; i < NewVar->Width; ++i) {
-        auto SaveZero = NewVar->KnownZeros;
-        auto SaveOne = NewVar->KnownOnes;
+        auto SaveZero = NewVar->attrs().KnownZeros;
+        auto SaveOne = NewVar->attrs().KnownOnes;
 
-        NewVar->KnownZeros.clearBit(i);
-        NewVar->KnownOnes.clearBit(i);
+        NewVar->mutableAttrs().KnownZeros.clearBit(i);
+        NewVar->mutableAttrs().KnownOnes.clearBit(i);
 
         if (!VerifyInput(Input)) {
-          NewVar->KnownZeros = SaveZero;
-          NewVar->KnownOnes = SaveOne;
+          NewVar->mutableAttrs().KnownZeros = SaveZero;
+          NewVar->mutableAttrs().KnownOnes = SaveOne;
         } else {
           BitsWeakened++;
         }
@@ -508,7 +515,7 @@ ParsedReplacement Reducer::ReduceRedundantPhis(ParsedReplacement Input) {
 
     Input.Mapping.LHS = Replace(Input.Mapping.LHS, ICache);
     Input.Mapping.RHS = Replace(Input.Mapping.RHS, ICache);
-    for (auto &PC : Input.PCs) {
+    for (auto &PC : Input.PCs.mutate()) {
       PC.LHS = Replace(PC.LHS, ICache);
       PC.RHS = Replace(PC.RHS, ICache);
     }
@@ -526,6 +533,7 @@ size_t WeakenSingleCR(ParsedReplacement Input,
     // Synthesize a value
     Inst *C = IC.createVar(Target->Width, "reservedconst_1");
     C->SynthesisConstID = 1;
+    C->summarize();
     std::map<Inst *, Inst *> InstCache = {{Target, C}};
 
     auto Copy = Input;
@@ -553,7 +561,7 @@ size_t WeakenSingleCR(ParsedReplacement Input,
     return 0; // fail
   }
 
-  auto Restore = Target->Range;
+  auto Restore = Target->attrs().Range;
 
   // Binary search to extend upper and lower boundaries
   llvm::ConstantRange R(Val.value());
@@ -570,38 +578,38 @@ size_t WeakenSingleCR(ParsedReplacement Input,
 
 //    llvm::errs() << "L " << L << " " << "U " << U << " inc " << inc <<"\n";
 
-    auto Backup = Target->Range;
+    auto Backup = Target->attrs().Range;
     auto Attempt = U + inc;
     if (Attempt.sge(Full.getUpper())) {
       Attempt = Full.getLower();
     }
-    Target->Range = llvm::ConstantRange(L, Attempt);
+    Target->mutableAttrs().Range = llvm::ConstantRange(L, Attempt);
     if (Verify(Input)) {
       U = Attempt;
 //      llvm::errs() << "U " << Attempt << '\n';
       inc *= 2;
     } else {
       inc /= 2;
-      Target->Range = Backup;
+      Target->mutableAttrs().Range = Backup;
     }
   }
 
   size_t dec = 1;
   while (dec && L.slt(0)) {
 //    llvm::errs() << "L " << L << " " << "U " << U << " inc " << dec <<"\n";
-    auto Backup = Target->Range;
+    auto Backup = Target->attrs().Range;
     auto Attempt = L - dec;
     if (Attempt.sle(Full.getLower())) {
       Attempt = Full.getLower();
     }
-    Target->Range = llvm::ConstantRange(Attempt, U);
+    Target->mutableAttrs().Range = llvm::ConstantRange(Attempt, U);
     if (Verify(Input)) {
       L = Attempt;
 //      llvm::errs() << "L " << Attempt << '\n';
       dec *= 2;
     } else {
       dec /= 2;
-      Target->Range = Backup;
+      Target->mutableAttrs().Range = Backup;
     }
   }
 
@@ -610,7 +618,7 @@ size_t WeakenSingleCR(ParsedReplacement Input,
   if ((U - L).sgt(1 << (Target->Width - 2))) { // Heuristic
     return (U - L).getLimitedValue();
   } else {
-    Target->Range = Restore;
+    Target->mutableAttrs().Range = Restore;
     return 0;
   };
 
@@ -627,6 +635,7 @@ size_t WeakenSingleKB(ParsedReplacement Input,
     // Synthesize a value
     Inst *C = IC.createVar(Target->Width, "reservedconst_1");
     C->SynthesisConstID = 1;
+    C->summarize();
     std::map<Inst *, Inst *> InstCache = {{Target, C}};
 
     auto Copy = Input;
@@ -654,34 +663,34 @@ size_t WeakenSingleKB(ParsedReplacement Input,
     return 0; // No bits weakened
   }
 
-  llvm::APInt RestoreZero = Target->KnownZeros;
-  llvm::APInt RestoreOne = Target->KnownOnes;
+  llvm::APInt RestoreZero = Target->attrs().KnownZeros;
+  llvm::APInt RestoreOne = Target->attrs().KnownOnes;
 
-  Target->KnownOnes = Val.value();
-  Target->KnownZeros = ~Val.value();
+  Target->mutableAttrs().KnownOnes = Val.value();
+  Target->mutableAttrs().KnownZeros = ~Val.value();
 
   for (size_t i = 0; i < Target->Width; ++i) {
-    llvm::APInt OriZ = Target->KnownZeros;
-    llvm::APInt OriO = Target->KnownOnes;
+    llvm::APInt OriZ = Target->attrs().KnownZeros;
+    llvm::APInt OriO = Target->attrs().KnownOnes;
 
     if (OriO[i] == 0 && OriZ[i] == 0) {
       continue;
     }
 
-    if (OriO[i] == 1) Target->KnownOnes.clearBit(i);
-    if (OriZ[i] == 1) Target->KnownZeros.clearBit(i);
+    if (OriO[i] == 1) Target->mutableAttrs().KnownOnes.clearBit(i);
+    if (OriZ[i] == 1) Target->mutableAttrs().KnownZeros.clearBit(i);
 
     if (!Verify(Input)) {
-      Target->KnownZeros = OriZ;
-      Target->KnownOnes = OriO;
+      Target->mutableAttrs().KnownZeros = OriZ;
+      Target->mutableAttrs().KnownOnes = OriO;
     } else {
       BitsWeakened++;
     }
   }
 
   if (BitsWeakened < Target->Width / 2) {
-    Target->KnownOnes = RestoreOne;
-    Target->KnownZeros = RestoreZero;
+    Target->mutableAttrs().KnownOnes = RestoreOne;
+    Target->mutableAttrs().KnownZeros = RestoreZero;
     BitsWeakened = 0;
   }
 
@@ -695,7 +704,7 @@ ParsedReplacement Reducer::ReducePCsToSimpleDF(ParsedReplacement Input) {
       auto V = PC.LHS->Ops[0];
       auto C = PC.LHS->Ops[1];
       if (V->K == Inst::Var && C->K == Inst::Const && C->Val.getLimitedValue() == 0) {
-        V->NonZero = true;
+        V->mutableAttrs().NonZero = true;
         continue;
       }
     }
@@ -716,7 +725,7 @@ ParsedReplacement Reducer::ReducePCsToDF(ParsedReplacement Input) {
   }
   std::set<Inst *> Vars;
   for (auto &&V : FoundVars) {
-    if (!V->Name.starts_with("sym") && !V->Name.starts_with("const")) {
+    if (!V->attrs().Name.starts_with("sym") && !V->attrs().Name.starts_with("const")) {
       Vars.insert(V);
     }
   }
@@ -771,8 +780,8 @@ ParsedReplacement Reducer::WeakenKB(ParsedReplacement Input) {
   std::vector<Inst *> Vars;
   findVars(Input.Mapping.LHS, Vars);
   for (auto &&V : Vars) {
-    auto OriZero = V->KnownZeros;
-    auto OriOne = V->KnownOnes;
+    auto OriZero = V->attrs().KnownZeros;
+    auto OriOne = V->attrs().KnownOnes;
     if (OriZero == 0 && OriOne == 0) {
       continue; // this var doesn't have a knownbits condition
     }
@@ -781,29 +790,29 @@ ParsedReplacement Reducer::WeakenKB(ParsedReplacement Input) {
     }
 
     // Try to remove KB
-    V->KnownOnes = llvm::APInt(V->Width, 0);
-    V->KnownZeros = llvm::APInt(V->Width, 0);
+    V->mutableAttrs().KnownOnes = llvm::APInt(V->Width, 0);
+    V->mutableAttrs().KnownZeros = llvm::APInt(V->Width, 0);
     if (VerifyInput(Input)) {
       continue; // Removed KB from this var
     }
-    V->KnownOnes = OriOne;
-    V->KnownZeros = OriZero;
+    V->mutableAttrs().KnownOnes = OriOne;
+    V->mutableAttrs().KnownZeros = OriZero;
 
     // Try resetting bitwise KB
 
     for (size_t i = 0; i < V->Width; ++i) {
-      auto Ones = V->KnownOnes;
+      auto Ones = V->attrs().KnownOnes;
       if (Ones[i]) {
-        V->KnownOnes.setBitVal(i, false);
+        V->mutableAttrs().KnownOnes.setBitVal(i, false);
         if (!VerifyInput(Input)) {
-          V->KnownOnes = Ones;
+          V->mutableAttrs().KnownOnes = Ones;
         }
       }
-      auto Zeros = V->KnownZeros;
+      auto Zeros = V->attrs().KnownZeros;
       if (Zeros[i]) {
-        V->KnownZeros.setBitVal(i, false);
+        V->mutableAttrs().KnownZeros.setBitVal(i, false);
         if (!VerifyInput(Input)) {
-          V->KnownZeros = Zeros;
+          V->mutableAttrs().KnownZeros = Zeros;
         }
       }
     }
@@ -817,16 +826,16 @@ ParsedReplacement Reducer::WeakenCR(ParsedReplacement Input) {
   findVars(Input.Mapping.LHS, Vars);
 
   for (auto &&V : Vars) {
-    auto Ori = V->Range;
-    if (V->Range.isFullSet()) {
+    auto Ori = V->attrs().Range;
+    if (V->attrs().Range.isFullSet()) {
       continue;
     }
-    V->Range = llvm::ConstantRange(V->Width, true);
+    V->mutableAttrs().Range = llvm::ConstantRange(V->Width, true);
     if (!VerifyInput(Input)) {
-      V->Range = Ori;
+      V->mutableAttrs().Range = Ori;
     }
 
-    auto R = V->Range;
+    auto R = V->attrs().Range;
 
     if (!R.isWrappedSet()) {
       auto Full = R.getFull(R.getBitWidth());
@@ -836,39 +845,39 @@ ParsedReplacement Reducer::WeakenCR(ParsedReplacement Input) {
 
       size_t inc = 1;
       while (inc && U.slt(Full.getUpper())) {
-        auto Backup = V->Range;
+        auto Backup = V->attrs().Range;
         auto Attempt = U + inc;
 
         if (Attempt.sge(Full.getUpper())) {
           Attempt = Full.getLower();
         }
 
-        V->Range = llvm::ConstantRange(L, Attempt);
+        V->mutableAttrs().Range = llvm::ConstantRange(L, Attempt);
         if (VerifyInput(Input)) {
           U = Attempt;
     //      llvm::errs() << "U " << Attempt << '\n';
           inc *= 2;
         } else {
           inc /= 2;
-          V->Range = Backup;
+          V->mutableAttrs().Range = Backup;
         }
       }
 
       size_t dec = 1;
       while (dec && L.slt(0)) {
-        auto Backup = V->Range;
+        auto Backup = V->attrs().Range;
         auto Attempt = L - dec;
         if (Attempt.sle(Full.getLower())) {
           Attempt = Full.getLower();
         }
-        V->Range = llvm::ConstantRange(Attempt, U);
+        V->mutableAttrs().Range = llvm::ConstantRange(Attempt, U);
         if (VerifyInput(Input)) {
           L = Attempt;
     //      llvm::errs() << "L " << Attempt << '\n';
           dec *= 2;
         } else {
           dec /= 2;
-          V->Range = Backup;
+          V->mutableAttrs().Range = Backup;
         }
       }
     }
@@ -910,11 +919,11 @@ ParsedReplacement Reducer::WeakenOther(ParsedReplacement Input) {
   findVars(Input.Mapping.LHS, Vars);
 
   for (auto &&V : Vars) {
-#define WEAKEN(X)           \
-if (V->X) {                 \
-  V->X = false;             \
-  if (!VerifyInput(Input)) {\
-    V->X = true;}}
+#define WEAKEN(X)                      \
+if (V->attrs().X) {                    \
+  V->mutableAttrs().X = false;         \
+  if (!VerifyInput(Input)) {           \
+    V->mutableAttrs().X = true;}}
 
     WEAKEN(NonZero)
     WEAKEN(NonNegative)
@@ -923,10 +932,10 @@ if (V->X) {                 \
 
 #undef WEAKEN
 
-    while (V->NumSignBits) {
-      V->NumSignBits--;
+    while (V->attrs().NumSignBits) {
+      V->mutableAttrs().NumSignBits--;
       if (!VerifyInput(Input)) {
-        V->NumSignBits++;
+        V->mutableAttrs().NumSignBits++;
         break;
       }
     }
@@ -945,12 +954,24 @@ bool Reducer::VerifyInput(ParsedReplacement &Input) {
   return Valid;
 }
 
+void Reducer::reclaimed(const llvm::DenseSet<Inst *> &Dead) {
+  for (auto I : Dead)
+    Unsafe.erase(I);
+}
+
+void Reducer::destroyed() {
+  Unsafe.clear();
+  Listening = false;
+}
+
 bool Reducer::safeToRemove(Inst *I, ParsedReplacement &Input) {
-  static std::set<Inst *> Unsafe;
+  // the root depends on the input, so it isn't cached
+  if (I == Input.Mapping.LHS)
+    return false;
   if (Unsafe.find(I) != Unsafe.end()) {
     return false;
   }
-  if (I == Input.Mapping.LHS || I->K == Inst::Var || I->K == Inst::Const ||
+  if (I->K == Inst::Var || I->K == Inst::Const ||
       I->K == Inst::UMulWithOverflow || I->K == Inst::UMulO ||
       I->K == Inst::SMulWithOverflow || I->K == Inst::SMulO ||
       I->K == Inst::UAddWithOverflow || I->K == Inst::UAddO ||
@@ -967,28 +988,14 @@ Inst *Reducer::Eliminate(ParsedReplacement &Input, Inst *I) {
   // Try to replace I with a new Var.
   Inst *NewVar = IC.createVar(I->Width, "newvar" + std::to_string(varnum++));
 
-  std::map<Inst *, Inst *> ICache;
-  ICache[I] = NewVar;
-
-  std::map<Block *, Block *> BCache;
-  std::map<Inst *, llvm::APInt> CMap;
+  InstRewriter R(IC);
+  R.substitute(I, NewVar);
 
-  ParsedReplacement NewInst = Input;
-
-  Input.Mapping.LHS = getInstCopy(Input.Mapping.LHS, IC, ICache,
-                                  BCache, &CMap, false);
-
-  Input.Mapping.RHS = getInstCopy(Input.Mapping.RHS, IC, ICache,
-                                  BCache, &CMap, false);
-
-  for (auto &M : Input.PCs) {
-    M.LHS = getInstCopy(M.LHS, IC, ICache, BCache, &CMap, false);
-    M.RHS = getInstCopy(M.RHS, IC, ICache, BCache, &CMap, false);
-  }
-  for (auto &BPC : Input.BPCs) {
-    BPC.PC.LHS = getInstCopy(BPC.PC.LHS, IC, ICache, BCache, &CMap, false);
-    BPC.PC.RHS = getInstCopy(BPC.PC.RHS, IC, ICache, BCache, &CMap, false);
-  }
+  R.rewrite(Input.Mapping);
+  for (auto &M : Input.PCs.mutate())
+    R.rewrite(M);
+  for (auto &BPC : Input.BPCs.mutate())
+    R.rewrite(BPC.PC);
   return NewVar;
 }
 
@@ -1097,7 +1104,7 @@ Inst *NonPoisonReplacement(Inst *I, InstContext &IC) {
   }
 
   auto Ret =  IC.getInst(K, I->Width, I->Ops);
-  Ret->Name = I->Name;
+  Ret->mutableAttrs().Name = I->attrs().Name;
   Ret->DemandedBits = I->DemandedBits;
   return Ret;
 }
@@ -0,0 +1,311 @@
+// Copyright 2014 The Souper Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "souper/Generalize/WidthSweep.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "souper/Extractor/ExprBuilder.h"
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <memory>
+#include <thread>
+
+extern unsigned DebugLevel;
+
+namespace {
+using namespace souper;
+
+static llvm::cl::opt<unsigned> WidthSweepMax("width-sweep-max",
+  llvm::cl::desc("Largest width checked when sweeping a rewrite over "
+                 "widths (default=64)"),
+  llvm::cl::init(64));
+
+static llvm::cl::opt<unsigned> WidthSweepThreads("width-sweep-threads",
+  llvm::cl::desc("Widths checked at once, 0 for one per hardware thread "
+                 "(default=0)"),
+  llvm::cl::init(0));
+
+struct WidthInstantiator {
+  InstContext &IC;
+  unsigned From, To;
+  std::map<Inst *, Inst *> Cache;
+
+  Inst *operator()(Inst *I) {
+    auto It = Cache.find(I);
+    if (It != Cache.end())
+      return It->second;
+    Inst *Result = build(I);
+    Cache[I] = Result;
+    return Result;
+  }
+
+  Inst *build(Inst *I) {
+    if (I->Width != 1 && I->Width != From)
+      return nullptr;
+    unsigned Width = I->Width == 1 ? 1 : To;
+
+    switch (I->K) {
+    case Inst::Var: {
+      if (I->Width == 1)
+        return I;
+      const InstAttrs &A = I->attrs();
+      // facts about particular bits or values don't carry over
+      if (!A.Range.isFullSet() || A.KnownZeros != 0 || A.KnownOnes != 0 ||
+          A.NumSignBits > 1 ||
+          (I->DemandedBits.getBitWidth() == I->Width &&
+           !I->DemandedBits.isAllOnes()))
+        return nullptr;
+      return IC.createVar(To, A.Name, llvm::ConstantRange(To, true),
+                          llvm::APInt(To, 0), llvm::APInt(To, 0), A.NonZero,
+                          A.NonNegative, A.PowOfTwo, A.Negative,
+                          /*NumSignBits=*/1, llvm::APInt::getAllOnes(To),
+                          I->SynthesisConstID);
+    }
+
+    case Inst::Const:
+      if (I->Width == 1)
+        return I;
+      if (I->Val.isZero())
+        return IC.getConst(llvm::APInt(To, 0));
+      if (I->Val.isOne())
+        return IC.getConst(llvm::APInt(To, 1));
+      if (I->Val.isAllOnes())
+        return IC.getConst(llvm::APInt::getAllOnes(To));
+      return nullptr;
+
+    case Inst::ZExt:
+    case Inst::SExt:
+      if (I->Ops[0]->Width != 1)
+        return nullptr;
+      // an i1 doesn't need extending to i1
+      if (To == 1)
+        return (*this)(I->Ops[0]);
+      break;
+
+    case Inst::Trunc:
+      if (To == 1)
+        return (*this)(I->Ops[0]);
+      break;
+
+    // only valid at some widths, or with operands of a fixed width
+    case Inst::BSwap:
+    case Inst::Lop3:
+    case Inst::Custom:
+      return nullptr;
+
+    case Inst::UntypedConst:
+    case Inst::Phi:
+    case Inst::Hole:
+    case Inst::ReservedConst:
+    case Inst::ReservedInst:
+      return nullptr;
+
+    default:
+      break;
+    }
+
+    std::vector<Inst *> Ops;
+    for (auto Op : I->Ops) {
+      Inst *NewOp = (*this)(Op);
+      if (!NewOp)
+        return nullptr;
+      Ops.push_back(NewOp);
+    }
+    // anything else the new width makes ill-typed is left out too
+    std::string ErrStr;
+    if (!typeCheckInst(IC, I->K, Width, Ops, ErrStr))
+      return nullptr;
+    return IC.getInst(I->K, Width, Ops);
+  }
+};
+
+// Replaces the width of the LHS in the type annotations of a printed
+// rewrite, which is all that distinguishes the instances of a width-uniform
+// rewrite at different widths
+std::string eraseWidth(const std::string &Text, unsigned Width) {
+  std::string WidthStr = std::to_string(Width);
+  std::string Result;
+  Result.reserve(Text.size());
+  for (size_t I = 0; I < Text.size(); ++I) {
+    if (Text.compare(I, 2, ":i") == 0) {
+      size_t End = I + 2;
+      while (End < Text.size() && isdigit(Text[End]))
+        ++End;
+      if (Text.compare(I + 2, End - I - 2, WidthStr) == 0 &&
+          End - I - 2 == WidthStr.size()) {
+        Result += ":iW";
+        I = End - 1;
+        continue;
+      }
+    }
+    Result += Text[I];
+  }
+  return Result;
+}
+
+using VerdictCache = std::map<std::pair<std::string, unsigned>, WidthVerdict>;
+
+// Only used from the thread that owns the InstContext
+VerdictCache &getVerdictCache() {
+  static VerdictCache Cache;
+  return Cache;
+}
+
+struct WidthCheck {
+  size_t Index;
+  std::string Query;
+  WidthVerdict Verdict = WidthVerdict::Unknown;
+};
+
+// Touches neither the InstContext nor anything shared besides Solver
+void runWidthCheck(SMTLIBSolver *Solver, WidthCheck &Check, unsigned Timeout) {
+  if (Check.Query.empty())
+    return;
+  bool IsSat;
+  if (Solver->isSatisfiable(Check.Query, IsSat, 0, nullptr, Timeout))
+    return;
+  Check.Verdict = IsSat ? WidthVerdict::Invalid : WidthVerdict::Valid;
+}
+
+}
+
+namespace souper {
+
+bool WidthSweepResult::allValid() const {
+  return std::all_of(Verdicts.begin(), Verdicts.end(), [](const auto &V) {
+    return V.second == WidthVerdict::Valid;
+  });
+}
+
+std::optional<ParsedReplacement> instantiateAtWidth(ParsedReplacement Input,
+                                                    unsigned Width) {
+  if (!Input.Mapping.LHS || !Input.Mapping.RHS || !Input.BPCs.empty())
+    return std::nullopt;
+  unsigned From = Input.Mapping.LHS->Width;
+  if (From == 1)
+    return std::nullopt;
+
+  WidthInstantiator WI{*Input.Mapping.LHS->IC, From, Width, {}};
+  Input.Mapping.LHS = WI(Input.Mapping.LHS);
+  Input.Mapping.RHS = WI(Input.Mapping.RHS);
+  if (!Input.Mapping.LHS || !Input.Mapping.RHS)
+    return std::nullopt;
+  for (auto &PC : Input.PCs.mutate()) {
+    PC.LHS = WI(PC.LHS);
+    PC.RHS = WI(PC.RHS);
+    if (!PC.LHS || !PC.RHS)
+      return std::nullopt;
+  }
+  return Input;
+}
+
+std::optional<WidthSweepResult>
+sweepWidths(ParsedReplacement Input, SMTLIBSolver *SMTSolver,
+            std::vector<unsigned> Widths, unsigned Timeout) {
+  // The instances are only needed to build the queries, so they are freed
+  // when the sweep is done instead of piling up in the context
+  auto &IC = *Input.Mapping.LHS->IC;
+  auto Scope = IC.beginScope();
+
+  // instantiating at the rewrite's own width tells whether it is uniform
+  if (!instantiateAtWidth(Input, Input.Mapping.LHS->Width))
+    return std::nullopt;
+
+  if (Widths.empty())
+    for (unsigned W = 1; W <= WidthSweepMax; ++W)
+      Widths.push_back(W);
+
+  std::string Key = eraseWidth(Input.getString(), Input.Mapping.LHS->Width);
+  auto &Cache = getVerdictCache();
+
+  WidthSweepResult Result;
+  std::vector<size_t> Pending;
+  for (auto W : Widths) {
+    auto It = Cache.find({Key, W});
+    auto Verdict = It == Cache.end() ? WidthVerdict::Unknown : It->second;
+    if (Verdict == WidthVerdict::Invalid && !Result.Counterexample)
+      Result.Counterexample = W;
+    if (It == Cache.end())
+      Pending.push_back(Result.Verdicts.size());
+    Result.Verdicts.push_back({W, Verdict});
+  }
+  if (Result.Counterexample)
+    return Result;
+
+  unsigned NumThreads = WidthSweepThreads ? WidthSweepThreads.getValue()
+                                          : std::thread::hardware_concurrency();
+  std::vector<std::unique_ptr<SMTLIBSolver>> Clones;
+  std::vector<SMTLIBSolver *> Solvers{SMTSolver};
+  while (Solvers.size() < std::max(NumThreads, 1u)) {
+    auto Clone = SMTSolver->clone();
+    if (!Clone)
+      break;
+    Solvers.push_back(Clone.get());
+    Clones.push_back(std::move(Clone));
+  }
+
+  // A batch of widths at a time, one per solver: the queries are built on
+  // this thread since that needs the InstContext, then each solver checks
+  // one of them on its own thread.
+  for (size_t Begin = 0; Begin < Pending.size() && !Result.Counterexample;
+       Begin += Solvers.size()) {
+    size_t End = std::min(Begin + Solvers.size(), Pending.size());
+    std::vector<WidthCheck> Checks;
+    for (size_t P = Begin; P < End; ++P) {
+      WidthCheck Check{Pending[P], {}};
+      unsigned W = Result.Verdicts[Pending[P]].first;
+      if (auto Instance = instantiateAtWidth(Input, W))
+        Check.Query = BuildQuery(IC, Instance->BPCs, Instance->PCs,
+                                 Instance->Mapping, nullptr, nullptr);
+      Checks.push_back(std::move(Check));
+    }
+
+    std::vector<std::thread> Threads;
+    for (size_t T = 1; T < Checks.size(); ++T)
+      Threads.emplace_back(runWidthCheck, Solvers[T], std::ref(Checks[T]),
+                           Timeout);
+    runWidthCheck(Solvers[0], Checks[0], Timeout);
+    for (auto &T : Threads)
+      T.join();
+
+    for (auto &Check : Checks) {
+      auto &[W, Verdict] = Result.Verdicts[Check.Index];
+      Verdict = Check.Verdict;
+      if (Verdict != WidthVerdict::Unknown)
+        Cache[{Key, W}] = Verdict;
+      if (Verdict == WidthVerdict::Invalid && !Result.Counterexample)
+        Result.Counterexample = W;
+    }
+  }
+
+  if (DebugLevel > 4) {
+    llvm::errs() << "WIDTH: swept " << Result.Verdicts.size() << " widths";
+    if (Result.Counterexample)
+      llvm::errs() << ", invalid at i" << Result.Counterexample;
+    llvm::errs() << "\n";
+    for (auto &[W, Verdict] : Result.Verdicts) {
+      llvm::errs() << "WIDTH: i" << W << " ";
+      switch (Verdict) {
+      case WidthVerdict::Valid: llvm::errs() << "valid\n"; break;
+      case WidthVerdict::Invalid: llvm::errs() << "invalid\n"; break;
+      case WidthVerdict::Unknown: llvm::errs() << "unknown\n"; break;
+      }
+    }
+  }
+  return Result;
+}
+
+}
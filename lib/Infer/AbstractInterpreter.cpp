@@ -21,6 +21,8 @@
 #include "llvm/ADT/SmallString.h"
 #include "llvm/IR/Operator.h"
 
+#include <array>
+
 using namespace llvm;
 
 namespace {
@@ -51,6 +53,48 @@ namespace {
     return Max;
   }
 
+#define KB_TABLE(Op, Width, ...) \
+  const uint8_t KBTable_##Op##_##Width[] = {__VA_ARGS__};
+#include "souper/Infer/KBTables.inc"
+#undef KB_TABLE
+
+  // Optimal known bits of a binary operator with narrow operands, generated
+  // by utils/gen-xfer-funcs/GenKBTables.cpp; nullptr if there's no table
+  const uint8_t *getKBTable(souper::Inst::Kind K, unsigned Width) {
+    static const auto Tables = [] {
+      std::vector<std::array<const uint8_t *, KB_TABLE_MAX_WIDTH + 1>>
+        T(souper::Inst::None + 1);
+#define KB_TABLE(Op, Width, ...) \
+      T[souper::Inst::Op][Width] = KBTable_##Op##_##Width;
+#include "souper/Infer/KBTables.inc"
+#undef KB_TABLE
+      return T;
+    }();
+    if (Width > KB_TABLE_MAX_WIDTH)
+      return nullptr;
+    return Tables[K][Width];
+  }
+
+  // Bit I contributes 3^I times 0 (unknown), 1 (zero) or 2 (one)
+  unsigned getKBTableIndex(const KnownBits &X) {
+    unsigned Idx = 0;
+    for (unsigned I = X.getBitWidth(); I-- > 0;)
+      Idx = Idx * 3 + (X.Zero[I] ? 1 : X.One[I] ? 2 : 0);
+    return Idx;
+  }
+
+  KnownBits lookupKBTable(const uint8_t *Table, const KnownBits &LHS,
+                          const KnownBits &RHS, unsigned ResultWidth) {
+    unsigned NumKB = 1;
+    for (unsigned I = 0; I < LHS.getBitWidth(); ++I)
+      NumKB *= 3;
+    uint8_t Entry = Table[getKBTableIndex(LHS) * NumKB + getKBTableIndex(RHS)];
+    KnownBits Result(ResultWidth);
+    Result.Zero = APInt(ResultWidth, Entry & 0xf);
+    Result.One = APInt(ResultWidth, Entry >> 4);
+    return Result;
+  }
+
 } // anonymous
 
 namespace souper {
@@ -463,10 +507,10 @@ namespace souper {
     if (KBCache.find(I) != KBCache.end())
       return true;
 
-    if (I->K == Inst::Var && (I->KnownZeros.getBoolValue() || I->KnownOnes.getBoolValue())) {
+    if (I->K == Inst::Var && (I->attrs().KnownZeros.getBoolValue() || I->attrs().KnownOnes.getBoolValue())) {
       llvm::KnownBits metadataKB;
-      metadataKB.Zero = I->KnownZeros;
-      metadataKB.One = I->KnownOnes;
+      metadataKB.Zero = I->attrs().KnownZeros;
+      metadataKB.One = I->attrs().KnownOnes;
 
       KBCache.emplace(I, std::move(metadataKB));
       return true;
@@ -481,6 +525,14 @@ namespace souper {
     if (cacheHasValue(I))
       return KBCache.at(I);
 
+    bool UseShared = Shared && UsePartialEval;
+    if (UseShared) {
+      if (auto KB = Shared->lookupKB(I, InputSet)) {
+        KBCache.emplace(I, *KB);
+        return *KB;
+      }
+    }
+
     if (UsePartialEval || I->K == Inst::Const) {
     EvalValue V = VAL(I);
     if (V.hasValue()) {
@@ -489,6 +541,8 @@ namespace souper {
 
       // cache before returning
       KBCache.emplace(I, Result);
+      if (UseShared)
+        Shared->insertKB(I, InputSet, Result);
 
       return Result;
     }
@@ -725,9 +779,21 @@ namespace souper {
       break;
     }
 
+    if (I->Ops.size() == 2) {
+      if (auto Table = getKBTable(I->K, I->Ops[0]->Width)) {
+        // The table is exact for all operand values, keep what the code
+        // above knows beyond that, e.g. synthesized constants being nonzero
+        auto Exact = lookupKBTable(Table, KB0, KB1, Result.getBitWidth());
+        Result.Zero |= Exact.Zero;
+        Result.One |= Exact.One;
+      }
+    }
+
     assert(!Result.hasConflict() && "Conflict in resulting KB!");
 
     KBCache.emplace(I, Result);
+    if (UseShared)
+      Shared->insertKB(I, InputSet, Result);
     return KBCache.at(I);
   }
 
@@ -753,8 +819,8 @@ namespace souper {
     if (CRCache.find(I) != CRCache.end())
       return true;
 
-    if (I->K == Inst::Var && !I->Range.isFullSet()) {
-      CRCache.emplace(I, I->Range);
+    if (I->K == Inst::Var && !I->attrs().Range.isFullSet()) {
+      CRCache.emplace(I, I->attrs().Range);
       return true;
     }
 
@@ -769,10 +835,20 @@ namespace souper {
     if (cacheHasValue(I))
       return CRCache.at(I);
 
+    bool UseShared = Shared && UsePartialEval;
+    if (UseShared) {
+      if (auto CR = Shared->lookupCR(I, InputSet)) {
+        CRCache.emplace(I, *CR);
+        return *CR;
+      }
+    }
+
     if (UsePartialEval || I->K == Inst::Const) {
     EvalValue V = VAL(I);
     if (V.hasValue()) {
       CRCache.emplace(I, llvm::ConstantRange(V.getValue()));
+      if (UseShared)
+        Shared->insertCR(I, InputSet, CRCache.at(I));
       return CRCache.at(I);
     }
     }
@@ -910,6 +986,8 @@ namespace souper {
     }
 
     CRCache.emplace(I, Result);
+    if (UseShared)
+      Shared->insertCR(I, InputSet, Result);
     return CRCache.at(I);
   }
 #undef CR0
@@ -930,7 +1008,14 @@ namespace souper {
     llvm::APInt Result(I->Width, 0);
     llvm::APInt AllZeroes = Result;
     Result.setAllBits();
+    unsigned VarVisitsBefore = VarVisits;
+    if (Shared) {
+      if (auto RB = Shared->lookupRB(I))
+        return *RB;
+    }
     if (RBCache.find(I) != RBCache.end()) {
+      // var-free subtrees would have been found in the shared cache
+      ++VarVisits;
       llvm::APInt CachedResult = RBCache[I];
       if (I->K == Inst::Var) {
         RBCache[I] = Result; // set to all ones after 'first' use
@@ -941,6 +1026,7 @@ namespace souper {
     if (isReservedConst(I)) {
       // nop, all bits set
     } else if (I->K == Inst::Kind::Var) {
+      ++VarVisits;
       RBCache[I] = Result;
       // ^ Restricts the variable
       Result = AllZeroes;
@@ -1049,6 +1135,8 @@ namespace souper {
     }
     if (I->K != Inst::Var) {
       RBCache[I] = Result;
+      if (Shared && VarVisits == VarVisitsBefore)
+        Shared->insertRB(I, Result);
     }
     return Result;
   }
@@ -15,16 +15,19 @@
 #include "alive2/util/errors.h"
 #include "alive2/util/symexec.h"
 
+#include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/ADT/StringExtras.h"
 
 #include <iostream>
+#include <list>
 #include <memory>
 #include <set>
 #include <sstream>
 #include <string_view>
+#include <unordered_map>
 #include <unordered_set>
 #include <z3.h>
 
@@ -57,6 +60,103 @@ static bool ShowValidWidths = false;
 //   llvm::cl::desc("Show widths for which the input is valid."),
 //   llvm::cl::init(false));
 
+static llvm::cl::opt<unsigned> MaxCachedDrivers("alive-max-cached-drivers",
+  llvm::cl::desc("Number of translated LHSs kept for reuse (default = 16)"),
+  llvm::cl::init(16));
+
+std::shared_ptr<smt::smt_initializer> getSMTInitializer() {
+  static std::weak_ptr<smt::smt_initializer> Current;
+  auto Init = Current.lock();
+  if (!Init) {
+    Init = std::make_shared<smt::smt_initializer>();
+    Current = Init;
+  }
+  return Init;
+}
+
+// What a driver was made for. Insts are hash-consed, so within a context
+// the identity of an Inst stands for its structure, for as long as the Inst
+// isn't freed.
+struct DriverKey {
+  uint64_t Context;
+  souper::Inst *LHS, *PreCondition;
+  std::vector<souper::Inst *> ExtraInputs;
+  bool WidthIndep;
+
+  bool operator==(const DriverKey &Other) const {
+    return Context == Other.Context && LHS == Other.LHS &&
+           PreCondition == Other.PreCondition &&
+           ExtraInputs == Other.ExtraInputs && WidthIndep == Other.WidthIndep;
+  }
+  size_t hash() const {
+    return llvm::hash_combine(Context, LHS, PreCondition, WidthIndep,
+                              llvm::hash_combine_range(ExtraInputs.begin(),
+                                                       ExtraInputs.end()));
+  }
+};
+
+struct CachedDriver {
+  DriverKey Key;
+  size_t Hash;
+  std::unique_ptr<souper::AliveDriver> Driver;
+};
+
+// Most recently used first. Alive2 isn't thread safe, so neither is this.
+std::list<CachedDriver> &getDriverCache() {
+  static std::list<CachedDriver> Drivers;
+  return Drivers;
+}
+
+// Drops the cached drivers of a context that refer to Insts a scope of the
+// context frees, and all of them when the context goes away. Once no
+// driver is left, Alive2's solver state is released.
+class DriverCacheListener : public souper::InstContextListener {
+  uint64_t Context;
+
+public:
+  explicit DriverCacheListener(uint64_t Context) : Context(Context) {}
+  void reclaimed(const llvm::DenseSet<souper::Inst *> &Dead) override;
+  void destroyed() override;
+};
+
+// One per context that has had a driver, keyed by the context ID
+std::unordered_map<uint64_t, std::unique_ptr<DriverCacheListener>> &
+getDriverCacheListeners() {
+  static std::unordered_map<uint64_t, std::unique_ptr<DriverCacheListener>>
+    Listeners;
+  return Listeners;
+}
+
+void DriverCacheListener::reclaimed(const llvm::DenseSet<souper::Inst *> &Dead) {
+  auto &Drivers = getDriverCache();
+  for (auto It = Drivers.begin(); It != Drivers.end();) {
+    auto &Key = It->Key;
+    if (Key.Context != Context) {
+      ++It;
+      continue;
+    }
+    // the rest of the DAGs is older than their roots, so it is freed only
+    // if a root is
+    bool Stale = Dead.count(Key.LHS) || Dead.count(Key.PreCondition);
+    for (auto I : Key.ExtraInputs)
+      Stale |= Dead.count(I) != 0;
+    if (Stale) {
+      It = Drivers.erase(It);
+    } else {
+      It->Driver->forget(Dead);
+      ++It;
+    }
+  }
+}
+
+void DriverCacheListener::destroyed() {
+  getDriverCache().remove_if([this](const CachedDriver &D) {
+    return D.Key.Context == Context;
+  });
+  // deletes this
+  getDriverCacheListeners().erase(Context);
+}
+
 
 class FunctionBuilder {
 public:
@@ -270,7 +370,8 @@ synthesizeConstantUsingSolver(tools::Transform &t,
 
 souper::AliveDriver::AliveDriver(Inst *LHS_, Inst *PreCondition_, InstContext &IC_,
                                  const std::vector<Inst *> &ExtraInputs, bool WidthIndep)
-    : LHS(LHS_), PreCondition(PreCondition_), IC(IC_) {
+    : LHS(LHS_), PreCondition(PreCondition_), IC(IC_),
+      SMTInit(getSMTInitializer()) {
   smt::set_query_timeout(std::to_string(10000)); // milliseconds
   IsLHS = true;
   WidthIndependentMode = WidthIndep;
@@ -300,6 +401,55 @@ souper::AliveDriver::AliveDriver(Inst *LHS_, Inst *PreCondition_, InstContext &I
   IsLHS = false;
 }
 
+souper::AliveDriver &
+souper::AliveDriver::get(Inst *LHS, Inst *PreCondition, InstContext &IC,
+                         const std::vector<Inst *> &ExtraInputs,
+                         bool WidthIndep) {
+  DriverKey Key{IC.getID(), LHS, PreCondition, ExtraInputs, WidthIndep};
+  size_t Hash = Key.hash();
+  auto &Drivers = getDriverCache();
+  auto &Listener = getDriverCacheListeners()[IC.getID()];
+  if (!Listener) {
+    Listener = std::make_unique<DriverCacheListener>(IC.getID());
+    IC.addListener(Listener.get());
+  }
+  for (auto It = Drivers.begin(); It != Drivers.end(); ++It) {
+    if (It->Hash == Hash && It->Key == Key) {
+      Drivers.splice(Drivers.begin(), Drivers, It);
+      return *Drivers.front().Driver;
+    }
+  }
+
+  auto Driver = std::make_unique<AliveDriver>(LHS, PreCondition, IC,
+                                              ExtraInputs, WidthIndep);
+  Drivers.push_front({std::move(Key), Hash, std::move(Driver)});
+  // evicting only now keeps the solver state alive for the new driver
+  while (Drivers.size() > std::max<unsigned>(MaxCachedDrivers, 1u))
+    Drivers.pop_back();
+  return *Drivers.front().Driver;
+}
+
+size_t souper::AliveDriver::getNumCached() {
+  return getDriverCache().size();
+}
+
+void souper::AliveDriver::forget(const llvm::DenseSet<Inst *> &Dead) {
+  for (auto It = SymTypes.begin(); It != SymTypes.end();) {
+    if (Dead.count(const_cast<Inst *>(It->first))) {
+      delete It->second;
+      It = SymTypes.erase(It);
+    } else {
+      ++It;
+    }
+  }
+  for (auto It = NameMap.begin(); It != NameMap.end();) {
+    if (Dead.count(const_cast<Inst *>(It->first)))
+      It = NameMap.erase(It);
+    else
+      ++It;
+  }
+}
+
 //TODO: Return an APInt when alive supports it
 std::map<souper::Inst *, llvm::APInt>
 souper::AliveDriver::synthesizeConstants(souper::Inst *RHS) {
@@ -410,6 +560,7 @@ void souper::AliveDriver::copyInputs(souper::AliveDriver::Cache &To,
 bool souper::AliveDriver::verify (Inst *RHS, Inst *RHSAssumptions) {
   RExprCache.clear();
   ValidTypings.clear();
+  InvalidTypings.clear();
   IR::Function RHSF;
   copyInputs(RExprCache, RHSF);
   if (!translateRoot(RHS, RHSAssumptions, RHSF, RExprCache)) {
@@ -451,7 +602,7 @@ bool souper::AliveDriver::verify (Inst *RHS, Inst *RHSAssumptions) {
         if (DebugLevel > 4) {
           llvm::errs() << "\nInvalid typing: \n";
           for (auto &&P : Inputs) {
-            llvm::errs() << P.first->Name << ' ' << P.second->bits() << "\t";
+            llvm::errs() << P.first->attrs().Name << ' ' << P.second->bits() << "\t";
           }
           llvm::errs() << "\n";
         }
@@ -474,7 +625,7 @@ bool souper::AliveDriver::verify (Inst *RHS, Inst *RHSAssumptions) {
         for (auto &&P : ValidTypings) {
           llvm::outs() << "; ";
           for (auto &&I : P) {
-            llvm::outs() << I.first->Name << ' ' <<  I.second << '\t';
+            llvm::outs() << I.first->attrs().Name << ' ' <<  I.second << '\t';
           }
           llvm::outs() << '\n';
         }
@@ -599,13 +750,13 @@ bool souper::AliveDriver::translateAndCache(const souper::Inst *I,
 
   if (NamesCache.find(I) != NamesCache.end()) {
     Name = NamesCache[I];
-  } else if (I->Name != "") {
+  } else if (I->attrs().Name != "") {
     if (I->SynthesisConstID != 0) {
       // No way to avoid string matching without
       // changes in Inst and EnumerativeSynthesis
       Name = "%" + souper::ReservedConstPrefix + std::to_string(I->SynthesisConstID);
     } else {
-      Name = "%var_" + I->Name;
+      Name = "%var_" + I->attrs().Name;
     }
   } else {
     Name = "%" + std::to_string(InstNumbers++);
@@ -1045,7 +1196,7 @@ bool souper::isTransformationValid(souper::Inst *LHS, souper::Inst *RHS,
     }
     std::vector<Inst *> Vars;
     findVars(Goal.RHS, Vars);
-    AliveDriver Verifier(Goal.LHS, Goal.Pre, IC, Vars);
+    auto &Verifier = AliveDriver::get(Goal.LHS, Goal.Pre, IC, Vars);
     if (!Verifier.verify(Goal.RHS, Goal.Pre))
       return false;
   }
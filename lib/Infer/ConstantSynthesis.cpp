@@ -16,10 +16,15 @@
 
 #include "llvm/ADT/APInt.h"
 #include "llvm/Support/CommandLine.h"
+#include "souper/Extractor/ExprBuilder.h"
 #include "souper/Infer/ConstantSynthesis.h"
 #include "souper/Infer/Interpreter.h"
 #include "souper/Infer/Pruning.h"
 
+#include <algorithm>
+#include <cmath>
+#include <random>
+
 extern unsigned DebugLevel;
 
 namespace {
@@ -32,6 +37,19 @@ namespace {
   // static cl::opt<unsigned> MaxSpecializations("souper-constant-synthesis-max-num-specializations",
   //   cl::desc("Maximum number of input specializations in constant synthesis (default=15)."),
   //   cl::init(15));
+  static cl::opt<bool> GuessConstants("souper-constant-synthesis-guess",
+    cl::desc("Try constants derived from the LHS on concrete inputs before "
+             "running CEGIS (default=true)"),
+    cl::init(true));
+  static cl::opt<unsigned> MaxConstantGuesses("souper-constant-synthesis-max-guesses",
+    cl::desc("Maximum number of constant assignments tried on concrete "
+             "inputs (default=1024)"),
+    cl::init(1024));
+  static cl::opt<unsigned> MaxGuessChecks("souper-constant-synthesis-max-guess-checks",
+    cl::desc("Maximum number of guessed constants checked with the solver "
+             "before falling back to CEGIS (default=4)"),
+    cl::init(4));
+  const unsigned NumGuessInputs = 16;
 }
 
 namespace souper {
@@ -294,6 +312,288 @@ static void visitConstants(Inst *I, std::set<Inst *> &Visited,
   }
 }
 
+static llvm::APInt getWidthConst(unsigned Width, uint64_t V) {
+  return llvm::APInt(64, V).zextOrTrunc(Width);
+}
+
+// Values worth trying for a constant of the given width, most promising
+// first: the literals of the replacement and simple functions of them (the
+// bit functions are those Generalize.cpp builds with BitFuncs), then small
+// integers and powers of two.
+static std::vector<llvm::APInt>
+getConstantCandidates(unsigned Width, const std::vector<Inst *> &Literals) {
+  std::vector<llvm::APInt> Result;
+  auto ULess = [](const llvm::APInt &A, const llvm::APInt &B) {
+    return A.ult(B);
+  };
+  std::set<llvm::APInt, decltype(ULess)> Seen(ULess);
+  auto Add = [&](llvm::APInt V) {
+    if (Seen.insert(V).second)
+      Result.push_back(std::move(V));
+  };
+
+  for (auto L : Literals) {
+    for (auto C : {L->Val.sextOrTrunc(Width), L->Val.zextOrTrunc(Width)}) {
+      Add(C);
+      Add(-C);
+      Add(~C);
+      Add(C + 1);
+      Add(C - 1);
+      Add(C.shl(1));
+      Add(C.lshr(1));
+      Add(C.ashr(1));
+      for (unsigned B : {C.popcount(), C.countLeadingZeros(),
+                         C.countTrailingZeros()}) {
+        Add(getWidthConst(Width, B));
+        Add(getWidthConst(Width, Width - B));
+      }
+      if (C.ult(Width)) {
+        unsigned Amt = C.getZExtValue();
+        Add(llvm::APInt::getOneBitSet(Width, Amt));
+        Add(llvm::APInt::getAllOnes(Width).shl(Amt));
+        Add(llvm::APInt::getLowBitsSet(Width, Amt));
+      }
+    }
+  }
+
+  for (uint64_t V = 0; V <= 8; ++V)
+    Add(getWidthConst(Width, V));
+  Add(llvm::APInt::getAllOnes(Width));
+  Add(-getWidthConst(Width, 2));
+  Add(getWidthConst(Width, Width));
+  Add(getWidthConst(Width, Width - 1));
+  Add(llvm::APInt::getSignedMinValue(Width));
+  Add(llvm::APInt::getSignedMaxValue(Width));
+  for (unsigned I = 0; I < Width; ++I) {
+    Add(llvm::APInt::getOneBitSet(Width, I));
+    Add(llvm::APInt::getLowBitsSet(Width, I));
+  }
+  return Result;
+}
+
+static llvm::APInt getGuessInput(unsigned Width, unsigned N,
+                                 std::mt19937_64 &Rand) {
+  switch (N) {
+  case 0: return llvm::APInt(Width, 0);
+  case 1: return getWidthConst(Width, 1);
+  case 2: return llvm::APInt::getAllOnes(Width);
+  case 3: return llvm::APInt::getSignedMinValue(Width);
+  case 4: return llvm::APInt::getSignedMaxValue(Width);
+  default: {
+    std::vector<uint64_t> Words((Width + 63) / 64);
+    for (auto &W : Words)
+      W = Rand();
+    return llvm::APInt(Width, Words);
+  }
+  }
+}
+
+namespace {
+// Checks whether an assignment of the constants makes the replacement valid.
+// A session is given the replacement's query once, with the constants left
+// as variables, and a check only adds the assignment to it; other solvers
+// get the query with the constants substituted for every check.
+class ConstantChecker {
+  SMTLIBSolver *Solver;
+  const BlockPCs &BPCs;
+  const std::vector<InstMapping> &PCs;
+  InstMapping Mapping;
+  InstContext &IC;
+  // null unless the session holds the query
+  std::unique_ptr<ExprBuilder> EB;
+  std::vector<Inst *> ModelInsts;
+  // the check-sat and get-value commands of the query
+  std::string Check;
+
+public:
+  ConstantChecker(SMTLIBSolver *Solver, bool Session, const BlockPCs &BPCs,
+                  const std::vector<InstMapping> &PCs, InstMapping Mapping,
+                  InstContext &IC)
+      : Solver(Solver), BPCs(BPCs), PCs(PCs), Mapping(Mapping), IC(IC) {
+    if (!Session)
+      return;
+    std::unique_ptr<ExprBuilder> B = createExprBuilder(IC);
+    std::string Query = B->BuildQuery(BPCs, PCs, Mapping, &ModelInsts, 0);
+    size_t CheckPos = Query.find("(check-sat)");
+    if (CheckPos != std::string::npos && Solver->addAssertions(Query)) {
+      Check = Query.substr(CheckPos);
+      EB = std::move(B);
+    }
+  }
+
+  // Sets IsSat if the replacement with the constants in ConstMap is wrong
+  // for some input, which the model in Insts and Vals then describes
+  std::error_code check(std::map<Inst *, llvm::APInt> &ConstMap, bool &IsSat,
+                        std::vector<Inst *> &Insts,
+                        std::vector<llvm::APInt> &Vals, unsigned Timeout) {
+    if (EB) {
+      Inst *Assignment = IC.getConst(llvm::APInt(1, true));
+      for (auto &C : ConstMap)
+        Assignment = IC.getInst(Inst::And, 1, {Assignment,
+                       IC.getInst(Inst::Eq, 1, {C.first,
+                                                IC.getConst(C.second)})});
+      Insts = ModelInsts;
+      return Solver->isSatisfiable(EB->BuildAssertion(Assignment) + Check,
+                                   IsSat, Insts.size(), &Vals, Timeout);
+    }
+
+    InstRewriter R(IC);
+    R.setConstMap(&ConstMap);
+    InstMapping Copy = Mapping;
+    R.rewrite(Copy);
+    std::string Query = BuildQuery(IC, BPCs, PCs, Copy, &Insts, 0);
+    if (Query.empty())
+      return std::make_error_code(std::errc::value_too_large);
+    return Solver->isSatisfiable(Query, IsSat, Insts.size(), &Vals, Timeout);
+  }
+};
+}
+
+// Screens assignments of constants that are simple functions of the
+// replacement's literals on a few concrete inputs, evaluating each
+// assignment on all inputs at once, and checks the survivors with the
+// solver. A refuted survivor contributes its counterexample to the inputs.
+// Returns true and fills ResultMap if one of them is valid for all inputs.
+// Guessing is only a shortcut, so a check that fails or times out ends it
+// and leaves the search to CEGIS.
+static bool guessConstants(ConstantChecker &Checker, const BlockPCs &BPCs,
+                           const std::vector<InstMapping> &PCs,
+                           InstMapping Mapping, std::set<Inst *> &ConstSet,
+                           Inst *ConstConstraints,
+                           std::map<Inst *, llvm::APInt> &ResultMap,
+                           InstContext &IC, unsigned Timeout) {
+  // the interpreter has no control flow to choose phi operands with
+  if (!BPCs.empty() || !getBlocksFromPhis(Mapping.LHS).empty() ||
+      !getBlocksFromPhis(Mapping.RHS).empty())
+    return false;
+
+  Inst *PCAnte = IC.getConst(llvm::APInt(1, true));
+  for (auto &PC : PCs)
+    PCAnte = IC.getInst(Inst::And, 1, {PCAnte,
+                          IC.getInst(Inst::Eq, 1, {PC.LHS, PC.RHS})});
+  std::set<Inst *> PCConsts;
+  getConstants(PCAnte, PCConsts);
+  if (!PCConsts.empty())
+    return false;
+
+  std::vector<Inst *> Consts(ConstSet.begin(), ConstSet.end());
+  std::vector<Inst *> Literals, Vars;
+  auto IsLiteral = [](Inst *I) { return I->K == Inst::Const; };
+  findInsts(Mapping.LHS, Literals, IsLiteral);
+  findInsts(Mapping.RHS, Literals, IsLiteral);
+  for (auto Root : {Mapping.LHS, Mapping.RHS, PCAnte})
+    findVars(Root, Vars);
+  std::sort(Vars.begin(), Vars.end());
+  Vars.erase(std::unique(Vars.begin(), Vars.end()), Vars.end());
+  Vars.erase(std::remove_if(Vars.begin(), Vars.end(), [&](Inst *V) {
+      return ConstSet.count(V);
+    }), Vars.end());
+
+  std::vector<std::vector<llvm::APInt>> Candidates;
+  size_t NumGuesses = 1;
+  for (auto C : Consts) {
+    Candidates.push_back(getConstantCandidates(C->Width, Literals));
+    NumGuesses *= Candidates.back().size();
+  }
+  // keep the product of the candidate lists within the budget by trimming
+  // all of them to the same length
+  if (NumGuesses > MaxConstantGuesses) {
+    size_t PerConst = std::max(1.0, std::floor(std::pow(
+        (double)MaxConstantGuesses, 1.0 / Consts.size())));
+    NumGuesses = 1;
+    for (auto &Cands : Candidates) {
+      if (Cands.size() > PerConst)
+        Cands.resize(PerConst);
+      NumGuesses *= Cands.size();
+    }
+  }
+
+  ValueCache Base;
+  for (auto Root : {Mapping.LHS, Mapping.RHS, ConstConstraints, PCAnte})
+    Base.addDAG(Root);
+
+  std::vector<ValueCache> Inputs;
+  std::mt19937_64 Rand(0);
+  for (unsigned N = 0; N < NumGuessInputs; ++N) {
+    ValueCache VC = Base;
+    for (auto V : Vars)
+      VC[V] = getGuessInput(V->Width, N, Rand);
+    if (!isDataflowConsistent(VC))
+      continue;
+    auto Ante = ConcreteInterpreter(VC).evaluateInst(PCAnte);
+    if (Ante.hasValue() && Ante.getValue().getBoolValue())
+      Inputs.push_back(std::move(VC));
+  }
+  if (Inputs.empty())
+    return false;
+
+  unsigned Checks = 0;
+  std::vector<unsigned> Choice(Consts.size());
+  std::vector<ConcreteInterpreter> Lanes;
+  for (size_t G = 0; G < NumGuesses && Checks < MaxGuessChecks; ++G) {
+    // mixed-radix counter over the candidate lists
+    for (size_t I = 0, Rest = G; I < Consts.size(); ++I) {
+      Choice[I] = Rest % Candidates[I].size();
+      Rest /= Candidates[I].size();
+    }
+
+    Lanes.clear();
+    for (auto &Input : Inputs) {
+      ValueCache VC = Input;
+      for (size_t I = 0; I < Consts.size(); ++I)
+        VC[Consts[I]] = Candidates[I][Choice[I]];
+      Lanes.emplace_back(std::move(VC));
+    }
+    auto Allowed = Lanes[0].evaluateInst(ConstConstraints);
+    if (!Allowed.hasValue() || !Allowed.getValue().getBoolValue())
+      continue;
+
+    LaneInterpreter LI(Lanes);
+    auto LHSVals = LI.evaluateInst(Mapping.LHS, Lanes.size());
+    auto RHSVals = LI.evaluateInst(Mapping.RHS, Lanes.size());
+    bool Survives = true, Witnessed = false;
+    for (size_t L = 0; L < Lanes.size() && Survives; ++L) {
+      // any RHS refines a LHS that has no value
+      if (!LHSVals[L].hasValue())
+        continue;
+      Witnessed = true;
+      Survives = RHSVals[L].hasValue() &&
+                 RHSVals[L].getValue() == LHSVals[L].getValue();
+    }
+    if (!Survives || !Witnessed)
+      continue;
+
+    std::map<Inst *, llvm::APInt> ConstMap;
+    for (size_t I = 0; I < Consts.size(); ++I)
+      ConstMap.insert({Consts[I], Candidates[I][Choice[I]]});
+
+    std::vector<Inst *> ModelInsts;
+    std::vector<llvm::APInt> ModelVals;
+    bool IsSat;
+    ++Checks;
+    if (std::error_code EC = Checker.check(ConstMap, IsSat, ModelInsts,
+                                           ModelVals, Timeout)) {
+      if (DebugLevel > 3)
+        llvm::errs() << "ConstantSynthesis: checking a guess failed: "
+                     << EC.message() << "\n";
+      return false;
+    }
+    if (!IsSat) {
+      if (DebugLevel > 3)
+        llvm::errs() << "ConstantSynthesis: guessed constants work\n";
+      ResultMap = std::move(ConstMap);
+      return true;
+    }
+
+    ValueCache VC = Base;
+    for (unsigned J = 0; J != ModelInsts.size(); ++J)
+      if (!ConstSet.count(ModelInsts[J]))
+        VC[ModelInsts[J]] = ModelVals[J];
+    Inputs.push_back(std::move(VC));
+  }
+  return false;
+}
+
 std::error_code
 ConstantSynthesis::synthesize(SMTLIBSolver *SMTSolver,
                               const BlockPCs &BPCs,
@@ -325,12 +625,12 @@ ConstantSynthesis::synthesize(SMTLIBSolver *SMTSolver,
         }
       }
       if (!VCCopy.empty()) {
-        std::map<Inst *, Inst *> InstCache;
-        std::map<Block *, Block *> BlockCache;
+        InstRewriter R(IC, /*CloneVars=*/true);
+        R.setConstMap(&VCCopy);
+        InstMapping Copy = Mapping;
+        R.rewrite(Copy);
         TriedAnte = IC.getInst(Inst::And, 1,
-                    {IC.getInst(Inst::Eq, 1,
-                    {getInstCopy(Mapping.LHS, IC, InstCache, BlockCache, &VCCopy, true),
-                    getInstCopy(Mapping.RHS, IC, InstCache, BlockCache, &VCCopy, true)}), TriedAnte});
+                    {IC.getInst(Inst::Eq, 1, {Copy.LHS, Copy.RHS}), TriedAnte});
       }
     }
   }
@@ -340,24 +640,67 @@ ConstantSynthesis::synthesize(SMTLIBSolver *SMTSolver,
   visitConstants(Mapping.LHS, Visited, ConstConstraints, ConstSet, IC, AvoidNops);
   visitConstants(Mapping.RHS, Visited, ConstConstraints, ConstSet, IC, AvoidNops);
 
+  // The guessing and the checking queries each get a solver that lives for
+  // the whole loop, so an iteration doesn't pay for starting two solvers.
+  std::unique_ptr<SMTLIBSolver> FirstSession = SMTSolver->startSession();
+  std::unique_ptr<SMTLIBSolver> SecondSession = SMTSolver->startSession();
+  SMTLIBSolver *FirstSolver = FirstSession ? FirstSession.get() : SMTSolver;
+  SMTLIBSolver *SecondSolver = SecondSession ? SecondSession.get() : SMTSolver;
+  ConstantChecker Checker(SecondSolver, SecondSession != nullptr, BPCs, PCs,
+                          Mapping, IC);
+
+  // Most constants are simple functions of the LHS's; only when none of
+  // those works does the search need the solver to come up with guesses
+  if (GuessConstants &&
+      guessConstants(Checker, BPCs, PCs, Mapping, ConstSet,
+                     ConstConstraints, ResultMap, IC, Timeout))
+    return EC;
+
+  // A session is given the first query once; every iteration then only adds
+  // the guess it rules out and the input it learned, and checks again.
+  std::unique_ptr<ExprBuilder> FirstEB;
+  std::vector<Inst *> FirstModelInsts;
+  std::string FirstCheck;
+  if (FirstSession) {
+    std::unique_ptr<ExprBuilder> B = createExprBuilder(IC);
+    Inst *FirstQueryAnte = IC.getInst(Inst::And, 1,
+                                      {ConstConstraints, TriedAnte});
+    std::string Query = B->BuildQuery(BPCs, PCs, Mapping, &FirstModelInsts,
+                                      FirstQueryAnte, true, true);
+    size_t CheckPos = Query.find("(check-sat)");
+    if (CheckPos != std::string::npos && FirstSolver->addAssertions(Query)) {
+      FirstCheck = Query.substr(CheckPos);
+      FirstEB = std::move(B);
+    }
+  }
+  auto AddToFirstQuery = [&](Inst *Constraint) {
+    return FirstSolver->addAssertions(FirstEB->BuildAssertion(Constraint));
+  };
+
   for (int I = 0; I < MaxTries; ++I)  {
     bool IsSat;
     std::vector<Inst *> ModelInstsFirstQuery;
     std::vector<llvm::APInt> ModelValsFirstQuery;
 
-    // TriedAnte /\ SubstAnte
-    Inst *FirstQueryAnte = IC.getInst(Inst::And, 1,
-                                      { ConstConstraints,
-                                        IC.getInst(Inst::And, 1, {SubstAnte, TriedAnte})});
+    std::string Query;
+    if (FirstEB) {
+      ModelInstsFirstQuery = FirstModelInsts;
+      Query = FirstCheck;
+    } else {
+      // TriedAnte /\ SubstAnte
+      Inst *FirstQueryAnte = IC.getInst(Inst::And, 1,
+                                        { ConstConstraints,
+                                          IC.getInst(Inst::And, 1, {SubstAnte, TriedAnte})});
 
-    std::string Query = BuildQuery(IC, BPCs, PCs, InstMapping(Mapping.LHS, Mapping.RHS),
-                                   &ModelInstsFirstQuery, FirstQueryAnte, true, true);
+      Query = BuildQuery(IC, BPCs, PCs, InstMapping(Mapping.LHS, Mapping.RHS),
+                         &ModelInstsFirstQuery, FirstQueryAnte, true, true);
+    }
 
     if (Query.empty())
       return std::make_error_code(std::errc::value_too_large);
 
-    EC = SMTSolver->isSatisfiable(Query, IsSat, ModelInstsFirstQuery.size(),
-                                  &ModelValsFirstQuery, Timeout);
+    EC = FirstSolver->isSatisfiable(Query, IsSat, ModelInstsFirstQuery.size(),
+                                    &ModelValsFirstQuery, Timeout);
 
     if (EC) {
       if (DebugLevel > 3)
@@ -381,7 +724,7 @@ ConstantSynthesis::synthesize(SMTLIBSolver *SMTSolver,
     for (unsigned J = 0; J != ModelInstsFirstQuery.size(); ++J) {
       if (ConstSet.find(ModelInstsFirstQuery[J]) != ConstSet.end()) {
         if (DebugLevel > 3) {
-          llvm::errs() << ModelInstsFirstQuery[J]->Name;
+          llvm::errs() << ModelInstsFirstQuery[J]->attrs().Name;
           llvm::errs() << ": ";
           llvm::errs() << ModelValsFirstQuery[J];
           llvm::errs() << "\n";
@@ -398,11 +741,8 @@ ConstantSynthesis::synthesize(SMTLIBSolver *SMTSolver,
       }
     }
     TriedAnte = IC.getInst(Inst::And, 1, {TriedAnte, TriedAnteLocal});
-
-    std::map<Inst *, Inst *> InstCache;
-    std::map<Block *, Block *> BlockCache;
-    Inst *RHSCopy = getInstCopy(Mapping.RHS, IC, InstCache, BlockCache, &ConstMap, false);
-    Inst *LHSCopy = getInstCopy(Mapping.LHS, IC, InstCache, BlockCache, &ConstMap, false);
+    if (FirstEB && !AddToFirstQuery(TriedAnteLocal))
+      return std::make_error_code(std::errc::protocol_error);
 
     std::vector<Block *> Blocks = getBlocksFromPhis(Mapping.LHS);
     for (auto Block : Blocks) {
@@ -410,6 +750,9 @@ ConstantSynthesis::synthesize(SMTLIBSolver *SMTSolver,
     }
 
     if (DebugLevel > 2 && Pruner) {
+      InstRewriter R(IC);
+      R.setConstMap(&ConstMap);
+      Inst *RHSCopy = R.rewrite(Mapping.RHS);
       if (Pruner->isInfeasible(RHSCopy, DebugLevel)) {
         //TODO(manasij)
         llvm::errs() << "Second Query Skipping opportunity.\n";
@@ -420,14 +763,8 @@ ConstantSynthesis::synthesize(SMTLIBSolver *SMTSolver,
     std::vector<Inst *> ModelInstsSecondQuery;
     std::vector<llvm::APInt> ModelValsSecondQuery;
 
-    Query = BuildQuery(IC, BPCs, PCs, InstMapping(LHSCopy, RHSCopy),
-                       &ModelInstsSecondQuery, 0);
-
-    if (Query.empty())
-      return std::make_error_code(std::errc::value_too_large);
-
-    EC = SMTSolver->isSatisfiable(Query, IsSat, ModelInstsSecondQuery.size(),
-                                  &ModelValsSecondQuery, Timeout);
+    EC = Checker.check(ConstMap, IsSat, ModelInstsSecondQuery,
+                       ModelValsSecondQuery, Timeout);
     if (EC) {
       if (DebugLevel > 3) {
         llvm::errs()<<"ConstantSynthesis: solver returns error on second query\n";
@@ -450,7 +787,7 @@ ConstantSynthesis::synthesize(SMTLIBSolver *SMTSolver,
       ValueCache VC;
       for (unsigned J = 0; J != ModelInstsSecondQuery.size(); ++J) {
         Inst* Var = ModelInstsSecondQuery[J];
-        if (Var->Name == BlockPred && !ModelValsSecondQuery[J].isZero())
+        if (Var->attrs().Name == BlockPred && !ModelValsSecondQuery[J].isZero())
           for (auto B : Blocks)
             for (unsigned I = 0 ; I < B->PredVars.size(); ++I)
               if (B->PredVars[I] == Var)
@@ -458,13 +795,13 @@ ConstantSynthesis::synthesize(SMTLIBSolver *SMTSolver,
 
         if (ConstSet.find(Var) == ConstSet.end()) {
           SubstConstMap.insert(std::pair<Inst *, llvm::APInt>(Var, ModelValsSecondQuery[J]));
-          VC.insert(std::pair<Inst *, llvm::APInt>(Var, ModelValsSecondQuery[J]));
+          VC[Var] = ModelValsSecondQuery[J];
         }
       }
 
       Inst *ConcreteLHS = nullptr;
-      std::map<Inst *, Inst *> InstCache;
-      std::map<Block *, Block *> BlockCache;
+      InstRewriter R(IC, /*CloneVars=*/true);
+      R.setConstMap(&SubstConstMap);
       if (EnableConcreteInterpreter) {
         ConcreteInterpreter CI(Mapping.LHS, VC);
         auto LHSV = CI.evaluateInst(Mapping.LHS);
@@ -474,15 +811,14 @@ ConstantSynthesis::synthesize(SMTLIBSolver *SMTSolver,
         }
         ConcreteLHS = IC.getConst(LHSV.getValue());
       } else {
-        ConcreteLHS = getInstCopy(Mapping.LHS, IC, InstCache,
-                                  BlockCache, &SubstConstMap, true);
+        ConcreteLHS = R.rewrite(Mapping.LHS);
       }
 
-      SubstAnte = IC.getInst(Inst::And, 1,
-                             {IC.getInst(Inst::Eq, 1, {ConcreteLHS,
-                                                       getInstCopy(Mapping.RHS, IC, InstCache,
-                                                                   BlockCache, &SubstConstMap, true)}),
-                              SubstAnte});
+      Inst *Subst = IC.getInst(Inst::Eq, 1, {ConcreteLHS,
+                                             R.rewrite(Mapping.RHS)});
+      SubstAnte = IC.getInst(Inst::And, 1, {Subst, SubstAnte});
+      if (FirstEB && !AddToFirstQuery(Subst))
+        return std::make_error_code(std::errc::protocol_error);
     }
   }
 
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "llvm/ADT/APInt.h"
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SetVector.h"
 #include "llvm/Support/CommandLine.h"
 #include "souper/Infer/AliveDriver.h"
@@ -22,7 +23,11 @@
 
 #include <queue>
 #include <functional>
+#include <memory>
+#include <optional>
 #include <set>
+#include <thread>
+#include <tuple>
 
 static const unsigned MaxTries = 30;
 
@@ -67,10 +72,6 @@ namespace {
   // static cl::opt<unsigned> MaxNumInstructions("souper-enumerative-synthesis-max-instructions",
   //   cl::desc("Maximum number of instructions to synthesize (default=1)."),
   //   cl::init(1));
-  static unsigned MaxV = 300;
-  // static cl::opt<unsigned> MaxV("souper-enumerative-synthesis-max-verification-load",
-  //   cl::desc("Maximum number of guesses verified at once (default=300)."),
-  //   cl::init(300));
   static bool AliveFlagParser = false;
   // static cl::opt<bool, /*ExternalStorage=*/true>
   //   AliveFlagParser("souper-use-alive", cl::desc("Use Alive2 as the backend"),
@@ -139,6 +140,14 @@ namespace {
   // static cl::opt<bool> OnlySynthesizeLop3("souper-only-synthesize-lop3",
   //   cl::desc("Only synthesize lop3(default=false)"),
   //   cl::init(false));
+  static cl::opt<unsigned> VerificationThreads("souper-enumerative-synthesis-verification-threads",
+    cl::desc("Solver queries verifying guesses concurrently (default=1)"),
+    cl::init(1));
+  static cl::opt<bool> ObservationalEquivalence(
+    "souper-enumerative-synthesis-observational-equivalence",
+    cl::desc("Skip guesses that evaluate like a refuted guess on the input "
+             "that refuted it (default=true)"),
+    cl::init(true));
 }
 
 // TODO
@@ -183,7 +192,10 @@ void addGuess(Inst *RHS, unsigned TargetWidth, InstContext &IC, int MaxCost,
     auto NTrunc = IC.getInst(Inst::Trunc, TargetWidth, { RHS });
     addGuess(NTrunc, TargetWidth, IC, MaxCost, Guesses, TooExpensive);
   } else {
-    if (IgnoreCost || souper::cost(RHS) < MaxCost)
+    // the tree cost bounds the cost from above, so only a guess it doesn't
+    // admit needs the walk
+    if (IgnoreCost || RHS->TreeCost < unsigned(MaxCost) ||
+        souper::cost(RHS) < MaxCost)
       Guesses.push_back(RHS);
     else
       TooExpensive++;
@@ -218,18 +230,91 @@ void sortGuesses(Container &Guesses) {
 
 using CallbackType = std::function<bool(Inst *)>;
 
-bool getGuesses(const std::set<Inst *> &Inputs,
-                int Width, int LHSCost,
-                InstContext &IC, Inst *PrevInst, Inst *PrevSlot,
-                int &TooExpensive,
-                PruneFunc prune, CallbackType Generate) {
+namespace {
 
+// The fillers of the hole PrevSlot of PrevInst, or of the root if PrevInst
+// is null, handed out in order of the cost they add to PrevInst. They are
+// made one kind of instruction at a time, and a kind is only made once the
+// fillers left over are no cheaper than a filler of that kind can be, so
+// the expensive kinds are never made if the enumeration stops early.
+class HoleFillers {
+  enum TierKind { Lop3Tier, ConversionTier, UnaryTier, BinaryTier,
+                  TernaryTier };
+  struct Tier {
+    TierKind TK;
+    Inst::Kind K;
+    // no filler of the tier adds less
+    int Bound;
+  };
+  struct Filler {
+    // what the filler adds to the cost of PrevInst, less one per hole since
+    // a hole may be filled by an input that costs nothing
+    int Cost;
+    // breaks ties in the order the fillers were made
+    unsigned Tier;
+    unsigned Pos;
+    Inst *I;
+  };
+  struct Later {
+    bool operator()(const Filler &A, const Filler &B) const {
+      return std::tie(A.Cost, A.Tier, A.Pos) > std::tie(B.Cost, B.Tier, B.Pos);
+    }
+  };
+
+  int Width;
+  int LHSCost;
+  InstContext &IC;
+  int &TooExpensive;
+  std::vector<Inst::Kind> unaryExclList;
+  // the inputs, then the reserved insts and consts I1, C1, I2, C2, C3, I3
+  std::vector<Inst *> Comps;
+  unsigned NumInputs;
+  Inst *I1 = nullptr, *C1 = nullptr, *I2 = nullptr;
+  Inst *C2 = nullptr, *C3 = nullptr, *I3 = nullptr;
+  // a filler shares these with PrevInst and doesn't pay for them
+  std::set<Inst *> PrevInsts;
+  std::vector<Tier> Tiers;
+  size_t NextTier = 0;
+  std::priority_queue<Filler, std::vector<Filler>, Later> Ready;
+
+  void makeLop3(std::vector<Inst *> &Guesses);
+  void makeConversions(std::vector<Inst *> &Guesses);
+  void makeUnary(Inst::Kind K, std::vector<Inst *> &Guesses);
+  void makeBinary(Inst::Kind K, std::vector<Inst *> &Guesses);
+  void makeTernary(Inst::Kind Op, std::vector<Inst *> &Guesses);
+  void fill();
+
+public:
+  HoleFillers(const std::set<Inst *> &Inputs, int Width, int LHSCost,
+              InstContext &IC, Inst *PrevInst, Inst *PrevSlot,
+              int &TooExpensive);
+
+  bool empty() {
+    fill();
+    return Ready.empty();
+  }
+  int nextCost() {
+    fill();
+    return Ready.top().Cost;
+  }
+  Inst *next() {
+    fill();
+    Inst *I = Ready.top().I;
+    Ready.pop();
+    return I;
+  }
+};
+
+HoleFillers::HoleFillers(const std::set<Inst *> &Inputs, int Width,
+                         int LHSCost, InstContext &IC, Inst *PrevInst,
+                         Inst *PrevSlot, int &TooExpensive)
+    : Width(Width), LHSCost(LHSCost), IC(IC), TooExpensive(TooExpensive),
+      Comps(Inputs.begin(), Inputs.end()), NumInputs(Comps.size()) {
   std::vector<Inst *> unaryHoleUsers;
   findInsts(PrevInst, unaryHoleUsers, [PrevSlot](Inst *I) {
     return I->Ops.size() == 1 && I->Ops[0] == PrevSlot;
   });
 
-  std::vector<Inst::Kind> unaryExclList;
   if (unaryHoleUsers.size() == 1 &&
       (unaryHoleUsers[0]->K == Inst::Ctlz ||
        unaryHoleUsers[0]->K == Inst::Cttz ||
@@ -242,369 +327,515 @@ bool getGuesses(const std::set<Inst *> &Inputs,
   if (unaryHoleUsers.size() == 1 && unaryHoleUsers[0]->K == Inst::Freeze)
     unaryExclList.push_back(Inst::Freeze);
 
-  std::vector<Inst *> PartialGuesses;
-  std::vector<Inst *> Comps(Inputs.begin(), Inputs.end());
-
+  std::vector<Inst *> Prev;
+  findInsts(PrevInst, Prev, [](Inst *I) { return true; });
+  PrevInsts.insert(Prev.begin(), Prev.end());
+
+  // A filler without holes can be an Inst PrevInst has already and then
+  // adds nothing, so a tier that makes the kind of such an Inst, or wraps
+  // its fillers in one, can't be put off
+  std::set<Inst::Kind> Shared;
+  for (auto I : Prev)
+    if (!I->Ops.empty() && !I->has(Inst::HasHole))
+      Shared.insert(I->K);
+  auto AddTier = [&](TierKind TK, Inst::Kind K) {
+    std::vector<Inst::Kind> Kinds = {K, Inst::SExt, Inst::ZExt, Inst::Trunc};
+    if (Inst::isOverflowIntrinsicMain(K) || Inst::isOverflowIntrinsicSub(K)) {
+      Inst::Kind Main = Inst::isOverflowIntrinsicMain(K) ?
+        K : Inst::getOverflowComplement(K);
+      Kinds.insert(Kinds.end(), {Inst::ExtractValue, Main,
+                                 Inst::getBasicInstrForOverflow(Main),
+                                 Inst::getOverflowComplement(Main)});
+    }
+    int Bound = Inst::getCost(K);
+    for (auto SK : Kinds)
+      if (Shared.count(SK))
+        Bound = 0;
+    Tiers.push_back({TK, K, Bound});
+  };
 
-  // Lop3
   if (SynthesizeLop3) {
-    auto CompsCopy = Comps;
-    
-    Inst *C1 = IC.createSynthesisConstant(Width, 1);
-    CompsCopy.push_back(C1);
-    Inst *C2 = IC.createSynthesisConstant(Width, 2);
-    CompsCopy.push_back(C2);
-
-    if (!OnlySynthesizeLop3) {
-      Inst *I1 = IC.getReservedInst();
-      CompsCopy.push_back(I1);
-    }
+    AddTier(Lop3Tier, Inst::Lop3);
+    if (OnlySynthesizeLop3)
+      return;
+  }
 
-    for (uint32_t i = 0; i < 256; i++) {
-      for (auto X : CompsCopy) {
-        for (auto Y : CompsCopy) {
-          for (auto Z : CompsCopy) {
-            auto N = IC.getInst(Inst::Lop3, Width, { X, Y, Z, IC.getConst(llvm::APInt(8, i)) });
-            addGuess(N, Width, IC, LHSCost, PartialGuesses, TooExpensive);
-          }
-        }
-      }
+  AddTier(ConversionTier, Inst::ZExt);
+
+  // reservedinst and reservedconsts starts with width 0
+  I1 = IC.getReservedInst();
+  C1 = IC.getReservedConst();
+  I2 = IC.getReservedInst();
+  C2 = IC.getReservedConst();
+  C3 = IC.getReservedConst();
+  I3 = IC.getReservedInst();
+  Comps.insert(Comps.end(), {I1, C1, I2, C2, C3, I3});
+
+  for (auto K : UnaryOperators)
+    AddTier(UnaryTier, K);
+  for (auto K : BinaryOperators)
+    AddTier(BinaryTier, K);
+  for (auto Op : TernaryOperators)
+    AddTier(TernaryTier, Op);
+
+  std::stable_sort(Tiers.begin(), Tiers.end(),
+                   [](const Tier &A, const Tier &B) {
+                     return A.Bound < B.Bound;
+                   });
+}
+
+// Makes the tiers whose fillers could be as cheap as the cheapest ready one
+void HoleFillers::fill() {
+  while (NextTier < Tiers.size() &&
+         (Ready.empty() || Tiers[NextTier].Bound <= Ready.top().Cost)) {
+    const Tier &T = Tiers[NextTier];
+    std::vector<Inst *> Guesses;
+    switch (T.TK) {
+    case Lop3Tier:
+      makeLop3(Guesses);
+      break;
+    case ConversionTier:
+      makeConversions(Guesses);
+      break;
+    case UnaryTier:
+      makeUnary(T.K, Guesses);
+      break;
+    case BinaryTier:
+      makeBinary(T.K, Guesses);
+      break;
+    case TernaryTier:
+      makeTernary(T.K, Guesses);
+      break;
+    }
+    for (unsigned Pos = 0; Pos < Guesses.size(); ++Pos) {
+      std::vector<Inst *> Holes;
+      getHoles(Guesses[Pos], Holes);
+      int Cost = souper::cost(Guesses[Pos], /*IgnoreDepsWithExternalUses=*/false,
+                              PrevInsts) - Holes.size();
+      Ready.push({Cost, unsigned(NextTier), Pos, Guesses[Pos]});
     }
+    ++NextTier;
+  }
+}
+
+void HoleFillers::makeLop3(std::vector<Inst *> &Guesses) {
+  std::vector<Inst *> CompsCopy(Comps.begin(), Comps.begin() + NumInputs);
+
+  CompsCopy.push_back(IC.createSynthesisConstant(Width, 1));
+  CompsCopy.push_back(IC.createSynthesisConstant(Width, 2));
 
-    if (OnlySynthesizeLop3) {
-      for (auto Guess : PartialGuesses) {
-        if (!Generate(Guess)) {
-          break;
+  if (!OnlySynthesizeLop3)
+    CompsCopy.push_back(IC.getReservedInst());
+
+  for (uint32_t i = 0; i < 256; i++) {
+    for (auto X : CompsCopy) {
+      for (auto Y : CompsCopy) {
+        for (auto Z : CompsCopy) {
+          auto N = IC.getInst(Inst::Lop3, Width, { X, Y, Z, IC.getConst(llvm::APInt(8, i)) });
+          addGuess(N, Width, IC, LHSCost, Guesses, TooExpensive);
         }
       }
-      return true;
     }
   }
+}
 
-  // Conversion Operators
-  for (auto Comp : Comps)
-    if (Comp->Width != Width)
-      addGuess(Comp, Width, IC, LHSCost, PartialGuesses, TooExpensive);
+void HoleFillers::makeConversions(std::vector<Inst *> &Guesses) {
+  for (unsigned I = 0; I < NumInputs; ++I)
+    if (Comps[I]->Width != Width)
+      addGuess(Comps[I], Width, IC, LHSCost, Guesses, TooExpensive);
+}
 
-  Inst *I1 = IC.getReservedInst();
-  Comps.push_back(I1);
+void HoleFillers::makeUnary(Inst::Kind K, std::vector<Inst *> &Guesses) {
+  if (std::find(unaryExclList.begin(), unaryExclList.end(), K) != unaryExclList.end())
+    return;
 
-  // Unary Operators
-  for (auto K : UnaryOperators) {
-    if (std::find(unaryExclList.begin(), unaryExclList.end(), K) != unaryExclList.end())
-      continue;
+  if (K != Inst::Freeze && Width <= 1)
+    return;
 
-    if (K != Inst::Freeze && Width <= 1)
+  // the inputs and I1
+  for (auto Comp : llvm::ArrayRef<Inst *>(Comps).drop_back(5)) {
+    if (K == Inst::BSwap && Width % 16 != 0)
       continue;
 
-    for (auto Comp : Comps) {
-      if (K == Inst::BSwap && Width % 16 != 0)
-        continue;
+    if (Comp->K == Inst::ReservedInst) {
+      auto V = IC.createHole(Width);
+      auto N = IC.getInst(K, Width, { V });
+      addGuess(N, Width, IC, LHSCost, Guesses, TooExpensive);
+      continue;
+    }
 
-      if (Comp->K == Inst::ReservedInst) {
-        auto V = IC.createHole(Width);
-        auto N = IC.getInst(K, Width, { V });
-        addGuess(N, Width, IC, LHSCost, PartialGuesses, TooExpensive);
-        continue;
-      }
+    if (Comp->Width != Width)
+      continue;
 
-      if (Comp->Width != Width)
-        continue;
+    // Prune: unary operation on constant
+    if (Comp->K == Inst::ReservedConst)
+      continue;
 
-      // Prune: unary operation on constant
-      if (Comp->K == Inst::ReservedConst)
-        continue;
+    auto N = IC.getInst(K, Width, { Comp });
+    addGuess(N, Width, IC, LHSCost, Guesses, TooExpensive);
+  }
+}
 
-      auto N = IC.getInst(K, Width, { Comp });
-      addGuess(N, Width, IC, LHSCost, PartialGuesses, TooExpensive);
-    }
+void HoleFillers::makeBinary(Inst::Kind K, std::vector<Inst *> &Guesses) {
+  // PRUNE: i1 is a special case for a number of operators
+  if (Width == 1 &&
+      (// these become trivial
+       Inst::isDivRem(K) || Inst::isShift(K) ||
+       // these canonicalize to "xor"
+       K == Inst::Add || K == Inst::Sub || K == Inst::Ne ||
+       // canonicalizes to "and"
+       K == Inst::Mul ||
+       // i1 versions of these do not tend to codegen well
+       K == Inst::SAddSat || K == Inst::UAddSat ||
+       K == Inst::SSubSat || K == Inst::USubSat ||
+       K == Inst::SAddWithOverflow || K == Inst::UAddWithOverflow ||
+       K == Inst::SSubWithOverflow || K == Inst::USubWithOverflow ||
+       K == Inst::SMulWithOverflow || K == Inst::UMulWithOverflow)) {
+    return;
   }
 
-  // reservedinst and reservedconsts starts with width 0
-  Inst *C1 = IC.getReservedConst();
-  Comps.push_back(C1);
-  Inst *I2 = IC.getReservedInst();
-  Comps.push_back(I2);
-
-  for (auto K : BinaryOperators) {
-
-    // PRUNE: i1 is a special case for a number of operators
-    if (Width == 1 &&
-        (// these become trivial
-         Inst::isDivRem(K) || Inst::isShift(K) ||
-         // these canonicalize to "xor"
-         K == Inst::Add || K == Inst::Sub || K == Inst::Ne ||
-         // canonicalizes to "and"
-         K == Inst::Mul ||
-         // i1 versions of these do not tend to codegen well
-         K == Inst::SAddSat || K == Inst::UAddSat ||
-         K == Inst::SSubSat || K == Inst::USubSat ||
-         K == Inst::SAddWithOverflow || K == Inst::UAddWithOverflow ||
-         K == Inst::SSubWithOverflow || K == Inst::USubWithOverflow ||
-         K == Inst::SMulWithOverflow || K == Inst::UMulWithOverflow)) {
+  // the inputs, I1, C1 and I2
+  auto BinaryComps = llvm::ArrayRef<Inst *>(Comps).drop_back(3);
+  for (auto I = BinaryComps.begin(); I != BinaryComps.end(); ++I) {
+    // Prune: only one of (mul x, C), (mul C, x) is allowed
+    if ((Inst::isCommutative(K) || Inst::isOverflowIntrinsicMain(K) ||
+         Inst::isOverflowIntrinsicSub(K)) && (*I)->K == Inst::ReservedConst)
       continue;
-    }
 
-    for (auto I = Comps.begin(); I != Comps.end(); ++I) {
-      // Prune: only one of (mul x, C), (mul C, x) is allowed
-      if ((Inst::isCommutative(K) || Inst::isOverflowIntrinsicMain(K) ||
-           Inst::isOverflowIntrinsicSub(K)) && (*I)->K == Inst::ReservedConst)
-        continue;
+    // Prune: I1 should only be the first argument
+    if ((*I)->K == Inst::ReservedInst && (*I) != I1)
+      continue;
 
-      // Prune: I1 should only be the first argument
-      if ((*I)->K == Inst::ReservedInst && (*I) != I1)
+    // PRUNE: don't try commutative operators both ways
+    auto Start = (Inst::isCommutative(K) ||
+		    Inst::isOverflowIntrinsicMain(K) ||
+		    Inst::isOverflowIntrinsicSub(K)) ? I : BinaryComps.begin();
+    for (auto J = Start; J != BinaryComps.end(); ++J) {
+      // Prune: I2 should only be the second argument
+      if ((*J)->K == Inst::ReservedInst && (*J) != I2)
         continue;
 
-      // PRUNE: don't try commutative operators both ways
-      auto Start = (Inst::isCommutative(K) ||
-		      Inst::isOverflowIntrinsicMain(K) ||
-		      Inst::isOverflowIntrinsicSub(K)) ? I : Comps.begin();
-      for (auto J = Start; J != Comps.end(); ++J) {
-        // Prune: I2 should only be the second argument
-        if ((*J)->K == Inst::ReservedInst && (*J) != I2)
-          continue;
-
-        // PRUNE: never useful to cmp, sub, and, or, xor, div, rem,
-        // usub.sat, ssub.sat, ashr, lshr a value against itself
-        // Also do it for sub.overflow -- no sense to check for overflow when results = 0
-        if ((*I == *J) && (Inst::isCmp(K) || K == Inst::And || K == Inst::Or ||
-                           K == Inst::Xor || K == Inst::Sub || K == Inst::UDiv ||
-                           K == Inst::SDiv || K == Inst::SRem || K == Inst::URem ||
-                           K == Inst::USubSat || K == Inst::SSubSat ||
-                           K == Inst::AShr || K == Inst::LShr || K == Inst::SSubWithOverflow ||
-                           K == Inst::USubWithOverflow || K == Inst::SSubO || K == Inst::USubO))
-          continue;
-
-        // PRUNE: never operate on two constants
-        if ((*I)->K == Inst::ReservedConst && (*J)->K == Inst::ReservedConst)
-          continue;
+      // PRUNE: never useful to cmp, sub, and, or, xor, div, rem,
+      // usub.sat, ssub.sat, ashr, lshr a value against itself
+      // Also do it for sub.overflow -- no sense to check for overflow when results = 0
+      if ((*I == *J) && (Inst::isCmp(K) || K == Inst::And || K == Inst::Or ||
+                         K == Inst::Xor || K == Inst::Sub || K == Inst::UDiv ||
+                         K == Inst::SDiv || K == Inst::SRem || K == Inst::URem ||
+                         K == Inst::USubSat || K == Inst::SSubSat ||
+                         K == Inst::AShr || K == Inst::LShr || K == Inst::SSubWithOverflow ||
+                         K == Inst::USubWithOverflow || K == Inst::SSubO || K == Inst::USubO))
+        continue;
 
-        // see if we need to make a var representing a constant
-        // that we don't know yet
+      // PRUNE: never operate on two constants
+      if ((*I)->K == Inst::ReservedConst && (*J)->K == Inst::ReservedConst)
+        continue;
 
-        Inst *V1, *V2;
-        if (Inst::isCmp(K)) {
+      // see if we need to make a var representing a constant
+      // that we don't know yet
 
-          if ((*I)->Width == 0 && (*J)->Width == 0) {
-            // TODO: support (cmp hole, hole);
-            // TODO: support (cmp hole, c) and (cmp c, hole)
-            continue;
-          }
+      Inst *V1, *V2;
+      if (Inst::isCmp(K)) {
 
-          if ((*I)->Width == 0) {
-            if ((*I)->K == Inst::ReservedConst) {
-              // (cmp const, comp)
-              V1 = IC.createSynthesisConstant((*J)->Width, (*I)->SynthesisConstID);
-            } else if ((*I)->K == Inst::ReservedInst) {
-              // (cmp hole, comp)
-              V1 = IC.createHole((*J)->Width);
-            }
-          } else {
-            V1 = *I;
-          }
+        if ((*I)->Width == 0 && (*J)->Width == 0) {
+          // TODO: support (cmp hole, hole);
+          // TODO: support (cmp hole, c) and (cmp c, hole)
+          continue;
+        }
 
-          if ((*J)->Width == 0) {
-            if ((*J)->K == Inst::ReservedConst) {
-              // (cmp comp, const)
-              V2 = IC.createSynthesisConstant((*I)->Width, (*J)->SynthesisConstID);
-            } else if ((*J)->K == Inst::ReservedInst) {
-              // (cmp comp, hole)
-              V2 = IC.createHole((*I)->Width);
-            }
-          } else {
-            V2 = *J;
-          }
-        } else {
+        if ((*I)->Width == 0) {
           if ((*I)->K == Inst::ReservedConst) {
-            // (binop const, comp)
-            V1 = IC.createSynthesisConstant(Width, (*I)->SynthesisConstID);
+            // (cmp const, comp)
+            V1 = IC.createSynthesisConstant((*J)->Width, (*I)->SynthesisConstID);
           } else if ((*I)->K == Inst::ReservedInst) {
-            // (binop hole, comp)
-            V1 = IC.createHole(Width);
-          } else {
-            V1 = *I;
+            // (cmp hole, comp)
+            V1 = IC.createHole((*J)->Width);
           }
+        } else {
+          V1 = *I;
+        }
 
+        if ((*J)->Width == 0) {
           if ((*J)->K == Inst::ReservedConst) {
-            // (binop comp, const)
-            V2 = IC.createSynthesisConstant(Width, (*J)->SynthesisConstID);
+            // (cmp comp, const)
+            V2 = IC.createSynthesisConstant((*I)->Width, (*J)->SynthesisConstID);
           } else if ((*J)->K == Inst::ReservedInst) {
-            // (binop comp, hole)
-            V2 = IC.createHole(Width);
-          } else {
-            V2 = *J;
+            // (cmp comp, hole)
+            V2 = IC.createHole((*I)->Width);
           }
+        } else {
+          V2 = *J;
+        }
+      } else {
+        if ((*I)->K == Inst::ReservedConst) {
+          // (binop const, comp)
+          V1 = IC.createSynthesisConstant(Width, (*I)->SynthesisConstID);
+        } else if ((*I)->K == Inst::ReservedInst) {
+          // (binop hole, comp)
+          V1 = IC.createHole(Width);
+        } else {
+          V1 = *I;
         }
 
-        if (V1->Width != V2->Width)
-          continue;
+        if ((*J)->K == Inst::ReservedConst) {
+          // (binop comp, const)
+          V2 = IC.createSynthesisConstant(Width, (*J)->SynthesisConstID);
+        } else if ((*J)->K == Inst::ReservedInst) {
+          // (binop comp, hole)
+          V2 = IC.createHole(Width);
+        } else {
+          V2 = *J;
+        }
+      }
 
-        if (!(Inst::isCmp(K) || Inst::isOverflowIntrinsicSub(K)) && V1->Width != Width)
-          continue;
+      if (V1->Width != V2->Width)
+        continue;
 
-        // PRUNE: don't synthesize sub x, C since this is covered by add x, -C
-        if (K == Inst::Sub && V2->K == Inst::Var && V2->SynthesisConstID != 0)
-          continue;
+      if (!(Inst::isCmp(K) || Inst::isOverflowIntrinsicSub(K)) && V1->Width != Width)
+        continue;
 
-        Inst *N = nullptr;
-        if (Inst::isOverflowIntrinsicMain(K)) {
-          auto Comp0 = IC.getInst(Inst::getBasicInstrForOverflow(K), V1->Width, {V1, V2});
-          auto Comp1 = IC.getInst(Inst::getOverflowComplement(K), 1, {V1, V2});
-          auto Orig = IC.getInst(K, V1->Width + 1, {Comp0, Comp1});
-          N = IC.getInst(Inst::ExtractValue, V1->Width, {Orig, IC.getConst(llvm::APInt(32, 0))});
-        }
-        else if (Inst::isOverflowIntrinsicSub(K)) {
-          auto Comp0 = IC.getInst(Inst::getBasicInstrForOverflow(Inst::getOverflowComplement(K)),
-                                  V1->Width, {V1, V2});
-          auto Comp1 = IC.getInst(K, 1, {V1, V2});
-          auto Orig = IC.getInst(Inst::getOverflowComplement(K), V1->Width + 1, {Comp0, Comp1});
-          N = IC.getInst(Inst::ExtractValue, 1, {Orig, IC.getConst(llvm::APInt(32, 1))});
-        }
-        else {
-          N = IC.getInst(K, Inst::isCmp(K) ? 1 : Width, {V1, V2});
-        }
+      // PRUNE: don't synthesize sub x, C since this is covered by add x, -C
+      if (K == Inst::Sub && V2->K == Inst::Var && V2->SynthesisConstID != 0)
+        continue;
 
-        addGuess(N, Width, IC, LHSCost, PartialGuesses, TooExpensive);
+      Inst *N = nullptr;
+      if (Inst::isOverflowIntrinsicMain(K)) {
+        auto Comp0 = IC.getInst(Inst::getBasicInstrForOverflow(K), V1->Width, {V1, V2});
+        auto Comp1 = IC.getInst(Inst::getOverflowComplement(K), 1, {V1, V2});
+        auto Orig = IC.getInst(K, V1->Width + 1, {Comp0, Comp1});
+        N = IC.getInst(Inst::ExtractValue, V1->Width, {Orig, IC.getConst(llvm::APInt(32, 0))});
+      }
+      else if (Inst::isOverflowIntrinsicSub(K)) {
+        auto Comp0 = IC.getInst(Inst::getBasicInstrForOverflow(Inst::getOverflowComplement(K)),
+                                V1->Width, {V1, V2});
+        auto Comp1 = IC.getInst(K, 1, {V1, V2});
+        auto Orig = IC.getInst(Inst::getOverflowComplement(K), V1->Width + 1, {Comp0, Comp1});
+        N = IC.getInst(Inst::ExtractValue, 1, {Orig, IC.getConst(llvm::APInt(32, 1))});
+      }
+      else {
+        N = IC.getInst(K, Inst::isCmp(K) ? 1 : Width, {V1, V2});
       }
+
+      addGuess(N, Width, IC, LHSCost, Guesses, TooExpensive);
     }
   }
+}
 
-  // Deal with ternary instructions separately, since some guesses might
-  // need two reserved per instruction
-  Inst *C2 = IC.getReservedConst();
-  Comps.push_back(C2);
-  Inst *C3 = IC.getReservedConst();
-  Comps.push_back(C3);
-  Inst *I3 = IC.getReservedInst();
-  Comps.push_back(I3);
-
-  for (auto Op : TernaryOperators) {
-    for (auto I : Comps) {
-      if (I->K == Inst::ReservedInst && I != I1)
-        continue;
-      if (I->K == Inst::ReservedConst && I != C1)
-        continue;
+// Ternary instructions are separate, since some guesses might need two
+// reserved per instruction
+void HoleFillers::makeTernary(Inst::Kind Op, std::vector<Inst *> &Guesses) {
+  for (auto I : Comps) {
+    if (I->K == Inst::ReservedInst && I != I1)
+      continue;
+    if (I->K == Inst::ReservedConst && I != C1)
+      continue;
 
-      // (select c, x, y)
-      // PRUNE: a select's control input should never be constant
-      if (Op == Inst::Select && I->K == Inst::ReservedConst)
-        continue;
+    // (select c, x, y)
+    // PRUNE: a select's control input should never be constant
+    if (Op == Inst::Select && I->K == Inst::ReservedConst)
+      continue;
+
+    // PRUNE: don't generate an i1 using funnel shift
+    if (Width == 1 && (Op == Inst::FShr || Op == Inst::FShl))
+      continue;
+
+    Inst *V1;
+    if (I->K == Inst::ReservedConst) {
+      V1 = IC.createSynthesisConstant(Width, I->SynthesisConstID);
+    } else if (I->K == Inst::ReservedInst) {
+      V1 = IC.createHole(Op == Inst::Select ? 1 : Width);
+    } else {
+      V1 = I;
+    }
+
+    if (Op == Inst::Select && V1->Width != 1)
+      continue;
+    if (Op != Inst::Select && V1->Width != Width)
+      continue;
 
-      // PRUNE: don't generate an i1 using funnel shift
-      if (Width == 1 && (Op == Inst::FShr || Op == Inst::FShl))
+    for (auto J : Comps) {
+      if (J->K == Inst::ReservedInst && J != I2)
+        continue;
+      if (J->K == Inst::ReservedConst && J != C2)
         continue;
 
-      Inst *V1;
-      if (I->K == Inst::ReservedConst) {
-        V1 = IC.createSynthesisConstant(Width, I->SynthesisConstID);
-      } else if (I->K == Inst::ReservedInst) {
-        V1 = IC.createHole(Op == Inst::Select ? 1 : Width);
+      Inst *V2;
+      if (J->K == Inst::ReservedConst) {
+        V2 = IC.createSynthesisConstant(Width, J->SynthesisConstID);
+      } else if (J->K == Inst::ReservedInst) {
+        V2 = IC.createHole(Width);
       } else {
-        V1 = I;
+        V2 = J;
       }
 
-      if (Op == Inst::Select && V1->Width != 1)
-        continue;
-      if (Op != Inst::Select && V1->Width != Width)
+      if (V2->Width != Width)
         continue;
 
-      for (auto J : Comps) {
-        if (J->K == Inst::ReservedInst && J != I2)
+      for (auto K : Comps) {
+        if (K->K == Inst::ReservedInst && K != I3)
           continue;
-        if (J->K == Inst::ReservedConst && J != C2)
+        if (K->K == Inst::ReservedConst && K != C3)
           continue;
 
-        Inst *V2;
-        if (J->K == Inst::ReservedConst) {
-          V2 = IC.createSynthesisConstant(Width, J->SynthesisConstID);
-        } else if (J->K == Inst::ReservedInst) {
-          V2 = IC.createHole(Width);
+        // PRUNE: ter-op c, c, c
+        if (I->K == Inst::ReservedConst && J->K == Inst::ReservedConst &&
+            K->K == Inst::ReservedConst)
+          continue;
+
+        // PRUNE: (select cond, x, x)
+        if (Op == Inst::Select && J == K)
+          continue;
+
+        Inst *V3;
+        if (K->K == Inst::ReservedConst) {
+          V3 = IC.createSynthesisConstant(Width, K->SynthesisConstID);
+        } else if (K->K == Inst::ReservedInst) {
+          V3 = IC.createHole(Width);
         } else {
-          V2 = J;
+          V3 = K;
         }
 
-        if (V2->Width != Width)
+        if (V2->Width != V3->Width)
           continue;
 
-        for (auto K : Comps) {
-          if (K->K == Inst::ReservedInst && K != I3)
-            continue;
-          if (K->K == Inst::ReservedConst && K != C3)
-            continue;
-
-          // PRUNE: ter-op c, c, c
-          if (I->K == Inst::ReservedConst && J->K == Inst::ReservedConst &&
-              K->K == Inst::ReservedConst)
-            continue;
-
-          // PRUNE: (select cond, x, x)
-          if (Op == Inst::Select && J == K)
-            continue;
-
-          Inst *V3;
-          if (K->K == Inst::ReservedConst) {
-            V3 = IC.createSynthesisConstant(Width, K->SynthesisConstID);
-          } else if (K->K == Inst::ReservedInst) {
-            V3 = IC.createHole(Width);
-          } else {
-            V3 = K;
-          }
+        auto N = IC.getInst(Op, Width, {V1, V2, V3});
+        addGuess(N, Width, IC, LHSCost, Guesses, TooExpensive);
+      }
+    }
+  }
+}
 
-          if (V2->Width != V3->Width)
-            continue;
+}
 
-          auto N = IC.getInst(Op, Width, {V1, V2, V3});
-          addGuess(N, Width, IC, LHSCost, PartialGuesses, TooExpensive);
-        }
+// Enumerates the guesses best-first. Every queued guess is keyed by a lower
+// bound on the cost of its completions: a hole costs one but may be filled
+// by an input that costs nothing. The fillers of a hole are queued as a
+// stream keyed by the bound of the cheapest guess they can still make, and
+// are plugged in a cost at a time. Complete guesses are therefore handed
+// to Generate in order of increasing cost as soon as they come up, so the
+// first one that verifies is the cheapest and the enumeration can stop
+// there.
+bool getGuesses(const std::set<Inst *> &Inputs,
+                int Width, int LHSCost,
+                InstContext &IC, int &TooExpensive,
+                PruneFunc prune, BatchPruneFunc BatchPrune,
+                CallbackType Generate) {
+  // The fillers of the first hole of a guess still to be plugged in
+  struct Stream {
+    Inst *Guess;
+    Inst *Slot;
+    int Bound;
+    HoleFillers Fillers;
+  };
+  struct Candidate {
+    int Bound;
+    // breaks ties in the order the candidates were found
+    unsigned Order;
+    Inst *Guess;
+    std::vector<Inst *> Slots;
+    std::shared_ptr<Stream> Fillers;
+  };
+  auto Later = [](const Candidate &A, const Candidate &B) {
+    return std::tie(A.Bound, A.Order) > std::tie(B.Bound, B.Order);
+  };
+  std::priority_queue<Candidate, std::vector<Candidate>, decltype(Later)>
+    Queue(Later);
+  unsigned Order = 0;
+
+  auto Open = [&](Inst *PrevInst, Inst *PrevSlot, int Bound, int SlotWidth) {
+    auto S = std::make_shared<Stream>(Stream{
+        PrevInst, PrevSlot, Bound,
+        HoleFillers(Inputs, SlotWidth, LHSCost, IC, PrevInst, PrevSlot,
+                    TooExpensive)});
+    if (!S->Fillers.empty())
+      Queue.push({Bound + S->Fillers.nextCost(), Order++, PrevInst, {}, S});
+  };
+
+  // Plugs the fillers into the hole of the stream and queues the joined
+  // guesses that survive pruning
+  auto Plug = [&](Stream &S, const std::vector<Inst *> &PartialGuesses) {
+    std::vector<Inst *> JoinedGuesses;
+    std::vector<std::vector<Inst *>> Slots;
+    for (auto I : PartialGuesses) {
+      Inst *JoinedGuess;
+      // if this is the root, do not plug it to any other insts
+      if (!S.Guess)
+        JoinedGuess = I;
+      else {
+        // plugin the new guess I to PrevInst
+        std::map<Inst *, Inst *> InstCache;
+        JoinedGuess = instJoin(S.Guess, S.Slot, I, InstCache, IC);
       }
+
+      // get all empty slots from the newly plugged inst
+      std::vector<Inst *> CurrSlots;
+      getHoles(JoinedGuess, CurrSlots);
+      //FIXME: This is inefficient, to do for each symbolic and concrete candidate
+      JoinedGuesses.push_back(JoinedGuess);
+      Slots.push_back(std::move(CurrSlots));
     }
-  }
 
-  // FIXME: This is a bit heavy-handed. Find a way to eliminate this sorting.
-  sortGuesses(PartialGuesses);
-
-  for (auto I : PartialGuesses) {
-    Inst *JoinedGuess;
-    // if it is the first time the function getGuesses() gets called, then
-    // leave it as the root and do not plug it to any other insts
-    if (!PrevInst)
-      JoinedGuess = I;
-    else {
-      // plugin the new guess I to PrevInst
-      std::map<Inst *, Inst *> InstCache;
-      JoinedGuess = instJoin(PrevInst, PrevSlot, I, InstCache, IC);
+    // Cheap pruning goes guess by guess, the survivors are then handed to
+    // the batch pruner all at once
+    std::vector<bool> Feasible(JoinedGuesses.size());
+    std::vector<Inst *> Survivors;
+    for (size_t I = 0; I < JoinedGuesses.size(); ++I) {
+      std::vector<Inst *> ReservedInsts = Slots[I];
+      Feasible[I] = prune(JoinedGuesses[I], ReservedInsts);
+      if (Feasible[I])
+        Survivors.push_back(JoinedGuesses[I]);
+    }
+    if (BatchPrune && !Survivors.empty()) {
+      auto Verdicts = BatchPrune(Survivors);
+      for (size_t I = 0, S = 0; I < JoinedGuesses.size(); ++I)
+        if (Feasible[I])
+          Feasible[I] = Verdicts[S++];
     }
 
-    // get all empty slots from the newly plugged inst
-    std::vector<Inst *> CurrSlots;
-    getHoles(JoinedGuess, CurrSlots);
-    //FIXME: This is inefficient, to do for each symbolic and concrete candidate
+    for (size_t I = 0; I < JoinedGuesses.size(); ++I) {
+      if (!Feasible[I])
+        continue;
+      Inst *JoinedGuess = JoinedGuesses[I];
 
-    // if no empty slot, then push the guess to the result list
-    if (CurrSlots.empty()) {
-      std::vector<Inst *> empty;
-      if (prune(JoinedGuess, empty)) {
+      // if no empty slot, then the guess is complete
+      if (Slots[I].empty()) {
         std::vector<Inst *> ConcreteTypedGuesses;
         addGuess(JoinedGuess, JoinedGuess->Width, IC, LHSCost, ConcreteTypedGuesses, TooExpensive);
-        for (auto &&Guess : ConcreteTypedGuesses) {
-          if (!Generate(Guess)) {
-            return false;
-          }
-        }
+        for (auto &&Guess : ConcreteTypedGuesses)
+          Queue.push({souper::cost(Guess), Order++, Guess, {}, nullptr});
+        continue;
       }
-      continue;
+
+      int Bound = souper::cost(JoinedGuess) - Slots[I].size();
+      Queue.push({Bound, Order++, JoinedGuess, std::move(Slots[I]), nullptr});
     }
+  };
 
-    // if there exist empty slots, then call getGuesses() recursively
-    // and fill the empty slots
-    if (prune(JoinedGuess, CurrSlots)) {
-      // TODO: replace this naive hole selection with some better algorithms
-      if (!getGuesses(Inputs, CurrSlots.front()->Width,
-                      LHSCost, IC, JoinedGuess,
-                      CurrSlots.front(), TooExpensive, prune, Generate)) {
-        return false;
+  Open(nullptr, nullptr, 0, Width);
+  while (!Queue.empty()) {
+    Candidate C = Queue.top();
+    Queue.pop();
+    if (C.Fillers) {
+      // the fillers adding the least go to the pruner as one batch, the
+      // rest wait for their turn
+      auto &Fillers = C.Fillers->Fillers;
+      std::vector<Inst *> Batch;
+      int Cost = Fillers.nextCost();
+      while (!Fillers.empty() && Fillers.nextCost() == Cost)
+        Batch.push_back(Fillers.next());
+      Plug(*C.Fillers, Batch);
+      if (!Fillers.empty()) {
+        C.Bound = C.Fillers->Bound + Fillers.nextCost();
+        Queue.push(C);
       }
+      continue;
+    }
+    if (C.Slots.empty()) {
+      if (!Generate(C.Guess))
+        return false;
+      continue;
     }
+    // TODO: replace this naive hole selection with some better algorithms
+    Open(C.Guess, C.Slots.front(), C.Bound, C.Slots.front()->Width);
   }
   return true;
 }
@@ -677,7 +908,7 @@ std::error_code synthesizeWithAlive(SynthesisContext &SC, std::vector<Inst *> &R
     Ante = SC.IC.getInst(Inst::And, 1, {Ante, Eq});
   }
 
-  AliveDriver Verifier(SC.LHS, Ante, SC.IC);
+  auto &Verifier = AliveDriver::get(SC.LHS, Ante, SC.IC);
   Inst *RHS;
   for (auto &&G : Guesses) {
     std::set<const Inst *> Visited;
@@ -724,26 +955,193 @@ std::error_code synthesizeWithAlive(SynthesisContext &SC, std::vector<Inst *> &R
   return EC;
 }
 
-std::error_code isConcreteCandidateSat(SynthesisContext &SC, Inst *RHSGuess, bool &IsSat) {
+namespace {
+
+// Observational equivalence over the counterexamples of failed
+// verifications. On each counterexample, the guesses without holes or
+// constants fall into classes by the value they take there, and the class
+// of the guess it refuted is refuted with it: its members fail on that input
+// just like that guess, so they are skipped without a query. Each new
+// counterexample splits the classes further. A guess is only skipped for an
+// input it fails on, so the results are the same unless the interpreter
+// disagrees with the solver about a value, and then a result can be missed
+// but never made up, since every result is still verified.
+class ObservationalClasses {
+  struct Counterexample {
+    std::vector<Inst *> ModelInsts;
+    std::vector<llvm::APInt> ModelVals;
+    ConcreteInterpreter Input;
+    // values of the guesses it refuted
+    std::vector<llvm::APInt> Refuted;
+  };
+  std::vector<Counterexample> Counterexamples;
+
+  // Only guesses whose value the interpreter computes exactly from the
+  // inputs are classed
+  static bool isClosed(Inst *Guess) {
+    if (Guess->has(Inst::HasHole | Inst::HasReserved | Inst::HasPhi |
+                   Inst::HasCustom | Inst::HasSynthesisConst))
+      return false;
+    std::vector<Inst *> Freezes;
+    findInsts(Guess, Freezes, [](Inst *I) { return I->K == Inst::Freeze; });
+    return Freezes.empty();
+  }
+
+  // The value of Guess on the input, if the input covers its variables
+  static std::optional<llvm::APInt> evaluate(Counterexample &C, Inst *Guess) {
+    std::vector<Inst *> Vars;
+    findVars(Guess, Vars);
+    for (auto V : Vars)
+      if (!C.Input.getCache().getNumbering().contains(V))
+        return std::nullopt;
+    auto V = C.Input.evaluateInst(Guess);
+    if (!V.hasValue())
+      return std::nullopt;
+    return V.getValue();
+  }
+
+public:
+  unsigned NumSkipped = 0;
+
+  bool isRefuted(Inst *Guess) {
+    if (!isClosed(Guess))
+      return false;
+    for (auto &C : Counterexamples) {
+      auto V = evaluate(C, Guess);
+      if (V && std::find(C.Refuted.begin(), C.Refuted.end(), *V) !=
+               C.Refuted.end()) {
+        ++NumSkipped;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Records that the model of a failed verification refutes Guess
+  void addRefuted(Inst *Guess, const std::vector<Inst *> &ModelInsts,
+                  const std::vector<llvm::APInt> &ModelVals) {
+    if (!isClosed(Guess) || ModelInsts.size() != ModelVals.size())
+      return;
+    // models repeat, and one input then refutes several classes
+    auto It = std::find_if(Counterexamples.begin(), Counterexamples.end(),
+                           [&](const Counterexample &C) {
+                             return C.ModelInsts == ModelInsts &&
+                                    C.ModelVals == ModelVals;
+                           });
+    if (It == Counterexamples.end()) {
+      ValueCache Input;
+      for (size_t I = 0; I < ModelInsts.size(); ++I)
+        Input[ModelInsts[I]] = ModelVals[I];
+      Counterexamples.push_back({ModelInsts, ModelVals,
+                                 ConcreteInterpreter(std::move(Input)), {}});
+      It = std::prev(Counterexamples.end());
+    }
+    if (auto V = evaluate(*It, Guess))
+      It->Refuted.push_back(*V);
+  }
+};
+
+}
+
+// The verification query of a guess without constants, and its answer
+struct ConcreteCheck {
+  std::string Query;
+  bool WantModel = false;
+  // the model of a failed guess becomes an input set for the pruner
+  std::vector<Inst *> ModelInsts;
+  std::vector<llvm::APInt> ModelVals;
+  bool IsSat = false;
   std::error_code EC;
+  // not checked, since it fails like a refuted guess
+  bool Refuted = false;
+};
+
+ConcreteCheck buildConcreteCheck(SynthesisContext &SC, Inst *RHSGuess,
+                                 bool WantModel) {
+  ConcreteCheck Check;
+  Check.WantModel = WantModel;
   InstMapping Mapping(SC.LHS, RHSGuess);
+  Check.Query = BuildQuery(SC.IC, SC.BPCs, SC.PCs, Mapping,
+                           WantModel ? &Check.ModelInsts : 0, 0);
+  return Check;
+}
 
-  std::string Query2 = BuildQuery(SC.IC, SC.BPCs, SC.PCs, Mapping, 0, 0);
+// Touches neither the InstContext nor anything shared besides Solver
+void runConcreteCheck(SMTLIBSolver *Solver, ConcreteCheck &Check,
+                      unsigned Timeout) {
+  Check.EC = Solver->isSatisfiable(Check.Query, Check.IsSat,
+                                   Check.ModelInsts.size(),
+                                   Check.WantModel ? &Check.ModelVals : 0,
+                                   Timeout);
+  Check.Query.clear();
+}
 
-  EC = SC.SMTSolver->isSatisfiable(Query2, IsSat, 0, 0, SC.Timeout);
-  if (EC && DebugLevel > 1) {
-    llvm::errs() << "verification query failed!\n";
+// Answers the checks of the guesses without constants starting at Begin,
+// one per solver, and returns the index after the last guess covered. The
+// queries are built on this thread since that needs the InstContext, then
+// every solver answers one of them on its own thread.
+size_t runConcreteChecks(SynthesisContext &SC,
+                         const std::vector<Inst *> &Guesses,
+                         const std::vector<bool> &HasConstant, size_t Begin,
+                         std::vector<ConcreteCheck> &Checks,
+                         std::vector<SMTLIBSolver *> &Solvers,
+                         bool WantModels, ObservationalClasses *Classes) {
+  std::vector<size_t> Batch;
+  size_t End = Begin;
+  for (; End < Guesses.size() && Batch.size() < Solvers.size(); ++End) {
+    if (HasConstant[End])
+      continue;
+    if (Classes && Classes->isRefuted(Guesses[End])) {
+      Checks[End].Refuted = true;
+      continue;
+    }
+    Checks[End] = buildConcreteCheck(SC, Guesses[End], WantModels);
+    Batch.push_back(End);
   }
-  return EC;
+
+  std::vector<std::thread> Threads;
+  for (size_t T = 1; T < Batch.size(); ++T)
+    Threads.emplace_back(runConcreteCheck, Solvers[T], std::ref(Checks[Batch[T]]),
+                         SC.Timeout);
+  if (!Batch.empty())
+    runConcreteCheck(Solvers[0], Checks[Batch[0]], SC.Timeout);
+  for (auto &T : Threads)
+    T.join();
+  return End;
 }
 
 std::error_code synthesizeWithKLEE(SynthesisContext &SC, std::vector<Inst *> &RHSs,
-                                   const std::vector<souper::Inst *> &Guesses) {
+                                   const std::vector<souper::Inst *> &Guesses,
+                                   PruningManager *Pruner,
+                                   ObservationalClasses *Classes) {
   std::error_code EC;
 
   // find the valid one
   int GuessIndex = -1;
 
+  std::vector<bool> HasConstant;
+  for (auto I : Guesses) {
+    std::set<Inst *> ConstSet;
+    souper::getConstants(I, ConstSet);
+    souper::getConstants(SC.LHS, ConstSet);
+    HasConstant.push_back(!ConstSet.empty());
+  }
+
+  // The guesses without constants need a single query each, those are
+  // answered ahead by several solvers at once. The guesses are still
+  // accepted in order, so the cheapest valid guess wins as before.
+  std::vector<std::unique_ptr<SMTLIBSolver>> Clones;
+  std::vector<SMTLIBSolver *> Solvers = {SC.SMTSolver};
+  for (unsigned T = 1; T < VerificationThreads; ++T) {
+    auto Clone = SC.SMTSolver->clone();
+    if (!Clone)
+      break;
+    Solvers.push_back(Clone.get());
+    Clones.push_back(std::move(Clone));
+  }
+  std::vector<ConcreteCheck> Checks(Guesses.size());
+  size_t ChecksEnd = 0;
+
   if (DebugLevel > 2) {
     llvm::errs() << "\n--------------------- synthesizeWithKLEE ---------------------------\n";
     ReplacementContext Context;
@@ -769,11 +1167,27 @@ std::error_code synthesizeWithKLEE(SynthesisContext &SC, std::vector<Inst *> &RH
     std::map <Inst *, llvm::APInt> ResultConstMap;
     souper::getConstants(I, ConstSet);
     souper::getConstants(SC.LHS, ConstSet);
-    bool GuessHasConstant = !ConstSet.empty();
+    bool GuessHasConstant = HasConstant[GuessIndex];
     if (!GuessHasConstant) {
-      bool IsSAT;
-
-      EC = isConcreteCandidateSat(SC, I, IsSAT);
+      if ((size_t)GuessIndex >= ChecksEnd)
+        ChecksEnd = runConcreteChecks(SC, Guesses, HasConstant, GuessIndex,
+                                      Checks, Solvers,
+                                      Pruner || Classes, Classes);
+      auto &Check = Checks[GuessIndex];
+      if (Check.Refuted) {
+        if (DebugLevel > 3)
+          llvm::errs() << "this guess fails like a refuted one\n";
+        continue;
+      }
+      bool IsSAT = Check.IsSat;
+      EC = Check.EC;
+      if (EC && DebugLevel > 1) {
+        llvm::errs() << "verification query failed!\n";
+      }
+      if (!EC && IsSAT && Pruner)
+        Pruner->addCounterexample(Check.ModelInsts, Check.ModelVals);
+      if (!EC && IsSAT && Classes)
+        Classes->addRefuted(I, Check.ModelInsts, Check.ModelVals);
       if (EC) {
         if (DebugLevel > 0)
           llvm::errs() << "OOPS: error from isConcreteCanddiateSat()\n";
@@ -800,7 +1214,7 @@ std::error_code synthesizeWithKLEE(SynthesisContext &SC, std::vector<Inst *> &RH
       std::map<Block *, Block *> BlockCache;
       RHS = getInstCopy(I, SC.IC, InstCache, BlockCache, &ResultConstMap, false, false);
       auto NewLHS = getInstCopy(SC.LHS, SC.IC, InstCache, BlockCache, &ResultConstMap, false, false);
-      RHS->Aux = NewLHS;
+      RHS->mutableAttrs().Aux = NewLHS;
     }
 
     assert(RHS);
@@ -863,13 +1277,15 @@ std::error_code synthesizeWithKLEE(SynthesisContext &SC, std::vector<Inst *> &RH
 }
 
 std::error_code verify(SynthesisContext &SC, std::vector<Inst *> &RHSs,
-                       const std::vector<souper::Inst *> &Guesses) {
+                       const std::vector<souper::Inst *> &Guesses,
+                       PruningManager *Pruner = nullptr,
+                       ObservationalClasses *Classes = nullptr) {
   std::error_code EC;
   if (SkipSolver || Guesses.empty())
     return EC;
 
   return UseAlive ? synthesizeWithAlive(SC, RHSs, Guesses) :
-                    synthesizeWithKLEE(SC, RHSs, Guesses);
+                    synthesizeWithKLEE(SC, RHSs, Guesses, Pruner, Classes);
 }
 
 std::error_code
@@ -915,23 +1331,33 @@ EnumerativeSynthesis::synthesize(SMTLIBSolver *SMTSolver,
   std::vector<PruneFunc> PruneFuncs = { [&Visited](Inst *I, std::vector<Inst*> &ReservedInsts)  {
     return CountPrune(I, ReservedInsts, Visited);
   }};
+  BatchPruneFunc BatchPrune;
+  PruningManager *Pruner = nullptr;
   if (EnableDataflowPruning) {
     DataflowPruning.init();
-    PruneFuncs.push_back(DataflowPruning.getPruneFunc());
+    BatchPrune = DataflowPruning.getBatchPruneFunc();
+    Pruner = &DataflowPruning;
   }
+  ObservationalClasses Observed;
+  ObservationalClasses *Classes = ObservationalEquivalence ? &Observed : nullptr;
   auto PruneCallback = MkPruneFunc(PruneFuncs);
 
   std::vector<Inst *> Guesses;
-
-  auto Generate = [&SC, &Guesses, &RHSs, &EC](Inst *Guess) {
+  unsigned NumGuesses = 0;
+
+  // The guesses come in order of increasing cost and are verified as they
+  // come, held back only until there is one for every verification thread
+  auto Generate = [&SC, &Guesses, &NumGuesses, &RHSs, &EC, Pruner,
+                   Classes](Inst *Guess) {
+    ++NumGuesses;
+    if (SkipSolver)
+      return true;
     Guesses.push_back(Guess);
-    if (Guesses.size() >= MaxV && !SkipSolver) {
-      sortGuesses(Guesses);
-      EC = verify(SC, RHSs, Guesses);
-      Guesses.clear();
-      return SC.CheckAllGuesses || (!SC.CheckAllGuesses && RHSs.empty()); // Continue if no RHS
-    }
-    return true;
+    if (Guesses.size() < VerificationThreads)
+      return true;
+    EC = verify(SC, RHSs, Guesses, Pruner, Classes);
+    Guesses.clear();
+    return SC.CheckAllGuesses || (!SC.CheckAllGuesses && RHSs.empty()); // Continue if no RHS
   };
 
   // add constant guess
@@ -947,23 +1373,33 @@ EnumerativeSynthesis::synthesize(SMTLIBSolver *SMTSolver,
     }
   }
 
+  NumGuesses = Guesses.size();
   if (DebugLevel > 1)
     llvm::errs() << "There are " << Guesses.size() << " guesses before enumeration\n";
 
-  if (MaxNumInstructions > 0)
+  // these cost nothing, so they go before any enumerated guess
+  sortGuesses(Guesses);
+  EC = verify(SC, RHSs, Guesses, Pruner, Classes);
+  Guesses.clear();
+
+  if (MaxNumInstructions > 0 && (SC.CheckAllGuesses || RHSs.empty()))
     getGuesses(Cands, SC.LHS->Width,
-               LHSCost, SC.IC, nullptr, nullptr, TooExpensive, PruneCallback, Generate);
+               LHSCost, SC.IC, TooExpensive, PruneCallback,
+               BatchPrune, Generate);
 
   if (DebugLevel > 1) {
     DataflowPruning.printStats(llvm::errs());
-    llvm::errs() << "There are " << Guesses.size() << " total guesses\n";
+    llvm::errs() << "There are " << NumGuesses << " total guesses\n";
     llvm::errs() << "(" << TooExpensive << " guesses were too expensive)\n";
   }
 
-  if (!Guesses.empty() && !SkipSolver) {
-    sortGuesses(Guesses);
-    EC = verify(SC, RHSs, Guesses);
-  }
+  // the guesses that didn't fill the last round
+  if (!Guesses.empty())
+    EC = verify(SC, RHSs, Guesses, nullptr, Classes);
+
+  if (DebugLevel > 1 && Classes)
+    llvm::errs() << "(" << Classes->NumSkipped
+                 << " guesses failed like a refuted guess)\n";
 
   // RHSs count, before duplication
   if (DebugLevel > 3)
@@ -1020,8 +1456,8 @@ EnumerativeSynthesis::generateExprs(InstContext &IC, size_t CountLimit,
     VarSet.insert(V);
   }
 
-  getGuesses(VarSet, Width, TooExpensive, IC, nullptr,
-             nullptr, TooExpensive, PruneCallback, Generate);
+  getGuesses(VarSet, Width, TooExpensive, IC,
+             TooExpensive, PruneCallback, nullptr, Generate);
 
   return Guesses;
 }
@@ -17,7 +17,10 @@
 #include "souper/Extractor/ExprBuilder.h"
 #include "souper/Infer/InstSynthesis.h"
 
+#include <algorithm>
+#include <deque>
 #include <queue>
+#include <thread>
 
 using namespace souper;
 using namespace llvm;
@@ -44,6 +47,14 @@ static cl::opt<unsigned> MaxWiringAttempts("souper-synthesis-wiring-iterations",
     cl::Hidden,
     cl::desc("Number of convergence iterations of wirings that contain constants"),
     cl::init(10));
+static cl::opt<bool> Incremental("souper-synthesis-incremental",
+    cl::desc("Keep one solver context alive across the refinement rounds "
+             "of a synthesis run (default=true)"),
+    cl::init(true));
+static cl::opt<unsigned> ParallelCompNums("souper-synthesis-parallel-comp-nums",
+    cl::desc("Number of component counts whose wiring queries are solved "
+             "at once, each on its own solver (default=1)"),
+    cl::init(1));
 
 }
 
@@ -116,6 +127,16 @@ std::error_code InstSynthesis::synthesize(SMTLIBSolver *SMTSolver,
   // we'll have to copy WiringQuery and replace its inputs with the new
   // concrete values from S
   std::vector<std::map<Inst *, Inst *>> S;
+  InputWirings.clear();
+
+  // In incremental mode one solver context serves every query of this
+  // synthesis run instead of a fresh solver per query
+  std::unique_ptr<SMTLIBSolver> Session;
+  if (Incremental)
+    Session = SMTSolver->startSession();
+  if (Session)
+    LSMTSolver = Session.get();
+
   // Ask the solver for four initial concrete inputs.
   // The number 4 was derived experimentally giving a good overall speed-up
   // for both small and big synthesis queries
@@ -142,157 +163,99 @@ std::error_code InstSynthesis::synthesize(SMTLIBSolver *SMTSolver,
   if (MaxCompNum > (int)Comps.size())
     MaxCompNum = Comps.size();
 
-  // Iterative synthesis loop with increasing number of components
-  for (int J = 0; J <= MaxCompNum; ++J) {
-    Inst *CompConstraint;
+  // Iterative synthesis loop with increasing number of components. Each
+  // component number is searched by its own lane; with
+  // -souper-synthesis-parallel-comp-nums > 1 the wiring queries of several
+  // lanes are solved at once, each lane on a solver of its own. All lanes
+  // share the counterexamples in S.
+  unsigned NumLanes = std::max(1u, (unsigned)ParallelCompNums);
+  ParallelLanes = NumLanes > 1;
+  std::deque<SynthesisLane> Lanes;
+  int NextCompNum = 0;
+  // A lane whose query fails or times out is dropped while the others keep
+  // searching; its error is only reported if no lane finds a program
+  std::error_code LaneEC;
+  auto DropLane = [&](SynthesisLane &Lane, std::error_code LaneError) {
     if (DebugLevel > 1)
-      llvm::outs() << "synthesizing using " << J << " component(s)\n";
-    // If synthesis using 0 components failed (aka nop synthesis),
-    // don't subsequently wire the output to the input(s)
-    if (J == 0)
-      CompConstraint = getOutputLocVarConstraint(0, N, IC);
-    else
-      CompConstraint = getOutputLocVarConstraint(N, N+J, IC);
-    // Init fresh loop PCs
-    auto LoopPCs = WiringPCs;
-    LoopPCs.emplace_back(CompConstraint, TrueConst);
-
-    // --------------------------------------------------------------------------
-    // -------------- Counterexample driven synthesis loop ----------------------
-    // --------------------------------------------------------------------------
-    unsigned Refinements = 0;
-    while (true) {
-      Inst *Query = TrueConst;
-      // Put each set of concrete inputs into a separate copy of the WiringQuery
-      // Solve the synthesis constraint.
-      Query = initConcreteInputWirings(Query, WiringQuery, Refinements, S);
-
-      // Each solution corresponds to a syntactically distinct and well-formed
-      // straight-line program obtained by composition of given components
-      std::vector<Inst *> ModelInsts;
-      std::vector<llvm::APInt> ModelVals;
-      InstMapping Mapping(Query, TrueConst);
-      // Negate the query to get a SAT model.
-      // Don't use original BPCs/PCs, they are useless
-      std::string QueryStr = BuildQuery(IC, {}, LoopPCs, Mapping,
-                                        &ModelInsts, /*Precondition=*/0, /*Negate=*/true);
-      if (QueryStr.empty())
-        return std::make_error_code(std::errc::value_too_large);
-      bool IsSat;
-      if (DebugLevel > 1)
-        llvm::outs() << "solving synthesis constraint.. ";
-      EC = SMTSolver->isSatisfiable(QueryStr, IsSat, ModelInsts.size(),
-                                    &ModelVals, Timeout);
-      if (EC)
+      llvm::outs() << "dropping a lane: " << LaneError.message() << "\n";
+    Lane.Done = true;
+    Lane.Result = nullptr;
+    if (!LaneEC)
+      LaneEC = LaneError;
+  };
+  while (true) {
+    // Programs are accepted in the order of their number of components, so
+    // a lane that found one waits until all lanes before it are exhausted
+    while (!Lanes.empty() && Lanes.front().Done) {
+      if (Lanes.front().Result) {
+        RHS = Lanes.front().Result;
         return EC;
-
-      // No valid wiring exists for the target comp number
-      if (!IsSat) {
-        if (DebugLevel > 1)
-          llvm::outs() << "UNSAT\n";
-        break;
       }
+      Lanes.pop_front();
+    }
 
+    unsigned Active = 0;
+    for (auto const &Lane : Lanes)
+      if (!Lane.Done)
+        ++Active;
+    for (; Active < NumLanes && NextCompNum <= MaxCompNum; ++Active) {
+      int J = NextCompNum++;
       if (DebugLevel > 1)
-        llvm::outs() << "SAT\n";
-
-      ProgramWiring CandWiring;
-      std::map<LocVar, llvm::APInt> ConstValMap;
-      Inst *Cand = createInstFromModel(std::make_pair(ModelInsts, ModelVals),
-                                       CandWiring, ConstValMap, IC);
-      if (!Cand)
-        report_fatal_error("synthesis bug: creating inst from a model failed");
-
-      if (DebugLevel > 1) {
-        llvm::outs() << "candidate:\n";
-        PrintReplacementRHS(llvm::outs(), Cand, Context);
-      }
+        llvm::outs() << "synthesizing using " << J << " component(s)\n";
+      Lanes.emplace_back();
+      auto &Lane = Lanes.back();
+      // If synthesis using 0 components failed (aka nop synthesis),
+      // don't subsequently wire the output to the input(s)
+      Inst *CompConstraint;
+      if (J == 0)
+        CompConstraint = getOutputLocVarConstraint(0, N, IC);
+      else
+        CompConstraint = getOutputLocVarConstraint(N, N+J, IC);
+      // Init fresh loop PCs
+      Lane.LoopPCs = WiringPCs;
+      Lane.LoopPCs.emplace_back(CompConstraint, TrueConst);
+      Lane.Solver = LSMTSolver;
+      // In incremental mode each lane keeps its wiring query in a session
+      // of its own, which the candidate checks on LSMTSolver don't see
+      if (Incremental)
+        Lane.OwnedSolver = SMTSolver->startSession();
+      if (!Lane.OwnedSolver && ParallelLanes)
+        Lane.OwnedSolver = SMTSolver->clone();
+      // Lanes that can't get a solver of their own are solved one at a time
+      if (Lane.OwnedSolver)
+        Lane.Solver = Lane.OwnedSolver.get();
+      else
+        ParallelLanes = false;
+    }
+    if (Lanes.empty())
+      break;
+
+    // --------------------------------------------------------------------------
+    // -------------- Counterexample driven synthesis loop ----------------------
+    // --------------------------------------------------------------------------
+    // Put each set of concrete inputs into a separate copy of the WiringQuery
+    Inst *Query = initConcreteInputWirings(WiringQuery, S);
 
-      // The synthesis loop assumes that each component has a cost of one.
-      // However, this is not the case for all components (e.g., bswap).
-      // Moreover, some components can be comprised of two components to meet
-      // the DefaultWidth criteria. For example, if the DefaultWidth is 32
-      // and the engine uses ule during synthesis, the instantiation of ule
-      // would be zext(ule) to 32 and sext(ule) to 32. Therefore, the cost
-      // of such a component would be two and not one. To address this issue,
-      // we forbid candidates that have no cost benefit and continue to search
-      // for others
-      int CandCost = cost(Cand);
-      int Benefit = benefit(LHS, Cand);
-      if (!IgnoreCost && Benefit <= 0) {
-        if (DebugLevel > 1)
-          llvm::outs() << "candidate has no benefit\n";
-        forbidInvalidCandWiring(CandWiring, LoopPCs, WiringPCs, IC);
+    std::vector<SynthesisLane *> Round;
+    for (auto &Lane : Lanes) {
+      if (Lane.Done)
+        continue;
+      if (auto BuildEC = buildWiringQuery(Lane, Query)) {
+        DropLane(Lane, BuildEC);
         continue;
       }
+      Round.push_back(&Lane);
+    }
 
-      // Does the candidate work for all inputs?
-      // Use original BPCs/PCs
-      ModelInsts.clear();
-      ModelVals.clear();
-      InstMapping CandMapping(LHS, Cand);
-      QueryStr = BuildQuery(IC, BPCs, PCs, CandMapping, &ModelInsts, /*Precondition=*/0, /*Negate=*/false);
-      if (QueryStr.empty())
-        return std::make_error_code(std::errc::value_too_large);
-      EC = SMTSolver->isSatisfiable(QueryStr, IsSat, ModelInsts.size(),
-                                    &ModelVals, Timeout);
-      if (EC)
-        return EC;
-
-      // Success
-      if (!IsSat) {
-        if (DebugLevel > 1)
-          llvm::outs() << "success:\n";
-        if (DebugLevel > 0) {
-          PrintReplacementRHS(llvm::outs(), Cand, Context);
-          llvm::outs() << "; LHS cost = " << LHSCost
-                       << ", RHS cost = " << CandCost
-                       << ", benefit = " << (Benefit > 0 ? Benefit : 0)
-                       << "\n";
-        }
-        RHS = Cand;
-        return EC;
-      }
+    // Solve the synthesis constraint.
+    if (DebugLevel > 1)
+      llvm::outs() << "solving synthesis constraint.. ";
+    solveLanes(Round);
 
-      Refinements++;
-      if (DebugLevel > 1)
-        llvm::outs() << "didn't work for all inputs "
-                     << "(#cex: "<< S.size()+1 << ", "
-                     << "refinement: " << Refinements << ")\n";
-      // Parse input counterexamples from the model
-      std::map<Inst *, Inst *> InputMap;
-      for (unsigned J = 0; J < ModelInsts.size(); ++J) {
-        auto Name = ModelInsts[J]->Name;
-        if (Name.find(INPUT_PREFIX) != std::string::npos) {
-          auto In = ModelInsts[J];
-          auto Val = ModelVals[J];
-          InputMap[In] = IC.getConst(Val);
-          if (DebugLevel > 2)
-            llvm::outs() << "counterexample: " << Name << " = " << Val << "\n";
-        }
-      }
-      // Counterexamples should be unique in each iteration
-      bool CexExists = false;
-      for (auto const &E : S)
-        if (std::equal(E.begin(), E.end(), InputMap.begin())) {
-          CexExists = true;
-          break;
-        }
-      // Add counterexamples to S
-      if (!CexExists)
-        S.push_back(InputMap);
-
-      // Constants are not constrained by the inputs, thus, we must explicitly
-      // constrain the not-working cand wiring incl. the constants and forbid
-      // the wiring completely after MaxWiringAttempts is reached
-      if (hasConst(Cand)) {
-        constrainConstWiring(Cand, CandWiring, NotWorkingConstWirings,
-                             ConstValMap, LoopPCs, WiringPCs);
-      } else {
-        // Forbid invalid constant-free wirings explicitly in the future,
-        // so they don't show up in the wiring result
-        forbidInvalidCandWiring(CandWiring, LoopPCs, WiringPCs, IC);
-      }
+    for (auto *Lane : Round) {
+      if (auto RefineEC = refineLane(*Lane, S, NotWorkingConstWirings,
+                                     WiringPCs, LHSCost))
+        DropLane(*Lane, RefineEC);
     }
   }
 
@@ -308,6 +271,212 @@ std::error_code InstSynthesis::synthesize(SMTLIBSolver *SMTSolver,
     llvm::outs() << "\n";
   }
 
+  return LaneEC;
+}
+
+std::error_code InstSynthesis::buildWiringQuery(SynthesisLane &Lane,
+                                                Inst *Query) {
+  InstContext &IC = *LIC;
+  Lane.ModelVals.clear();
+
+  if (Lane.EB) {
+    // The session holds the query of an earlier round, so it only needs the
+    // copies for the input sets and the loop PCs added since
+    Inst *New = TrueConst;
+    for (size_t K = Lane.NumWirings; K < InputWirings.size(); ++K) {
+      Inst *Copy = InputWirings[K];
+      New = IC.getInst(Inst::And, 1, {New, Copy});
+      New = IC.getInst(Inst::And, 1, {New, Lane.EB->getUBInstCondition(Copy)});
+    }
+    for (size_t K = Lane.NumPCs; K < Lane.LoopPCs.size(); ++K) {
+      auto const &PC = Lane.LoopPCs[K];
+      Inst *Eq = IC.getInst(Inst::Eq, 1, {PC.LHS, PC.RHS});
+      New = IC.getInst(Inst::And, 1, {New, Eq});
+      New = IC.getInst(Inst::And, 1, {New, Lane.EB->getUBInstCondition(Eq)});
+    }
+    if (New != TrueConst &&
+        !Lane.OwnedSolver->addAssertions(Lane.EB->BuildAssertion(New)))
+      return std::make_error_code(std::errc::protocol_error);
+    Lane.NumWirings = InputWirings.size();
+    Lane.NumPCs = Lane.LoopPCs.size();
+    Lane.ModelInsts = Lane.SessionModelInsts;
+    Lane.QueryStr = Lane.Check;
+    return std::error_code();
+  }
+
+  // Each solution corresponds to a syntactically distinct and well-formed
+  // straight-line program obtained by composition of given components
+  Lane.ModelInsts.clear();
+  InstMapping Mapping(Query, TrueConst);
+  // Negate the query to get a SAT model.
+  // Don't use original BPCs/PCs, they are useless
+  std::unique_ptr<ExprBuilder> EB = createExprBuilder(IC);
+  Lane.QueryStr = EB->BuildQuery({}, Lane.LoopPCs, Mapping, &Lane.ModelInsts,
+                                 /*Precondition=*/0, /*Negate=*/true);
+  if (Lane.QueryStr.empty())
+    return std::make_error_code(std::errc::value_too_large);
+
+  // A session that keeps the query only needs its check-sat from now on
+  if (Incremental && Lane.OwnedSolver) {
+    size_t CheckPos = Lane.QueryStr.find("(check-sat)");
+    if (CheckPos != std::string::npos &&
+        Lane.OwnedSolver->addAssertions(Lane.QueryStr)) {
+      Lane.Check = Lane.QueryStr.substr(CheckPos);
+      Lane.SessionModelInsts = Lane.ModelInsts;
+      Lane.QueryStr = Lane.Check;
+      Lane.NumWirings = InputWirings.size();
+      Lane.NumPCs = Lane.LoopPCs.size();
+      Lane.EB = std::move(EB);
+    }
+  }
+  return std::error_code();
+}
+
+void InstSynthesis::solveLanes(const std::vector<SynthesisLane *> &Round) {
+  auto Solve = [this](SynthesisLane *Lane) {
+    Lane->EC = Lane->Solver->isSatisfiable(Lane->QueryStr, Lane->IsSat,
+                                           Lane->ModelInsts.size(),
+                                           &Lane->ModelVals, LTimeout);
+  };
+  if (!ParallelLanes || Round.size() < 2) {
+    for (auto *Lane : Round)
+      Solve(Lane);
+    return;
+  }
+  std::vector<std::thread> Threads;
+  for (size_t T = 1; T < Round.size(); ++T)
+    Threads.emplace_back(Solve, Round[T]);
+  Solve(Round[0]);
+  for (auto &T : Threads)
+    T.join();
+}
+
+std::error_code InstSynthesis::refineLane(SynthesisLane &Lane,
+                                          std::vector<std::map<Inst *, Inst *>> &S,
+                                          std::map<ProgramWiring, unsigned> &NotWorkingConstWirings,
+                                          std::vector<InstMapping> &WiringPCs,
+                                          int LHSCost) {
+  std::error_code EC = Lane.EC;
+  if (EC)
+    return EC;
+
+  // No valid wiring exists for the target comp number
+  if (!Lane.IsSat) {
+    if (DebugLevel > 1)
+      llvm::outs() << "UNSAT\n";
+    Lane.Done = true;
+    return EC;
+  }
+
+  if (DebugLevel > 1)
+    llvm::outs() << "SAT\n";
+
+  InstContext &IC = *LIC;
+  ProgramWiring CandWiring;
+  std::map<LocVar, llvm::APInt> ConstValMap;
+  Inst *Cand = createInstFromModel(std::make_pair(Lane.ModelInsts,
+                                                  Lane.ModelVals),
+                                   CandWiring, ConstValMap, IC);
+  if (!Cand)
+    report_fatal_error("synthesis bug: creating inst from a model failed");
+
+  if (DebugLevel > 1) {
+    llvm::outs() << "candidate:\n";
+    PrintReplacementRHS(llvm::outs(), Cand, Context);
+  }
+
+  // The synthesis loop assumes that each component has a cost of one.
+  // However, this is not the case for all components (e.g., bswap).
+  // Moreover, some components can be comprised of two components to meet
+  // the DefaultWidth criteria. For example, if the DefaultWidth is 32
+  // and the engine uses ule during synthesis, the instantiation of ule
+  // would be zext(ule) to 32 and sext(ule) to 32. Therefore, the cost
+  // of such a component would be two and not one. To address this issue,
+  // we forbid candidates that have no cost benefit and continue to search
+  // for others
+  int CandCost = cost(Cand);
+  int Benefit = benefit(LHS, Cand);
+  if (!IgnoreCost && Benefit <= 0) {
+    if (DebugLevel > 1)
+      llvm::outs() << "candidate has no benefit\n";
+    forbidInvalidCandWiring(CandWiring, Lane.LoopPCs, WiringPCs, IC);
+    return EC;
+  }
+
+  // Does the candidate work for all inputs?
+  // Use original BPCs/PCs
+  std::vector<Inst *> ModelInsts;
+  std::vector<llvm::APInt> ModelVals;
+  InstMapping CandMapping(LHS, Cand);
+  std::string QueryStr = BuildQuery(IC, *LBPCs, *LPCs, CandMapping,
+                                    &ModelInsts, /*Precondition=*/0,
+                                    /*Negate=*/false);
+  if (QueryStr.empty())
+    return std::make_error_code(std::errc::value_too_large);
+  // Lane.Solver may hold the lane's wiring query, so candidates are
+  // checked on the shared solver; lanes are refined one at a time
+  bool IsSat;
+  EC = LSMTSolver->isSatisfiable(QueryStr, IsSat, ModelInsts.size(),
+                                 &ModelVals, LTimeout);
+  if (EC)
+    return EC;
+
+  // Success
+  if (!IsSat) {
+    if (DebugLevel > 1)
+      llvm::outs() << "success:\n";
+    if (DebugLevel > 0) {
+      PrintReplacementRHS(llvm::outs(), Cand, Context);
+      llvm::outs() << "; LHS cost = " << LHSCost
+                   << ", RHS cost = " << CandCost
+                   << ", benefit = " << (Benefit > 0 ? Benefit : 0)
+                   << "\n";
+    }
+    Lane.Result = Cand;
+    Lane.Done = true;
+    return EC;
+  }
+
+  Lane.Refinements++;
+  if (DebugLevel > 1)
+    llvm::outs() << "didn't work for all inputs "
+                 << "(#cex: "<< S.size()+1 << ", "
+                 << "refinement: " << Lane.Refinements << ")\n";
+  // Parse input counterexamples from the model
+  std::map<Inst *, Inst *> InputMap;
+  for (unsigned J = 0; J < ModelInsts.size(); ++J) {
+    auto Name = ModelInsts[J]->attrs().Name;
+    if (Name.find(INPUT_PREFIX) != std::string::npos) {
+      auto In = ModelInsts[J];
+      auto Val = ModelVals[J];
+      InputMap[In] = IC.getConst(Val);
+      if (DebugLevel > 2)
+        llvm::outs() << "counterexample: " << Name << " = " << Val << "\n";
+    }
+  }
+  // Counterexamples should be unique in each iteration
+  bool CexExists = false;
+  for (auto const &E : S)
+    if (std::equal(E.begin(), E.end(), InputMap.begin())) {
+      CexExists = true;
+      break;
+    }
+  // Add counterexamples to S
+  if (!CexExists)
+    S.push_back(InputMap);
+
+  // Constants are not constrained by the inputs, thus, we must explicitly
+  // constrain the not-working cand wiring incl. the constants and forbid
+  // the wiring completely after MaxWiringAttempts is reached
+  if (hasConst(Cand)) {
+    constrainConstWiring(Cand, CandWiring, NotWorkingConstWirings,
+                         ConstValMap, Lane.LoopPCs, WiringPCs);
+  } else {
+    // Forbid invalid constant-free wirings explicitly in the future,
+    // so they don't show up in the wiring result
+    forbidInvalidCandWiring(CandWiring, Lane.LoopPCs, WiringPCs, IC);
+  }
+
   return EC;
 }
 
@@ -389,7 +558,7 @@ void InstSynthesis::initInputVars(InstContext &IC) {
     I.emplace_back(In, Loc);
     // Update input name
     LocVarStr = getLocVarStr(In, INPUT_PREFIX);
-    Inputs[J]->Name = LocVarStr;
+    Inputs[J]->mutableAttrs().Name = LocVarStr;
     LocInstMap[LocVarStr] = std::make_pair(In, Loc);
     // Update CompInstMap map with concrete Inst
     CompInstMap[In] = Inputs[J];
@@ -1005,7 +1174,7 @@ LocVar InstSynthesis::parseWiringModel(const SolverSolution &Solution,
   auto ModelVals = Solution.second;
   assert(ModelVals.size() && "there must models to parse");
   for (unsigned J = 0; J < ModelInsts.size(); ++J) {
-    auto Name = ModelInsts[J]->Name;
+    auto Name = ModelInsts[J]->attrs().Name;
     // Parse location variable models
     if (Name.find(LOC_PREFIX) != std::string::npos) {
       LocVar Loc = getLocVarFromStr(Name.substr(LOC_PREFIX.size()));
@@ -1391,7 +1560,7 @@ std::error_code InstSynthesis::getInitialConcreteInputs(std::vector<std::map<Ins
 
     std::map<Inst *, Inst *> ConcreteInputs;
     for (unsigned K = 0; K < ModelInsts.size(); ++K) {
-      auto Name = ModelInsts[K]->Name;
+      auto Name = ModelInsts[K]->attrs().Name;
       if (Name.find(INPUT_PREFIX) != std::string::npos) {
         auto Input = ModelInsts[K];
         ConcreteInputs[Input] = LIC->getConst(ModelVals[K]);
@@ -1405,16 +1574,17 @@ std::error_code InstSynthesis::getInitialConcreteInputs(std::vector<std::map<Ins
   return EC;
 }
 
-Inst *InstSynthesis::initConcreteInputWirings(Inst *Query, Inst *WiringQuery,
-                                              unsigned Refinements,
+Inst *InstSynthesis::initConcreteInputWirings(Inst *WiringQuery,
                                               std::vector<std::map<Inst *, Inst *>> &S) {
-  for (unsigned K = 0; K < S.size(); ++K) {
+  // Copies made in earlier refinement rounds are kept, so only the input
+  // sets that were added since need a new copy
+  for (unsigned K = InputWirings.size(); K < S.size(); ++K) {
     auto InputMap = S[K];
     if (DebugLevel > 2) {
       for (auto const &Input : InputMap) {
-        if (Input.first->Name.find(COMP_INPUT_PREFIX) != std::string::npos)
+        if (Input.first->attrs().Name.find(COMP_INPUT_PREFIX) != std::string::npos)
           continue;
-        llvm::outs() << "setting input " << Input.first->Name
+        llvm::outs() << "setting input " << Input.first->attrs().Name
                      << " to " << Input.second->Val << "\n";
       }
     }
@@ -1424,12 +1594,16 @@ Inst *InstSynthesis::initConcreteInputWirings(Inst *Query, Inst *WiringQuery,
       for (auto const &E : LocInstMap) {
         if (E.first.find(COMP_INPUT_PREFIX) != std::string::npos) {
           auto In = E.second.second;
-          std::string Name = E.first + LOC_SEP + std::to_string(Refinements);
+          std::string Name = E.first + LOC_SEP + std::to_string(K);
           InputMap[In] = LIC->createVar(In->Width, Name);
         }
       }
     }
-    Inst *Copy = replaceVars(WiringQuery, *LIC, InputMap);
+    InputWirings.push_back(replaceVars(WiringQuery, *LIC, InputMap));
+  }
+
+  Inst *Query = TrueConst;
+  for (auto *Copy : InputWirings) {
     Query = LIC->getInst(Inst::And, 1, {Query, Copy});
     Query->DemandedBits = APInt::getAllOnes(Query->Width);
   }
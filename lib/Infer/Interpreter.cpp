@@ -479,9 +479,64 @@ namespace souper {
 #undef ARG1
 #undef ARG2
 
+  InstNumbering &ValueCache::getMutableNumbering() {
+    // copy on write: other caches may still be indexed by this numbering
+    if (Numbering.use_count() > 1)
+      Numbering = std::make_shared<InstNumbering>(*Numbering);
+    return *Numbering;
+  }
+
+  void ValueCache::addDAG(Inst *Root) {
+    if (Numbering->contains(Root))
+      return;
+    getMutableNumbering().addDAG(Root);
+    grow();
+  }
+
+  EvalValue &ValueCache::operator[](Inst *I) {
+    unsigned Idx = Numbering->lookup(I);
+    if (Idx == InstNumbering::NotFound) {
+      Idx = getMutableNumbering().add(I);
+      grow();
+    }
+    if (!Present[Idx]) {
+      Present[Idx] = true;
+      ++NumPresent;
+    }
+    return Values[Idx];
+  }
+
+  // Evaluates a node of the cache's numbering, finding its operands through
+  // the numbering's operand indices instead of hashing each of them.
+  EvalValue ConcreteInterpreter::evaluateIndex(unsigned Idx) {
+    if (auto V = Cache.lookupIndex(Idx))
+      return *V;
+
+    auto &N = Cache.getNumbering();
+    Inst *Root = N.getInst(Idx);
+    if (Root->K == Inst::BitWidth) {
+      return {llvm::APInt(Root->Width, Root->Width)};
+    }
+
+    std::vector<EvalValue> EvaluatedArgs;
+    if (size_t(N.op_end(Idx) - N.op_begin(Idx)) == Root->Ops.size()) {
+      for (auto Op = N.op_begin(Idx); Op != N.op_end(Idx); ++Op)
+        EvaluatedArgs.push_back(evaluateIndex(*Op));
+    } else {
+      // numbered as a leaf, its operands may not have indices
+      for (auto &&I : Root->Ops)
+        EvaluatedArgs.push_back(evaluateInst(I));
+    }
+    auto Result = evaluateSingleInst(Root, EvaluatedArgs);
+    if (CacheWritable)
+      Cache.setIndex(Idx, Result);
+    return Result;
+  }
+
   EvalValue ConcreteInterpreter::evaluateInst(Inst *Root) {
-    if (Cache.find(Root) != Cache.end())
-      return Cache[Root];
+    unsigned Idx = Cache.getNumbering().lookup(Root);
+    if (Idx != InstNumbering::NotFound)
+      return evaluateIndex(Idx);
 
     if (Root->K == Inst::BitWidth) {
       return {llvm::APInt(Root->Width, Root->Width)};
@@ -491,16 +546,80 @@ namespace souper {
     std::vector<EvalValue> EvaluatedArgs;
     for (auto &&I : Root->Ops)
       EvaluatedArgs.push_back(evaluateInst(I));
-    auto Result = evaluateSingleInst(Root, EvaluatedArgs);
-    if (CacheWritable)
-      Cache[Root] = Result;
-    return Result;
+    return evaluateSingleInst(Root, EvaluatedArgs);
   }
 
   void ConcreteInterpreter::printCache(llvm::raw_ostream &Out) {
     for (auto &&KV : Cache) {
-      Out << KV.first->Name << " = " << KV.second.getValue() << '\n';
+      Out << KV.first->attrs().Name << " = " << KV.second.getValue() << '\n';
     }
   }
 
+  LaneInterpreter::LaneInterpreter(std::vector<ConcreteInterpreter> &Lanes)
+    : Lanes(Lanes) {
+    if (Lanes.empty())
+      return;
+    Numbering = &Lanes[0].Cache.getNumbering();
+    for (auto &L : Lanes)
+      if (&L.Cache.getNumbering() != Numbering)
+        Numbering = nullptr;
+  }
+
+  const std::vector<EvalValue> &
+  LaneInterpreter::evaluateColumn(Inst *I, unsigned NumLanes,
+                                  ColumnMap &Columns) {
+    auto It = Columns.find(I);
+    if (It != Columns.end())
+      return It->second;
+
+    std::vector<EvalValue> Column(NumLanes);
+    std::vector<bool> Done(NumLanes);
+    bool AllDone = true;
+    unsigned Idx = Numbering ? Numbering->lookup(I) : InstNumbering::NotFound;
+    for (unsigned L = 0; L < NumLanes; ++L) {
+      const EvalValue *V = nullptr;
+      if (Idx != InstNumbering::NotFound)
+        V = Lanes[L].Cache.lookupIndex(Idx);
+      if (V) {
+        Column[L] = *V;
+        Done[L] = true;
+      } else {
+        AllDone = false;
+      }
+    }
+
+    if (!AllDone) {
+      if (!Numbering) {
+        // lanes number Insts differently, fall back to one lane at a time
+        for (unsigned L = 0; L < NumLanes; ++L)
+          if (!Done[L])
+            Column[L] = Lanes[L].evaluateInst(I);
+      } else if (I->K == Inst::BitWidth) {
+        for (unsigned L = 0; L < NumLanes; ++L)
+          if (!Done[L])
+            Column[L] = llvm::APInt(I->Width, I->Width);
+      } else {
+        std::vector<const std::vector<EvalValue> *> OpColumns;
+        for (auto Op : I->Ops)
+          OpColumns.push_back(&evaluateColumn(Op, NumLanes, Columns));
+        std::vector<EvalValue> Args(I->Ops.size());
+        for (unsigned L = 0; L < NumLanes; ++L) {
+          if (Done[L])
+            continue;
+          for (unsigned J = 0; J < OpColumns.size(); ++J)
+            Args[J] = (*OpColumns[J])[L];
+          Column[L] = Lanes[L].evaluateSingleInst(I, Args);
+        }
+      }
+    }
+    return Columns.emplace(I, std::move(Column)).first->second;
+  }
+
+  std::vector<EvalValue> LaneInterpreter::evaluateInst(Inst *Root,
+                                                       unsigned NumLanes) {
+    assert(NumLanes <= Lanes.size());
+    ColumnMap Columns;
+    return evaluateColumn(Root, NumLanes, Columns);
+  }
+
 }
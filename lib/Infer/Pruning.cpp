@@ -17,7 +17,10 @@
 #include "souper/Infer/AbstractInterpreter.h"
 #include "souper/Infer/Pruning.h"
 #include "souper/Extractor/Candidates.h"
+
+#include <algorithm>
 #include <cstdlib>
+#include <thread>
 
 namespace {
   static bool EnableHeavyDataflowPruning = false;
@@ -54,15 +57,25 @@ namespace {
   // static llvm::cl::opt<bool> EnableBB("souper-dataflow-pruning-bb",
   //   llvm::cl::desc("Prune with bivalent-bits analysis (default=true)"),
   //   llvm::cl::init(false));
-}
 
-namespace souper {
+  static llvm::cl::opt<unsigned> PruningThreads("souper-dataflow-pruning-threads",
+    llvm::cl::desc("Threads pruning a generation of guesses, 0 for one per core (default=0)"),
+    llvm::cl::init(0));
 
-std::string getUniqueName() {
-  static int counter = 0;
-  return "dummy" + std::to_string(counter++);
+  static llvm::cl::opt<unsigned> MaxInputSets("souper-dataflow-pruning-max-inputs",
+    llvm::cl::desc("Maximum number of concrete input sets, counterexamples included (default=32)"),
+    llvm::cl::init(32));
+
+  // Below this many guesses per thread, starting threads costs more than it saves
+  const size_t MinGuessesPerThread = 64;
+
+  // Every concrete RHS gets top from the abstract interpreters, so
+  // isInfeasible gives up on it after this many input sets
+  const size_t MaxConcreteInputs = 10;
 }
 
+namespace souper {
+
 llvm::ConstantRange mkCR(llvm::APInt Low, llvm::APInt High) {
   return llvm::ConstantRange(Low, High);
 }
@@ -72,6 +85,10 @@ llvm::ConstantRange mkCR(Inst *I, size_t Low, size_t High) {
                              llvm::APInt(I->Width, High));
 }
 
+bool hasCustomInst(Inst *Root) {
+  return Root->has(Inst::HasCustom);
+}
+
 bool isRangeInfeasible(Inst *C, llvm::APInt LHSV, Inst *RHS,
                        llvm::ConstantRange Range, ConcreteInterpreter &I) {
   std::unordered_map<Inst *, llvm::ConstantRange> CRCache;
@@ -160,7 +177,8 @@ std::pair<llvm::APInt, llvm::APInt> knownBitsNarrowing
 
 // TODO : Comment out debug stmts and conditions before benchmarking
 bool PruningManager::isInfeasible(souper::Inst *RHS,
-                                 unsigned StatsLevel) {
+                                  unsigned StatsLevel, WorkerState &W) {
+  W.CurrentInput = -1;
   std::unordered_map<Inst *, ExprInfo> RHSInfo = LHSInfo;
   ExprInfo::analyze(RHS, RHSInfo);
   bool HasHole = RHSInfo[RHS].HasHole;
@@ -173,14 +191,16 @@ bool PruningManager::isInfeasible(souper::Inst *RHS,
   std::set<souper::Inst *> Constants;
   getConstants(RHS, Constants);
 
-  if (HA.findIfHole(RHS)) {
+  if (W.HA.findIfHole(RHS)) {
     // Do not attempt pruning if the RHS will provably produce top
     // for all abstract interpreters
     return false;
   }
 
   if (EnableBB && !Constants.empty()) {
-    auto RestrictedBits = RestrictedBitsAnalysis().findRestrictedBits(RHS);
+    RestrictedBitsAnalysis RBA;
+    RBA.Shared = &W.AVCache;
+    auto RestrictedBits = RBA.findRestrictedBits(RHS);
     if ((~RestrictedBits & (LHSKnownBitsNoSpec.Zero | LHSKnownBitsNoSpec.One)) != 0) {
 //     if (RestrictedBits == 0 && (LHSKB.Zero != 0 || LHSKB.One != 0)) {
       if (StatsLevel > 2) {
@@ -227,7 +247,7 @@ bool PruningManager::isInfeasible(souper::Inst *RHS,
       if (Pair.second != 0 && DontCareBits.find(Pair.first) == DontCareBits.end()) {
         // This input is must demanded in LHS and DontCare in RHS.
         if (StatsLevel > 2) {
-          llvm::errs() << "Var : " << Pair.first->Name << " : ";
+          llvm::errs() << "Var : " << Pair.first->attrs().Name << " : ";
           llvm::SmallString<64> S1;
           Pair.second.toString(S1, 2, false);
           llvm::SmallString<64> S2;
@@ -241,10 +261,14 @@ bool PruningManager::isInfeasible(souper::Inst *RHS,
     }
   }
 
+  if (RHSIsConcrete && !(LHSHasPhi && AbstractInterpretPhi))
+    return isInfeasibleConcrete(RHS, StatsLevel, W);
+
   bool FoundNonTopAnalysisResult = false;
   ForcedValueAnalysis FVA(RHS);
-  for (int I = 0; I < InputVals.size(); ++I) {
-    if (I > 9 && !FoundNonTopAnalysisResult) {
+  for (size_t I = 0; I < InputVals.size(); ++I) {
+    W.CurrentInput = I;
+    if (I >= MaxConcreteInputs && !FoundNonTopAnalysisResult) {
       break;
       // Give up if first 10 known bits and constant range results
       // are all TOP.
@@ -259,7 +283,7 @@ bool PruningManager::isInfeasible(souper::Inst *RHS,
       llvm::errs() << "  Input:\n";
       for (auto &&p : InputVals[I]) {
         if (p.second.hasValue()) {
-          llvm::errs() << "  Var " << p.first->Name << " : "
+          llvm::errs() << "  Var " << p.first->attrs().Name << " : "
                         << p.second.getValue() << "\n";
         }
       }
@@ -267,7 +291,7 @@ bool PruningManager::isInfeasible(souper::Inst *RHS,
 
     if (LHSHasPhi && AbstractInterpretPhi) {
       auto LHSCR = LHSConstantRange[I];
-      auto RHSCR = ConstantRangeAnalysis().findConstantRange(RHS, ConcreteInterpreters[I]);
+      auto RHSCR = ConstantRangeAnalysis(W.AVCache, InputIds[I]).findConstantRange(RHS, ConcreteInterpreters[I]);
       if (!RHSCR.isFullSet()) {
         FoundNonTopAnalysisResult = true;
       }
@@ -286,7 +310,7 @@ bool PruningManager::isInfeasible(souper::Inst *RHS,
       }
 
       auto LHSKB = LHSKnownBits[I];
-      auto RHSKB = KnownBitsAnalysis().findKnownBits(RHS, ConcreteInterpreters[I]);
+      auto RHSKB = KnownBitsAnalysis(W.AVCache, InputIds[I]).findKnownBits(RHS, ConcreteInterpreters[I]);
       if (!RHSKB.isUnknown()) {
         FoundNonTopAnalysisResult = true;
       }
@@ -310,8 +334,8 @@ bool PruningManager::isInfeasible(souper::Inst *RHS,
         auto Val = C.getValue();
         if (StatsLevel > 2)
           llvm::errs() << "  LHS value = " << Val <<" - " <<RHSIsConcrete<< "\n";
-        if (!RHSIsConcrete) {
-          auto CR = ConstantRangeAnalysis().findConstantRange(RHS, ConcreteInterpreters[I]);
+        if (!RHSIsConcrete) { // always, see isInfeasibleConcrete
+          auto CR = ConstantRangeAnalysis(W.AVCache, InputIds[I]).findConstantRange(RHS, ConcreteInterpreters[I]);
           if (StatsLevel > 2)
             llvm::errs() << "  RHS ConstantRange = " << CR << "\n";
           if (EnableCR && !CR.contains(Val)) {
@@ -326,7 +350,7 @@ bool PruningManager::isInfeasible(souper::Inst *RHS,
             }
             return true;
           }
-          auto KB = KnownBitsAnalysis().findKnownBits(RHS, ConcreteInterpreters[I]);
+          auto KB = KnownBitsAnalysis(W.AVCache, InputIds[I]).findKnownBits(RHS, ConcreteInterpreters[I]);
           if (StatsLevel > 2)
             llvm::errs() << "  RHS KnownBits = " << KnownBitsAnalysis::knownBitsString(KB) << "\n";
           if (EnableKB && (KB.Zero & Val) != 0 || (KB.One & ~Val) != 0) {
@@ -416,7 +440,7 @@ bool PruningManager::isInfeasible(souper::Inst *RHS,
                     std::map<Block *, Block *> BlockCache;
                     Inst *RHSCopy = getInstCopy(RHS, SC.IC, InstCache, BlockCache, &CMap, false);
 
-                    if (isInfeasible(RHSCopy, StatsLevel)) {
+                    if (isInfeasible(RHSCopy, StatsLevel, W)) {
                       if (StatsLevel > 2) {
                         llvm::errs() << "  pruned using KNOTB instantiation!  ";
                         llvm::errs() << "Inst had a symbolic const.\n";
@@ -429,26 +453,12 @@ bool PruningManager::isInfeasible(souper::Inst *RHS,
 
             }
           }
-        } else {
-          auto RHSV = ConcreteInterpreters[I].evaluateInst(lowerCustomInst(SC.IC, RHS));
-          if (RHSV.hasValue()) {
-            auto RVal = RHSV.getValue();
-            if (SC.LHS->DemandedBits != 0) {
-              Val &= SC.LHS->DemandedBits;
-              RVal &= SC.LHS->DemandedBits;
-            }
-            if (Val != RVal) {
-              if (StatsLevel > 2) {
-                llvm::errs() << "  RHS value = " << RHSV.getValue() << "\n";
-                llvm::errs() << "  pruned using concrete interpreter!\n";
-              }
-              return true;
-            }
-          }
         }
+        // a concrete RHS was handled by isInfeasibleConcrete
       }
     }
   }
+  W.CurrentInput = -1;
 
   if (EnableHeavyDataflowPruning) {
     for (auto &C : ConstantLimits) {
@@ -470,7 +480,7 @@ bool PruningManager::isInfeasible(souper::Inst *RHS,
 
         if (ResidualSize < 8192 && Rs.size() < 3) {
           // TODO: Tune. These thresholds control when the solver is involved
-          C.first->RangeRefinement = Rs;
+          C.first->mutableAttrs().RangeRefinement = Rs;
         }
       }
     }
@@ -483,6 +493,236 @@ bool PruningManager::isInfeasible(souper::Inst *RHS,
   }
 }
 
+bool PruningManager::isInfeasibleConcrete(Inst *RHS, unsigned StatsLevel,
+                                          WorkerState &W) {
+  if (hasCustomInst(RHS))
+    RHS = lowerCustomInst(SC.IC, RHS);
+
+  size_t NumLanes = std::min(InputVals.size(), MaxConcreteInputs);
+  LaneInterpreter LI(ConcreteInterpreters);
+  auto LHSV = LI.evaluateInst(SC.LHS, NumLanes);
+  auto RHSV = LI.evaluateInst(RHS, NumLanes);
+
+  for (size_t I = 0; I < NumLanes; ++I) {
+    if (!LHSV[I].hasValue() || !RHSV[I].hasValue())
+      continue;
+    auto Val = LHSV[I].getValue();
+    auto RVal = RHSV[I].getValue();
+    if (SC.LHS->DemandedBits != 0) {
+      Val &= SC.LHS->DemandedBits;
+      RVal &= SC.LHS->DemandedBits;
+    }
+    if (Val != RVal) {
+      if (StatsLevel > 2) {
+        llvm::errs() << "  Input:\n";
+        for (auto &&p : InputVals[I]) {
+          if (p.second.hasValue()) {
+            llvm::errs() << "  Var " << p.first->attrs().Name << " : "
+                          << p.second.getValue() << "\n";
+          }
+        }
+        llvm::errs() << "  LHS value = " << LHSV[I].getValue() << "\n";
+        llvm::errs() << "  RHS value = " << RHSV[I].getValue() << "\n";
+        llvm::errs() << "  pruned using concrete interpreter!\n";
+      }
+      W.CurrentInput = I;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool PruningManager::pruneWith(Inst *RHS, unsigned StatsLevel,
+                               WorkerState &W) {
+  if (!isInfeasible(RHS, StatsLevel, W))
+    return false;
+  if (W.CurrentInput >= 0) {
+    if (W.InputPrunes.size() < InputVals.size())
+      W.InputPrunes.resize(InputVals.size());
+    ++W.InputPrunes[W.CurrentInput];
+  }
+  return true;
+}
+
+void PruningManager::rankInputSets() {
+  InputPrunes.resize(InputVals.size());
+  for (auto &W : Workers) {
+    for (size_t I = 0; I < W.InputPrunes.size(); ++I)
+      InputPrunes[I] += W.InputPrunes[I];
+    W.InputPrunes.clear();
+  }
+
+  std::vector<size_t> Order(InputVals.size());
+  for (size_t I = 0; I < Order.size(); ++I)
+    Order[I] = I;
+  std::stable_sort(Order.begin(), Order.end(), [this](size_t A, size_t B) {
+    return InputPrunes[A] > InputPrunes[B];
+  });
+
+  auto Permute = [&Order](auto &V) {
+    if (V.empty())
+      return;
+    std::remove_reference_t<decltype(V)> Sorted;
+    for (auto I : Order)
+      Sorted.push_back(std::move(V[I]));
+    V = std::move(Sorted);
+  };
+  Permute(InputVals);
+  Permute(ConcreteInterpreters);
+  Permute(LHSKnownBits);
+  Permute(LHSConstantRange);
+  Permute(InputPrunes);
+  Permute(InputIds);
+}
+
+void PruningManager::addInputSet(ValueCache Input) {
+  unsigned Prunes = InputPrunes.empty() ? 1 : InputPrunes.front() + 1;
+  ConcreteInterpreters.emplace(ConcreteInterpreters.begin(), SC.LHS, Input);
+  InputVals.insert(InputVals.begin(), std::move(Input));
+  InputPrunes.insert(InputPrunes.begin(), Prunes);
+  InputIds.insert(InputIds.begin(), NextInputId++);
+  if (LHSHasPhi && AbstractInterpretPhi) {
+    LHSKnownBits.insert(LHSKnownBits.begin(), KnownBitsAnalysis().findKnownBits(SC.LHS, ConcreteInterpreters[0]));
+    LHSConstantRange.insert(LHSConstantRange.begin(), ConstantRangeAnalysis().findConstantRange(SC.LHS, ConcreteInterpreters[0]));
+  }
+}
+
+namespace {
+  bool sameInputs(ValueCache &A, ValueCache &B,
+                  const std::vector<Inst *> &Vars) {
+    for (auto *V : Vars) {
+      auto *VA = A.lookup(V), *VB = B.lookup(V);
+      if (!VA || !VB || !VA->hasValue() || !VB->hasValue() ||
+          VA->getValue() != VB->getValue())
+        return false;
+    }
+    return true;
+  }
+}
+
+void PruningManager::addCounterexample(const std::vector<Inst *> &ModelInsts,
+                                       const std::vector<llvm::APInt> &ModelVals) {
+  // pruning is disabled
+  if (!InputNumbering)
+    return;
+
+  ValueCache Cache(InputNumbering);
+  std::vector<Inst *> Vars;
+  for (auto *I : InputVars) {
+    if (I->K != Inst::Var)
+      continue;
+    Vars.push_back(I);
+    Cache[I] = llvm::APInt(I->Width, 0);
+    for (size_t J = 0; J < ModelInsts.size(); ++J)
+      if (ModelInsts[J] == I && ModelVals[J].getBitWidth() == I->Width)
+        Cache[I] = ModelVals[J];
+  }
+
+  for (auto &Input : InputVals)
+    if (sameInputs(Input, Cache, Vars))
+      return;
+  if (!isInputValid(Cache))
+    return;
+
+  rankInputSets();
+  // the ranking put the input set that pruned the fewest guesses last
+  if (InputVals.size() >= std::max<unsigned>(MaxInputSets, 1u)) {
+    for (auto &W : Workers)
+      W.AVCache.eraseInputSet(InputIds.back());
+    InputVals.pop_back();
+    ConcreteInterpreters.pop_back();
+    InputPrunes.pop_back();
+    InputIds.pop_back();
+    if (!LHSKnownBits.empty()) {
+      LHSKnownBits.pop_back();
+      LHSConstantRange.pop_back();
+    }
+  }
+  // Age the counts, so that input sets that pruned a lot a while ago make
+  // room for the ones that prune the current guesses
+  for (auto &Prunes : InputPrunes)
+    Prunes /= 2;
+  if (StatsLevel > 2) {
+    llvm::errs() << "Added counterexample input set:";
+    for (auto *V : Vars)
+      llvm::errs() << "  Var " << V->attrs().Name << " : "
+                   << Cache[V].getValue() << ",";
+    llvm::errs() << "\n";
+  }
+
+  // The counterexample refuted a guess that got past all input sets. Only
+  // the first few input sets are evaluated on some guesses, so it goes
+  // first to get its chance; it stays ahead only if it prunes.
+  addInputSet(std::move(Cache));
+  ++NumCounterexamples;
+}
+
+std::vector<bool>
+PruningManager::isInfeasibleBatch(const std::vector<Inst *> &Guesses,
+                                  unsigned StatsLevel) {
+  // not std::vector<bool>, threads write neighbouring elements
+  std::vector<char> Infeasible(Guesses.size());
+
+  // The heavy pruning and the lowering of custom instructions create Insts,
+  // and detailed stats print as they go, all of which stay on this thread
+  std::vector<size_t> Parallel;
+  for (size_t I = 0; I < Guesses.size(); ++I) {
+    if (StatsLevel > 2 || EnableHeavyDataflowPruning ||
+        hasCustomInst(Guesses[I]))
+      Infeasible[I] = pruneWith(Guesses[I], StatsLevel, Workers[0]);
+    else
+      Parallel.push_back(I);
+  }
+
+  size_t NumThreads = PruningThreads ? PruningThreads :
+                                       std::thread::hardware_concurrency();
+  NumThreads = std::max<size_t>(1, std::min(NumThreads,
+                                            Parallel.size() / MinGuessesPerThread));
+  if (Workers.size() < NumThreads)
+    Workers.resize(NumThreads);
+
+  // Thread T prunes the T-th contiguous chunk with its own WorkerState, so
+  // the results don't depend on scheduling
+  auto Work = [&](size_t T) {
+    size_t Begin = Parallel.size() * T / NumThreads;
+    size_t End = Parallel.size() * (T + 1) / NumThreads;
+    for (size_t I = Begin; I < End; ++I)
+      Infeasible[Parallel[I]] =
+        pruneWith(Guesses[Parallel[I]], StatsLevel, Workers[T]);
+  };
+  std::vector<std::thread> Threads;
+  for (size_t T = 1; T < NumThreads; ++T)
+    Threads.emplace_back(Work, T);
+  Work(0);
+  for (auto &T : Threads)
+    T.join();
+
+  return std::vector<bool>(Infeasible.begin(), Infeasible.end());
+}
+
+BatchPruneFunc PruningManager::getBatchPruneFunc() {
+  if (StatsLevel > 1) {
+    // print every guess as it is pruned
+    return [this](const std::vector<Inst *> &Guesses) {
+      std::vector<bool> Result;
+      std::vector<Inst *> Empty;
+      for (auto G : Guesses)
+        Result.push_back(DataflowPrune(G, Empty));
+      return Result;
+    };
+  }
+  return [this](const std::vector<Inst *> &Guesses) {
+    auto Infeasible = isInfeasibleBatch(Guesses, StatsLevel);
+    std::vector<bool> Result(Guesses.size());
+    for (size_t I = 0; I < Guesses.size(); ++I) {
+      Result[I] = !Infeasible[I];
+      NumPruned += Infeasible[I];
+    }
+    TotalGuesses += Guesses.size();
+    return Result;
+  };
+}
+
 bool PruningManager::isInfeasibleWithSolver(Inst *RHS, unsigned StatsLevel) {
   for (int I = 0; I < InputVals.size(); ++I) {
     auto C = ConcreteInterpreters[I].evaluateInst(SC.LHS);
@@ -494,7 +734,8 @@ bool PruningManager::isInfeasibleWithSolver(Inst *RHS, unsigned StatsLevel) {
         std::map<Inst *, Inst *> InstCache;
         std::vector<Inst *> Empty;
         for (auto *Hole : Holes) {
-          auto DummyVar = SC.IC.createVar(Hole->Width, getUniqueName());
+          auto DummyVar = SC.IC.createVar(Hole->Width, "dummy" +
+                                          std::to_string(DummyVarCount++));
           InstCache[Hole] = DummyVar;
         }
         std::map<Inst *, llvm::APInt> ConstMap;
@@ -545,7 +786,7 @@ bool PruningManager::isInfeasibleWithSolver(Inst *RHS, unsigned StatsLevel) {
             llvm::errs() << "Failed to prune using Solver, Solver returned SAT\n";
             llvm::errs() << "Model:";
             for (int i = 0; i < Holes.size(); ++i) {
-              llvm::errs() << ModelVars[i]->Name << " : " << Models[i] << "\n";
+              llvm::errs() << ModelVars[i]->attrs().Name << " : " << Models[i] << "\n";
             }
             llvm::errs() << "\n\n";
           }
@@ -559,7 +800,7 @@ bool PruningManager::isInfeasibleWithSolver(Inst *RHS, unsigned StatsLevel) {
 
 PruningManager::PruningManager(
   souper::SynthesisContext &SC_, std::vector<Inst*> &Inputs_, unsigned StatsLevel_)
-                  : SC(SC_), NumPruned(0),
+                  : SC(SC_), Workers(1), NumPruned(0),
                     TotalGuesses(0),
                     StatsLevel(StatsLevel_),
                     InputVars(Inputs_) {}
@@ -574,19 +815,24 @@ void PruningManager::init() {
 
   findVars(Ante, InputVars);
 
+  InputNumbering = std::make_shared<InstNumbering>(SC.LHS);
+  InputNumbering->addDAG(Ante);
   InputVals = generateInputSets(InputVars);
 
   for (auto &&Input : InputVals) {
     ConcreteInterpreters.emplace_back(SC.LHS, Input);
   }
+  InputPrunes.assign(InputVals.size(), 0);
+  for (size_t I = 0; I < InputVals.size(); ++I)
+    InputIds.push_back(NextInputId++);
 
-  if (hasGivenInst(SC.LHS, [](Inst *I){ return I->K == Inst::Phi;})) {
+  if (SC.LHS->has(Inst::HasPhi)) {
     LHSHasPhi = true;
     if (AbstractInterpretPhi) {
       // Abstract interpret LHS because of phi
       for (unsigned I = 0; I < InputVals.size(); I++) {
-        LHSKnownBits.push_back(KnownBitsAnalysis().findKnownBits(SC.LHS, ConcreteInterpreters[I]));
-        LHSConstantRange.push_back(ConstantRangeAnalysis().findConstantRange(SC.LHS, ConcreteInterpreters[I]));
+        LHSKnownBits.push_back(KnownBitsAnalysis(Workers[0].AVCache, InputIds[I]).findKnownBits(SC.LHS, ConcreteInterpreters[I]));
+        LHSConstantRange.push_back(ConstantRangeAnalysis(Workers[0].AVCache, InputIds[I]).findConstantRange(SC.LHS, ConcreteInterpreters[I]));
       }
     }
   }
@@ -644,33 +890,33 @@ bool isDataflowConsistent(ValueCache &Cache) {
       auto *I = Pair.first;
       llvm::APInt V = Pair.second.getValue();
 
-      if ((I->KnownZeros & V) != 0 || (I->KnownOnes & ~V) != 0) {
+      if ((I->attrs().KnownZeros & V) != 0 || (I->attrs().KnownOnes & ~V) != 0) {
         return false;
       }
 
-      if (!I->Range.isFullSet()) {
-        if (!I->Range.contains(V)) {
+      if (!I->attrs().Range.isFullSet()) {
+        if (!I->attrs().Range.contains(V)) {
           return false;
         }
       }
 
-      if (I->NonZero && !V) {
+      if (I->attrs().NonZero && !V) {
         return false;
       }
 
-      if (I->NonNegative && V.isNegative()) {
+      if (I->attrs().NonNegative && V.isNegative()) {
         return false;
       }
 
-      if (I->PowOfTwo && !V.isPowerOf2()) {
+      if (I->attrs().PowOfTwo && !V.isPowerOf2()) {
         return false;
       }
 
-      if (I->Negative && !V.isNegative()) {
+      if (I->attrs().Negative && !V.isNegative()) {
         return false;
       }
 
-      if (I->NumSignBits > V.getNumSignBits()) {
+      if (I->attrs().NumSignBits > V.getNumSignBits()) {
         return false;
       }
     }
@@ -693,7 +939,7 @@ bool PruningManager::isInputValid(ValueCache &Cache) {
         continue;
 
       if (p.second.hasValue()) {
-        llvm::errs() << "  Var " << p.first->Name << " : "
+        llvm::errs() << "  Var " << p.first->attrs().Name << " : "
                      << p.second.getValue() << ", ";
       }
     }
@@ -758,13 +1004,22 @@ namespace {
     }
     return llvm::APInt::getSignedMinValue(Width);
   }
+
+  llvm::APInt getRandomAPInt(unsigned Width) {
+    llvm::APInt Result(Width, 0);
+    for (unsigned I = 0; I < Width; I += 16) {
+      auto Chunk = llvm::APInt(32, std::rand() & 0xFFFF).zextOrTrunc(Width);
+      Result |= Chunk.shl(I);
+    }
+    return Result;
+  }
 } // anon
 
 std::vector<ValueCache> PruningManager::generateInputSets(
   std::vector<Inst *> &Inputs) {
   std::vector<ValueCache> InputSets;
 
-  ValueCache Cache;
+  ValueCache Cache(InputNumbering);
 
   constexpr unsigned PermutedLimit = 15;
   std::string specialInputs = "abcde";
@@ -857,6 +1112,31 @@ std::vector<ValueCache> PruningManager::generateInputSets(
     llvm::errs() << "MaxTries (100) exhausted searching for small inputs.\n";
   }
 
+  // Fill up the rest with inputs mixing special and random values
+  std::vector<Inst *> Vars;
+  for (auto &&I : Inputs) {
+    if (I->K == souper::Inst::Var)
+      Vars.push_back(I);
+  }
+  for (m = 0; InputSets.size() < MaxInputSets && m < MaxTries; ++m) {
+    for (auto &&I : Vars) {
+      if (std::rand() % 2)
+        Cache[I] = {getSpecialAPInt('a' + std::rand() % 5, I->Width)};
+      else
+        Cache[I] = {getRandomAPInt(I->Width)};
+    }
+    bool Seen = false;
+    for (auto &Input : InputSets)
+      Seen |= sameInputs(Input, Cache, Vars);
+    if (!Seen && isInputValid(Cache))
+      InputSets.push_back(Cache);
+  }
+
+  // Once this is full, counterexamples replace the input sets that prune
+  // the fewest guesses
+  if (InputSets.size() > MaxInputSets)
+    InputSets.resize(MaxInputSets);
+
   return InputSets;
 }
 
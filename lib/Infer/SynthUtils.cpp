@@ -3,85 +3,93 @@
 
 namespace souper {
 extern Solver *S;
+namespace {
+// Rewrites the mapping (unless WithMapping is false) and the path conditions
+// of P in one walk.
+void rewrite(InstRewriter &R, ParsedReplacement &P, bool WithMapping = true) {
+  std::vector<Inst *> Roots;
+  if (WithMapping) {
+    Roots.push_back(P.Mapping.LHS);
+    Roots.push_back(P.Mapping.RHS);
+  }
+  for (const auto &PC : P.PCs) {
+    Roots.push_back(PC.LHS);
+    Roots.push_back(PC.RHS);
+  }
+  R.rewrite(Roots);
+  auto It = Roots.begin();
+  if (WithMapping) {
+    P.Mapping = InstMapping(It[0], It[1]);
+    It += 2;
+  }
+  for (auto &PC : P.PCs.mutate()) {
+    PC = InstMapping(It[0], It[1]);
+    It += 2;
+  }
+}
+
+InstRewriter replacing(InstContext &IC, const std::map<Inst *, Inst *> &M) {
+  InstRewriter R(IC);
+  for (const auto &P : M)
+    R.substitute(P.first, P.second);
+  return R;
+}
+}
+
 Inst *Replace(Inst *R, std::map<Inst *, Inst *> &M) {
-  std::map<Block *, Block *> BlockCache;
-  std::map<Inst *, llvm::APInt> ConstMap;
-  return getInstCopy(R, *R->IC, M, BlockCache, &ConstMap, false);
+  return replacing(*R->IC, M).rewrite(R);
 }
 
 Inst *Replace(Inst *R, std::map<Inst *, llvm::APInt> &ConstMap) {
-  std::map<Block *, Block *> BlockCache;
-  std::map<Inst *, Inst *> M;
-  return getInstCopy(R, *R->IC, M, BlockCache, &ConstMap, false);
+  InstRewriter Rewriter(*R->IC);
+  Rewriter.setConstMap(&ConstMap);
+  return Rewriter.rewrite(R);
 }
 
 ParsedReplacement Replace(ParsedReplacement I, std::map<Inst *, Inst *> &M) {
-  std::map<Block *, Block *> BlockCache;
-  std::map<Inst *, llvm::APInt> ConstMap;
-  auto &IC = *I.Mapping.LHS->IC;
-
-  I.Mapping.LHS =  getInstCopy(I.Mapping.LHS, IC, M, BlockCache, &ConstMap, false);
-  I.Mapping.RHS =  getInstCopy(I.Mapping.RHS, IC, M, BlockCache, &ConstMap, false);
-
-  for (auto &PC : I.PCs) {
-    PC.LHS = getInstCopy(PC.LHS, IC, M, BlockCache, &ConstMap, false, false);
-    PC.RHS = getInstCopy(PC.RHS, IC, M, BlockCache, &ConstMap, false, false);
-  }
-
+  auto R = replacing(*I.Mapping.LHS->IC, M);
+  rewrite(R, I);
   return I;
 }
 
 ParsedReplacement Replace(ParsedReplacement I, std::map<Inst *, llvm::APInt> &ConstMap) {
-  std::map<Block *, Block *> BlockCache;
-  std::map<Inst *, Inst *> M;
-  auto &IC = *I.Mapping.LHS->IC;
-
-  I.Mapping.LHS =  getInstCopy(I.Mapping.LHS, IC, M, BlockCache, &ConstMap, false);
-  I.Mapping.RHS =  getInstCopy(I.Mapping.RHS, IC, M, BlockCache, &ConstMap, false);
-
-  for (auto &PC : I.PCs) {
-    PC.LHS = getInstCopy(PC.LHS, IC, M, BlockCache, &ConstMap, false, false);
-    PC.RHS = getInstCopy(PC.RHS, IC, M, BlockCache, &ConstMap, false, false);
-  }
-
+  InstRewriter R(*I.Mapping.LHS->IC);
+  R.setConstMap(&ConstMap);
+  rewrite(R, I);
   return I;
 }
 
 Inst *Clone(Inst *R) {
-  std::map<Block *, Block *> BlockCache;
-  std::map<Inst *, llvm::APInt> ConstMap;
-  std::map<Inst *, Inst *> InstCache;
-  return getInstCopy(R, *R->IC, InstCache, BlockCache, &ConstMap, true, false);
+  return InstRewriter(*R->IC, /*CloneVars=*/true,
+                      /*CloneBlocks=*/false).rewrite(R);
 }
 
 InstMapping Clone(InstMapping In) {
-  std::map<Block *, Block *> BlockCache;
-  std::map<Inst *, llvm::APInt> ConstMap;
-  std::map<Inst *, Inst *> InstCache;
-  auto &IC = *In.LHS->IC;
-  InstMapping Out;
-  Out.LHS = getInstCopy(In.LHS, IC, InstCache, BlockCache, &ConstMap, true, false);
-  Out.RHS = getInstCopy(In.RHS, IC, InstCache, BlockCache, &ConstMap, true, false);
-  return Out;
+  InstRewriter R(*In.LHS->IC, /*CloneVars=*/true, /*CloneBlocks=*/false);
+  R.rewrite(In);
+  return In;
 }
 
 ParsedReplacement Clone(ParsedReplacement In) {
-  std::map<Block *, Block *> BlockCache;
-  std::map<Inst *, llvm::APInt> ConstMap;
-  std::map<Inst *, Inst *> InstCache;
-  auto &IC = *In.Mapping.LHS->IC;
-  std::vector<Inst *> RHSVars;
-  findVars(In.Mapping.RHS, RHSVars);
-  In.Mapping.LHS = getInstCopy(In.Mapping.LHS, IC, InstCache, BlockCache, &ConstMap, true, false);
-  In.Mapping.RHS = getInstCopy(In.Mapping.RHS, IC, InstCache, BlockCache, &ConstMap, true, false);
-  for (auto &PC : In.PCs) {
-    PC.LHS = getInstCopy(PC.LHS, IC, InstCache, BlockCache, &ConstMap, false, false);
-    PC.RHS = getInstCopy(PC.RHS, IC, InstCache, BlockCache, &ConstMap, false, false);
-  }
-
+  InstRewriter R(*In.Mapping.LHS->IC, /*CloneVars=*/true,
+                 /*CloneBlocks=*/false);
+  R.rewrite(In.Mapping);
+  // Vars only used by path conditions are shared with the original
+  R.setCloneVars(false);
+  rewrite(R, In, /*WithMapping=*/false);
   return In;
 }
 
+void Keep(InstContext::Scope &Scope, const ParsedReplacement &P) {
+  Scope.keep(P.Mapping);
+  for (const auto &PC : P.PCs)
+    Scope.keep(PC);
+  for (const auto &BPC : P.BPCs) {
+    Scope.keep(BPC.B);
+    Scope.keep(BPC.PC);
+  }
+}
+
 // bool IsValid(ParsedReplacement Input, InstContext &IC, Solver *S) {
 //   if (Input.PCs.empty()) {
 //     SynthesisContext SC{IC, S->getSMTLIBSolver(), Input.Mapping.LHS, nullptr,
@@ -127,7 +135,10 @@ std::optional<ParsedReplacement> Verify(ParsedReplacement Input) {
   //   }
   // }
   // Input.print(llvm::errs(), true);
-  Input = Clone(Input);
+
+  // Queries are built from Input as it is, so that checking a replacement
+  // again finds it in the caches. Only what is returned gets fresh Vars:
+  // callers go on to change the facts of the Vars they passed in.
   std::set<Inst *> ConstSet;
   souper::getConstants(Input.Mapping.RHS, ConstSet);
   souper::getConstants(Input.Mapping.LHS, ConstSet);
@@ -146,7 +157,7 @@ std::optional<ParsedReplacement> Verify(ParsedReplacement Input) {
       auto LHSCopy = getInstCopy(Input.Mapping.LHS, IC, InstCache, BlockCache, &ResultConstMap, true);
       auto RHS = getInstCopy(Input.Mapping.RHS, IC, InstCache, BlockCache, &ResultConstMap, true);
       Input.Mapping = InstMapping(LHSCopy, RHS);
-      for (auto &PC : Input.PCs) {
+      for (auto &PC : Input.PCs.mutate()) {
         PC.LHS = getInstCopy(PC.LHS, IC, InstCache, BlockCache, &ResultConstMap, true);
         PC.RHS = getInstCopy(PC.RHS, IC, InstCache, BlockCache, &ResultConstMap, true);
       }
@@ -164,7 +175,7 @@ std::optional<ParsedReplacement> Verify(ParsedReplacement Input) {
     llvm::errs() << EC.message() << '\n';
   }
   if (IsValid) {
-    return Input;
+    return Clone(Input);
   } else {
     static int C = 0;
 //    llvm::errs() << "C " << C++ << '\n';
@@ -350,7 +361,7 @@ std::vector<ValueCache> GetMultipleCEX(ParsedReplacement Input, size_t MaxCount
 }
 
 void tagConstExprs(Inst *I, std::set<Inst *> &Set) {
-  if (I->K == Inst::Const || (I->K == Inst::Var && I->Name.starts_with("sym"))) {
+  if (I->K == Inst::Const || (I->K == Inst::Var && I->attrs().Name.starts_with("sym"))) {
     Set.insert(I);
   } else {
     for (auto Op : I->Ops) {
@@ -421,8 +432,8 @@ void InfixPrinter::registerSymDBVar() {
 
 bool InfixPrinter::registerSymDFVars(Inst *I) {
   if (I->K == Inst::KnownOnesP && I->Ops[0]->K == Inst::Var &&
-    I->Ops[1]->Name.starts_with("symDF_K")) {
-    auto CName = I->Ops[0]->Name;
+    I->Ops[1]->attrs().Name.starts_with("symDF_K")) {
+    auto CName = I->Ops[0]->attrs().Name;
     if (CName.starts_with("symconst_")) {
       CName = "C" + CName.substr(9);
     }
@@ -431,8 +442,8 @@ bool InfixPrinter::registerSymDFVars(Inst *I) {
     return true;
   }
   if (I->K == Inst::KnownZerosP && I->Ops[0]->K == Inst::Var &&
-    I->Ops[1]->Name.starts_with("symDF_K")) {
-    auto CName = I->Ops[0]->Name;
+    I->Ops[1]->attrs().Name.starts_with("symDF_K")) {
+    auto CName = I->Ops[0]->attrs().Name;
     if (CName.starts_with("symconst_")) {
       CName = "C" + CName.substr(9);
     }
@@ -442,8 +453,8 @@ bool InfixPrinter::registerSymDFVars(Inst *I) {
   }
 
   if (I->K == Inst::Ult && I->Ops[0]->K == Inst::Var &&
-    I->Ops[1]->Name.starts_with("symDF_HI")) {
-    auto CName = I->Ops[0]->Name;
+    I->Ops[1]->attrs().Name.starts_with("symDF_HI")) {
+    auto CName = I->Ops[0]->attrs().Name;
     if (CName.starts_with("symconst_")) {
       CName = "C" + CName.substr(9);
     }
@@ -453,8 +464,8 @@ bool InfixPrinter::registerSymDFVars(Inst *I) {
   }
 
   if (I->K == Inst::Ule && I->Ops[1]->K == Inst::Var &&
-    I->Ops[0]->Name.starts_with("symDF_LO")) {
-    auto CName = I->Ops[1]->Name;
+    I->Ops[0]->attrs().Name.starts_with("symDF_LO")) {
+    auto CName = I->Ops[1]->attrs().Name;
     if (CName.starts_with("symconst_")) {
       CName = "C" + CName.substr(9);
     }
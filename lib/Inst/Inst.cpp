@@ -14,10 +14,14 @@
 
 #include "souper/Inst/Inst.h"
 
+#include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/StringSwitch.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MathExtras.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+#include <atomic>
 #include <queue>
 #include <set>
 #include <iostream>
@@ -28,8 +32,68 @@ const std::string souper::ReservedConstPrefix = "reservedconst_";
 const std::string souper::ReservedInstPrefix = "reservedinst";
 const std::string souper::BlockPred = "blockpred";
 
+const InstAttrs Inst::DefaultAttrs;
+
+Inst &Inst::operator=(const Inst &Other) {
+  llvm::FoldingSetNode::operator=(Other);
+  K = Other.K;
+  Width = Other.Width;
+  Number = Other.Number;
+  SynthesisConstID = Other.SynthesisConstID;
+  Available = Other.Available;
+  nReservedConsts = Other.nReservedConsts;
+  nHoles = Other.nHoles;
+  B = Other.B;
+  IC = Other.IC;
+  Ops = Other.Ops;
+  Val = Other.Val;
+  DemandedBits = Other.DemandedBits;
+  Summary = Other.Summary;
+  TreeSize = Other.TreeSize;
+  TreeCost = Other.TreeCost;
+  Attrs = Other.Attrs ? std::make_unique<InstAttrs>(*Other.Attrs) : nullptr;
+  return *this;
+}
+
+void Inst::summarize() {
+  Summary = 0;
+  switch (K) {
+  case Var:
+    if (SynthesisConstID != 0)
+      Summary = HasSynthesisConst;
+    else if (attrs().Name.starts_with("reserved"))
+      Summary = HasVar | HasReservedVar;
+    else
+      Summary = HasVar;
+    break;
+  case Phi:
+    Summary = Ops.size() > 1 ? HasPhi | HasMultiArgPhi : HasPhi;
+    break;
+  case ReservedConst:
+  case ReservedInst:
+    Summary = HasReserved;
+    break;
+  case Hole:
+    Summary = HasHole;
+    break;
+  case Custom:
+    Summary = HasCustom;
+    break;
+  default:
+    break;
+  }
+
+  TreeSize = 1;
+  TreeCost = getCost(K);
+  for (auto Op : Ops) {
+    Summary |= Op->Summary;
+    TreeSize = llvm::SaturatingAdd(TreeSize, Op->TreeSize);
+    TreeCost = llvm::SaturatingAdd(TreeCost, Op->TreeCost);
+  }
+}
+
 bool Inst::hasOrigin(llvm::Value *V) const {
-  return std::find(Origins.begin(), Origins.end(), V) != Origins.end();
+  return llvm::is_contained(attrs().Origins, V);
 }
 
 bool Inst::operator<(const Inst &Other) const {
@@ -73,8 +137,8 @@ bool Inst::operator<(const Inst &Other) const {
   if (Ops.size() > Other.Ops.size())
     return false;
 
-  const std::vector<Inst *> &OpsA = orderedOps();
-  const std::vector<Inst *> &OpsB = Other.orderedOps();
+  llvm::ArrayRef<Inst *> OpsA = orderedOps();
+  llvm::ArrayRef<Inst *> OpsB = Other.orderedOps();
 
   for (unsigned I = 0; I != OpsA.size(); ++I) {
     if (OpsA[I] == OpsB[I])
@@ -82,26 +146,30 @@ bool Inst::operator<(const Inst &Other) const {
     return (*OpsA[I] < *OpsB[I]);
   }
 
-  if (HarvestKind == HarvestType::HarvestedFromDef &&
-      Other.HarvestKind == HarvestType::HarvestedFromUse) {
+  const InstAttrs &A = attrs(), &OtherA = Other.attrs();
+  if (A.HarvestKind == HarvestType::HarvestedFromDef &&
+      OtherA.HarvestKind == HarvestType::HarvestedFromUse) {
     return false;
   }
-  else if (HarvestKind == HarvestType::HarvestedFromUse &&
-           Other.HarvestKind == HarvestType::HarvestedFromDef) {
+  else if (A.HarvestKind == HarvestType::HarvestedFromUse &&
+           OtherA.HarvestKind == HarvestType::HarvestedFromDef) {
     return true;
   }
 
-  if (HarvestFrom != Other.HarvestFrom)
-    return HarvestFrom < Other.HarvestFrom;
+  if (A.HarvestFrom != OtherA.HarvestFrom)
+    return A.HarvestFrom < OtherA.HarvestFrom;
   return false;
 }
 
-const std::vector<Inst *> &Inst::orderedOps() const {
+llvm::ArrayRef<Inst *> Inst::orderedOps() const {
   if (!isCommutative(K))
     return Ops;
 
+  if (!Attrs)
+    Attrs = std::make_unique<InstAttrs>();
+  auto &OrderedOps = Attrs->OrderedOps;
   if (OrderedOps.empty()) {
-    OrderedOps = Ops;
+    OrderedOps.assign(Ops.begin(), Ops.end());
     std::sort(OrderedOps.begin(), OrderedOps.end(), [](Inst *A, Inst *B) {
       return *A < *B;
     });
@@ -146,7 +214,7 @@ std::string ReplacementContext::printInstImpl(Inst *I, llvm::raw_ostream &Out,
     break;
   }
 
-  const std::vector<Inst *> &Ops = I->orderedOps();
+  llvm::ArrayRef<Inst *> Ops = I->orderedOps();
   for (unsigned Idx = 0; Idx != Ops.size(); ++Idx) {
     if (Idx == 0)
       OpsSS << " ";
@@ -167,9 +235,9 @@ std::string ReplacementContext::printInstImpl(Inst *I, llvm::raw_ostream &Out,
     }
   }
   std::string InstName;
-  std::string CustomNameSave = I->Name;
-  if (printNames && !I->Name.empty() && I->K != Inst::Custom) {
-    InstName = I->Name;
+  std::string CustomNameSave = I->attrs().Name;
+  if (printNames && !I->attrs().Name.empty() && I->K != Inst::Custom) {
+    InstName = I->attrs().Name;
   } else {
     InstName = std::to_string(InstNames.size() + BlockNames.size());
   }
@@ -190,31 +258,32 @@ std::string ReplacementContext::printInstImpl(Inst *I, llvm::raw_ostream &Out,
       Out << "%" << InstName << ":i" << I->Width << " = "
           << ((I->K == Inst::Custom) ? CustomNameSave : Inst::getKindName(I->K));
       if (I->K == Inst::Var) {
-        if (I->KnownZeros.getBoolValue() || I->KnownOnes.getBoolValue())
-          Out << " (knownBits=" << Inst::getKnownBitsString(I->KnownZeros, I->KnownOnes)
+        const InstAttrs &A = I->attrs();
+        if (A.KnownZeros.getBoolValue() || A.KnownOnes.getBoolValue())
+          Out << " (knownBits=" << Inst::getKnownBitsString(A.KnownZeros, A.KnownOnes)
               << ")";
 
-        if (I->NonNegative)
+        if (A.NonNegative)
           Out << " (nonNegative)";
-        if (I->Negative)
+        if (A.Negative)
           Out << " (negative)";
-        if (I->NonZero)
+        if (A.NonZero)
           Out << " (nonZero)";
-        if (I->PowOfTwo)
+        if (A.PowOfTwo)
           Out << " (powerOfTwo)";
-        if (I->NumSignBits > 1)
-          Out << " (signBits=" << I->NumSignBits << ")";
-        if (!I->Range.isFullSet())
-          Out << " (range=[" << I->Range.getLower()
-              << "," << I->Range.getUpper() << "))";
+        if (A.NumSignBits > 1)
+          Out << " (signBits=" << A.NumSignBits << ")";
+        if (!A.Range.isFullSet())
+          Out << " (range=[" << A.Range.getLower()
+              << "," << A.Range.getUpper() << "))";
       }
       Out << OpsSS.str();
 
-      if (OrigI->DepsWithExternalUses.find(I) != OrigI->DepsWithExternalUses.end())
+      if (OrigI->attrs().DepsWithExternalUses.find(I) != OrigI->attrs().DepsWithExternalUses.end())
         Out << " (hasExternalUses)";
 
-      if (printNames && !I->Name.empty())
-        Out << " ; " << I->Name;
+      if (printNames && !I->attrs().Name.empty())
+        Out << " ; " << I->attrs().Name;
       Out << '\n';
       break;
     }
@@ -277,25 +346,299 @@ bool ReplacementContext::empty() {
 }
 
 Inst *ReplacementContext::getInst(llvm::StringRef Name) {
-  auto InstIt = NameToInst.find(Name.str());
+  auto InstIt = NameToInst.find(Name);
   return (InstIt == NameToInst.end()) ? 0 : InstIt->second;
 }
 
 void ReplacementContext::setInst(llvm::StringRef Name, Inst *I) {
-  NameToInst[Name.str()] = I;
+  NameToInst[Name] = I;
   InstNames[I] = Name;
 }
 
+llvm::StringRef ReplacementContext::getName(Inst *I) const {
+  auto It = InstNames.find(I);
+  return It == InstNames.end() ? llvm::StringRef() : It->second;
+}
+
+llvm::StringRef ReplacementContext::getName(Block *B) const {
+  auto It = BlockNames.find(B);
+  return It == BlockNames.end() ? llvm::StringRef() : It->second;
+}
+
 Block *ReplacementContext::getBlock(llvm::StringRef Name) {
-  auto BlockIt = NameToBlock.find(Name.str());
+  auto BlockIt = NameToBlock.find(Name);
   return (BlockIt == NameToBlock.end()) ? 0 : BlockIt->second;
 }
 
 void ReplacementContext::setBlock(llvm::StringRef Name, Block *B) {
-  NameToBlock[Name.str()] = B;
+  NameToBlock[Name] = B;
   BlockNames[B] = Name;
 }
 
+void ReplacementPrinter::reset(bool printNames) {
+  InstNums.clear();
+  BlockNums.clear();
+  Buf.clear();
+  PrintNames = printNames;
+}
+
+void ReplacementPrinter::appendNum(uint64_t N) {
+  char Digits[20];
+  char *End = Digits + sizeof(Digits), *Begin = End;
+  do {
+    *--Begin = '0' + N % 10;
+    N /= 10;
+  } while (N);
+  Buf.append(Begin, End);
+}
+
+llvm::ArrayRef<Inst *> ReplacementPrinter::operands(Inst *I) const {
+  llvm::ArrayRef<Inst *> Ops = I->orderedOps();
+  switch (I->K) {
+  default:
+    return Ops;
+  case Inst::SAddWithOverflow:
+  case Inst::UAddWithOverflow:
+  case Inst::SSubWithOverflow:
+  case Inst::USubWithOverflow:
+  case Inst::SMulWithOverflow:
+  case Inst::UMulWithOverflow:
+    // the tuple is printed with the operands of its overflow half
+    return llvm::ArrayRef<Inst *>(I->Ops[1]->Ops).take_front(Ops.size());
+  }
+}
+
+void ReplacementPrinter::printBlock(Block *B) {
+  unsigned Num = InstNums.size() + BlockNums.size();
+  if (!BlockNums.insert({B, Num}).second)
+    return;
+  Buf.push_back('%');
+  appendNum(Num);
+  append(" = block ");
+  appendNum(B->Preds);
+  Buf.push_back('\n');
+}
+
+void ReplacementPrinter::printRef(Inst *I) {
+  auto It = InstNums.find(I);
+  if (It != InstNums.end()) {
+    Buf.push_back('%');
+    if (hasName(I))
+      append(I->attrs().Name);
+    else
+      appendNum(It->second);
+    return;
+  }
+  assert(I->K == Inst::Const || I->K == Inst::UntypedConst);
+  if (I->Val.getBitWidth() <= 64) {
+    appendNum(I->Val.getZExtValue());
+  } else {
+    llvm::raw_svector_ostream OS(Buf);
+    I->Val.print(OS, false);
+  }
+  if (I->K == Inst::Const) {
+    append(":i");
+    appendNum(I->Val.getBitWidth());
+  }
+}
+
+// Operands are printed before their users, in the order the recursive
+// ReplacementContext::printInst visits them, so the numbering is the same
+void ReplacementPrinter::printInst(Inst *Root) {
+  auto IsPrinted = [this](Inst *I) {
+    return I->K == Inst::Const || I->K == Inst::UntypedConst ||
+           InstNums.count(I);
+  };
+  auto Enter = [this](Inst *I) {
+    if (I->K == Inst::Phi)
+      printBlock(I->B);
+    Stack.push_back({I, 0});
+  };
+
+  if (IsPrinted(Root))
+    return;
+  Stack.clear();
+  Enter(Root);
+  while (!Stack.empty()) {
+    Inst *I = Stack.back().first;
+    unsigned &NextOp = Stack.back().second;
+    llvm::ArrayRef<Inst *> Ops = operands(I);
+    if (NextOp != Ops.size()) {
+      Inst *Op = Ops[NextOp++];
+      if (!IsPrinted(Op))
+        Enter(Op);
+      continue;
+    }
+    Stack.pop_back();
+    printInstLine(I, Root);
+  }
+}
+
+void ReplacementPrinter::printInstLine(Inst *I, Inst *Root) {
+  unsigned Num = InstNums.size() + BlockNums.size();
+  InstNums[I] = Num;
+
+  // Skip the elements of overflow instruction tuple in souper IR
+  switch (I->K) {
+  case Inst::SAddO:
+  case Inst::UAddO:
+  case Inst::SSubO:
+  case Inst::USubO:
+  case Inst::SMulO:
+  case Inst::UMulO:
+    return;
+  default:
+    break;
+  }
+
+  const InstAttrs &A = I->attrs();
+  printRef(I);
+  append(":i");
+  appendNum(I->Width);
+  append(" = ");
+  append(I->K == Inst::Custom ? llvm::StringRef(A.Name)
+                              : llvm::StringRef(Inst::getKindName(I->K)));
+  if (I->K == Inst::Var) {
+    if (A.KnownZeros.getBoolValue() || A.KnownOnes.getBoolValue()) {
+      append(" (knownBits=");
+      append(Inst::getKnownBitsString(A.KnownZeros, A.KnownOnes));
+      Buf.push_back(')');
+    }
+    if (A.NonNegative)
+      append(" (nonNegative)");
+    if (A.Negative)
+      append(" (negative)");
+    if (A.NonZero)
+      append(" (nonZero)");
+    if (A.PowOfTwo)
+      append(" (powerOfTwo)");
+    if (A.NumSignBits > 1) {
+      append(" (signBits=");
+      appendNum(A.NumSignBits);
+      Buf.push_back(')');
+    }
+    if (!A.Range.isFullSet()) {
+      llvm::raw_svector_ostream OS(Buf);
+      OS << " (range=[" << A.Range.getLower()
+         << "," << A.Range.getUpper() << "))";
+    }
+  }
+
+  if (I->K == Inst::Phi) {
+    append(" %");
+    appendNum(BlockNums.lookup(I->B));
+    Buf.push_back(',');
+  }
+  llvm::ArrayRef<Inst *> Ops = operands(I);
+  for (unsigned Idx = 0; Idx != Ops.size(); ++Idx) {
+    append(Idx == 0 ? " " : ", ");
+    printRef(Ops[Idx]);
+  }
+
+  const auto &ExternalUses = Root->attrs().DepsWithExternalUses;
+  if (!ExternalUses.empty() && ExternalUses.count(I))
+    append(" (hasExternalUses)");
+  if (PrintNames && !A.Name.empty()) {
+    append(" ; ");
+    append(A.Name);
+  }
+  Buf.push_back('\n');
+}
+
+void ReplacementPrinter::printRootAttributes(Inst *LHS) {
+  if (!LHS->DemandedBits.isAllOnes()) {
+    append(" (demandedBits=");
+    append(Inst::getDemandedBitsString(LHS->DemandedBits));
+    Buf.push_back(')');
+  }
+  if (LHS->attrs().HarvestKind == HarvestType::HarvestedFromUse)
+    append(" (harvestedFromUse)");
+  Buf.push_back('\n');
+}
+
+void ReplacementPrinter::printPCs(const BlockPCs &BPCs,
+                                  const std::vector<InstMapping> &PCs) {
+  for (const auto &PC : PCs) {
+    printInst(PC.LHS);
+    printInst(PC.RHS);
+    append("pc ");
+    printRef(PC.LHS);
+    Buf.push_back(' ');
+    printRef(PC.RHS);
+    Buf.push_back('\n');
+  }
+  for (const auto &BPC : BPCs) {
+    assert(BPC.B && "NULL Block pointer!");
+    printBlock(BPC.B);
+    printInst(BPC.PC.LHS);
+    printInst(BPC.PC.RHS);
+    append("blockpc %");
+    appendNum(BlockNums.lookup(BPC.B));
+    Buf.push_back(' ');
+    appendNum(BPC.PredIdx);
+    Buf.push_back(' ');
+    printRef(BPC.PC.LHS);
+    Buf.push_back(' ');
+    printRef(BPC.PC.RHS);
+    Buf.push_back('\n');
+  }
+}
+
+llvm::StringRef ReplacementPrinter::print(const BlockPCs &BPCs,
+                                          const std::vector<InstMapping> &PCs,
+                                          InstMapping Mapping,
+                                          bool printNames) {
+  assert(Mapping.LHS);
+  assert(Mapping.RHS);
+  reset(printNames);
+  printPCs(BPCs, PCs);
+  printInst(Mapping.LHS);
+  printInst(Mapping.RHS);
+  append("cand ");
+  printRef(Mapping.LHS);
+  Buf.push_back(' ');
+  printRef(Mapping.RHS);
+  printRootAttributes(Mapping.LHS);
+  return Buf;
+}
+
+llvm::StringRef ReplacementPrinter::printLHS(const BlockPCs &BPCs,
+                                             const std::vector<InstMapping> &PCs,
+                                             Inst *LHS, bool printNames) {
+  assert(LHS);
+  reset(printNames);
+  printPCs(BPCs, PCs);
+  printInst(LHS);
+  append("infer ");
+  printRef(LHS);
+  printRootAttributes(LHS);
+  return Buf;
+}
+
+llvm::StringRef ReplacementPrinter::printRHS(Inst *RHS) {
+  size_t Begin = Buf.size();
+  printInst(RHS);
+  append("result ");
+  printRef(RHS);
+  Buf.push_back('\n');
+  return Buf.str().substr(Begin);
+}
+
+void ReplacementPrinter::getContext(ReplacementContext &Context) const {
+  // names are given in the order they were printed, so that a name used
+  // twice refers to the same value as after ReplacementContext::printInst
+  std::vector<std::pair<unsigned, Inst *>> Insts;
+  Insts.reserve(InstNums.size());
+  for (const auto &[I, Num] : InstNums)
+    Insts.push_back({Num, I});
+  llvm::sort(Insts);
+  for (const auto &[Num, I] : Insts)
+    Context.setInst(hasName(I) ? llvm::StringRef(I->attrs().Name)
+                               : llvm::StringRef(std::to_string(Num)), I);
+  for (const auto &[B, Num] : BlockNums)
+    Context.setBlock(std::to_string(Num), B);
+}
+
 std::string Inst::getKnownBitsString(llvm::APInt Zero, llvm::APInt One) {
   std::string Str;
   for (int K = Zero.getBitWidth() - 1; K >= 0; --K) {
@@ -483,7 +826,7 @@ const char *Inst::getKindName(Kind K) {
   }
 }
 
-Inst::Kind Inst::getKind(std::string Name) {
+Inst::Kind Inst::getKind(llvm::StringRef Name) {
   return llvm::StringSwitch<Inst::Kind>(Name)
                    .Case("var", Inst::Var)
                    .Case("phi", Inst::Phi)
@@ -576,8 +919,8 @@ void Inst::Profile(llvm::FoldingSetNodeID &ID) const {
   default:
     if (!DemandedBits.isAllOnes())
       ID.Add(DemandedBits);
-    if (HarvestKind == HarvestType::HarvestedFromUse) {
-      ID.Add(HarvestFrom);
+    if (attrs().HarvestKind == HarvestType::HarvestedFromUse) {
+      ID.Add(attrs().HarvestFrom);
     }
     break;
   }
@@ -593,6 +936,129 @@ void Inst::Print() {
 }
 #endif
 
+static std::atomic<uint64_t> NextContextID{0};
+
+InstContext::InstContext() : ID(NextContextID++) {}
+
+InstContext::~InstContext() {
+  // a listener may remove or delete itself
+  auto Current = Listeners;
+  for (auto L : Current)
+    L->destroyed();
+}
+
+void InstContext::removeListener(InstContextListener *L) {
+  Listeners.erase(std::remove(Listeners.begin(), Listeners.end(), L),
+                  Listeners.end());
+}
+
+InstContext::Scope::Scope(InstContext &IC)
+    : IC(&IC), Depth(++IC.OpenScopes), NumInsts(IC.Insts.size()) {
+  for (const auto &P : IC.VarInstsByWidth)
+    NumVars[P.first] = P.second.size();
+  for (const auto &P : IC.BlocksByPreds)
+    NumBlocks[P.first] = P.second.size();
+}
+
+InstContext::Scope::Scope(Scope &&Other)
+    : IC(Other.IC), Depth(Other.Depth), NumInsts(Other.NumInsts),
+      NumVars(std::move(Other.NumVars)), NumBlocks(std::move(Other.NumBlocks)),
+      Kept(std::move(Other.Kept)), KeptBlocks(std::move(Other.KeptBlocks)) {
+  Other.IC = nullptr;
+}
+
+void InstContext::Scope::rollback() {
+  if (IC)
+    IC->reclaim(*this);
+}
+
+void InstContext::Scope::commitOrRollback(bool Commit) {
+  if (!IC)
+    return;
+  if (!Commit)
+    IC->reclaim(*this);
+  assert(IC->OpenScopes == Depth && "scopes must be closed in reverse order");
+  --IC->OpenScopes;
+  IC = nullptr;
+}
+
+InstContext::Scope InstContext::beginScope() {
+  return Scope(*this);
+}
+
+void InstContext::reclaim(Scope &S) {
+  assert(OpenScopes == S.Depth && "an inner scope is still open");
+
+  llvm::DenseSet<Inst *> Fresh;
+  for (size_t I = S.NumInsts; I < Insts.size(); ++I)
+    Fresh.insert(Insts[I].get());
+  for (const auto &P : VarInstsByWidth)
+    for (size_t I = S.NumVars.lookup(P.first); I < P.second.size(); ++I)
+      Fresh.insert(P.second[I].get());
+  llvm::DenseSet<Block *> FreshBlocks;
+  for (const auto &P : BlocksByPreds)
+    for (size_t I = S.NumBlocks.lookup(P.first); I < P.second.size(); ++I)
+      FreshBlocks.insert(P.second[I].get());
+
+  // Insts only point to older Insts, so only fresh ones need to be walked
+  llvm::DenseSet<Inst *> Live;
+  llvm::DenseSet<Block *> LiveBlocks;
+  std::vector<Inst *> Worklist(S.Kept.begin(), S.Kept.end());
+  auto KeepBlock = [&](Block *B) {
+    if (FreshBlocks.count(B) && LiveBlocks.insert(B).second)
+      Worklist.insert(Worklist.end(), B->PredVars.begin(), B->PredVars.end());
+  };
+  for (auto B : S.KeptBlocks)
+    KeepBlock(B);
+  while (!Worklist.empty()) {
+    Inst *I = Worklist.back();
+    Worklist.pop_back();
+    if (!Fresh.count(I) || !Live.insert(I).second)
+      continue;
+    Worklist.insert(Worklist.end(), I->Ops.begin(), I->Ops.end());
+    if (I->K == Inst::Phi)
+      KeepBlock(I->B);
+  }
+  if (Live.size() == Fresh.size() && LiveBlocks.size() == FreshBlocks.size())
+    return;
+
+  if (!Listeners.empty()) {
+    llvm::DenseSet<Inst *> Dead;
+    for (auto I : Fresh)
+      if (!Live.count(I))
+        Dead.insert(I);
+    auto Current = Listeners;
+    for (auto L : Current)
+      L->reclaimed(Dead);
+  }
+
+  // Unlink every dead Inst from InstSet before deleting any of them, as
+  // unlinking walks the bucket chain through the other nodes
+  auto IsLive = [&](const std::unique_ptr<Inst> &I) {
+    return Live.count(I.get());
+  };
+  auto Dead = std::stable_partition(Insts.begin() + S.NumInsts, Insts.end(),
+                                    IsLive);
+  for (auto I = Dead; I != Insts.end(); ++I)
+    InstSet.RemoveNode(I->get());
+  Insts.erase(Dead, Insts.end());
+  for (auto &P : VarInstsByWidth) {
+    auto &List = P.second;
+    List.erase(std::stable_partition(List.begin() + S.NumVars.lookup(P.first),
+                                     List.end(), IsLive),
+               List.end());
+  }
+  for (auto &P : BlocksByPreds) {
+    auto &List = P.second;
+    List.erase(std::stable_partition(
+                   List.begin() + S.NumBlocks.lookup(P.first), List.end(),
+                   [&](const std::unique_ptr<Block> &B) {
+                     return LiveBlocks.count(B.get());
+                   }),
+               List.end());
+  }
+}
+
 Inst *InstContext::getConst(const llvm::APInt &Val) {
   llvm::FoldingSetNodeID ID;
   ID.AddInteger(Inst::Const);
@@ -609,6 +1075,7 @@ Inst *InstContext::getConst(const llvm::APInt &Val) {
   N->Width = Val.getBitWidth();
   N->Val = Val;
   N->IC = this;
+  N->summarize();
   InstSet.InsertNode(N, IP);
   return N;
 }
@@ -630,6 +1097,7 @@ Inst *InstContext::getUntypedConst(const llvm::APInt &Val) {
   N->Width = 0;
   N->Val = Val;
   N->IC = this;
+  N->summarize();
   InstSet.InsertNode(N, IP);
   return N;
 }
@@ -641,6 +1109,7 @@ Inst *InstContext::getReservedConst() {
   N->SynthesisConstID = ++ReservedConstCounter;
   N->Width = 0;
   N->IC = this;
+  N->summarize();
   return N;
 }
 
@@ -650,6 +1119,7 @@ Inst *InstContext::getReservedInst() {
   N->K = Inst::ReservedInst;
   N->Width = 0;
   N->IC = this;
+  N->summarize();
   return N;
 }
 
@@ -659,6 +1129,7 @@ Inst *InstContext::createHole(unsigned Width) {
   N->K = Inst::Hole;
   N->Width = Width;
   N->IC = this;
+  N->summarize();
   return N;
 }
 
@@ -670,7 +1141,8 @@ Inst *InstContext::createVar(unsigned Width, llvm::StringRef Name,
                              unsigned SynthesisConstID) {
   // Create a new vector of Insts if Width is not found in VarInstsByWidth
   auto &InstList = VarInstsByWidth[Width];
-  unsigned Number = InstList.size();
+  // Vars freed by a scope leave gaps, so don't reuse the number of the last one
+  unsigned Number = InstList.empty() ? 0 : InstList.back()->Number + 1;
   auto I = new Inst;
   InstList.emplace_back(I);
   assert(Range.getBitWidth() == Width && Zero.getBitWidth() == Width && One.getBitWidth() == Width);
@@ -678,18 +1150,20 @@ Inst *InstContext::createVar(unsigned Width, llvm::StringRef Name,
   I->K = Inst::Var;
   I->Number = Number;
   I->Width = Width;
-  I->Name = Name;
-  I->Range = Range;
-  I->KnownZeros = Zero;
-  I->KnownOnes = One;
-  I->NonZero = NonZero;
-  I->NonNegative = NonNegative;
-  I->PowOfTwo = PowOfTwo;
-  I->Negative = Negative;
-  I->NumSignBits = NumSignBits;
+  InstAttrs &A = I->mutableAttrs();
+  A.Name = Name.str();
+  A.Range = Range;
+  A.KnownZeros = Zero;
+  A.KnownOnes = One;
+  A.NonZero = NonZero;
+  A.NonNegative = NonNegative;
+  A.PowOfTwo = PowOfTwo;
+  A.Negative = Negative;
+  A.NumSignBits = NumSignBits;
   I->DemandedBits = DemandedBits;
   I->SynthesisConstID = SynthesisConstID;
   I->IC = this;
+  I->summarize();
   return I;
 }
 
@@ -713,7 +1187,7 @@ Inst *InstContext::createSynthesisConstant(unsigned Width, unsigned SynthesisCon
 
 Block *InstContext::createBlock(unsigned Preds) {
   auto &BlockList = BlocksByPreds[Preds];
-  unsigned Number = BlockList.size();
+  unsigned Number = BlockList.empty() ? 0 : BlockList.back()->Number + 1;
   auto B = new Block;
   BlockList.emplace_back(B);
 
@@ -724,7 +1198,7 @@ Block *InstContext::createBlock(unsigned Preds) {
   return B;
 }
 
-Inst *InstContext::getPhi(Block *B, const std::vector<Inst *> &Ops, llvm::APInt DemandedBits) {
+Inst *InstContext::getPhi(Block *B, llvm::ArrayRef<Inst *> Ops, llvm::APInt DemandedBits) {
   llvm::FoldingSetNodeID ID;
   ID.AddInteger(Inst::Phi);
   ID.AddInteger(Ops[0]->Width);
@@ -743,40 +1217,34 @@ Inst *InstContext::getPhi(Block *B, const std::vector<Inst *> &Ops, llvm::APInt
   N->K = Inst::Phi;
   N->Width = Ops[0]->Width;
   N->B = B;
-  N->Ops = Ops;
+  N->Ops.assign(Ops.begin(), Ops.end());
   N->DemandedBits = DemandedBits;
   N->IC = this;
+  N->summarize();
   InstSet.InsertNode(N, IP);
   return N;
 }
 
-Inst *InstContext::getPhi(Block *B, const std::vector<Inst *> &Ops) {
+Inst *InstContext::getPhi(Block *B, llvm::ArrayRef<Inst *> Ops) {
   llvm::APInt DemandedBits = llvm::APInt::getAllOnes(Ops[0]->Width);
   return getPhi(B, Ops, DemandedBits);
 }
 
 
 Inst *InstContext::getInst(Inst::Kind K, unsigned Width,
-                           const std::vector<Inst *> &Ops,
+                           llvm::ArrayRef<Inst *> Ops,
                            llvm::APInt DemandedBits, bool Available) {
   if (K == Inst::Var)
     llvm::report_fatal_error("Use createVar() to make a var, not getInst()");
 
-  std::vector<Inst *> OrderedOps;
-
-  const std::vector<Inst *> *InstOps;
-  if (Inst::isCommutative(K)) {
-    OrderedOps = Ops;
-    std::sort(OrderedOps.begin(), OrderedOps.end());
-    InstOps = &OrderedOps;
-  } else {
-    InstOps = &Ops;
-  }
+  llvm::SmallVector<Inst *, 3> InstOps(Ops.begin(), Ops.end());
+  if (Inst::isCommutative(K))
+    std::sort(InstOps.begin(), InstOps.end());
 
   llvm::FoldingSetNodeID ID;
   ID.AddInteger(K);
   ID.AddInteger(Width);
-  for (auto O : *InstOps)
+  for (auto O : InstOps)
     ID.AddPointer(O);
   if (!DemandedBits.isAllOnes())
     ID.Add(DemandedBits);
@@ -789,18 +1257,17 @@ Inst *InstContext::getInst(Inst::Kind K, unsigned Width,
   Insts.emplace_back(N);
   N->K = K;
   N->Width = Width;
-  N->Ops = *InstOps;
+  N->Ops = std::move(InstOps);
   N->DemandedBits = DemandedBits;
   N->Available = Available;
-  N->HarvestKind = HarvestType::HarvestedFromDef;
-  N->HarvestFrom = nullptr;
   N->IC = this;
+  N->summarize();
   InstSet.InsertNode(N, IP);
   return N;
 }
 
 Inst *InstContext::getInst(Inst::Kind K, unsigned Width,
-                           const std::vector<Inst *> &Ops,
+                           llvm::ArrayRef<Inst *> Ops,
                            bool Available) {
   llvm::APInt DemandedBits = llvm::APInt::getAllOnes(Width);
   return getInst(K, Width, Ops, DemandedBits, Available);
@@ -1005,7 +1472,7 @@ static int costHelper(Inst *I, Inst *Root, std::set<Inst *> &Visited,
   if (!Visited.insert(I).second)
     return 0;
   if (IgnoreDepsWithExternalUses && I != Root &&
-      Root->DepsWithExternalUses.find(I) != Root->DepsWithExternalUses.end()) {
+      Root->attrs().DepsWithExternalUses.find(I) != Root->attrs().DepsWithExternalUses.end()) {
     return 0;
   }
   int Cost = Inst::getCost(I->K);
@@ -1065,7 +1532,7 @@ void souper::PrintReplacement(llvm::raw_ostream &Out,
        << Inst::getDemandedBitsString(Mapping.LHS->DemandedBits)
        << ")";
   }
-  if (Mapping.LHS->HarvestKind == HarvestType::HarvestedFromUse) {
+  if (Mapping.LHS->attrs().HarvestKind == HarvestType::HarvestedFromUse) {
     Out << " (harvestedFromUse)";
   }
   Out << "\n";
@@ -1098,7 +1565,7 @@ void souper::PrintReplacementLHS(llvm::raw_ostream &Out,
        << Inst::getDemandedBitsString(LHS->DemandedBits)
        << ")";
   }
-  if (LHS->HarvestKind == HarvestType::HarvestedFromUse) {
+  if (LHS->attrs().HarvestKind == HarvestType::HarvestedFromUse) {
     Out << " (harvestedFromUse)";
   }
   Out << "\n";
@@ -1162,6 +1629,8 @@ void souper::findCands(Inst *Root, std::set<Inst *> &Guesses,
 
 /* TODO call findCands instead */
 void souper::findVars(Inst *Root, std::vector<Inst *> &Vars) {
+  if (!Root->has(Inst::HasVar))
+    return;
   findInsts(Root, Vars, [](Inst *I) {
     return I->K == Inst::Var && I->SynthesisConstID == 0;
   });
@@ -1189,7 +1658,7 @@ void souper::findInsts(Inst *Root, std::vector<Inst *> &Insts, std::function<boo
 
 void hasConstantHelper(Inst *I, std::set<Inst *> &Visited,
                        std::set<Inst *> &ConstSet) {
-  if (I->K == Inst::Var && (I->SynthesisConstID != 0 || I->Name.starts_with("reserved"))) {
+  if (I->K == Inst::Var && (I->SynthesisConstID != 0 || I->attrs().Name.starts_with("reserved"))) {
     ConstSet.insert(I);
   } else {
     if (Visited.insert(I).second)
@@ -1200,6 +1669,8 @@ void hasConstantHelper(Inst *I, std::set<Inst *> &Visited,
 
 // TODO do this a more efficient way
 void souper::getConstants(Inst *I, std::set<Inst *> &ConstSet) {
+  if (!I->has(Inst::HasSynthesisConst | Inst::HasReservedVar))
+    return;
   std::set<Inst *> Visited;
   hasConstantHelper(I, Visited, ConstSet);
 }
@@ -1208,6 +1679,8 @@ void souper::getConstants(Inst *I, std::set<Inst *> &ConstSet) {
 
 // TODO: Convert to a more generic getGivenInst similar to hasGivenInst below
 void souper::getHoles(Inst *Root, std::vector<Inst *> &Holes) {
+  if (!Root->has(Inst::HasHole))
+    return;
   // breadth-first search
   std::set<Inst *> Visited;
   std::queue<Inst *> Q;
@@ -1232,69 +1705,152 @@ bool souper::hasGivenInst(Inst *Root, std::function<bool(Inst*)> InstTester) {
   return Insts.size() > 0;
 }
 
-Inst *souper::getInstCopy(Inst *I, InstContext &IC,
-                          std::map<Inst *, Inst *> &InstCache,
-                          std::map<Block *, Block *> &BlockCache,
-                          std::map<Inst *, llvm::APInt> *ConstMap,
-                          bool CloneVars, bool CloneBlocks) {
+unsigned InstNumbering::addNode(Inst *I) {
+  unsigned Idx = Insts.size();
+  Index[I] = Idx;
+  Insts.push_back(I);
+  return Idx;
+}
+
+unsigned InstNumbering::add(Inst *I) {
+  auto It = Index.find(I);
+  if (It != Index.end())
+    return It->second;
+  OpBegin.push_back(OpIndices.size());
+  return addNode(I);
+}
+
+unsigned InstNumbering::addDAG(Inst *Root) {
+  // iterative post-order walk, so deep DAGs don't exhaust the stack
+  std::vector<std::pair<Inst *, unsigned>> Stack;
+  if (!Index.count(Root))
+    Stack.push_back({Root, 0});
+  while (!Stack.empty()) {
+    auto &[I, NextOp] = Stack.back();
+    if (NextOp < I->Ops.size()) {
+      Inst *Op = I->Ops[NextOp++];
+      if (!Index.count(Op))
+        Stack.push_back({Op, 0});
+      continue;
+    }
+    for (auto Op : I->Ops)
+      OpIndices.push_back(Index[Op]);
+    OpBegin.push_back(OpIndices.size());
+    addNode(I);
+    Stack.pop_back();
+  }
+  return Index[Root];
+}
 
-  if (InstCache.count(I))
-    return InstCache.at(I);
+Inst *InstRewriter::lookup(Inst *I) const {
+  if (InstCache) {
+    auto It = InstCache->find(I);
+    return It == InstCache->end() ? nullptr : It->second;
+  }
+  return Insts.lookup(I);
+}
 
-  std::vector<Inst *> Ops;
-  for (auto const &Op : I->Ops)
-    Ops.push_back(getInstCopy(Op, IC, InstCache, BlockCache, ConstMap, CloneVars));
+Block *InstRewriter::lookup(Block *B) const {
+  if (BlockCache) {
+    auto It = BlockCache->find(B);
+    return It == BlockCache->end() ? nullptr : It->second;
+  }
+  return Blocks.lookup(B);
+}
 
-  Inst *Copy = 0;
+Inst *InstRewriter::rebuild(Inst *I, llvm::ArrayRef<Inst *> Ops) {
+  Inst *Copy = nullptr;
   if (I->K == Inst::Var) {
     if (ConstMap) {
-      auto it = ConstMap->find(I);
-      if (it != ConstMap->end()) {
-        {
-          llvm::APInt x = it->second;
-          /*
-          llvm::outs() << "found a var to replace with a constant width " <<
-            x.getBitWidth() << " and value " << x << "\n";
-          */
-        }
-        Copy = IC.getConst(it->second);
-      }
+      auto It = ConstMap->find(I);
+      if (It != ConstMap->end())
+        Copy = IC.getConst(It->second);
     }
     if (!Copy) {
       if (CloneVars && I->SynthesisConstID == 0) {
-        Copy = IC.createVar(I->Width, I->Name, I->Range, I->KnownZeros,
-                            I->KnownOnes, I->NonZero, I->NonNegative,
-                            I->PowOfTwo, I->Negative, I->NumSignBits,
+        const InstAttrs &A = I->attrs();
+        Copy = IC.createVar(I->Width, A.Name, A.Range, A.KnownZeros,
+                            A.KnownOnes, A.NonZero, A.NonNegative,
+                            A.PowOfTwo, A.Negative, A.NumSignBits,
                             I->DemandedBits,
                             I->SynthesisConstID);
-      }
-      else {
+      } else {
         Copy = I;
       }
     }
   } else if (I->K == Inst::Phi) {
-    if (!BlockCache.count(I->B)) {
-      if (CloneBlocks) {
-        auto BlockCopy = IC.createBlock(I->B->Preds);
-        BlockCache[I->B] = BlockCopy;
-        Copy = IC.getPhi(BlockCopy, Ops, I->DemandedBits);
-      } else {
-        Copy = IC.getPhi(I->B, Ops, I->DemandedBits);
-      }
-    } else {
-      Copy = IC.getPhi(BlockCache.at(I->B), Ops, I->DemandedBits);
+    Block *B = I->B;
+    if (Block *NewB = lookup(B)) {
+      B = NewB;
+    } else if (CloneBlocks) {
+      B = IC.createBlock(B->Preds);
+      substitute(I->B, B);
     }
+    Copy = IC.getPhi(B, Ops, I->DemandedBits);
   } else if (I->K == Inst::Const || I->K == Inst::UntypedConst) {
     Copy = I;
   } else {
     Copy = IC.getInst(I->K, I->Width, Ops, I->DemandedBits, I->Available);
   }
   assert(Copy);
-  InstCache[I] = Copy;
-  Copy->Name = I->Name;
+  if (Copy->attrs().Name != I->attrs().Name)
+    Copy->mutableAttrs().Name = I->attrs().Name;
   return Copy;
 }
 
+void InstRewriter::rewrite(llvm::MutableArrayRef<Inst *> Roots) {
+  // iterative post-order walk, operands are rebuilt in order so that cloned
+  // Vars are numbered as a recursive walk would number them
+  std::vector<std::pair<Inst *, unsigned>> Stack;
+  llvm::SmallVector<Inst *, 3> Ops;
+  for (auto Root : Roots) {
+    if (!lookup(Root))
+      Stack.push_back({Root, 0});
+    while (!Stack.empty()) {
+      auto &[I, NextOp] = Stack.back();
+      if (NextOp < I->Ops.size()) {
+        Inst *Op = I->Ops[NextOp++];
+        if (!lookup(Op))
+          Stack.push_back({Op, 0});
+        continue;
+      }
+      Inst *Orig = I;
+      Stack.pop_back();
+      // a DAG can reach the same Inst twice before either is rebuilt
+      if (lookup(Orig))
+        continue;
+      Ops.clear();
+      for (auto Op : Orig->Ops)
+        Ops.push_back(lookup(Op));
+      substitute(Orig, rebuild(Orig, Ops));
+    }
+  }
+  for (auto &Root : Roots)
+    Root = lookup(Root);
+}
+
+Inst *InstRewriter::rewrite(Inst *Root) {
+  rewrite(llvm::MutableArrayRef<Inst *>(Root));
+  return Root;
+}
+
+void InstRewriter::rewrite(InstMapping &M) {
+  Inst *Roots[] = {M.LHS, M.RHS};
+  rewrite(Roots);
+  M.LHS = Roots[0];
+  M.RHS = Roots[1];
+}
+
+Inst *souper::getInstCopy(Inst *I, InstContext &IC,
+                          std::map<Inst *, Inst *> &InstCache,
+                          std::map<Block *, Block *> &BlockCache,
+                          std::map<Inst *, llvm::APInt> *ConstMap,
+                          bool CloneVars, bool CloneBlocks) {
+  InstRewriter R(IC, InstCache, BlockCache, CloneVars, CloneBlocks);
+  R.setConstMap(ConstMap);
+  return R.rewrite(I);
+}
+
 Inst *souper::instJoin(Inst *I, Inst *EmptyInst, Inst *NewInst,
                        std::map<Inst *, Inst *> &InstCache,
                        InstContext &IC) {
@@ -1314,9 +1870,10 @@ Inst *souper::instJoin(Inst *I, Inst *EmptyInst, Inst *NewInst,
   } else if (I->K == Inst::Var) {
     // copy constant
     if (I->SynthesisConstID != 0) {
-      Copy = IC.createVar(I->Width, I->Name, I->Range, I->KnownZeros,
-                          I->KnownOnes, I->NonZero, I->NonNegative,
-                          I->PowOfTwo, I->Negative, I->NumSignBits,
+      const InstAttrs &A = I->attrs();
+      Copy = IC.createVar(I->Width, A.Name, A.Range, A.KnownZeros,
+                          A.KnownOnes, A.NonZero, A.NonNegative,
+                          A.PowOfTwo, A.Negative, A.NumSignBits,
                           I->DemandedBits,
                           I->SynthesisConstID);
     } else {
@@ -1339,15 +1896,14 @@ void souper::separateBlockPCs(const BlockPCs &BPCs, BlockPCs &BPCsCopy,
                               InstContext &IC,
                               std::map<Inst *, llvm::APInt> *ConstMap,
                               bool CloneVars) {
+  InstRewriter R(IC, InstCache, BlockCache, CloneVars);
+  R.setConstMap(ConstMap);
   for (const auto &BPC : BPCs) {
     auto BPCCopy = BPC;
     assert(BPC.B);
     assert(BlockCache[BPC.B]);
     BPCCopy.B = BlockCache[BPC.B];
-    BPCCopy.PC = InstMapping(getInstCopy(BPC.PC.LHS, IC, InstCache, BlockCache,
-                                         ConstMap, CloneVars),
-                             getInstCopy(BPC.PC.RHS, IC, InstCache, BlockCache,
-                                         ConstMap, CloneVars));
+    R.rewrite(BPCCopy.PC);
     BPCsCopy.emplace_back(BPCCopy);
   }
 }
@@ -1359,11 +1915,12 @@ void souper::separatePCs(const std::vector<InstMapping> &PCs,
                          InstContext &IC,
                          std::map<Inst *, llvm::APInt> *ConstMap,
                          bool CloneVars) {
-  for (const auto &PC : PCs)
-    PCsCopy.emplace_back(getInstCopy(PC.LHS, IC, InstCache, BlockCache,
-                                     ConstMap, CloneVars),
-                         getInstCopy(PC.RHS, IC, InstCache, BlockCache,
-                                     ConstMap, CloneVars));
+  InstRewriter R(IC, InstCache, BlockCache, CloneVars);
+  R.setConstMap(ConstMap);
+  for (auto PC : PCs) {
+    R.rewrite(PC);
+    PCsCopy.push_back(PC);
+  }
 }
 
 
@@ -1387,15 +1944,184 @@ std::vector<Block *> souper::getBlocksFromPhis(Inst *I) {
   return Result;
 }
 
+static Inst *lowerCustomInstImpl(InstContext &IC, Inst *I,
+                                 std::map<Inst *, Inst *> &Cache) {
+  if (I->K == Inst::Custom)
+    return CustomInstructionMap[I->attrs().Name](&IC, I->Ops);
+  if (I->Ops.empty())
+    return I;
+  auto It = Cache.find(I);
+  if (It != Cache.end())
+    return It->second;
+
+  // Changing the operands of I in place could make it point to an Inst
+  // that is newer than it, which a scope open around this call would free
+  // from under it, so lowered operands mean a new Inst
+  std::vector<Inst *> LoweredOps;
+  bool Changed = false;
+  for (auto Op : I->Ops) {
+    LoweredOps.push_back(lowerCustomInstImpl(IC, Op, Cache));
+    Changed |= LoweredOps.back() != Op;
+  }
+  Inst *Lowered = I;
+  if (Changed) {
+    if (I->K == Inst::Phi)
+      Lowered = IC.getPhi(I->B, LoweredOps, I->DemandedBits);
+    else
+      Lowered = IC.getInst(I->K, I->Width, LoweredOps, I->DemandedBits,
+                           I->Available);
+  }
+
+  return Cache[I] = Lowered;
+}
+
 Inst *souper::lowerCustomInst(InstContext &IC, Inst *I) {
-  if (I->K == Inst::Custom) {
-    return CustomInstructionMap[I->Name](&IC, I->Ops);
-  } else {
-    for (auto &Op : I->Ops) {
-      Op = lowerCustomInst(IC, Op);
+  std::map<Inst *, Inst *> Cache;
+  return lowerCustomInstImpl(IC, I, Cache);
+}
+
+// precondition: operands are const, won't check here
+std::optional<llvm::APInt> souper::Fold(Inst *I) {
+  switch (I->K) {
+    case Inst::Add:
+      return I->Ops[0]->Val + I->Ops[1]->Val;
+    case Inst::Sub:
+      return I->Ops[0]->Val - I->Ops[1]->Val;
+    case Inst::Mul:
+      return I->Ops[0]->Val * I->Ops[1]->Val;
+    case Inst::And:
+      return I->Ops[0]->Val & I->Ops[1]->Val;
+    case Inst::Or:
+      return I->Ops[0]->Val | I->Ops[1]->Val;
+    case Inst::Xor:{
+      return I->Ops[0]->Val ^ I->Ops[1]->Val;}
+    case Inst::Trunc:
+      return I->Ops[0]->Val.trunc(I->Width);
+    case Inst::SExt:
+     if (I->Ops[0]->Val == 0)
+       return I->Ops[0]->Val.sext(I->Width);
+     else
+       return std::nullopt;
+    case Inst::ZExt:
+      if (I->Ops[0]->Val == 0)
+       return I->Ops[0]->Val.zext(I->Width);
+     else
+       return std::nullopt;
+    case Inst::Eq:
+      return llvm::APInt(1, I->Ops[0]->Val == I->Ops[1]->Val);
+    case Inst::Ne:
+      return llvm::APInt(1, I->Ops[0]->Val != I->Ops[1]->Val);
+    case Inst::Ult:
+      return llvm::APInt(1, I->Ops[0]->Val.ult(I->Ops[1]->Val));
+    case Inst::Slt:
+      return llvm::APInt(1, I->Ops[0]->Val.slt(I->Ops[1]->Val));
+    case Inst::Ule:
+      return llvm::APInt(1, I->Ops[0]->Val.ule(I->Ops[1]->Val));
+    case Inst::Sle:
+      return llvm::APInt(1, I->Ops[0]->Val.sle(I->Ops[1]->Val));
+    default: return std::nullopt;
+  }
+}
+
+bool souper::OpsConstP(Inst *I) {
+  for (auto &&Op : I->Ops) {
+    if (Op->K != Inst::Const) {
+      return false;
     }
+  }
+  return true;
+}
+
+static bool LHSZ(Inst *I) {
+  return I->Ops.size() ==2 && I->Ops[0]->K == Inst::Const && I->Ops[0]->Val == 0;
+}
+static bool RHSZ(Inst *I) {
+  return I->Ops.size() ==2 && I->Ops[1]->K == Inst::Const && I->Ops[1]->Val == 0;
+}
+static bool LHSM1(Inst *I) {
+  return I->Ops.size() ==2 && I->Ops[0]->K == Inst::Const && I->Ops[0]->Val.isAllOnes();
+}
+static bool RHSM1(Inst *I) {
+  return I->Ops.size() ==2 && I->Ops[1]->K == Inst::Const && I->Ops[1]->Val.isAllOnes();
+}
+
+// Folds I, whose operands are already folded
+static Inst *foldInst(InstContext &IC, Inst *I) {
+  if (OpsConstP(I)) {
+    if (auto C = Fold(I))
+      return IC.getConst(C.value());
+  }
+
+  if (I->K == Inst::Select && I->Ops[0]->K == Inst::Const)
+    return I->Ops[0]->Val.getBoolValue() ? I->Ops[1] : I->Ops[2];
+
+  if (LHSZ(I)) {
+    if (I->K == Inst::Add || I->K == Inst::Xor || I->K == Inst::Or)
+      return I->Ops[1];
+    if (I->K == Inst::Mul || I->K == Inst::And)
+      return IC.getConst(llvm::APInt(I->Width, 0));
+  }
+
+  if (RHSZ(I)) {
+    if (I->K == Inst::Add || I->K == Inst::Sub ||
+        I->K == Inst::Xor || I->K == Inst::Or)
+      return I->Ops[0];
+    if (I->K == Inst::Mul || I->K == Inst::And)
+      return IC.getConst(llvm::APInt(I->Width, 0));
+  }
+
+  if (LHSM1(I)) {
+    if (I->K == Inst::And)
+      return I->Ops[1];
+    if (I->K == Inst::Or)
+      return I->Ops[0];
+  }
+
+  if (RHSM1(I)) {
+    if (I->K == Inst::And)
+      return I->Ops[0];
+    if (I->K == Inst::Or)
+      return I->Ops[1];
+  }
+
+  return I;
+}
+
+static Inst *ConstantFoldingLiteImpl(InstContext &IC, Inst *I,
+                                     std::map<Inst *, Inst *> &Cache) {
+  if (I->Ops.empty())
     return I;
+  auto It = Cache.find(I);
+  if (It != Cache.end())
+    return It->second;
+
+  // Insts are shared, so a folded operand means a new Inst instead of
+  // changing the operands of this one
+  std::vector<Inst *> FoldedOps;
+  bool Changed = false;
+  for (auto Op : I->Ops) {
+    FoldedOps.push_back(ConstantFoldingLiteImpl(IC, Op, Cache));
+    Changed |= FoldedOps.back() != Op;
   }
+  Inst *Copy = I;
+  if (Changed) {
+    if (I->K == Inst::Phi)
+      Copy = IC.getPhi(I->B, FoldedOps, I->DemandedBits);
+    else
+      Copy = IC.getInst(I->K, I->Width, FoldedOps, I->DemandedBits,
+                        I->Available);
+    // getInst does not take a name, but a custom instruction is looked up
+    // by it, so carry it over the way the parser does
+    if (I->K == Inst::Custom)
+      Copy->mutableAttrs().Name = I->attrs().Name;
+  }
+
+  return Cache[I] = foldInst(IC, Copy);
+}
+
+Inst *souper::ConstantFoldingLite(InstContext &IC, Inst *I) {
+  std::map<Inst *, Inst *> Cache;
+  return ConstantFoldingLiteImpl(IC, I, Cache);
 }
 
 // Add custom instructions here.
@@ -1403,7 +2129,7 @@ Inst *souper::lowerCustomInst(InstContext &IC, Inst *I) {
 namespace souper {
 std::unordered_map<std::string, CustomInstructionCreator>
 CustomInstructionMap = {
-  {"custom.identity", [](InstContext *IC, const std::vector<Inst *> &Ops) {
+  {"custom.identity", [](InstContext *IC, llvm::ArrayRef<Inst *> Ops) {
     assert(Ops.size() == 1);
     return Ops[0];
   }},
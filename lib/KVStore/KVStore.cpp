@@ -109,7 +109,8 @@ bool KVStore::KVImpl::hGet(llvm::StringRef Key, llvm::StringRef Field,
     freeReplyObject(reply);
     return false;
   } else if (reply->type == REDIS_REPLY_STRING) {
-    Value = reply->str;
+    // values may be binary
+    Value.assign(reply->str, reply->len);
     freeReplyObject(reply);
     return true;
   } else {
@@ -121,8 +122,8 @@ bool KVStore::KVImpl::hGet(llvm::StringRef Key, llvm::StringRef Field,
 
 void KVStore::KVImpl::hSet(llvm::StringRef Key, llvm::StringRef Field,
                               llvm::StringRef Value) {
-  redisReply *reply = (redisReply *)redisCommand(Ctx, "HSET %s %s %s",
-      Key.data(), Field.data(), Value.data());
+  redisReply *reply = (redisReply *)redisCommand(Ctx, "HSET %s %s %b",
+      Key.data(), Field.data(), Value.data(), Value.size());
   if (!reply || Ctx->err)
     llvm::report_fatal_error((llvm::StringRef)"Redis error: " + Ctx->errstr);
   if (reply->type != REDIS_REPLY_INTEGER) {
@@ -0,0 +1,652 @@
+// Copyright 2014 The Souper Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "souper/Parser/BinaryFormat.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/Support/LEB128.h"
+
+using namespace llvm;
+using namespace souper;
+
+namespace {
+
+// Inst kinds are written as numbers, bump the version when they change
+const unsigned FormatVersion = 1;
+static_assert(Inst::None == 79, "Inst::Kind changed, bump FormatVersion");
+
+const char CorpusMagic[] = "\x7fSRC";
+const char RHSMagic[] = "\x7fSRH";
+const size_t MagicSize = 4;
+// magic, version and number of replacements
+const size_t HeaderSize = MagicSize + 4 + 8;
+
+// Insts and blocks with this tag refer to a name in a ReplacementContext,
+// other Insts are tagged with their kind plus one
+const unsigned RefTag = 0;
+
+enum NodeFlags {
+  HasDemandedBits = 1 << 0,
+  NotAvailable = 1 << 1,
+  HarvestedFromUse = 1 << 2,
+  HasName = 1 << 3,
+  ExternalUses = 1 << 4,
+};
+
+enum VarFlags {
+  VarNonZero = 1 << 0,
+  VarNonNegative = 1 << 1,
+  VarPowOfTwo = 1 << 2,
+  VarNegative = 1 << 3,
+};
+
+enum RangeTag { FullRange, EmptyRange, BoundedRange };
+
+void write64(raw_ostream &OS, uint64_t V) {
+  for (unsigned I = 0; I < 8; ++I)
+    OS << char(V >> (8 * I));
+}
+
+uint64_t read64(const char *P) {
+  uint64_t V = 0;
+  for (unsigned I = 0; I < 8; ++I)
+    V |= uint64_t(uint8_t(P[I])) << (8 * I);
+  return V;
+}
+
+class Encoder {
+  std::string &Out;
+  // Insts and blocks with a name here are written as references
+  ReplacementContext *Context;
+  DenseMap<Inst *, unsigned> InstIdx;
+  DenseMap<Block *, unsigned> BlockIdx;
+  std::vector<Inst *> Insts;
+  std::vector<Block *> Blocks;
+
+  void uleb(uint64_t V) {
+    uint8_t Buf[16];
+    unsigned N = encodeULEB128(V, Buf);
+    Out.append(reinterpret_cast<char *>(Buf), N);
+  }
+  void str(StringRef S) {
+    uleb(S.size());
+    Out.append(S.data(), S.size());
+  }
+  void apint(const APInt &V) {
+    uleb(V.getBitWidth());
+    for (unsigned I = 0; I < V.getNumWords(); ++I)
+      uleb(V.getRawData()[I]);
+  }
+
+  bool isRef(Inst *I) { return Context && !Context->getName(I).empty(); }
+  bool isRef(Block *B) { return Context && !Context->getName(B).empty(); }
+
+  void addBlock(Block *B) {
+    if (BlockIdx.insert({B, Blocks.size()}).second)
+      Blocks.push_back(B);
+  }
+
+  // Numbers Root and the Insts it uses in post-order
+  void add(Inst *Root) {
+    if (!Root || InstIdx.count(Root))
+      return;
+    std::vector<std::pair<Inst *, unsigned>> Stack{{Root, 0}};
+    while (!Stack.empty()) {
+      auto &[I, NextOp] = Stack.back();
+      auto Ops = isRef(I) ? ArrayRef<Inst *>() : I->orderedOps();
+      if (NextOp < Ops.size()) {
+        Inst *Op = Ops[NextOp++];
+        if (!InstIdx.count(Op))
+          Stack.push_back({Op, 0});
+        continue;
+      }
+      Inst *Done = I;
+      Stack.pop_back();
+      if (InstIdx.count(Done))
+        continue;
+      if (Done->K == Inst::Phi && !isRef(Done))
+        addBlock(Done->B);
+      InstIdx[Done] = Insts.size();
+      Insts.push_back(Done);
+    }
+  }
+
+  unsigned idx(Inst *I) { return I ? InstIdx[I] + 1 : 0; }
+
+  void writeBlock(Block *B) {
+    if (isRef(B)) {
+      uleb(RefTag);
+      str(Context->getName(B));
+      return;
+    }
+    uleb(B->Preds);
+  }
+
+  void writeInst(Inst *I, Inst *LHS) {
+    if (isRef(I)) {
+      uleb(RefTag);
+      str(Context->getName(I));
+      return;
+    }
+    const InstAttrs &A = I->attrs();
+    bool Named = !A.Name.empty() && (I->K == Inst::Var || I->K == Inst::Hole ||
+                                     I->K == Inst::Custom);
+    unsigned Flags = 0;
+    // Insts that aren't built with demanded bits, like constants, hold a
+    // default APInt that doesn't mean anything
+    if (I->DemandedBits.getBitWidth() == I->Width &&
+        !I->DemandedBits.isAllOnes())
+      Flags |= HasDemandedBits;
+    if (!I->Available)
+      Flags |= NotAvailable;
+    if (A.HarvestKind == HarvestType::HarvestedFromUse)
+      Flags |= HarvestedFromUse;
+    if (Named)
+      Flags |= HasName;
+    if (LHS && LHS->attrs().DepsWithExternalUses.count(I))
+      Flags |= ExternalUses;
+
+    uleb(I->K + 1);
+    uleb(I->Width);
+    uleb(Flags);
+    if (Named)
+      str(A.Name);
+    if (Flags & HasDemandedBits)
+      apint(I->DemandedBits);
+
+    switch (I->K) {
+    case Inst::Const:
+    case Inst::UntypedConst:
+      apint(I->Val);
+      return;
+    case Inst::Var: {
+      uleb(I->SynthesisConstID);
+      uleb(A.NumSignBits);
+      uleb((A.NonZero ? VarNonZero : 0) | (A.NonNegative ? VarNonNegative : 0) |
+           (A.PowOfTwo ? VarPowOfTwo : 0) | (A.Negative ? VarNegative : 0));
+      apint(A.KnownZeros);
+      apint(A.KnownOnes);
+      if (A.Range.isFullSet()) {
+        uleb(FullRange);
+      } else if (A.Range.isEmptySet()) {
+        uleb(EmptyRange);
+      } else {
+        uleb(BoundedRange);
+        apint(A.Range.getLower());
+        apint(A.Range.getUpper());
+      }
+      return;
+    }
+    case Inst::Hole:
+    case Inst::ReservedConst:
+    case Inst::ReservedInst:
+      return;
+    case Inst::Phi:
+      uleb(BlockIdx[I->B]);
+      break;
+    default:
+      break;
+    }
+    auto Ops = I->orderedOps();
+    uleb(Ops.size());
+    for (auto Op : Ops)
+      uleb(InstIdx[Op]);
+  }
+
+public:
+  Encoder(std::string &Out, ReplacementContext *Context = nullptr)
+    : Out(Out), Context(Context) {}
+
+  void encode(InstMapping Mapping, const std::vector<InstMapping> &PCs,
+              const BlockPCs &BPCs) {
+    for (const auto &BPC : BPCs)
+      addBlock(BPC.B);
+    for (const auto &PC : PCs) {
+      add(PC.LHS);
+      add(PC.RHS);
+    }
+    for (const auto &BPC : BPCs) {
+      add(BPC.PC.LHS);
+      add(BPC.PC.RHS);
+    }
+    add(Mapping.LHS);
+    add(Mapping.RHS);
+
+    uleb(Blocks.size());
+    for (auto B : Blocks)
+      writeBlock(B);
+    uleb(Insts.size());
+    for (auto I : Insts)
+      writeInst(I, Mapping.LHS);
+
+    uleb(idx(Mapping.LHS));
+    uleb(idx(Mapping.RHS));
+    uleb(PCs.size());
+    for (const auto &PC : PCs) {
+      uleb(idx(PC.LHS));
+      uleb(idx(PC.RHS));
+    }
+    uleb(BPCs.size());
+    for (const auto &BPC : BPCs) {
+      uleb(BlockIdx[BPC.B]);
+      uleb(BPC.PredIdx);
+      uleb(idx(BPC.PC.LHS));
+      uleb(idx(BPC.PC.RHS));
+    }
+  }
+};
+
+class Decoder {
+  const uint8_t *Cur, *End;
+  InstContext &IC;
+  ReplacementContext *Context;
+  std::string &ErrStr;
+  std::vector<Inst *> Insts;
+  std::vector<Block *> Blocks;
+
+  bool fail(const Twine &Msg) {
+    if (ErrStr.empty())
+      ErrStr = ("malformed binary replacement: " + Msg).str();
+    return false;
+  }
+
+  bool uleb(uint64_t &V) {
+    const char *Error = nullptr;
+    unsigned N;
+    V = decodeULEB128(Cur, &N, End, &Error);
+    if (Error)
+      return fail(Error);
+    Cur += N;
+    return true;
+  }
+  bool uleb(unsigned &V, uint64_t Max = ~0U) {
+    uint64_t W;
+    if (!uleb(W))
+      return false;
+    if (W > Max)
+      return fail("value out of range");
+    V = W;
+    return true;
+  }
+  bool str(std::string &S) {
+    uint64_t Size;
+    if (!uleb(Size))
+      return false;
+    if (Size > uint64_t(End - Cur))
+      return fail("string runs past the end");
+    S.assign(reinterpret_cast<const char *>(Cur), Size);
+    Cur += Size;
+    return true;
+  }
+  bool apint(APInt &V, unsigned Width = 0) {
+    unsigned BitWidth;
+    if (!uleb(BitWidth, IntegerType::MAX_INT_BITS))
+      return false;
+    if (BitWidth == 0 || (Width && BitWidth != Width))
+      return fail("bad integer width");
+    SmallVector<uint64_t, 2> Words(APInt::getNumWords(BitWidth));
+    for (auto &W : Words)
+      if (!uleb(W))
+        return false;
+    V = APInt(BitWidth, Words);
+    return true;
+  }
+  bool inst(Inst *&I, bool Nullable = false) {
+    unsigned Idx;
+    if (!uleb(Idx))
+      return false;
+    if (Idx == 0 && Nullable) {
+      I = nullptr;
+      return true;
+    }
+    if (Idx == 0 || Idx > Insts.size())
+      return fail("bad inst number");
+    I = Insts[Idx - 1];
+    return true;
+  }
+  bool block(Block *&B) {
+    unsigned Idx;
+    if (!uleb(Idx))
+      return false;
+    if (Idx >= Blocks.size())
+      return fail("bad block number");
+    B = Blocks[Idx];
+    return true;
+  }
+
+  bool readBlock() {
+    unsigned Preds;
+    if (!uleb(Preds, MaxPreds))
+      return false;
+    if (Preds != RefTag) {
+      Blocks.push_back(IC.createBlock(Preds));
+      return true;
+    }
+    std::string Name;
+    if (!str(Name))
+      return false;
+    Block *B = Context ? Context->getBlock(Name) : nullptr;
+    if (!B)
+      return fail("unknown block %" + Name);
+    Blocks.push_back(B);
+    return true;
+  }
+
+  bool readInst(std::vector<Inst *> &ExternalUsers) {
+    unsigned Tag, Width, Flags;
+    if (!uleb(Tag, Inst::None))
+      return false;
+    if (Tag == RefTag) {
+      std::string Name;
+      if (!str(Name))
+        return false;
+      Inst *I = Context ? Context->getInst(Name) : nullptr;
+      if (!I)
+        return fail("unknown inst %" + Name);
+      Insts.push_back(I);
+      return true;
+    }
+    auto K = static_cast<Inst::Kind>(Tag - 1);
+    if (!uleb(Width, IntegerType::MAX_INT_BITS) || !uleb(Flags))
+      return false;
+    std::string Name;
+    if ((Flags & HasName) && !str(Name))
+      return false;
+    APInt DemandedBits;
+    if ((Flags & HasDemandedBits) && !apint(DemandedBits, Width))
+      return false;
+
+    Inst *I = nullptr;
+    switch (K) {
+    case Inst::Const:
+    case Inst::UntypedConst: {
+      APInt Val;
+      if (!apint(Val))
+        return false;
+      I = K == Inst::Const ? IC.getConst(Val) : IC.getUntypedConst(Val);
+      break;
+    }
+    case Inst::Var: {
+      unsigned SynthesisConstID, NumSignBits, VFlags, RTag;
+      APInt Zero, One, Lower, Upper;
+      if (Width == 0 || !uleb(SynthesisConstID) ||
+          !uleb(NumSignBits, Width) || !uleb(VFlags) ||
+          !apint(Zero, Width) || !apint(One, Width) ||
+          !uleb(RTag, BoundedRange))
+        return fail("bad var");
+      ConstantRange CR(Width, RTag != EmptyRange);
+      if (RTag == BoundedRange) {
+        if (!apint(Lower, Width) || !apint(Upper, Width) || Lower == Upper)
+          return fail("bad range");
+        CR = ConstantRange(Lower, Upper);
+      }
+      I = IC.createVar(Width, Name, CR, Zero, One, VFlags & VarNonZero,
+                       VFlags & VarNonNegative, VFlags & VarPowOfTwo,
+                       VFlags & VarNegative, NumSignBits,
+                       Flags & HasDemandedBits ? DemandedBits :
+                                                 APInt::getAllOnes(Width),
+                       SynthesisConstID);
+      break;
+    }
+    case Inst::Hole:
+      I = IC.createHole(Width);
+      break;
+    case Inst::ReservedConst:
+      I = IC.getReservedConst();
+      break;
+    case Inst::ReservedInst:
+      I = IC.getReservedInst();
+      break;
+    default: {
+      Block *B = nullptr;
+      if (K == Inst::Phi && !block(B))
+        return false;
+      unsigned NumOps;
+      if (!uleb(NumOps, End - Cur))
+        return false;
+      std::vector<Inst *> Ops(NumOps);
+      for (auto &Op : Ops) {
+        unsigned Idx;
+        if (!uleb(Idx))
+          return false;
+        if (Idx >= Insts.size())
+          return fail("bad operand number");
+        Op = Insts[Idx];
+      }
+      // the operands are checked as the text parser checks them, so that
+      // later passes can rely on the same invariants for both formats
+      if (K == Inst::Phi) {
+        if (Ops.empty() || Ops.size() != B->Preds ||
+            Width != Ops[0]->Width)
+          return fail("bad phi");
+        for (auto Op : Ops)
+          if (Op->Width != Width)
+            return fail("bad phi");
+        I = IC.getPhi(B, Ops);
+      } else {
+        std::string TypeErr;
+        unsigned CheckedWidth = Width;
+        if (!typeCheckInst(IC, K, CheckedWidth, Ops, TypeErr) ||
+            CheckedWidth != Width)
+          return fail("bad " + std::string(Inst::getKindName(K)) + ": " +
+                      (TypeErr.empty() ? "bad width" : TypeErr));
+        I = IC.getInst(K, Width, Ops, !(Flags & NotAvailable));
+      }
+      break;
+    }
+    }
+
+    // like the text parser, names and demanded bits are set on the shared
+    // Inst rather than being part of its identity
+    if (!Name.empty() && K != Inst::Var)
+      I->mutableAttrs().Name = Name;
+    if ((Flags & HasDemandedBits) && K != Inst::Var)
+      I->DemandedBits = DemandedBits;
+    if (Flags & HarvestedFromUse)
+      I->mutableAttrs().HarvestKind = HarvestType::HarvestedFromUse;
+    if (Flags & ExternalUses)
+      ExternalUsers.push_back(I);
+    Insts.push_back(I);
+    return true;
+  }
+
+public:
+  Decoder(StringRef Data, InstContext &IC, ReplacementContext *Context,
+          std::string &ErrStr)
+    : Cur(reinterpret_cast<const uint8_t *>(Data.begin())),
+      End(reinterpret_cast<const uint8_t *>(Data.end())), IC(IC),
+      Context(Context), ErrStr(ErrStr) {}
+
+  bool decode(ParsedReplacement &Rep) {
+    unsigned NumBlocks, NumInsts;
+    if (!uleb(NumBlocks, End - Cur))
+      return false;
+    for (unsigned I = 0; I < NumBlocks; ++I)
+      if (!readBlock())
+        return false;
+    if (!uleb(NumInsts, End - Cur))
+      return false;
+    std::vector<Inst *> ExternalUsers;
+    for (unsigned I = 0; I < NumInsts; ++I)
+      if (!readInst(ExternalUsers))
+        return false;
+
+    unsigned NumPCs, NumBPCs;
+    if (!inst(Rep.Mapping.LHS, true) || !inst(Rep.Mapping.RHS, true) ||
+        !uleb(NumPCs, End - Cur))
+      return false;
+    std::vector<InstMapping> PCs(NumPCs);
+    for (auto &PC : PCs)
+      if (!inst(PC.LHS) || !inst(PC.RHS))
+        return false;
+    Rep.PCs = std::move(PCs);
+    if (!uleb(NumBPCs, End - Cur))
+      return false;
+    BlockPCs BPCs(NumBPCs);
+    for (auto &BPC : BPCs) {
+      if (!block(BPC.B) || !uleb(BPC.PredIdx) || !inst(BPC.PC.LHS) ||
+          !inst(BPC.PC.RHS))
+        return false;
+      if (BPC.PredIdx >= BPC.B->Preds)
+        return fail("blockpc predecessor out of range");
+    }
+    Rep.BPCs = std::move(BPCs);
+    if (Cur != End)
+      return fail("trailing bytes");
+
+    if (!ExternalUsers.empty()) {
+      if (!Rep.Mapping.LHS)
+        return fail("external uses without an LHS");
+      auto &Deps = Rep.Mapping.LHS->mutableAttrs().DepsWithExternalUses;
+      Deps.insert(ExternalUsers.begin(), ExternalUsers.end());
+    }
+    return true;
+  }
+};
+
+}
+
+bool souper::isBinaryCorpus(StringRef Data) {
+  return Data.starts_with(StringRef(CorpusMagic, MagicSize));
+}
+
+void BinaryCorpusWriter::add(const ParsedReplacement &Rep) {
+  Offsets.push_back(Records.size());
+  Encoder(Records).encode(Rep.Mapping, Rep.PCs, Rep.BPCs);
+}
+
+std::string BinaryCorpusWriter::encode(const ParsedReplacement &Rep) {
+  std::string Record;
+  Encoder(Record).encode(Rep.Mapping, Rep.PCs, Rep.BPCs);
+  return Record;
+}
+
+void BinaryCorpusWriter::addEncoded(StringRef Record) {
+  Offsets.push_back(Records.size());
+  Records += Record;
+}
+
+void BinaryCorpusWriter::write(raw_ostream &OS) const {
+  OS.write(CorpusMagic, MagicSize);
+  for (unsigned I = 0; I < 4; ++I)
+    OS << char(FormatVersion >> (8 * I));
+  write64(OS, Offsets.size());
+  for (auto Offset : Offsets)
+    write64(OS, Offset);
+  write64(OS, Records.size());
+  OS << Records;
+}
+
+std::unique_ptr<BinaryCorpusReader>
+BinaryCorpusReader::create(StringRef Data, std::string &ErrStr) {
+  if (Data.size() < HeaderSize || !isBinaryCorpus(Data)) {
+    ErrStr = "not a binary replacement corpus";
+    return nullptr;
+  }
+  const char *P = Data.data() + MagicSize;
+  uint32_t Version = read64(P) & 0xffffffff;
+  if (Version != FormatVersion) {
+    ErrStr = "unsupported binary corpus version " + std::to_string(Version);
+    return nullptr;
+  }
+  uint64_t NumRecords = read64(P + 4);
+  // the offset table has an entry past the last record
+  if (NumRecords >= (Data.size() - HeaderSize) / 8) {
+    ErrStr = "truncated binary corpus";
+    return nullptr;
+  }
+  uint64_t TableEnd = HeaderSize + 8 * (NumRecords + 1);
+  uint64_t RecordsEnd = read64(Data.data() + TableEnd - 8);
+  if (RecordsEnd != Data.size() - TableEnd) {
+    ErrStr = "truncated binary corpus";
+    return nullptr;
+  }
+  std::unique_ptr<BinaryCorpusReader> R(new BinaryCorpusReader);
+  R->Data = Data;
+  R->NumRecords = NumRecords;
+  return R;
+}
+
+std::unique_ptr<BinaryCorpusReader>
+BinaryCorpusReader::open(StringRef Filename, std::string &ErrStr) {
+  auto MB = MemoryBuffer::getFile(Filename, /*IsText=*/false,
+                                  /*RequiresNullTerminator=*/false);
+  if (!MB) {
+    ErrStr = MB.getError().message();
+    return nullptr;
+  }
+  auto R = create((*MB)->getBuffer(), ErrStr);
+  if (R)
+    R->Buffer = std::move(*MB);
+  return R;
+}
+
+ParsedReplacement BinaryCorpusReader::get(size_t Idx, InstContext &IC,
+                                          std::string &ErrStr) const {
+  assert(Idx < NumRecords);
+  const char *Table = Data.data() + HeaderSize;
+  uint64_t TableEnd = HeaderSize + 8 * (NumRecords + 1);
+  uint64_t Begin = read64(Table + 8 * Idx);
+  uint64_t End = read64(Table + 8 * (Idx + 1));
+  ParsedReplacement Rep;
+  if (Begin > End || End > Data.size() - TableEnd) {
+    ErrStr = "bad offset for replacement " + std::to_string(Idx);
+    return Rep;
+  }
+  StringRef Record = Data.substr(TableEnd + Begin, End - Begin);
+  if (Decoder(Record, IC, nullptr, ErrStr).decode(Rep) &&
+      (!Rep.Mapping.LHS || !Rep.Mapping.RHS))
+    ErrStr = "replacement " + std::to_string(Idx) + " has no LHS or RHS";
+  return Rep;
+}
+
+std::vector<ParsedReplacement>
+BinaryCorpusReader::getAll(InstContext &IC, std::string &ErrStr) const {
+  std::vector<ParsedReplacement> Reps;
+  for (size_t I = 0; I < NumRecords && ErrStr.empty(); ++I)
+    Reps.push_back(get(I, IC, ErrStr));
+  if (!ErrStr.empty())
+    Reps.clear();
+  return Reps;
+}
+
+std::string souper::EncodeReplacementRHS(Inst *RHS,
+                                         ReplacementContext &Context) {
+  std::string Out(RHSMagic, MagicSize);
+  Encoder(Out, &Context).encode(InstMapping(nullptr, RHS), {}, {});
+  return Out;
+}
+
+bool souper::isBinaryRHS(StringRef Data) {
+  return Data.starts_with(StringRef(RHSMagic, MagicSize));
+}
+
+Inst *souper::DecodeReplacementRHS(InstContext &IC, StringRef Data,
+                                   ReplacementContext &Context,
+                                   std::string &ErrStr) {
+  if (!isBinaryRHS(Data)) {
+    ErrStr = "not a binary RHS";
+    return nullptr;
+  }
+  ParsedReplacement Rep;
+  if (!Decoder(Data.drop_front(MagicSize), IC, &Context, ErrStr).decode(Rep))
+    return nullptr;
+  if (Rep.Mapping.LHS || !Rep.Mapping.RHS || !Rep.PCs.empty() ||
+      !Rep.BPCs.empty()) {
+    ErrStr = "binary RHS has more than an RHS";
+    return nullptr;
+  }
+  return Rep.Mapping.RHS;
+}
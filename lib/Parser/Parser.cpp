@@ -13,15 +13,18 @@
 // limitations under the License.
 
 #include "souper/Parser/Parser.h"
+#include "souper/Parser/BinaryFormat.h"
 
 #include "llvm/ADT/APInt.h"
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 #include "souper/Extractor/Candidates.h"
 #include "souper/Inst/Inst.h"
 
+#include <algorithm>
 #include <string>
 #include <unordered_set>
 
@@ -53,7 +56,7 @@ struct Token {
   APInt Val;
   StringRef Name;
   unsigned Width;
-  std::string PatternString;
+  StringRef Pattern;
 
   StringRef str() const {
     return StringRef(Pos, Len);
@@ -70,8 +73,8 @@ struct Lexer {
   const char *LineBegin;
   unsigned LineNum;
 
-  Lexer(const char *Begin, const char *End)
-      : Begin(Begin), End(End), LineBegin(Begin), LineNum(1) {}
+  Lexer(const char *Begin, const char *End, unsigned LineNum = 1)
+      : Begin(Begin), End(End), LineBegin(Begin), LineNum(LineNum) {}
 
   Token getNextToken(std::string &ErrStr);
 
@@ -171,22 +174,22 @@ FoundChar:
       ++Begin;
     } while (Begin != End && ((*Begin >= 'a' && *Begin <= 'z') ||
              (*Begin == '.') || (*Begin >= 'A' && *Begin <= 'Z')));
-    std::string DataFlowFact = StringRef(TokenBegin, Begin - TokenBegin).str();
+    StringRef DataFlowFact(TokenBegin, Begin - TokenBegin);
     if (DataFlowFact == "knownBits") {
-      if (*Begin != '=') {
+      if (Begin == End || *Begin != '=') {
         ErrStr = "expected '=' for knownBits";
         return Token{Token::Error, Begin, 0, APInt()};
       }
       ++Begin;
       const char *PatternBegin = Begin;
-      while (*Begin == '0' || *Begin == '1' || *Begin == 'x')
+      while (Begin != End && (*Begin == '0' || *Begin == '1' || *Begin == 'x'))
         ++Begin;
       if (Begin == PatternBegin) {
         ErrStr = "expected [0|1|x]+ for knownBits";
         return Token{Token::Error, Begin, 0, APInt()};
       }
       return Token{Token::KnownBits, TokenBegin, size_t(Begin - TokenBegin), APInt(),
-                   "", 0, StringRef(PatternBegin, Begin - PatternBegin).str()};
+                   "", 0, StringRef(PatternBegin, Begin - PatternBegin)};
     } else
       return Token{Token::Ident, TokenBegin, size_t(Begin - TokenBegin), APInt()};
   }
@@ -286,9 +289,9 @@ struct Parser {
   Parser(StringRef FileName, StringRef Str, InstContext &IC,
          std::vector<ParsedReplacement> &Reps, ReplacementKind RK,
          std::vector<ReplacementContext> *RCsIn,
-         std::vector<ReplacementContext> *RCsOut)
+         std::vector<ReplacementContext> *RCsOut, unsigned FirstLine = 1)
       : FileName(FileName),
-        L(Str.data(), Str.data() + Str.size()),
+        L(Str.data(), Str.data() + Str.size(), FirstLine),
         IC(IC),
         Reps(Reps),
         RK(RK),
@@ -308,6 +311,7 @@ struct Parser {
   ReplacementContext Context;
   int Index = 0;
   int ReservedConstCounter = 0;
+  bool Started = false;
 
   std::vector<InstMapping> PCs;
   BlockPCs BPCs;
@@ -327,14 +331,6 @@ struct Parser {
            ErrStr;
   }
 
-  bool lossy(const APInt &I, unsigned NewWidth) {
-    unsigned W = I.getBitWidth();
-    if (NewWidth >= W)
-      return false;
-    auto NI = I.trunc(NewWidth);
-    return NI.zext(W) != I && NI.sext(W) != I;
-  }
-
   bool consumeToken(std::string &ErrStr) {
     CurTok = L.getNextToken(ErrStr);
     if (CurTok.K == Token::Error) {
@@ -350,18 +346,14 @@ struct Parser {
 
   bool typeCheckPhi(unsigned Width, Block *B, std::vector<Inst *> &Ops,
                     std::string &ErrStr);
-  bool typeCheckInst(Inst::Kind IK, unsigned &Width, std::vector<Inst *> &Ops,
-                     std::string &ErrStr);
-  bool typeCheckOpsMatchingWidths(llvm::MutableArrayRef<Inst *> Ops,
-                                  std::string &ErrStr);
 
   bool parseLine(std::string &ErrStr);
 
   ParsedReplacement parseReplacement(std::string &ErrStr);
   std::vector<ParsedReplacement> parseReplacements(std::string &ErrStr);
+  bool parseNextReplacement(ParsedReplacement &Rep, std::string &ErrStr);
   void nextReplacement();
   bool parseInstAttribute(std::string &ErrStr, Inst *LHS);
-  bool isOverflow(Inst::Kind IK);
 };
 
 }
@@ -406,14 +398,23 @@ Inst *Parser::parseInst(std::string &ErrStr) {
   }
 }
 
-bool Parser::isOverflow(Inst::Kind IK) {
+static bool lossy(const APInt &I, unsigned NewWidth) {
+  unsigned W = I.getBitWidth();
+  if (NewWidth >= W)
+    return false;
+  auto NI = I.trunc(NewWidth);
+  return NI.zext(W) != I && NI.sext(W) != I;
+}
+
+static bool isOverflow(Inst::Kind IK) {
   return (IK == Inst::SAddWithOverflow || IK == Inst::UAddWithOverflow ||
           IK == Inst::SSubWithOverflow || IK == Inst::USubWithOverflow ||
           IK == Inst::SMulWithOverflow || IK == Inst::UMulWithOverflow);
 }
 
-bool Parser::typeCheckOpsMatchingWidths(llvm::MutableArrayRef<Inst *> Ops,
-                                        std::string &ErrStr) {
+static bool typeCheckOpsMatchingWidths(InstContext &IC,
+                                       llvm::MutableArrayRef<Inst *> Ops,
+                                       std::string &ErrStr) {
   unsigned Width = 0;
   for (auto Op : Ops) {
     if (Width == 0)
@@ -455,7 +456,7 @@ bool Parser::typeCheckPhi(unsigned Width, Block *B,
     return false;
   }
 
-  if (!typeCheckOpsMatchingWidths(Ops, ErrStr))
+  if (!typeCheckOpsMatchingWidths(IC, Ops, ErrStr))
     return false;
 
   if (Width != 0 && Width != Ops[0]->Width) {
@@ -474,9 +475,8 @@ bool Parser::typeCheckPhi(unsigned Width, Block *B,
   return true;
 }
 
-bool Parser::typeCheckInst(Inst::Kind IK, unsigned &Width,
-                           std::vector<Inst *> &Ops,
-                           std::string &ErrStr) {
+bool souper::typeCheckInst(InstContext &IC, Inst::Kind IK, unsigned &Width,
+                           std::vector<Inst *> &Ops, std::string &ErrStr) {
   unsigned MinOps = 2, MaxOps = 2;
   llvm::MutableArrayRef<Inst *> OpsMatchingWidths = Ops;
 
@@ -606,7 +606,7 @@ bool Parser::typeCheckInst(Inst::Kind IK, unsigned &Width,
 
   case Inst::Lop3:
     MaxOps = MinOps = 4;
-    if (Ops[3]->Width != 8 || Ops[3]->K != Inst::Const) {
+    if (Ops.size() == 4 && (Ops[3]->Width != 8 || Ops[3]->K != Inst::Const)) {
       ErrStr = "last operand of lop3 must be a constant of width 8";
       return false;
     }
@@ -619,7 +619,10 @@ bool Parser::typeCheckInst(Inst::Kind IK, unsigned &Width,
     break;
 
   default:
-    llvm::report_fatal_error("unhandled");
+    // kinds that no instruction line produces, read from a binary corpus
+    ErrStr = std::string("unexpected ") + Inst::getKindName(IK) +
+             " instruction";
+    return false;
   }
 
   if (MinOps == MaxOps && Ops.size() != MinOps) {
@@ -648,7 +651,7 @@ bool Parser::typeCheckInst(Inst::Kind IK, unsigned &Width,
   // ExtractValue instruction is an index value. We don't type check
   // the operands width as the two elements vary in width.
   if (IK != Inst::ExtractValue) {
-    if (!typeCheckOpsMatchingWidths(OpsMatchingWidths, ErrStr))
+    if (!typeCheckOpsMatchingWidths(IC, OpsMatchingWidths, ErrStr))
       return false;
 
     for (auto Op : Ops) {
@@ -766,6 +769,7 @@ void Parser::nextReplacement() {
   PCs.clear();
   BPCs.clear();
   BlockPCIdxMap.clear();
+  ExternalUsesSet.clear();
   if (RCsOut)
     RCsOut->emplace_back(Context);
   ++Index;
@@ -787,7 +791,7 @@ InstMapping Parser::parseInstMapping(std::string &ErrStr) {
     return InstMapping();
 
   if (!(SrcRep[1]->Width == 1 && SrcRep[0]->Width != 1) && // represents an invariant
-      !typeCheckOpsMatchingWidths(SrcRep, ErrStr)) {
+      !typeCheckOpsMatchingWidths(IC, SrcRep, ErrStr)) {
     ErrStr = makeErrStr(ErrStr);
     return InstMapping();
   }
@@ -798,7 +802,7 @@ InstMapping Parser::parseInstMapping(std::string &ErrStr) {
 bool Parser::parseInstAttribute(std::string &ErrStr, Inst *LHS) {
   int DemandedBitsCount = 0;
   int HarvestKindCount = 0;
-  LHS->HarvestKind = HarvestType::HarvestedFromDef;
+  LHS->mutableAttrs().HarvestKind = HarvestType::HarvestedFromDef;
   LHS->DemandedBits = APInt::getAllOnes(LHS->Width);
   while (CurTok.K == Token::OpenParen) {
     llvm::APInt DemandedBitsVal = APInt(LHS->Width, 0, false);
@@ -863,7 +867,7 @@ bool Parser::parseInstAttribute(std::string &ErrStr, Inst *LHS) {
       }
       if (!consumeToken(ErrStr))
         return false;
-      LHS->HarvestKind = HarvestType::HarvestedFromUse;
+      LHS->mutableAttrs().HarvestKind = HarvestType::HarvestedFromUse;
     } else {
       ErrStr = makeErrStr("invalid Inst attribute string");
       return false;
@@ -1061,8 +1065,8 @@ bool Parser::parseLine(std::string &ErrStr) {
         return false;
       }
 
-      Inst::Kind IK = Inst::getKind(CurTok.str().str());
-      std::string InstNameStr = CurTok.str().str();
+      Inst::Kind IK = Inst::getKind(CurTok.str());
+      StringRef InstNameStr = CurTok.str();
 
       if (IK == Inst::None) {
         if (CurTok.str() == "block") {
@@ -1115,16 +1119,16 @@ bool Parser::parseLine(std::string &ErrStr) {
               return false;
             switch (CurTok.K) {
               case Token::KnownBits:
-                if (InstWidth != CurTok.PatternString.length()) {
+                if (InstWidth != CurTok.Pattern.size()) {
                   ErrStr = makeErrStr(TP, "knownbits pattern must be of same length as var width");
                   return false;
                 }
                 for (unsigned i = 0; i < InstWidth; ++i) {
-                  if (CurTok.PatternString[i] == '0')
-                    Zero += ConstOne.shl(CurTok.PatternString.length() - 1 - i);
-                  else if (CurTok.PatternString[i] == '1')
-                    One += ConstOne.shl(CurTok.PatternString.length() - 1 - i);
-                  else if (CurTok.PatternString[i] != 'x') {
+                  if (CurTok.Pattern[i] == '0')
+                    Zero += ConstOne.shl(CurTok.Pattern.size() - 1 - i);
+                  else if (CurTok.Pattern[i] == '1')
+                    One += ConstOne.shl(CurTok.Pattern.size() - 1 - i);
+                  else if (CurTok.Pattern[i] != 'x') {
                     ErrStr = makeErrStr(TP, "invalid knownBits string");
                     return false;
                   }
@@ -1270,7 +1274,7 @@ bool Parser::parseLine(std::string &ErrStr) {
                            llvm::APInt::getAllOnes(InstWidth), ++ReservedConstCounter);
         else if (IK == Inst::ReservedInst) {
           I = IC.createHole(InstWidth);
-          I->Name = InstName;
+          I->mutableAttrs().Name = InstName;
         }
 
         Context.setInst(InstName, I);
@@ -1346,7 +1350,7 @@ bool Parser::parseLine(std::string &ErrStr) {
         }
         I = IC.getPhi(B, Ops);
       } else {
-        if (!typeCheckInst(IK, InstWidth, Ops, ErrStr)) {
+        if (!typeCheckInst(IC, IK, InstWidth, Ops, ErrStr)) {
           ErrStr = makeErrStr(TP, ErrStr);
           return false;
         }
@@ -1389,14 +1393,14 @@ bool Parser::parseLine(std::string &ErrStr) {
       }
 
       if (IK == Inst::Custom) {
-        I->Name = InstNameStr;
+        I->mutableAttrs().Name = InstNameStr.str();
 
       }
 
       if (hasExternalUses)
         ExternalUsesSet.insert(I);
       for (auto EU: ExternalUsesSet)
-        I->DepsWithExternalUses.insert(EU);
+        I->mutableAttrs().DepsWithExternalUses.insert(EU);
       Context.setInst(InstName, I);
       return true;
     }
@@ -1505,6 +1509,13 @@ std::vector<ParsedReplacement> Parser::parseReplacements(std::string &ErrStr) {
 std::vector<ParsedReplacement> souper::ParseReplacements(
     InstContext &IC, llvm::StringRef Filename, llvm::StringRef Str,
     std::string &ErrStr) {
+  if (isBinaryCorpus(Str)) {
+    auto Reader = BinaryCorpusReader::create(Str, ErrStr);
+    if (!Reader)
+      return {};
+    return Reader->getAll(IC, ErrStr);
+  }
+
   std::vector<ParsedReplacement> Reps;
   Parser P(Filename, Str, IC, Reps, ReplacementKind::ParseBoth, 0, 0);
   std::vector<ParsedReplacement> R = P.parseReplacements(ErrStr);
@@ -1517,6 +1528,143 @@ std::vector<ParsedReplacement> souper::ParseReplacements(
   return R;
 }
 
+bool Parser::parseNextReplacement(ParsedReplacement &Rep,
+                                  std::string &ErrStr) {
+  if (!Started) {
+    Started = true;
+    if (!consumeToken(ErrStr))
+      return false;
+  }
+
+  while (CurTok.K != Token::Eof) {
+    if (!parseLine(ErrStr))
+      return false;
+    if (!Reps.empty()) {
+      Rep = std::move(Reps.back());
+      Reps.clear();
+      return true;
+    }
+  }
+
+  if (!PCs.empty() || !BPCs.empty() || !Context.empty() ||
+      !BlockPCIdxMap.empty())
+    ErrStr = makeErrStr("incomplete replacement");
+  return false;
+}
+
+struct ReplacementStream::Impl {
+  std::unique_ptr<MemoryBuffer> Buffer;
+  std::vector<ParsedReplacement> Reps;
+  std::unique_ptr<Parser> P;
+  InstContext &IC;
+  std::unique_ptr<BinaryCorpusReader> Binary;
+  size_t NextBinary = 0;
+  std::string BinaryErr;
+  bool Done = false;
+
+  Impl(InstContext &IC, StringRef Filename, StringRef Str, unsigned FirstLine)
+      : IC(IC) {
+    if (isBinaryCorpus(Str)) {
+      Binary = BinaryCorpusReader::create(Str, BinaryErr);
+      return;
+    }
+    P = std::make_unique<Parser>(Filename, Str, IC, Reps,
+                                 ReplacementKind::ParseBoth, nullptr, nullptr,
+                                 FirstLine);
+  }
+};
+
+ReplacementStream::ReplacementStream(InstContext &IC, StringRef Filename,
+                                     StringRef Str, unsigned FirstLine)
+    : P(std::make_unique<Impl>(IC, Filename, Str, FirstLine)) {}
+
+ReplacementStream::~ReplacementStream() = default;
+
+std::unique_ptr<ReplacementStream>
+ReplacementStream::open(InstContext &IC, StringRef Filename,
+                        std::string &ErrStr) {
+  auto MB = MemoryBuffer::getFileOrSTDIN(Filename, /*IsText=*/false,
+                                         /*RequiresNullTerminator=*/false);
+  if (!MB) {
+    ErrStr = Filename.str() + ": " + MB.getError().message();
+    return nullptr;
+  }
+  auto S = std::make_unique<ReplacementStream>(
+      IC, (*MB)->getBufferIdentifier(), (*MB)->getBuffer());
+  S->P->Buffer = std::move(*MB);
+  return S;
+}
+
+bool ReplacementStream::isBinary() const {
+  return !P->P;
+}
+
+bool ReplacementStream::next(ParsedReplacement &Rep, std::string &ErrStr) {
+  if (P->Done)
+    return false;
+  if (P->P) {
+    if (P->P->parseNextReplacement(Rep, ErrStr))
+      return true;
+    P->Done = true;
+    return false;
+  }
+  if (!P->Binary || P->NextBinary == P->Binary->size()) {
+    ErrStr = P->BinaryErr;
+    P->Done = true;
+    return false;
+  }
+  Rep = P->Binary->get(P->NextBinary++, P->IC, ErrStr);
+  if (!ErrStr.empty()) {
+    P->Done = true;
+    return false;
+  }
+  return true;
+}
+
+// Returns the offset just past the first line at or after Pos that ends a
+// replacement: a 'cand' or 'result' line, or an 'infer' line that the next
+// 'infer' or 'cand' shows to have no 'result', as in a file of LHSs
+static size_t findReplacementEnd(StringRef Str, size_t Pos) {
+  size_t LineBegin = Pos == 0 ? 0 : Str.rfind('\n', Pos - 1);
+  LineBegin = LineBegin == StringRef::npos ? 0 : LineBegin + 1;
+  size_t InferEnd = StringRef::npos;
+  while (LineBegin < Str.size()) {
+    size_t LineEnd = Str.find('\n', LineBegin);
+    LineEnd = LineEnd == StringRef::npos ? Str.size() : LineEnd + 1;
+    StringRef Line = Str.slice(LineBegin, LineEnd).ltrim(" \t");
+    if (Line.starts_with("result ") || Line.starts_with("result\t"))
+      return LineEnd;
+    if (Line.starts_with("cand ") || Line.starts_with("cand\t"))
+      return InferEnd == StringRef::npos ? LineEnd : InferEnd;
+    if (Line.starts_with("infer ") || Line.starts_with("infer\t")) {
+      if (InferEnd != StringRef::npos)
+        return InferEnd;
+      InferEnd = LineEnd;
+    }
+    LineBegin = LineEnd;
+  }
+  return InferEnd == StringRef::npos ? Str.size() : InferEnd;
+}
+
+std::vector<ReplacementShard> souper::SplitReplacements(StringRef Str,
+                                                        unsigned N) {
+  if (N <= 1 || isBinaryCorpus(Str))
+    return {{Str, 1}};
+
+  std::vector<ReplacementShard> Shards;
+  size_t Begin = 0;
+  unsigned Line = 1;
+  for (unsigned I = 1; I <= N && Begin < Str.size(); ++I) {
+    size_t End = I == N ? Str.size() :
+      findReplacementEnd(Str, std::max(Begin, Str.size() / N * I));
+    StringRef Shard = Str.slice(Begin, End);
+    Shards.push_back({Shard, Line});
+    Line += Shard.count('\n');
+    Begin = End;
+  }
+  return Shards;
+}
+
 std::vector<ParsedReplacement> souper::ParseReplacementLHSs(
     InstContext &IC, llvm::StringRef Filename, llvm::StringRef Str,
     std::vector<ReplacementContext> &RCs, std::string &ErrStr) {
@@ -272,6 +272,8 @@ public:
       for (auto &R : B->Replacements)
         AddToCandidateMap(CandMap, R);
 
+    // static profile keys are printed by one printer, whose buffer is reused
+    ReplacementPrinter ProfilePrinter;
     for (auto &Cand : CandMap) {
 
       if (DebugLevel > 1)
@@ -289,10 +291,8 @@ public:
         llvm::raw_string_ostream Loc(Str);
         Cand.Origin->getDebugLoc().print(Loc);
         std::string HField = "sprofile " + Loc.str();
-        ReplacementContext Context;
-        KV->hIncrBy(GetReplacementLHSString(Cand.BPCs, Cand.PCs,
-                                            Cand.Mapping.LHS,
-                                            Context), HField, 1);
+        KV->hIncrBy(ProfilePrinter.printLHS(Cand.BPCs, Cand.PCs,
+                                            Cand.Mapping.LHS), HField, 1);
       }
       if (DynamicProfileAll) {
         dynamicProfile(&F, Cand);
@@ -337,7 +337,7 @@ public:
                                ReplacedValues, Builder, F.getParent());
 
       // if LHS comes from use, then NewVal should be a constant
-      assert(Cand.Mapping.LHS->HarvestKind != HarvestType::HarvestedFromUse ||
+      assert(Cand.Mapping.LHS->attrs().HarvestKind != HarvestType::HarvestedFromUse ||
              isa<llvm::Constant>(NewVal));
 
       // TODO can we assert that getValue() succeeds?
@@ -360,7 +360,7 @@ public:
         ++ReplacementIdx;
       ReplacementsDone++;
 
-      if (Cand.Mapping.LHS->HarvestKind == HarvestType::HarvestedFromDef)
+      if (Cand.Mapping.LHS->attrs().HarvestKind == HarvestType::HarvestedFromDef)
         ReplacedValues[Cand.Mapping.LHS] = NewVal;
 
       if (DebugLevel > 1) {
@@ -390,7 +390,7 @@ public:
       if (DynamicProfile)
         dynamicProfile(&F, Cand);
 
-      if (Cand.Mapping.LHS->HarvestKind == HarvestType::HarvestedFromDef) {
+      if (Cand.Mapping.LHS->attrs().HarvestKind == HarvestType::HarvestedFromDef) {
         I->replaceAllUsesWith(NewVal);
       } else {
         for (llvm::Value::use_iterator UI = I->use_begin();
@@ -399,7 +399,7 @@ public:
           ++UI;
           // TODO: Handle general values, not only instructions
           auto *Usr = dyn_cast<llvm::Instruction>(U.getUser());
-          if (Usr && Usr->getParent() == Cand.Mapping.LHS->HarvestFrom) {
+          if (Usr && Usr->getParent() == Cand.Mapping.LHS->attrs().HarvestFrom) {
             U.set(NewVal);
           }
         }
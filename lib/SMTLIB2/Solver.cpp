@@ -15,16 +15,24 @@
 #define DEBUG_TYPE "souper"
 
 #include "llvm/ADT/APInt.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Program.h"
 #include "llvm/Support/raw_ostream.h"
 #include "souper/SMTLIB2/Solver.h"
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstring>
 #include <fcntl.h>
 #include <stdio.h>
+#include <mutex>
 #include <optional>
 #include <sys/resource.h>
 #include <sys/stat.h>
@@ -32,6 +40,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <system_error>
+#include <z3.h>
 
 using namespace llvm;
 using namespace souper;
@@ -202,17 +211,247 @@ std::vector<APInt> ParseModels(StringRef Models, unsigned NumModels,
   return ModelVals;
 }
 
+// Calls F on each top-level command of Query, skipping comments.
+void forEachCommand(StringRef Query, function_ref<void(StringRef)> F) {
+  size_t I = 0, N = Query.size();
+  while (I != N) {
+    if (Query[I] == ';') {
+      while (I != N && Query[I] != '\n')
+        ++I;
+      continue;
+    }
+    if (Query[I] != '(') {
+      ++I;
+      continue;
+    }
+    size_t Begin = I;
+    unsigned Level = 0;
+    for (; I != N; ++I) {
+      char C = Query[I];
+      if (C == '|' || C == '"') {
+        // quoted symbols and strings may contain parentheses
+        for (++I; I != N && Query[I] != C; ++I)
+          ;
+        if (I == N)
+          break;
+      } else if (C == '(') {
+        ++Level;
+      } else if (C == ')' && --Level == 0) {
+        ++I;
+        break;
+      }
+    }
+    F(Query.slice(Begin, I));
+  }
+}
+
+StringRef commandName(StringRef Cmd) {
+  StringRef Head = Cmd.drop_front().ltrim();
+  return Head.take_until([](char C) { return isSpace(C) || C == ')'; });
+}
+
+// The symbol that a declare-fun or declare-const command declares, or an
+// empty string for other commands
+StringRef declaredSymbol(StringRef Cmd) {
+  StringRef Name = commandName(Cmd);
+  if (Name != "declare-fun" && Name != "declare-const")
+    return StringRef();
+  StringRef Rest = Cmd.drop_front().ltrim().drop_front(Name.size()).ltrim();
+  if (Rest.starts_with("|"))
+    return Rest.take_front(Rest.find('|', 1) + 1);
+  return Rest.take_until([](char C) { return isSpace(C) || C == '('; });
+}
+
+// Drops the top-level commands of a standalone query that can't be issued
+// in the middle of a session: set-logic and set-option are only legal before
+// the first declaration, exit would end the session, and the symbols in
+// Declared are declared by the session already. Drops check-sat and
+// get-value too unless Actions is set.
+std::string stripSessionCommands(StringRef Query, const StringSet<> &Declared,
+                                 bool Actions) {
+  std::string Result;
+  Result.reserve(Query.size());
+  forEachCommand(Query, [&](StringRef Cmd) {
+    StringRef Name = commandName(Cmd);
+    if (Name == "set-logic" || Name == "set-option" || Name == "exit")
+      return;
+    if (!Actions && (Name == "check-sat" || Name == "get-value"))
+      return;
+    StringRef Symbol = declaredSymbol(Cmd);
+    if (!Symbol.empty() && Declared.count(Symbol))
+      return;
+    Result += Cmd;
+    Result += '\n';
+  });
+  return Result;
+}
+
+// Z3 running in this process. The context is kept across queries, so a query
+// costs neither a process start nor a round trip through temporary files;
+// each one is evaluated between a push and a pop, on top of the assertions
+// that addAssertions() keeps.
+class Z3SessionSolver : public SMTLIBSolver {
+  Z3_context Ctx;
+  // checks with (check-sat-using Tactic) instead of (check-sat) if not empty
+  std::string Tactic;
+  // Interrupted and Running are guarded by M. Z3_interrupt only stops a
+  // check that is under way, so it is only called while Running.
+  std::mutex M;
+  std::condition_variable Idle;
+  bool Interrupted = false;
+  bool Running = false;
+  // symbols declared by the kept assertions
+  StringSet<> Declared;
+
+  std::string eval(StringRef Script) {
+    // the result is only valid until the next call
+    return Z3_eval_smtlib2_string(Ctx, Script.str().c_str());
+  }
+
+public:
+  Z3SessionSolver(StringRef Tactic = "") : Tactic(Tactic) {
+    Z3_config Cfg = Z3_mk_config();
+    Ctx = Z3_mk_context(Cfg);
+    Z3_del_config(Cfg);
+    // errors are reported in the output of Z3_eval_smtlib2_string
+    Z3_set_error_handler(Ctx, [](Z3_context, Z3_error_code) {});
+    eval("(set-option :produce-models true)");
+  }
+
+  ~Z3SessionSolver() {
+    Z3_del_context(Ctx);
+  }
+
+  std::string getName() const override {
+    if (Tactic.empty())
+      return "Z3 session";
+    return "Z3 session using " + Tactic;
+  }
+
+  void interrupt() override {
+    std::unique_lock<std::mutex> Lock(M);
+    Interrupted = true;
+    // an interrupt that lands before check-sat has started is lost, so it
+    // is repeated until the query returns
+    while (Running) {
+      Z3_interrupt(Ctx);
+      Idle.wait_for(Lock, std::chrono::milliseconds(1));
+    }
+  }
+
+  void resume() override {
+    std::lock_guard<std::mutex> Lock(M);
+    Interrupted = false;
+  }
+
+  bool addAssertions(StringRef Query) override {
+    // each set is kept in a scope of its own, so that a set that fails can
+    // be dropped without touching the earlier ones
+    std::string Body = stripSessionCommands(Query, Declared, /*Actions=*/false);
+    // declarations and assertions print nothing unless they fail
+    if (!StringRef(eval("(push 1)\n" + Body)).trim().empty()) {
+      eval("(pop 1)");
+      ++Errors;
+      return false;
+    }
+    forEachCommand(Body, [this](StringRef Cmd) {
+      StringRef Symbol = declaredSymbol(Cmd);
+      if (!Symbol.empty())
+        Declared.insert(Symbol);
+    });
+    return true;
+  }
+
+  std::error_code isSatisfiable(StringRef Query, bool &Result,
+                                unsigned NumModels, std::vector<APInt> *Models,
+                                unsigned Timeout) override {
+    std::string Body = stripSessionCommands(Query, Declared, /*Actions=*/true);
+    size_t CheckPos = Body.find("(check-sat)");
+    if (CheckPos == std::string::npos) {
+      ++Errors;
+      return std::make_error_code(std::errc::protocol_error);
+    }
+    // the get-value commands are only issued once the query turned out to
+    // be satisfiable; for any other answer they would just fail
+    StringRef GetValues =
+        StringRef(Body).drop_front(CheckPos + strlen("(check-sat)"));
+
+    // the timeout is a global option that push and pop don't restore, so
+    // every query sets it, to Z3's default if it has none
+    std::string Script = "(push 1)\n(set-option :timeout " +
+                         std::to_string(Timeout ? Timeout * 1000 : UINT_MAX) +
+                         ")\n";
+    Script.append(Body, 0, CheckPos);
+    // as for a solver process, anything printed before the answer means the
+    // query was malformed; declarations and assertions print nothing unless
+    // they fail
+    if (!StringRef(eval(Script)).trim().empty()) {
+      eval("(pop 1)");
+      ++Errors;
+      return std::make_error_code(std::errc::protocol_error);
+    }
+
+    // only the check itself may be interrupted, an interrupted push or
+    // declaration would leave the scopes unbalanced
+    bool Started = false;
+    {
+      std::lock_guard<std::mutex> Lock(M);
+      if (!Interrupted)
+        Started = Running = true;
+    }
+    std::string Out = "unknown";
+    bool WasInterrupted = !Started;
+    if (Started) {
+      Out = eval(Tactic.empty() ? "(check-sat)"
+                                : "(check-sat-using " + Tactic + ")");
+      {
+        std::lock_guard<std::mutex> Lock(M);
+        Running = false;
+        WasInterrupted = Interrupted;
+      }
+      Idle.notify_all();
+    }
+
+    std::error_code EC;
+    StringRef Answer = StringRef(Out).split('\n').first.rtrim();
+    if (Answer == "sat") {
+      Result = true;
+      ++Sats;
+      if (Models) {
+        std::string ErrStr;
+        *Models = ParseModels(eval(GetValues), NumModels, ErrStr);
+        if (!ErrStr.empty())
+          EC = std::make_error_code(std::errc::protocol_error);
+      }
+    } else if (Answer == "unsat") {
+      Result = false;
+      ++Unsats;
+    } else if (Answer == "unknown" || WasInterrupted) {
+      ++Timeouts;
+      EC = std::make_error_code(std::errc::timed_out);
+    } else {
+      ++Errors;
+      EC = std::make_error_code(std::errc::protocol_error);
+    }
+    eval("(pop 1)");
+    return EC;
+  }
+};
+
 class ProcessSMTLIBSolver : public SMTLIBSolver {
   std::string Name;
   bool Keep;
+  // whether startSession() can hand out an in-process Z3
+  bool Sessions;
   SolverProgram Prog;
   std::vector<std::string> Args;
   std::vector<const char *> ArgPtrs;
 
 public:
   ProcessSMTLIBSolver(std::string Name, bool Keep, SolverProgram Prog,
-                      const std::vector<std::string> &Args)
-      : Name(Name), Keep(Keep), Prog(Prog), Args(Args) {
+                      const std::vector<std::string> &Args,
+                      bool Sessions = false)
+      : Name(Name), Keep(Keep), Sessions(Sessions), Prog(Prog), Args(Args) {
     std::transform(Args.begin(), Args.end(), std::back_inserter(ArgPtrs),
                    [](const std::string &Arg) { return Arg.c_str(); });
     ArgPtrs.push_back(0);
@@ -222,6 +461,19 @@ public:
     return Name;
   }
 
+  std::unique_ptr<SMTLIBSolver> clone() const override {
+    // every query runs in its own process and temporary files
+    return std::make_unique<ProcessSMTLIBSolver>(Name, Keep, Prog, Args,
+                                                 Sessions);
+  }
+
+  std::unique_ptr<SMTLIBSolver> startSession() const override {
+    // queries that are kept for inspection have to go through files
+    if (!Sessions || Keep)
+      return nullptr;
+    return std::make_unique<Z3SessionSolver>();
+  }
+
   std::error_code isSatisfiable(StringRef Query, bool &Result,
                                 unsigned NumModels, std::vector<APInt> *Models,
                                 unsigned Timeout) override {
@@ -367,7 +619,12 @@ SolverProgram souper::makeInternalSolverProgram(int MainPtr(int argc,
 }
 
 std::unique_ptr<SMTLIBSolver> souper::createZ3Solver(SolverProgram Prog,
-                                                     bool Keep) {
+                                                     bool Keep,
+                                                     bool Sessions) {
   return std::unique_ptr<SMTLIBSolver>(
-      new ProcessSMTLIBSolver("Z3", Keep, Prog, {"-smt2", "-in"}));
+      new ProcessSMTLIBSolver("Z3", Keep, Prog, {"-smt2", "-in"}, Sessions));
+}
+
+std::unique_ptr<SMTLIBSolver> souper::createZ3SessionSolver(StringRef Tactic) {
+  return std::unique_ptr<SMTLIBSolver>(new Z3SessionSolver(Tactic));
 }
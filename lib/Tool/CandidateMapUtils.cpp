@@ -335,17 +335,16 @@ bool SolveCandidateMap(llvm::raw_ostream &OS, CandidateMap &M,
     OS << "; Using solver: " << S->getName() << '\n';
 
     std::vector<int> Profile;
-    std::map<std::string,int> Index;
+    llvm::StringMap<int> Index;
+    ReplacementPrinter Printer;
     for (int I=0; I < M.size(); ++I) {
       auto &Cand = M[I];
-      ReplacementContext Context;
-      auto S = GetReplacementLHSString(Cand.BPCs, Cand.PCs,
-                                       Cand.Mapping.LHS, Context);
-      if (Index.find(S) == Index.end()) {
-        Index[S] = I;
+      auto [It, Inserted] = Index.try_emplace(
+          Printer.printLHS(Cand.BPCs, Cand.PCs, Cand.Mapping.LHS), I);
+      if (Inserted) {
         Profile.push_back(1);
       } else {
-        ++Profile[Index[S]];
+        ++Profile[It->second];
         Profile.push_back(0);
       }
     }
@@ -361,9 +360,8 @@ bool SolveCandidateMap(llvm::raw_ostream &OS, CandidateMap &M,
         Instruction *I = Cand.Origin;
         I->getDebugLoc().print(Loc);
         std::string HField = "sprofile " + Loc.str();
-        ReplacementContext Context;
-        KVForStaticProfile->hIncrBy(GetReplacementLHSString(Cand.BPCs,
-            Cand.PCs, Cand.Mapping.LHS, Context), HField, 1);
+        KVForStaticProfile->hIncrBy(Printer.printLHS(Cand.BPCs,
+            Cand.PCs, Cand.Mapping.LHS), HField, 1);
       }
 
       if (isInferDFA()) {
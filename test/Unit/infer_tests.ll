@@ -0,0 +1 @@
+; RUN: %builddir/infer_tests
@@ -0,0 +1 @@
+; RUN: %builddir/util_tests
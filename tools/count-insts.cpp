@@ -49,7 +49,7 @@ void countHelper(Inst *I, std::set<Inst *> &Visited,
   ++Result[I->K];
 
   for (auto Op : I->Ops)
-    if (!(StopAtExtUse && OrigI->DepsWithExternalUses.find(Op) != OrigI->DepsWithExternalUses.end()))
+    if (!(StopAtExtUse && OrigI->attrs().DepsWithExternalUses.find(Op) != OrigI->attrs().DepsWithExternalUses.end()))
       countHelper(Op, Visited, Result, OrigI);
 }
 
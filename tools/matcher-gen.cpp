@@ -605,7 +605,7 @@ struct SymbolTable {
   bool GenPCConstraints(std::vector<InstMapping> PCs) {
     for (auto M : PCs) {
       if (M.LHS->K == Inst::KnownZerosP) {
-        if (M.LHS->Ops[0]->K == Inst::Var && M.LHS->Ops[1]->Name.starts_with("symDF_K")) {
+        if (M.LHS->Ops[0]->K == Inst::Var && M.LHS->Ops[1]->attrs().Name.starts_with("symDF_K")) {
           auto C = new SymK0Bind(T.at(M.LHS->Ops[0]),
                                  T.at(M.LHS->Ops[1]));
           Constraints.push_front(C);
@@ -616,7 +616,7 @@ struct SymbolTable {
           Constraints.push_back(C);
         }
       } else if (M.LHS->K == Inst::KnownOnesP) {
-        if (M.LHS->Ops[0]->K == Inst::Var && M.LHS->Ops[1]->Name.starts_with("symDF_K")) {
+        if (M.LHS->Ops[0]->K == Inst::Var && M.LHS->Ops[1]->attrs().Name.starts_with("symDF_K")) {
           auto C = new SymK1Bind(T.at(M.LHS->Ops[0]),
                                  T.at(M.LHS->Ops[1]));
           Constraints.push_front(C);
@@ -674,17 +674,17 @@ struct SymbolTable {
 
     for (auto &&V : VarSet) {
       auto Name = T.at(V);
-      if (V->KnownOnes.getBitWidth() == V->Width &&
-          V->KnownOnes != 0) {
-        Constraints.push_back(new K1(Name, llvm::toString(V->KnownOnes, 2, false), V->Width));
+      if (V->attrs().KnownOnes.getBitWidth() == V->Width &&
+          V->attrs().KnownOnes != 0) {
+        Constraints.push_back(new K1(Name, llvm::toString(V->attrs().KnownOnes, 2, false), V->Width));
       }
-      if (V->KnownZeros.getBitWidth() == V->Width &&
-          V->KnownZeros != 0) {
-        Constraints.push_back(new K0(Name, llvm::toString(V->KnownZeros, 2, false), V->Width));
+      if (V->attrs().KnownZeros.getBitWidth() == V->Width &&
+          V->attrs().KnownZeros != 0) {
+        Constraints.push_back(new K0(Name, llvm::toString(V->attrs().KnownZeros, 2, false), V->Width));
       }
 
-      if (!V->Range.isFullSet()) {
-        Constraints.push_back(new CR(Name, llvm::toString(V->Range.getLower(), 10, false), llvm::toString(V->Range.getUpper(), 10, false)));
+      if (!V->attrs().Range.isFullSet()) {
+        Constraints.push_back(new CR(Name, llvm::toString(V->attrs().Range.getLower(), 10, false), llvm::toString(V->attrs().Range.getUpper(), 10, false)));
       }
     }
   }
@@ -700,20 +700,20 @@ struct SymbolTable {
         Constraints.push_back(new WidthEq(Name, V->Width));
       }
 
-      if (V->PowOfTwo) {
+      if (V->attrs().PowOfTwo) {
         Constraints.push_back(new VC("pow2", Name));
       }
-      if (V->NonZero) {
+      if (V->attrs().NonZero) {
         Constraints.push_back(new VC("nz", Name));
       }
-      if (V->NonNegative) {
+      if (V->attrs().NonNegative) {
         Constraints.push_back(new VC("nn", Name));
       }
-      if (V->Negative) {
+      if (V->attrs().Negative) {
         Constraints.push_back(new VC("neg", Name));
       }
-      if (V->NumSignBits) {
-        Constraints.push_back(new NSB(Name, V->NumSignBits));
+      if (V->attrs().NumSignBits) {
+        Constraints.push_back(new NSB(Name, V->attrs().NumSignBits));
       }
     }
   }
@@ -845,14 +845,14 @@ bool GenLHSMatcher(Inst *I, Stream &Out, SymbolTable &Syms, bool IsRoot = false)
         Out << "m_SpecificInt( " << Child->Width << "," << Str << ")";
       }
     } else if (Child->K == Inst::Var) {
-      if (Child->Name.starts_with("symconst")) {
+      if (Child->attrs().Name.starts_with("symconst")) {
         if (MatchedVals.find(Child) == MatchedVals.end()) {
           MatchedVals.insert(Child);
           Out << "m_Constant(&" << Syms.T[Child] << ")";
         } else {
           Out << "m_Deferred(" << Syms.T[Child] << ")";
         }
-      } else if (Child->Name.starts_with("constexpr")) {
+      } else if (Child->attrs().Name.starts_with("constexpr")) {
         llvm::errs() << "FOUND A CONSTEXPR\n";
         return false;
       } else {
@@ -1297,7 +1297,7 @@ bool PCHasVar(const ParsedReplacement &Input) {
 
   for (auto &&V : Vars) {
     // llvm::errs() << V->Name << "\n";
-    if (!V->Name.starts_with("sym")) {
+    if (!V->attrs().Name.starts_with("sym")) {
       return true;
     }
   }
@@ -1404,12 +1404,12 @@ int main(int argc, char **argv) {
       findVars(Input.Mapping.RHS, Vars);
       bool found = false;
       for (auto V : Vars) {
-        if (V->KnownOnes.getBitWidth() == V->Width && V->KnownOnes != 0) {
+        if (V->attrs().KnownOnes.getBitWidth() == V->Width && V->attrs().KnownOnes != 0) {
           found = true;
           break;
         }
 
-        if (V->KnownZeros.getBitWidth() == V->Width && V->KnownZeros != 0) {
+        if (V->attrs().KnownZeros.getBitWidth() == V->Width && V->attrs().KnownZeros != 0) {
           found = true;
           break;
         }
@@ -0,0 +1,106 @@
+// Copyright 2014 The Souper Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Times printing a corpus of replacements with GetReplacementString and its
+// LHS and RHS variants against a reused ReplacementPrinter, and checks that
+// both print the same text.
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include "souper/Parser/Parser.h"
+
+#include <chrono>
+
+using namespace llvm;
+using namespace souper;
+
+static cl::opt<std::string> InputFilename(cl::Positional,
+    cl::desc("<input replacements>"),
+    cl::init("-"));
+
+static cl::opt<unsigned> Iterations("iterations",
+    cl::desc("Number of times the corpus is printed (default=10)"),
+    cl::init(10));
+
+static cl::opt<bool> PrintNames("print-names",
+    cl::desc("Print names (default=false)"),
+    cl::init(false));
+
+namespace {
+
+template <typename F> double timeIt(F Fn) {
+  auto Start = std::chrono::steady_clock::now();
+  for (unsigned It = 0; It < Iterations; ++It)
+    Fn();
+  std::chrono::duration<double> D = std::chrono::steady_clock::now() - Start;
+  return D.count();
+}
+
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv);
+
+  InstContext IC;
+  std::string ErrStr;
+  auto S = ReplacementStream::open(IC, InputFilename, ErrStr);
+  if (!S) {
+    llvm::errs() << ErrStr << '\n';
+    return 1;
+  }
+  std::vector<ParsedReplacement> Reps;
+  ParsedReplacement Rep;
+  while (S->next(Rep, ErrStr))
+    Reps.push_back(Rep);
+  if (!ErrStr.empty()) {
+    llvm::errs() << ErrStr << '\n';
+    return 1;
+  }
+
+  ReplacementPrinter P;
+  for (const auto &R : Reps) {
+    if (R.getString(PrintNames) !=
+        P.print(R.BPCs, R.PCs, R.Mapping, PrintNames)) {
+      llvm::errs() << "printers disagree on:\n" << R.getString(PrintNames);
+      return 1;
+    }
+  }
+
+  size_t Bytes = 0;
+  double Old = timeIt([&]() {
+    for (const auto &R : Reps) {
+      Bytes += R.getString(PrintNames).size();
+      ReplacementContext Context;
+      Bytes += GetReplacementLHSString(R.BPCs, R.PCs, R.Mapping.LHS, Context,
+                                       PrintNames).size();
+      Bytes += GetReplacementRHSString(R.Mapping.RHS, Context,
+                                       PrintNames).size();
+    }
+  });
+  double New = timeIt([&]() {
+    for (const auto &R : Reps) {
+      Bytes += P.print(R.BPCs, R.PCs, R.Mapping, PrintNames).size();
+      Bytes += P.printLHS(R.BPCs, R.PCs, R.Mapping.LHS, PrintNames).size();
+      Bytes += P.printRHS(R.Mapping.RHS).size();
+    }
+  });
+
+  llvm::outs() << Reps.size() << " replacements, " << Iterations
+               << " iterations (" << Bytes / 2 << " bytes each way)\n";
+  llvm::outs() << "ReplacementContext: " << format("%.3f", Old) << "s\n";
+  llvm::outs() << "ReplacementPrinter: " << format("%.3f", New) << "s ("
+               << format("%.2f", Old / New) << "x)\n";
+  return 0;
+}
@@ -430,7 +430,7 @@ int SolveInst(const MemoryBufferRef &MB, Solver *S) {
           } else if (SymInferRHS) {
             ReplacementContext Context;
             PrintReplacementLHS(llvm::outs(), Rep.BPCs, Rep.PCs,
-                                Rep.Mapping.RHS->Aux, Context);
+                                Rep.Mapping.RHS->attrs().Aux, Context);
             PrintReplacementRHS(llvm::outs(), Rep.Mapping.RHS, Context);
           } else {
             ReplacementContext Context;
@@ -458,7 +458,7 @@ int SolveInst(const MemoryBufferRef &MB, Solver *S) {
       if (InferConstBlockList.size() > 1) {
         std::map<std::string, Inst *> Consts;
         for (auto C : ConstSet) {
-          Consts[C->Name] = C;
+          Consts[C->attrs().Name] = C;
         }
 
         std::map<std::string, std::vector<int64_t>> BlockList;
@@ -507,7 +507,7 @@ int SolveInst(const MemoryBufferRef &MB, Solver *S) {
         if (!ResultConstMap.empty()) {
           if (InferConstOnlyPrintConsts) {
             for (auto &Const : ResultConstMap) {
-              llvm::outs() << Const.first->Name << "  ";
+              llvm::outs() << Const.first->attrs().Name << "  ";
               Const.second.print(llvm::outs(), false);
               llvm::outs() << "\n";
             }
@@ -634,10 +634,10 @@ int SolveInst(const MemoryBufferRef &MB, Solver *S) {
           std::sort(Models.begin(), Models.end(),
                     [](const std::pair<Inst *, APInt> &A,
                        const std::pair<Inst *, APInt> &B) {
-                      return A.first->Name < B.first->Name;
+                      return A.first->attrs().Name < B.first->attrs().Name;
                     });
           for (const auto &M : Models) {
-            llvm::outs() << '%' << M.first->Name << " = " << M.second << '\n';
+            llvm::outs() << '%' << M.first->attrs().Name << " = " << M.second << '\n';
           }
         } else {
           llvm::outs() << "\n";
@@ -0,0 +1,115 @@
+// Copyright 2014 The Souper Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Converts replacements between Souper's text and binary formats. Text
+// input is written as a binary corpus, and a binary corpus is printed as
+// text. With -cache-values, each RHS instead makes the trip that the
+// external cache's binary values make and is printed as text again.
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include "souper/Parser/BinaryFormat.h"
+#include "souper/Parser/Parser.h"
+
+using namespace llvm;
+using namespace souper;
+
+static cl::opt<std::string> InputFilename(cl::Positional,
+    cl::desc("<input replacements>"),
+    cl::init("-"));
+
+static cl::opt<std::string> OutputFilename("o",
+    cl::desc("Output file (default: stdout)"),
+    cl::init("-"));
+
+static cl::opt<bool> PrintNames("print-names",
+    cl::desc("Print names when writing text (default=false)"),
+    cl::init(false));
+
+static cl::opt<bool> CacheValues("cache-values",
+    cl::desc("Encode each RHS as an external cache value, decode it and "
+             "print the replacement as text (default=false)"),
+    cl::init(false));
+
+// Does to the RHS of Rep what storing it in the external cache with
+// -souper-binary-cache-values and looking it up again does
+static bool roundTripCacheValue(InstContext &IC, ParsedReplacement &Rep,
+                                std::string &ErrStr) {
+  if (!Rep.Mapping.RHS)
+    return true;
+  ReplacementContext StoreContext;
+  GetReplacementLHSString(Rep.BPCs, Rep.PCs, Rep.Mapping.LHS, StoreContext);
+  std::string Value = EncodeReplacementRHS(Rep.Mapping.RHS, StoreContext);
+  if (!isBinaryRHS(Value)) {
+    ErrStr = "cache value is not in the binary format";
+    return false;
+  }
+  ReplacementContext LoadContext;
+  GetReplacementLHSString(Rep.BPCs, Rep.PCs, Rep.Mapping.LHS, LoadContext);
+  Inst *RHS = DecodeReplacementRHS(IC, Value, LoadContext, ErrStr);
+  if (!ErrStr.empty())
+    return false;
+  Rep.Mapping.RHS = RHS;
+  return true;
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv);
+
+  InstContext IC;
+  std::string ErrStr;
+  auto S = ReplacementStream::open(IC, InputFilename, ErrStr);
+  if (!S) {
+    llvm::errs() << ErrStr << '\n';
+    return 1;
+  }
+
+  bool ToText = S->isBinary() || CacheValues;
+
+  std::error_code EC;
+  raw_fd_ostream OS(OutputFilename, EC,
+                    ToText ? sys::fs::OF_Text : sys::fs::OF_None);
+  if (EC) {
+    llvm::errs() << EC.message() << '\n';
+    return 1;
+  }
+
+  // every replacement is converted in a scope of its own, so the context
+  // doesn't grow with the corpus
+  BinaryCorpusWriter W;
+  while (true) {
+    auto Scope = IC.beginScope();
+    ParsedReplacement Rep;
+    if (!S->next(Rep, ErrStr))
+      break;
+    if (CacheValues && !roundTripCacheValue(IC, Rep, ErrStr))
+      break;
+    if (ToText) {
+      Rep.print(OS, PrintNames);
+      OS << '\n';
+    } else {
+      W.add(Rep);
+    }
+  }
+  if (!ErrStr.empty()) {
+    llvm::errs() << ErrStr << '\n';
+    return 1;
+  }
+
+  if (!ToText)
+    W.write(OS);
+
+  return 0;
+}
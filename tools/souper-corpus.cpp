@@ -0,0 +1,332 @@
+// Copyright 2014 The Souper Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Prepares a corpus of replacements: reads files and directories of text or
+// binary replacements on all cores, drops the replacements that don't pass
+// the filters, deduplicates the rest by their canonical form and writes them
+// out as one file, a number of shards, or one file per replacement.
+
+#include "llvm/ADT/CachedHashString.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+#include "souper/Infer/SynthUtils.h"
+#include "souper/Inst/Inst.h"
+#include "souper/Parser/BinaryFormat.h"
+#include "souper/Parser/Parser.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+using namespace llvm;
+using namespace souper;
+
+static cl::list<std::string> InputPaths(cl::Positional, cl::OneOrMore,
+    cl::desc("<input files or directories>"));
+
+static cl::opt<std::string> OutputPath("o",
+    cl::desc("Output file, or directory when writing more than one shard "
+             "(default: stdout)"),
+    cl::init("-"));
+
+static cl::opt<unsigned> NumShards("shards",
+    cl::desc("Number of output files, 0 for one file per replacement "
+             "(default=1)"),
+    cl::init(1));
+
+static cl::opt<bool> BinaryOutput("binary",
+    cl::desc("Write binary corpora instead of text (default=false)"),
+    cl::init(false));
+
+static cl::opt<unsigned> NumThreads("j",
+    cl::desc("Number of threads, 0 for one per core (default=0)"),
+    cl::init(0));
+
+static cl::opt<bool> NoDedup("no-dedup",
+    cl::desc("Keep duplicate replacements (default=false)"),
+    cl::init(false));
+
+static cl::opt<int> MinProfit("min-profit",
+    cl::desc("Drop replacements with a smaller profit"),
+    cl::init(0));
+
+static cl::opt<unsigned> MaxWidth("max-width",
+    cl::desc("Drop replacements with a wider instruction, 0 for no limit "
+             "(default=0)"),
+    cl::init(0));
+
+static cl::opt<unsigned> MaxLHSInsts("max-lhs-insts",
+    cl::desc("Drop replacements with more LHS instructions, 0 for no limit "
+             "(default=0)"),
+    cl::init(0));
+
+static cl::opt<bool> PrintStats("print-stats",
+    cl::desc("Print how many replacements were read, dropped and written "
+             "(default=false)"),
+    cl::init(false));
+
+namespace {
+
+struct Entry {
+  // the replacement printed without names, which is the same for
+  // replacements that differ only in names, numbering or the order of
+  // commutative operands
+  std::string Text;
+  // the binary record, if binary output was asked for
+  std::string Record;
+  uint32_t Hash;
+};
+
+// A piece of the input that one thread parses: a shard of a text file or a
+// range of the records of a binary corpus
+struct WorkItem {
+  StringRef Filename;
+  ReplacementShard Shard;
+  const BinaryCorpusReader *Binary = nullptr;
+  size_t Begin = 0, End = 0;
+
+  std::vector<Entry> Entries;
+  size_t NumRead = 0, NumFiltered = 0;
+  std::string ErrStr;
+};
+
+unsigned maxWidth(const ParsedReplacement &Rep) {
+  unsigned Width = 0;
+  std::vector<Inst *> Stack{Rep.Mapping.LHS, Rep.Mapping.RHS};
+  llvm::DenseSet<Inst *> Visited;
+  while (!Stack.empty()) {
+    Inst *I = Stack.back();
+    Stack.pop_back();
+    if (!Visited.insert(I).second)
+      continue;
+    Width = std::max(Width, I->Width);
+    Stack.insert(Stack.end(), I->Ops.begin(), I->Ops.end());
+  }
+  return Width;
+}
+
+bool isWanted(const ParsedReplacement &Rep) {
+  if (MaxWidth && maxWidth(Rep) > MaxWidth)
+    return false;
+  if (MaxLHSInsts && unsigned(instCount(Rep.Mapping.LHS)) > MaxLHSInsts)
+    return false;
+  if (MinProfit.getNumOccurrences() && profit(Rep) < MinProfit)
+    return false;
+  return true;
+}
+
+void addEntry(WorkItem &W, const ParsedReplacement &Rep) {
+  ++W.NumRead;
+  if (!isWanted(Rep)) {
+    ++W.NumFiltered;
+    return;
+  }
+  Entry E;
+  E.Text = Rep.getString(/*printNames=*/false);
+  E.Hash = xxHash64(E.Text);
+  if (BinaryOutput)
+    E.Record = BinaryCorpusWriter::encode(Rep);
+  W.Entries.push_back(std::move(E));
+}
+
+// Every replacement is parsed in a scope of its own, so a thread's context
+// only ever holds one replacement
+void process(InstContext &IC, WorkItem &W) {
+  if (W.Binary) {
+    for (size_t Idx = W.Begin; Idx != W.End; ++Idx) {
+      auto Scope = IC.beginScope();
+      ParsedReplacement Rep = W.Binary->get(Idx, IC, W.ErrStr);
+      if (!W.ErrStr.empty()) {
+        W.ErrStr = W.Filename.str() + ": " + W.ErrStr;
+        return;
+      }
+      addEntry(W, Rep);
+    }
+    return;
+  }
+
+  ReplacementStream S(IC, W.Filename, W.Shard.Str, W.Shard.FirstLine);
+  while (true) {
+    auto Scope = IC.beginScope();
+    ParsedReplacement Rep;
+    if (!S.next(Rep, W.ErrStr))
+      return;
+    addEntry(W, Rep);
+  }
+}
+
+bool addInputs(StringRef Path, std::vector<std::string> &Files) {
+  bool IsDir = false;
+  if (Path != "-" && !sys::fs::is_directory(Path, IsDir) && IsDir) {
+    std::error_code EC;
+    std::vector<std::string> DirFiles;
+    for (sys::fs::directory_iterator It(Path, EC), End; It != End && !EC;
+         It.increment(EC))
+      if (It->type() != sys::fs::file_type::directory_file)
+        DirFiles.push_back(It->path());
+    if (EC) {
+      llvm::errs() << Path << ": " << EC.message() << '\n';
+      return false;
+    }
+    llvm::sort(DirFiles);
+    Files.insert(Files.end(), DirFiles.begin(), DirFiles.end());
+    return true;
+  }
+  Files.push_back(Path.str());
+  return true;
+}
+
+bool writeFile(StringRef Path, ArrayRef<const Entry *> Entries) {
+  std::error_code EC;
+  raw_fd_ostream OS(Path, EC,
+                    BinaryOutput ? sys::fs::OF_None : sys::fs::OF_Text);
+  if (EC) {
+    llvm::errs() << Path << ": " << EC.message() << '\n';
+    return false;
+  }
+  if (BinaryOutput) {
+    BinaryCorpusWriter W;
+    for (auto *E : Entries)
+      W.addEncoded(E->Record);
+    W.write(OS);
+  } else {
+    for (auto *E : Entries)
+      OS << E->Text << '\n';
+  }
+  return true;
+}
+
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv);
+
+  unsigned Threads = NumThreads ? NumThreads
+                                : std::thread::hardware_concurrency();
+  Threads = std::max(Threads, 1u);
+
+  std::vector<std::string> Files;
+  for (const auto &Path : InputPaths)
+    if (!addInputs(Path, Files))
+      return 1;
+
+  // Inputs are mapped rather than read, and cut into a few more pieces than
+  // there are threads so that the threads finish at about the same time
+  std::vector<std::unique_ptr<MemoryBuffer>> Buffers;
+  std::vector<std::unique_ptr<BinaryCorpusReader>> Readers;
+  std::vector<WorkItem> Items;
+  unsigned PiecesPerFile = Threads * 4;
+  for (const auto &File : Files) {
+    auto MB = MemoryBuffer::getFileOrSTDIN(File, /*IsText=*/false,
+                                           /*RequiresNullTerminator=*/false);
+    if (!MB) {
+      llvm::errs() << File << ": " << MB.getError().message() << '\n';
+      return 1;
+    }
+    StringRef Data = (*MB)->getBuffer();
+    StringRef Filename = (*MB)->getBufferIdentifier();
+    Buffers.push_back(std::move(*MB));
+
+    if (isBinaryCorpus(Data)) {
+      std::string ErrStr;
+      auto Reader = BinaryCorpusReader::create(Data, ErrStr);
+      if (!Reader) {
+        llvm::errs() << Filename << ": " << ErrStr << '\n';
+        return 1;
+      }
+      size_t Step = std::max<size_t>(1, Reader->size() / PiecesPerFile);
+      for (size_t Begin = 0; Begin < Reader->size(); Begin += Step) {
+        WorkItem W;
+        W.Filename = Filename;
+        W.Binary = Reader.get();
+        W.Begin = Begin;
+        W.End = std::min(Begin + Step, Reader->size());
+        Items.push_back(std::move(W));
+      }
+      Readers.push_back(std::move(Reader));
+      continue;
+    }
+
+    for (const auto &Shard : SplitReplacements(Data, PiecesPerFile)) {
+      WorkItem W;
+      W.Filename = Filename;
+      W.Shard = Shard;
+      Items.push_back(std::move(W));
+    }
+  }
+
+  std::atomic<size_t> NextItem{0};
+  auto Worker = [&]() {
+    InstContext IC;
+    for (size_t Idx = NextItem++; Idx < Items.size(); Idx = NextItem++)
+      process(IC, Items[Idx]);
+  };
+  std::vector<std::thread> Pool;
+  for (unsigned T = 1; T < std::min<size_t>(Threads, Items.size()); ++T)
+    Pool.emplace_back(Worker);
+  Worker();
+  for (auto &T : Pool)
+    T.join();
+
+  // The first occurrence of a replacement in input order is kept, so the
+  // output doesn't depend on the number of threads
+  size_t NumRead = 0, NumFiltered = 0;
+  std::vector<const Entry *> Unique;
+  DenseSet<CachedHashStringRef> Seen;
+  for (const auto &W : Items) {
+    if (!W.ErrStr.empty()) {
+      llvm::errs() << W.ErrStr << '\n';
+      return 1;
+    }
+    NumRead += W.NumRead;
+    NumFiltered += W.NumFiltered;
+    for (const auto &E : W.Entries)
+      if (NoDedup || Seen.insert(CachedHashStringRef(E.Text, E.Hash)).second)
+        Unique.push_back(&E);
+  }
+
+  if (NumShards == 1) {
+    if (!writeFile(OutputPath, Unique))
+      return 1;
+  } else {
+    if (std::error_code EC = sys::fs::create_directories(OutputPath)) {
+      llvm::errs() << OutputPath << ": " << EC.message() << '\n';
+      return 1;
+    }
+    size_t Shards = NumShards ? NumShards : Unique.size();
+    std::vector<std::vector<const Entry *>> ShardEntries(Shards);
+    for (size_t Idx = 0; Idx < Unique.size(); ++Idx)
+      ShardEntries[Idx % Shards].push_back(Unique[Idx]);
+    for (size_t Idx = 0; Idx < Shards; ++Idx) {
+      SmallString<128> Path(OutputPath);
+      sys::path::append(Path, std::to_string(Idx) +
+                              (BinaryOutput ? ".bin" : ".opt"));
+      if (!writeFile(Path, ShardEntries[Idx]))
+        return 1;
+    }
+  }
+
+  if (PrintStats)
+    llvm::errs() << "read " << NumRead << " replacements, filtered "
+                 << NumFiltered << ", dropped "
+                 << NumRead - NumFiltered - Unique.size()
+                 << " duplicates, wrote " << Unique.size() << '\n';
+
+  return 0;
+}
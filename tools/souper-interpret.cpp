@@ -155,10 +155,10 @@ static int Interpret(const MemoryBufferRef &MB, Solver *S) {
         std::copy(DB.begin(), DB.end(), Copy.begin());
         std::sort(Copy.begin(), Copy.end(),
                   [] (std::pair<Inst *, llvm::APInt> A, std::pair<Inst *, llvm::APInt> B) {
-                    return A.first->Name < B.first->Name;
+                    return A.first->attrs().Name < B.first->attrs().Name;
                   });
         for (auto P : Copy) {
-          llvm::outs() << "var : " << P.first->Name << '\t' << souper::getPaddedBinaryString(P.second) << "\n";
+          llvm::outs() << "var : " << P.first->attrs().Name << '\t' << souper::getPaddedBinaryString(P.second) << "\n";
         }
         llvm::outs() << "=====\n";
       };
@@ -183,14 +183,14 @@ static int Interpret(const MemoryBufferRef &MB, Solver *S) {
       }
       bool Found = false;
       for (auto V : Vars) {
-        if (V->Name == Name) {
+        if (V->attrs().Name == Name) {
           if (!fitsInBits(Val, V->Width)) {
             llvm::errs() << "Error: value '" << Val << "' is too large for ";
             llvm::errs() << V->Width << " bits.\n";
             return 1;
           }
-          if (InputValues.find(V) != InputValues.end()) {
-            llvm::errs() << "Error: duplicate value for %" << V->Name << "\n";
+          if (InputValues.count(V)) {
+            llvm::errs() << "Error: duplicate value for %" << V->attrs().Name << "\n";
             return 1;
           }
           APInt ValObj = APInt(V->Width, Val, 10);
@@ -198,7 +198,7 @@ static int Interpret(const MemoryBufferRef &MB, Solver *S) {
           InputValuesInstMappings.emplace_back(V, IC.getConst(ValObj));
           Found = true;
           if (DebugLevel > 3)
-            llvm::outs() << "var '" << V->Name << "' gets value '" <<
+            llvm::outs() << "var '" << V->attrs().Name << "' gets value '" <<
               APInt(V->Width, Val, 10) << "'\n";
           break;
         }
@@ -18,6 +18,7 @@
 #include "llvm/Support/SourceMgr.h"
 #include "souper/Extractor/Candidates.h"
 #include "souper/Extractor/ExprBuilder.h"
+#include "souper/Extractor/QueryPreprocessor.h"
 #include <memory>
 #include "llvm-gtest/gtest/gtest.h"
 
@@ -310,3 +311,39 @@ cand %2 1:i1
 cand %3 1:i1
 )c"));
 }
+
+TEST(QueryPreprocessorTest, Slicing) {
+  InstContext IC;
+  Inst *X = IC.createVar(8, "x");
+  Inst *Y = IC.createVar(8, "y");
+  Inst *Z = IC.createVar(8, "z");
+  Inst *W = IC.createVar(8, "w");
+  Inst *True = IC.getConst(APInt(1, true));
+  Inst *C5 = IC.getConst(APInt(8, 5));
+
+  InstMapping Mapping(IC.getInst(Inst::Add, 8, {X, X}),
+                      IC.getInst(Inst::Shl, 8, {X, IC.getConst(APInt(8, 1))}));
+  // x and y are used together, z and w aren't used with the mapping
+  InstMapping XY(IC.getInst(Inst::Ult, 1, {X, Y}), True);
+  InstMapping Y5(IC.getInst(Inst::Ne, 1, {Y, C5}), True);
+  InstMapping Z5(IC.getInst(Inst::Eq, 1, {Z, C5}), True);
+  InstMapping W5(IC.getInst(Inst::Ult, 1, {W, C5}), True);
+  // always holds once folded
+  InstMapping Folds(IC.getInst(Inst::Eq, 1, {IC.getInst(Inst::Add, 8, {Y, IC.getConst(APInt(8, 0))}), Y}),
+                    IC.getInst(Inst::Eq, 1, {Y, Y}));
+
+  auto PQ = preprocessQuery(IC, {}, {Z5, XY, W5, Folds, Y5}, Mapping);
+  EXPECT_FALSE(PQ.TriviallyValid);
+  ASSERT_EQ(2u, PQ.PCs.size());
+  EXPECT_EQ(XY.LHS, PQ.PCs[0].LHS);
+  EXPECT_EQ(Y5.LHS, PQ.PCs[1].LHS);
+  ASSERT_EQ(2u, PQ.IndependentPCs.size());
+  EXPECT_EQ(Z5.LHS, PQ.IndependentPCs[0][0].LHS);
+  EXPECT_EQ(W5.LHS, PQ.IndependentPCs[1][0].LHS);
+
+  // a path condition that never holds
+  InstMapping Never(IC.getInst(Inst::Ult, 1, {C5, IC.getConst(APInt(8, 2))}),
+                    True);
+  EXPECT_TRUE(preprocessQuery(IC, {}, {XY, Never}, Mapping).TriviallyValid);
+  EXPECT_TRUE(preprocessQuery(IC, {}, {XY}, InstMapping(X, X)).TriviallyValid);
+}
@@ -0,0 +1,86 @@
+// Copyright 2019 The Souper Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "souper/Infer/AliveDriver.h"
+#include "souper/Infer/EnumerativeSynthesis.h"
+#include "souper/Inst/Inst.h"
+#include "gtest/gtest.h"
+
+using namespace souper;
+
+// Checks that the enumerated guesses come out in order of increasing cost,
+// across guesses with one and two instructions
+TEST(InferTests, GuessesInCostOrder) {
+  InstContext IC;
+
+  Inst *X = IC.createVar(8, "x");
+  Inst *Y = IC.createVar(8, "y");
+
+  EnumerativeSynthesis ES;
+  auto Guesses = ES.generateExprs(IC, 2, {X, Y}, 8);
+  ASSERT_LT(2u, Guesses.size());
+  ASSERT_EQ(X, Guesses[0]);
+  ASSERT_EQ(Y, Guesses[1]);
+
+  int Prev = 0;
+  bool SawTwoInsts = false;
+  for (auto G : Guesses) {
+    int Cost = souper::cost(G);
+    ASSERT_LE(Prev, Cost);
+    Prev = Cost;
+    SawTwoInsts |= instCount(G) == 2;
+  }
+  ASSERT_TRUE(SawTwoInsts);
+}
+
+// Checks that a driver is reused across scopes that don't free its LHS,
+// and dropped when its LHS is freed or its context is destroyed
+TEST(InferTests, AliveDriverCache) {
+  {
+    InstContext IC;
+
+    Inst *X = IC.createVar(8, "x");
+    Inst *LHS = IC.getInst(Inst::Add, 8, {X, IC.getConst(llvm::APInt(8, 1))});
+    auto &D = AliveDriver::get(LHS, nullptr, IC);
+    ASSERT_EQ(1u, AliveDriver::getNumCached());
+
+    {
+      auto S = IC.beginScope();
+      Inst *RHS = IC.getInst(Inst::Sub, 8,
+                             {X, IC.getConst(llvm::APInt(8, 255))});
+      ASSERT_EQ(&D, &AliveDriver::get(LHS, nullptr, IC));
+      ASSERT_TRUE(D.verify(RHS));
+    }
+    ASSERT_EQ(&D, &AliveDriver::get(LHS, nullptr, IC));
+    ASSERT_EQ(1u, AliveDriver::getNumCached());
+
+    {
+      auto S = IC.beginScope();
+      Inst *Y = IC.createVar(8, "y");
+      Inst *Freed = IC.getInst(Inst::Mul, 8, {Y, Y});
+      AliveDriver::get(Freed, nullptr, IC);
+      ASSERT_EQ(2u, AliveDriver::getNumCached());
+    }
+    ASSERT_EQ(1u, AliveDriver::getNumCached());
+    ASSERT_EQ(&D, &AliveDriver::get(LHS, nullptr, IC));
+
+    // past the default of 16, the least recently used driver is evicted
+    for (unsigned I = 2; I < 20; ++I)
+      AliveDriver::get(IC.getInst(Inst::Add, 8,
+                                  {X, IC.getConst(llvm::APInt(8, I))}),
+                       nullptr, IC);
+    ASSERT_EQ(16u, AliveDriver::getNumCached());
+  }
+  ASSERT_EQ(0u, AliveDriver::getNumCached());
+}
@@ -63,3 +63,242 @@ TEST(InstTest, Print) {
   EXPECT_EQ("%0:i64 = add 1:i64, 2:i64\n"
             "%1:i64 = mul 3:i64, %0\n", SS.str());
 }
+
+TEST(InstTest, Numbering) {
+  InstContext IC;
+
+  Inst *X = IC.createVar(8, "x");
+  Inst *C = IC.getConst(llvm::APInt(8, 1));
+  Inst *Add = IC.getInst(Inst::Add, 8, {X, C});
+  Inst *Sub = IC.getInst(Inst::Sub, 8, {Add, X});
+
+  InstNumbering N(Sub);
+  ASSERT_EQ(4u, N.size());
+  EXPECT_LT(N.lookup(X), N.lookup(Add));
+  EXPECT_LT(N.lookup(C), N.lookup(Add));
+  EXPECT_LT(N.lookup(Add), N.lookup(Sub));
+  EXPECT_EQ(InstNumbering::NotFound, N.lookup(IC.createVar(8, "y")));
+
+  unsigned SubIdx = N.lookup(Sub);
+  ASSERT_EQ(2, N.op_end(SubIdx) - N.op_begin(SubIdx));
+  EXPECT_EQ(Add, N.getInst(N.op_begin(SubIdx)[0]));
+  EXPECT_EQ(X, N.getInst(N.op_begin(SubIdx)[1]));
+}
+
+TEST(InstTest, ConstantFoldingLite) {
+  InstContext IC;
+
+  Inst *X = IC.createVar(8, "x");
+  Inst *Zero = IC.getConst(llvm::APInt(8, 0));
+  Inst *Sum = IC.getInst(Inst::Add, 8, {IC.getConst(llvm::APInt(8, 2)),
+                                        IC.getConst(llvm::APInt(8, 3))});
+  Inst *Or = IC.getInst(Inst::Or, 8, {X, Sum});
+  Inst *Root = IC.getInst(Inst::Sub, 8, {Or, Zero});
+
+  EXPECT_EQ(IC.getInst(Inst::Or, 8, {X, IC.getConst(llvm::APInt(8, 5))}),
+            ConstantFoldingLite(IC, Root));
+  // shared Insts are left alone
+  EXPECT_TRUE(llvm::is_contained(Or->Ops, Sum));
+  EXPECT_EQ(Or, Root->Ops[0]);
+
+  // 0 - x and x * -1 are not x
+  Inst *Neg = IC.getInst(Inst::Sub, 8, {Zero, X});
+  EXPECT_EQ(Neg, ConstantFoldingLite(IC, Neg));
+  Inst *MulM1 = IC.getInst(Inst::Mul, 8, {X, IC.getConst(llvm::APInt(8, -1))});
+  EXPECT_EQ(MulM1, ConstantFoldingLite(IC, MulM1));
+
+  Inst *Cmp = IC.getInst(Inst::Ult, 1, {IC.getConst(llvm::APInt(8, 2)), Sum});
+  EXPECT_EQ(IC.getConst(llvm::APInt(1, 1)), ConstantFoldingLite(IC, Cmp));
+
+  // a rebuilt custom instruction keeps its name
+  Inst *Custom = IC.getInst(Inst::Custom, 8, {Sum});
+  Custom->mutableAttrs().Name = "custom.identity";
+  Inst *Folded = ConstantFoldingLite(IC, Custom);
+  ASSERT_EQ(Inst::Custom, Folded->K);
+  EXPECT_EQ("custom.identity", Folded->attrs().Name);
+  EXPECT_EQ(IC.getConst(llvm::APInt(8, 5)), Folded->Ops[0]);
+}
+
+TEST(InstTest, LowerCustomInst) {
+  InstContext IC;
+
+  Inst *X = IC.createVar(8, "x");
+  Inst *Custom = IC.getInst(Inst::Custom, 8, {X});
+  Custom->mutableAttrs().Name = "custom.identity";
+  Inst *Add = IC.getInst(Inst::Add, 8, {Custom, X});
+
+  EXPECT_EQ(IC.getInst(Inst::Add, 8, {X, X}), lowerCustomInst(IC, Add));
+  // the original is left alone, since a scope may free what it is lowered to
+  EXPECT_EQ(Custom, Add->Ops[0]);
+  EXPECT_TRUE(Add->has(Inst::HasCustom));
+}
+
+namespace {
+struct RecordingListener : InstContextListener {
+  llvm::DenseSet<Inst *> Dead;
+  bool Destroyed = false;
+  void reclaimed(const llvm::DenseSet<Inst *> &D) override {
+    Dead.insert(D.begin(), D.end());
+  }
+  void destroyed() override { Destroyed = true; }
+};
+}
+
+TEST(InstTest, Scope) {
+  RecordingListener Listener;
+  {
+    InstContext IC;
+    IC.addListener(&Listener);
+
+    Inst *X = IC.createVar(8, "x");
+    Inst *One = IC.getConst(llvm::APInt(8, 1));
+    uint64_t ID = IC.getID();
+
+    Inst *Kept, *Mul;
+    {
+      auto Scope = IC.beginScope();
+      Inst *Y = IC.createVar(8, "y");
+      Inst *Add = IC.getInst(Inst::Add, 8, {X, IC.getConst(llvm::APInt(8, 2))});
+      Mul = IC.getInst(Inst::Mul, 8, {Add, Y});
+      Kept = Scope.keep(IC.getInst(Inst::Sub, 8, {Add, One}));
+      IC.createBlock(2);
+
+      {
+        // everything an inner scope keeps is freed with the outer one
+        auto Inner = IC.beginScope();
+        Inner.keep(IC.getInst(Inst::Xor, 8, {Add, Y}));
+      }
+      EXPECT_EQ(3u, IC.getVariables().size());
+      EXPECT_EQ(ID, IC.getID());
+    }
+
+    // the listener is told what is freed instead
+    EXPECT_EQ(ID, IC.getID());
+    EXPECT_TRUE(Listener.Dead.count(Mul));
+    EXPECT_FALSE(Listener.Dead.count(Kept));
+    EXPECT_FALSE(Listener.Dead.count(Kept->Ops[0]));
+    std::vector<Inst *> Vars = IC.getVariables();
+    ASSERT_EQ(1u, Vars.size());
+    EXPECT_EQ(X, Vars[0]);
+    // kept Insts and their operands are still hash-consed
+    Inst *Add = IC.getInst(Inst::Add, 8, {X, IC.getConst(llvm::APInt(8, 2))});
+    EXPECT_EQ(Kept->Ops[0], Add);
+    EXPECT_EQ(Kept, IC.getInst(Inst::Sub, 8, {Add, One}));
+
+    // numbers of freed vars aren't handed out twice
+    Inst *Z = IC.createVar(8, "z");
+    EXPECT_NE(X->Number, Z->Number);
+
+    {
+      auto Scope = IC.beginScope();
+      IC.getInst(Inst::Shl, 8, {Z, One});
+      Scope.commit();
+    }
+    EXPECT_EQ(2u, IC.getVariables().size());
+    EXPECT_FALSE(Listener.Destroyed);
+  }
+  EXPECT_TRUE(Listener.Destroyed);
+}
+
+TEST(InstTest, Attrs) {
+  InstContext IC;
+
+  Inst *X = IC.createVar(8, "x", llvm::ConstantRange(8, true),
+                         llvm::APInt(8, 1), llvm::APInt(8, 2), false, false,
+                         false, false, 3, llvm::APInt::getAllOnes(8), 0);
+  EXPECT_EQ("x", X->attrs().Name);
+  EXPECT_EQ(1u, X->attrs().KnownZeros);
+  EXPECT_EQ(3u, X->attrs().NumSignBits);
+
+  // Insts without attributes read the defaults
+  Inst *Add = IC.getInst(Inst::Add, 8, {X, IC.getConst(llvm::APInt(8, 1))});
+  EXPECT_TRUE(Add->attrs().Name.empty());
+  EXPECT_TRUE(Add->attrs().Origins.empty());
+  EXPECT_EQ(HarvestType::HarvestedFromDef, Add->attrs().HarvestKind);
+
+  Add->mutableAttrs().Name = "add";
+  Inst Copy = *Add;
+  Copy.mutableAttrs().Name = "copy";
+  EXPECT_EQ("add", Add->attrs().Name);
+  EXPECT_EQ(Add->Ops, Copy.Ops);
+}
+
+TEST(InstTest, Rewriter) {
+  InstContext IC;
+
+  Inst *X = IC.createVar(8, "x");
+  Inst *Y = IC.createVar(8, "y");
+  Inst *Add = IC.getInst(Inst::Add, 8, {X, Y});
+  Inst *Mul = IC.getInst(Inst::Mul, 8, {Add, Add});
+
+  InstRewriter R(IC);
+  R.substitute(Y, IC.getConst(llvm::APInt(8, 2)));
+  std::map<Inst *, llvm::APInt> ConstMap{{X, llvm::APInt(8, 3)}};
+  R.setConstMap(&ConstMap);
+  Inst *Roots[] = {Mul, Add};
+  R.rewrite(Roots);
+  Inst *NewAdd = IC.getInst(Inst::Add, 8, {IC.getConst(llvm::APInt(8, 3)),
+                                           IC.getConst(llvm::APInt(8, 2))});
+  EXPECT_EQ(IC.getInst(Inst::Mul, 8, {NewAdd, NewAdd}), Roots[0]);
+  EXPECT_EQ(NewAdd, Roots[1]);
+
+  // cloned Vars are shared between the roots of one rewriter
+  InstRewriter Cloner(IC, /*CloneVars=*/true);
+  InstMapping M(Add, IC.getInst(Inst::Sub, 8, {X, Y}));
+  Cloner.rewrite(M);
+  ASSERT_NE(Add, M.LHS);
+  EXPECT_TRUE(llvm::is_contained(M.LHS->Ops, M.RHS->Ops[0]));
+  EXPECT_EQ(4u, IC.getVariables().size());
+
+  // rewriters on the same caches reuse each other's copies
+  std::map<Inst *, Inst *> InstCache;
+  std::map<Block *, Block *> BlockCache;
+  Inst *AddCopy = getInstCopy(Add, IC, InstCache, BlockCache, nullptr,
+                              /*CloneVars=*/true);
+  Inst *MulCopy = getInstCopy(Mul, IC, InstCache, BlockCache, nullptr,
+                              /*CloneVars=*/true);
+  EXPECT_EQ(IC.getInst(Inst::Mul, 8, {AddCopy, AddCopy}), MulCopy);
+  EXPECT_EQ(6u, IC.getVariables().size());
+  EXPECT_EQ(AddCopy, InstCache[Add]);
+
+  // deep DAGs are rewritten without recursion
+  Inst *Chain = X;
+  for (unsigned I = 0; I < 100000; ++I)
+    Chain = IC.getInst(Inst::Xor, 8, {Chain, IC.getConst(llvm::APInt(8, I % 256))});
+  InstRewriter Deep(IC);
+  Deep.substitute(X, Y);
+  Inst *NewChain = Deep.rewrite(Chain);
+  for (unsigned I = 1; I < 100000; ++I)
+    NewChain = NewChain->Ops[0]->K == Inst::Xor ? NewChain->Ops[0] :
+                                                  NewChain->Ops[1];
+  EXPECT_TRUE(llvm::is_contained(NewChain->Ops, Y));
+}
+
+TEST(InstTest, Summary) {
+  InstContext IC;
+
+  Inst *X = IC.createVar(8, "x");
+  Inst *C = IC.createSynthesisConstant(8, 1);
+  Inst *One = IC.getConst(llvm::APInt(8, 1));
+  EXPECT_FALSE(One->has(Inst::HasVar));
+
+  Inst *Add = IC.getInst(Inst::Add, 8, {X, One});
+  EXPECT_TRUE(Add->has(Inst::HasVar));
+  EXPECT_FALSE(Add->has(Inst::HasSynthesisConst | Inst::HasPhi));
+
+  Block *B = IC.createBlock(2);
+  Inst *Phi = IC.getPhi(B, {Add, C});
+  Inst *Root = IC.getInst(Inst::Sub, 8, {Phi, IC.createHole(8)});
+  EXPECT_TRUE(Root->has(Inst::HasMultiArgPhi));
+  EXPECT_TRUE(Root->has(Inst::HasSynthesisConst));
+  EXPECT_TRUE(Root->has(Inst::HasHole));
+  EXPECT_FALSE(Root->has(Inst::HasCustom | Inst::HasReserved));
+
+  // a shared Inst counts once per path in the tree summaries
+  Inst *Y = IC.createVar(8, "y");
+  Inst *AddXY = IC.getInst(Inst::Add, 8, {X, Y});
+  Inst *Mul = IC.getInst(Inst::Mul, 8, {AddXY, AddXY});
+  EXPECT_EQ(7u, Mul->TreeSize);
+  EXPECT_EQ(unsigned(cost(Mul)) + unsigned(cost(AddXY)), Mul->TreeCost);
+  EXPECT_EQ(unsigned(cost(AddXY)), AddXY->TreeCost);
+}
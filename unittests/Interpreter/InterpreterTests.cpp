@@ -20,6 +20,7 @@
 #include "InterpreterInfra.h"
 #include "souper/Infer/Interpreter.h"
 #include "souper/Infer/AbstractInterpreter.h"
+#include "souper/Infer/Pruning.h"
 #include "souper/Inst/Inst.h"
 #include "gtest/gtest.h"
 
@@ -81,6 +82,34 @@ TEST(InterpreterTests, KBTransferFunctions) {
   }
 }
 
+// Narrow binary operators are looked up in the generated tables, check that
+// the results are as precise as brute force
+TEST(InterpreterTests, KBTablesAreOptimal) {
+  const int WIDTH = 3;
+  KBTesting kbObj(WIDTH);
+  for (auto K : {Inst::Add, Inst::SubNSW, Inst::MulNUW, Inst::URem,
+                 Inst::ShlNW, Inst::AShr, Inst::Slt}) {
+    llvm::KnownBits x(WIDTH);
+    do {
+      llvm::KnownBits y(WIDTH);
+      do {
+        InstContext IC;
+        auto Op0 = IC.createVar(WIDTH, "Op0");
+        auto Op1 = IC.createVar(WIDTH, "Op1");
+        auto I = IC.getInst(K, K == Inst::Slt ? 1 : WIDTH, {Op0, Op1});
+        std::unordered_map<Inst *, llvm::KnownBits> C{{Op0, x}, {Op1, y}};
+        ConcreteInterpreter BlankCI;
+        auto Calculated = KnownBitsAnalysis(C).findKnownBits(I, BlankCI, false);
+        auto Expected = kbObj.bruteForce(x, y, I);
+        if (!Expected.hasValue())
+          continue;
+        ASSERT_EQ(Calculated.Zero, Expected.ValueKB.Zero);
+        ASSERT_EQ(Calculated.One, Expected.ValueKB.One);
+      } while (KBTesting::nextKB(y));
+    } while (KBTesting::nextKB(x));
+  }
+}
+
 TEST(InterpreterTests, CRTransferFunctions) {
   for (int WIDTH = 1; WIDTH <= MAX_WIDTH; ++WIDTH) {
     CRTesting crObj(WIDTH);
@@ -213,3 +242,158 @@ TEST(InterpreterTests, ConcreteCache) {
   // We would have got 0xFF if evaluateInst had returned result from cache.
   ASSERT_EQ(Val.getValue(), APInt(8, 0x0F, true));
 }
+
+// Checks that copies of a ValueCache share the numbering but not the values
+TEST(InterpreterTests, ValueCacheCopy) {
+  InstContext IC;
+
+  Inst *I1 = IC.createVar(8, "x");
+  Inst *I2 = IC.createVar(8, "y");
+  Inst *I3 = IC.getInst(Inst::Add, 8, {I1, I2});
+
+  ValueCache Input(std::make_shared<InstNumbering>(I3));
+  Input[I1] = APInt(8, 1);
+  Input[I2] = APInt(8, 2);
+  ValueCache Copy = Input;
+  Copy[I2] = APInt(8, 3);
+  ASSERT_EQ(&Input.getNumbering(), &Copy.getNumbering());
+  ASSERT_EQ(2u, Copy.size());
+
+  souper::ConcreteInterpreter CI1(I3, Input), CI2(I3, Copy);
+  ASSERT_EQ(CI1.evaluateInst(I3).getValue(), APInt(8, 3));
+  ASSERT_EQ(CI2.evaluateInst(I3).getValue(), APInt(8, 4));
+  ASSERT_EQ(&CI1.getCache().getNumbering(), &Input.getNumbering());
+
+  // Numbering an Inst the other copies don't know about clones the numbering
+  Inst *I4 = IC.createVar(8, "z");
+  Copy[I4] = APInt(8, 4);
+  ASSERT_NE(&Input.getNumbering(), &Copy.getNumbering());
+  ASSERT_FALSE(Input.count(I4));
+  ASSERT_EQ(Copy[I2].getValue(), APInt(8, 3));
+}
+
+// Checks that lane-wise evaluation agrees with evaluating each input set alone
+TEST(InterpreterTests, LaneInterpreter) {
+  InstContext IC;
+
+  Inst *I1 = IC.createVar(8, "x");
+  Inst *I2 = IC.createVar(8, "y");
+  Inst *I3 = IC.getInst(Inst::Add, 8, {I1, I2});
+
+  // the guess is not part of the DAG the input sets were numbered for
+  Inst *I4 = IC.getInst(Inst::UDiv, 8, {I3, I2});
+  Inst *I5 = IC.getInst(Inst::Ult, 1, {I4, I1});
+
+  auto Numbering = std::make_shared<InstNumbering>(I3);
+  std::vector<souper::ConcreteInterpreter> Lanes;
+  for (unsigned Y = 0; Y < 4; ++Y) {
+    ValueCache Input(Numbering);
+    Input[I1] = APInt(8, 6);
+    Input[I2] = APInt(8, Y);
+    Lanes.emplace_back(I3, Input);
+  }
+
+  souper::LaneInterpreter LI(Lanes);
+  auto Values = LI.evaluateInst(I5, 3);
+  ASSERT_EQ(3u, Values.size());
+  // udiv by zero
+  ASSERT_FALSE(Values[0].hasValue());
+  for (unsigned Y = 1; Y < 3; ++Y) {
+    ASSERT_EQ(Values[Y].getValue(),
+              Lanes[Y].evaluateInst(I5).getValue());
+  }
+  ASSERT_EQ(Values[1].getValue(), APInt(1, 0));
+  ASSERT_EQ(Values[2].getValue(), APInt(1, 1));
+}
+
+// Checks that results shared through an AbstractValueCache are keyed by input set
+TEST(InterpreterTests, SharedAbstractValues) {
+  InstContext IC;
+
+  Inst *I1 = IC.createVar(8, "x");
+  Inst *I2 = IC.getConst(llvm::APInt(8, 0x0F));
+  Inst *I3 = IC.getInst(Inst::And, 8, {I1, I2});
+  Inst *I4 = IC.getInst(Inst::ReservedConst, 8, {});
+  Inst *I5 = IC.getInst(Inst::Or, 8, {I3, I4});
+
+  souper::ConcreteInterpreter CI0(I3, {{I1, APInt(8, 0x03)}});
+  souper::ConcreteInterpreter CI1(I3, {{I1, APInt(8, 0x30)}});
+
+  AbstractValueCache Shared;
+  auto KB = KnownBitsAnalysis(Shared, 0).findKnownBits(I5, CI0);
+  ASSERT_EQ(KB.One, APInt(8, 0x03));
+  ASSERT_EQ(0u, Shared.Hits);
+
+  // A different guess over the same subtree reuses its value
+  Inst *I6 = IC.getInst(Inst::Xor, 8, {I3, I4});
+  KB = KnownBitsAnalysis(Shared, 0).findKnownBits(I6, CI0);
+  ASSERT_EQ(KB.One, APInt(8, 0x00));
+  unsigned Hits = Shared.Hits;
+  ASSERT_NE(0u, Hits);
+
+  // but not one computed for another input set
+  KB = KnownBitsAnalysis(Shared, 1).findKnownBits(I5, CI1);
+  ASSERT_EQ(KB.One, APInt(8, 0x00));
+  ASSERT_EQ(KB.Zero, APInt(8, 0x00));
+  ASSERT_EQ(Hits, Shared.Hits);
+
+  auto CR = ConstantRangeAnalysis(Shared, 1).findConstantRange(I3, CI1);
+  ASSERT_EQ(*CR.getSingleElement(), APInt(8, 0x00));
+  CR = ConstantRangeAnalysis(Shared, 0).findConstantRange(I3, CI0);
+  ASSERT_EQ(*CR.getSingleElement(), APInt(8, 0x03));
+}
+
+// Checks that a counterexample prunes the guesses it refutes from then on,
+// and that the input sets stay capped at the default of 32
+TEST(InterpreterTests, CounterexampleInputSets) {
+  InstContext IC;
+
+  Inst *X = IC.createVar(8, "x");
+  Inst *LHS = IC.getInst(Inst::Add, 8, {X, IC.getConst(APInt(8, 1))});
+  std::vector<InstMapping> PCs;
+  BlockPCs BPCs;
+  SynthesisContext SC{IC, nullptr, LHS, nullptr, PCs, BPCs, false, 0};
+  std::vector<Inst *> Inputs;
+  findVars(LHS, Inputs);
+
+  PruningManager Pruner(SC, Inputs, 0);
+  Pruner.init();
+  ASSERT_LE(Pruner.getInputVals().size(), 32u);
+
+  // a value of x that none of the generated input sets has
+  auto Unseen = [&Pruner, X]() {
+    for (uint64_t V = 1; V < 256; ++V) {
+      bool Seen = false;
+      for (auto &Input : Pruner.getInputVals())
+        Seen |= Input[X].getValue() == V;
+      if (!Seen)
+        return V;
+    }
+    return uint64_t(0);
+  };
+  uint64_t C = Unseen();
+  ASSERT_NE(0u, C);
+
+  // agrees with the LHS except when x is C
+  Inst *RHS = IC.getInst(Inst::Select, 8,
+                         {IC.getInst(Inst::Eq, 1, {X, IC.getConst(APInt(8, C))}),
+                          X, LHS});
+  ASSERT_FALSE(Pruner.isInfeasible(RHS, 0));
+
+  Pruner.addCounterexample({X}, {APInt(8, C)});
+  ASSERT_TRUE(Pruner.isInfeasible(RHS, 0));
+
+  // a counterexample the input sets already have isn't added again
+  auto Size = Pruner.getInputVals().size();
+  Pruner.addCounterexample({X}, {APInt(8, C)});
+  ASSERT_EQ(Size, Pruner.getInputVals().size());
+
+  // new ones replace the input sets that pruned the fewest guesses
+  for (unsigned I = 0; I < 64; ++I) {
+    uint64_t V = Unseen();
+    ASSERT_NE(0u, V);
+    Pruner.addCounterexample({X}, {APInt(8, V)});
+    ASSERT_LE(Pruner.getInputVals().size(), 32u);
+  }
+  ASSERT_EQ(32u, Pruner.getInputVals().size());
+}
@@ -13,9 +13,12 @@
 // limitations under the License.
 
 #include "llvm/Support/raw_ostream.h"
+#include "souper/Parser/BinaryFormat.h"
 #include "souper/Parser/Parser.h"
 #include "gtest/gtest.h"
 
+#include <algorithm>
+
 using namespace souper;
 
 TEST(ParserTest, Errors) {
@@ -1069,3 +1072,275 @@ cand %4 %7
     EXPECT_EQ(T.Test, UnSplit);
   }
 }
+
+TEST(ParserTest, BinaryRoundTrip) {
+  std::string Test = R"i(%0:i8 = var (knownBits=1xx0xxx0) (signBits=2) (nonZero) (range=[2,90)) ; x
+%1:i8 = var ; y
+%2:i8 = add %1, %0
+%3:i1 = ult %0, %1
+pc %3 1:i1
+cand %2 %0 (demandedBits=00001111)
+
+%0 = block 2
+%1:i32 = var ; 1
+%2:i32 = lshr %1, 31:i32
+%3:i32 = var ; 3
+%4:i1 = eq 0:i32, %3
+blockpc %0 0 %4 1:i1
+%5:i32 = zext %4
+%6:i32 = phi %0, %2, %5
+%7:i32 = ashr %6, 1:i32
+%8:i32 = reservedinst
+infer %7
+result %8
+
+%0:i128 = var ; 0
+%1:i128 = bswap %0
+%2:i1 = eq 100000000000000000000000000000:i128, %1
+infer %2 (harvestedFromUse)
+result 0:i1
+)i";
+
+  InstContext IC;
+  std::string ErrStr;
+  auto Reps = ParseReplacements(IC, "<input>", Test, ErrStr);
+  ASSERT_EQ("", ErrStr);
+  ASSERT_EQ(3u, Reps.size());
+
+  BinaryCorpusWriter W;
+  for (const auto &Rep : Reps)
+    W.add(Rep);
+  std::string Data;
+  llvm::raw_string_ostream OS(Data);
+  W.write(OS);
+  OS.flush();
+  ASSERT_TRUE(isBinaryCorpus(Data));
+
+  // the corpus is read into a different context, both all at once and one
+  // replacement at a time
+  InstContext IC2;
+  auto Decoded = ParseReplacements(IC2, "<input>", Data, ErrStr);
+  ASSERT_EQ("", ErrStr);
+  ASSERT_EQ(Reps.size(), Decoded.size());
+  auto Reader = BinaryCorpusReader::create(Data, ErrStr);
+  ASSERT_TRUE(Reader);
+  ASSERT_EQ(Reps.size(), Reader->size());
+  for (size_t I = 0; I != Reps.size(); ++I) {
+    EXPECT_EQ(Reps[I].getString(/*printNames=*/true),
+              Decoded[I].getString(/*printNames=*/true));
+    ParsedReplacement Rep = Reader->get(Reps.size() - I - 1, IC2, ErrStr);
+    ASSERT_EQ("", ErrStr);
+    EXPECT_EQ(Reps[Reps.size() - I - 1].getString(/*printNames=*/true),
+              Rep.getString(/*printNames=*/true));
+  }
+
+  // RHSs refer to the LHS they were found for by name
+  ReplacementContext Context;
+  std::string LHS = Reps[0].getLHSString(Context);
+  std::string RHS = EncodeReplacementRHS(Reps[0].Mapping.RHS, Context);
+  ASSERT_TRUE(isBinaryRHS(RHS));
+  std::vector<ReplacementContext> Contexts;
+  auto LHSs = ParseReplacementLHSs(IC2, "<input>", LHS, Contexts, ErrStr);
+  ASSERT_EQ("", ErrStr);
+  ASSERT_EQ(1u, LHSs.size());
+  Inst *NewRHS = DecodeReplacementRHS(IC2, RHS, Contexts[0], ErrStr);
+  ASSERT_EQ("", ErrStr);
+  EXPECT_TRUE(llvm::is_contained(LHSs[0].Mapping.LHS->Ops, NewRHS));
+
+  // truncated input is an error, not a crash
+  for (size_t Len : {size_t(5), size_t(20), Data.size() - 1}) {
+    std::string Cut = Data.substr(0, Len);
+    ErrStr.clear();
+    auto R = ParseReplacements(IC2, "<input>", Cut, ErrStr);
+    EXPECT_NE("", ErrStr);
+  }
+
+  // so are records that the text parser would have rejected
+  Inst *X = IC.createVar(8, "x");
+  Block *B = IC.createBlock(2);
+  std::vector<ParsedReplacement> Bad(4);
+  Bad[0].Mapping = InstMapping(IC.getInst(Inst::Add, 8, {X}), X);
+  Bad[1].Mapping = InstMapping(IC.getInst(Inst::Eq, 8, {X, X}), X);
+  Bad[2].Mapping = InstMapping(IC.getInst(Inst::ZExt, 8, {X}), X);
+  Bad[3].Mapping = InstMapping(IC.getPhi(B, {X, X}), X);
+  Bad[3].BPCs = {BlockPCMapping(B, 2, InstMapping(X, X))};
+  for (const auto &Rep : Bad) {
+    BinaryCorpusWriter BW;
+    BW.add(Rep);
+    std::string BadData;
+    llvm::raw_string_ostream BOS(BadData);
+    BW.write(BOS);
+    BOS.flush();
+    ErrStr.clear();
+    auto R = ParseReplacements(IC2, "<input>", BadData, ErrStr);
+    EXPECT_NE("", ErrStr);
+  }
+}
+
+TEST(ParserTest, Stream) {
+  std::string Test;
+  for (unsigned I = 0; I < 20; ++I) {
+    Test += "%0:i8 = var ; 0\n"
+            "%1:i8 = add %0, " + std::to_string(I) + ":i8\n"
+            "%2:i1 = ult %0, 100:i8\n"
+            "pc %2 1:i1\n";
+    if (I % 2)
+      Test += "cand %1 %0\n";
+    else
+      Test += "infer %1\nresult %0\n";
+  }
+
+  InstContext IC;
+  std::string ErrStr;
+  auto Reps = ParseReplacements(IC, "<input>", Test, ErrStr);
+  ASSERT_EQ("", ErrStr);
+  ASSERT_EQ(20u, Reps.size());
+
+  ReplacementStream S(IC, "<input>", Test);
+  ParsedReplacement Rep;
+  size_t N = 0;
+  while (S.next(Rep, ErrStr)) {
+    ASSERT_LT(N, Reps.size());
+    EXPECT_EQ(Reps[N++].getString(), Rep.getString());
+  }
+  EXPECT_EQ("", ErrStr);
+  EXPECT_EQ(Reps.size(), N);
+
+  // shards hold whole replacements and can be parsed on their own
+  auto Shards = SplitReplacements(Test, 7);
+  ASSERT_LE(Shards.size(), 7u);
+  std::string Joined;
+  N = 0;
+  for (const auto &Shard : Shards) {
+    Joined += Shard.Str.str();
+    InstContext ShardIC;
+    ReplacementStream SS(ShardIC, "<input>", Shard.Str, Shard.FirstLine);
+    while (SS.next(Rep, ErrStr))
+      EXPECT_EQ(Reps[N++].getString(), Rep.getString());
+    EXPECT_EQ("", ErrStr);
+  }
+  EXPECT_EQ(Test, Joined);
+  EXPECT_EQ(Reps.size(), N);
+
+  // errors in a shard are reported at their line in the whole file
+  std::string Bad = Test + "%0:i8 = var\n%1:i8 = add %0, %2\n";
+  Shards = SplitReplacements(Bad, 3);
+  ReplacementStream Last(IC, "<input>", Shards.back().Str,
+                         Shards.back().FirstLine);
+  while (Last.next(Rep, ErrStr))
+    ;
+  unsigned Line = std::count(Test.begin(), Test.end(), '\n') + 2;
+  EXPECT_EQ("<input>:" + std::to_string(Line) + ":17: %2 is not an inst",
+            ErrStr);
+}
+
+TEST(ParserTest, SplitLHSs) {
+  // a file of LHSs has no 'result' lines, so its 'infer' lines end the
+  // replacements
+  std::string Test;
+  for (unsigned I = 0; I < 20; ++I)
+    Test += "%0:i8 = var ; 0\n"
+            "%1:i8 = add %0, " + std::to_string(I) + ":i8\n"
+            "infer %1\n";
+
+  InstContext IC;
+  std::string ErrStr;
+  std::vector<ReplacementContext> Contexts;
+  auto Reps = ParseReplacementLHSs(IC, "<input>", Test, Contexts, ErrStr);
+  ASSERT_EQ("", ErrStr);
+  ASSERT_EQ(20u, Reps.size());
+
+  auto Shards = SplitReplacements(Test, 7);
+  ASSERT_EQ(7u, Shards.size());
+  std::string Joined;
+  size_t N = 0;
+  for (const auto &Shard : Shards) {
+    EXPECT_TRUE(Shard.Str.ends_with("infer %1\n"));
+    Joined += Shard.Str.str();
+    InstContext ShardIC;
+    std::vector<ReplacementContext> ShardContexts;
+    auto ShardReps = ParseReplacementLHSs(ShardIC, "<input>", Shard.Str,
+                                          ShardContexts, ErrStr);
+    EXPECT_EQ("", ErrStr);
+    for (auto &Rep : ShardReps) {
+      ASSERT_LT(N, Reps.size());
+      ReplacementContext Expected, Actual;
+      EXPECT_EQ(Reps[N++].getLHSString(Expected), Rep.getLHSString(Actual));
+    }
+  }
+  EXPECT_EQ(Test, Joined);
+  EXPECT_EQ(Reps.size(), N);
+
+  // an 'infer' followed by a 'cand' ends a replacement too
+  std::string LHS = "%0:i8 = var ; 0\n%1:i8 = add %0, 1:i8\n"
+                    "%2:i8 = mul %1, %1\ninfer %2\n";
+  std::string Mixed = LHS + "%0:i8 = var ; 0\ncand %0 %0\n";
+  Shards = SplitReplacements(Mixed, 2);
+  ASSERT_EQ(2u, Shards.size());
+  EXPECT_EQ(LHS, Shards[0].Str.str());
+  EXPECT_EQ(5u, Shards[1].FirstLine);
+}
+
+TEST(ParserTest, Printer) {
+  std::string Tests[] = {
+      R"i(%0 = block 2
+%1:i32 = var ; x
+%2:i32 = lshr %1, 31:i32
+%3:i32 = var (knownBits=xxxxxxxxxxxxxxxxxxxxxxxxxxxxxx00) (nonZero) ; y
+%4:i32 = udiv %2, %3
+%5:i1 = eq 0:i32, %3
+%6:i32 = zext %5
+%7:i32 = phi %0, %4, %6
+%8:i32 = ashr %7, 1:i32
+%9:i1 = eq 0:i32, %8
+blockpc %0 1 %5 0:i1
+pc %9 0:i1
+cand %8 %7
+)i",
+      R"i(%0:i32 = var (range=[-4,90)) ; 0
+%1:i33 = uadd.with.overflow %0, 1:i32
+%2:i32 = extractvalue %1, 0:i32
+%3:i1 = ult 0:i32, %2
+%4:i1 = extractvalue %1, 1:i32 (hasExternalUses)
+%5:i1 = or %3, %4
+cand %5 1:i1 (demandedBits=1)
+)i",
+      R"i(%0:i8 = var (signBits=3) (nonNegative) ; a
+%1:i8 = var (negative) (powerOfTwo) ; b
+%2:i8 = add %0, %1 (hasExternalUses)
+%3:i8 = mul %2, %2
+infer %3 (harvestedFromUse)
+%4:i8 = shl %2, 1:i8
+result %4
+)i",
+  };
+
+  ReplacementPrinter P;
+  for (const auto &T : Tests) {
+    InstContext IC;
+    std::string ErrStr;
+    auto Reps = ParseReplacements(IC, "<input>", T, ErrStr);
+    ASSERT_EQ("", ErrStr);
+    ASSERT_EQ(1u, Reps.size());
+    auto &R = Reps[0];
+
+    for (bool Names : {false, true}) {
+      EXPECT_EQ(R.getString(Names),
+                P.print(R.BPCs, R.PCs, R.Mapping, Names).str());
+
+      ReplacementContext Context;
+      std::string LHS = GetReplacementLHSString(R.BPCs, R.PCs, R.Mapping.LHS,
+                                                Context, Names);
+      EXPECT_EQ(LHS, P.printLHS(R.BPCs, R.PCs, R.Mapping.LHS, Names).str());
+
+      // the RHS is numbered on from the LHS, both by the printer and by a
+      // context it hands its names to
+      ReplacementContext PrinterContext;
+      P.getContext(PrinterContext);
+      std::string RHS = GetReplacementRHSString(R.Mapping.RHS, Context, Names);
+      EXPECT_EQ(RHS, P.printRHS(R.Mapping.RHS).str());
+      EXPECT_EQ(RHS, GetReplacementRHSString(R.Mapping.RHS, PrinterContext,
+                                             Names));
+    }
+  }
+}
@@ -0,0 +1,81 @@
+// Copyright 2014 The Souper Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "souper/Util/SharedVector.h"
+#include "gtest/gtest.h"
+
+using namespace souper;
+
+TEST(SharedVectorTest, CopiesShare) {
+  SharedVector<int> V{1, 2, 3};
+  SharedVector<int> Copy = V;
+  EXPECT_FALSE(Copy.unique());
+  EXPECT_EQ(&V.get(), &Copy.get());
+
+  // a change makes a private copy first
+  Copy.push_back(4);
+  EXPECT_TRUE(Copy.unique());
+  EXPECT_TRUE(V.unique());
+  EXPECT_EQ((std::vector<int>{1, 2, 3}), V.get());
+  EXPECT_EQ((std::vector<int>{1, 2, 3, 4}), Copy.get());
+
+  Copy.set(0, 5);
+  EXPECT_EQ(5, Copy[0]);
+  EXPECT_EQ(1, V[0]);
+}
+
+TEST(SharedVectorTest, OwnerChangesInPlace) {
+  SharedVector<int> V{1, 2, 3};
+  const int *Elts = V.get().data();
+  V.pop_back();
+  V.push_back(4);
+  EXPECT_EQ(Elts, V.get().data());
+  EXPECT_EQ((std::vector<int>{1, 2, 4}), V.get());
+}
+
+TEST(SharedVectorTest, PopSharedCopy) {
+  SharedVector<int> V{1, 2, 3};
+  const int *Elts = V.get().data();
+  SharedVector<int> Copy = V;
+
+  // popping a shared copy gives it its own elements, leaving the others
+  // where they were
+  Copy.pop_back();
+  EXPECT_NE(Elts, Copy.get().data());
+  EXPECT_EQ(Elts, V.get().data());
+  EXPECT_TRUE(Copy.unique());
+  EXPECT_TRUE(V.unique());
+  EXPECT_EQ((std::vector<int>{1, 2}), Copy.get());
+  EXPECT_EQ((std::vector<int>{1, 2, 3}), V.get());
+
+  Copy.pop_back();
+  Copy.pop_back();
+  EXPECT_TRUE(Copy.empty());
+  EXPECT_EQ(3u, V.size());
+  EXPECT_EQ(3, V.back());
+}
+
+TEST(SharedVectorTest, Clear) {
+  SharedVector<int> V{1, 2};
+  SharedVector<int> Copy = V;
+  Copy.clear();
+  EXPECT_TRUE(Copy.empty());
+  EXPECT_EQ(2u, V.size());
+
+  SharedVector<int> Empty;
+  EXPECT_TRUE(Empty.unique());
+  EXPECT_TRUE(Empty.empty());
+  Empty.clear();
+  EXPECT_EQ(0u, Empty.size());
+}
@@ -0,0 +1,259 @@
+// Copyright 2019 The Souper Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Emits the optimal known bits transfer functions of the binary operators
+// handled by BinaryTransferFunctionsKB as lookup tables, for all widths up to
+// -max-width. The tables are computed by exhaustively enumerating the
+// concretizations of both operands, so at these widths they are exact;
+// KnownBitsAnalysis combines them with the hand-written functions.
+//
+// Each table is emitted as KB_TABLE(Kind, Width, Entries...). An operand's
+// known bits are encoded in base 3, bit I contributing 3^I times 0 (unknown),
+// 1 (known zero) or 2 (known one); the entry for (LHS, RHS) lives at
+// LHS * 3^Width + RHS and holds the result's Zero bits in its low nibble and
+// its One bits in the high nibble. Results that are poison or UB for every
+// concrete input are reported as unknown.
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <functional>
+#include <optional>
+#include <vector>
+
+using namespace llvm;
+
+static cl::opt<std::string> OutputFilename("o",
+    cl::desc("Output file (default: stdout)"),
+    cl::init("-"));
+
+static cl::opt<unsigned> MaxWidth("max-width",
+    cl::desc("Largest operand width to emit tables for, at most 4 "
+             "(default=4)"),
+    cl::init(4));
+
+namespace {
+
+// nullopt stands for poison or UB
+using Semantics = std::function<std::optional<APInt>(APInt, APInt)>;
+
+struct TableOp {
+  const char *Kind;
+  Semantics F;
+  // comparisons produce an i1
+  bool Predicate = false;
+};
+
+std::optional<APInt> val(APInt V, bool Ov) {
+  if (Ov)
+    return std::nullopt;
+  return V;
+}
+
+std::optional<APInt> fromBool(bool B) {
+  return APInt(1, B);
+}
+
+// Mirrors the semantics of ConcreteInterpreter for these operators
+const std::vector<TableOp> Ops = {
+  {"Add", [](APInt A, APInt B) { return val(A + B, false); }},
+  {"AddNSW", [](APInt A, APInt B) {
+    bool Ov;
+    auto R = A.sadd_ov(B, Ov);
+    return val(R, Ov);
+  }},
+  {"AddNUW", [](APInt A, APInt B) {
+    bool Ov;
+    auto R = A.uadd_ov(B, Ov);
+    return val(R, Ov);
+  }},
+  {"AddNW", [](APInt A, APInt B) {
+    bool Ov1, Ov2;
+    auto R = A.sadd_ov(B, Ov1);
+    (void)A.uadd_ov(B, Ov2);
+    return val(R, Ov1 || Ov2);
+  }},
+  {"Sub", [](APInt A, APInt B) { return val(A - B, false); }},
+  {"SubNSW", [](APInt A, APInt B) {
+    bool Ov;
+    auto R = A.ssub_ov(B, Ov);
+    return val(R, Ov);
+  }},
+  {"SubNUW", [](APInt A, APInt B) {
+    bool Ov;
+    auto R = A.usub_ov(B, Ov);
+    return val(R, Ov);
+  }},
+  {"SubNW", [](APInt A, APInt B) {
+    bool Ov1, Ov2;
+    auto R = A.ssub_ov(B, Ov1);
+    (void)A.usub_ov(B, Ov2);
+    return val(R, Ov1 || Ov2);
+  }},
+  {"Mul", [](APInt A, APInt B) { return val(A * B, false); }},
+  {"MulNSW", [](APInt A, APInt B) {
+    bool Ov;
+    auto R = A.smul_ov(B, Ov);
+    return val(R, Ov);
+  }},
+  {"MulNUW", [](APInt A, APInt B) {
+    bool Ov;
+    auto R = A.umul_ov(B, Ov);
+    return val(R, Ov);
+  }},
+  {"MulNW", [](APInt A, APInt B) {
+    bool Ov1, Ov2;
+    auto R = A.smul_ov(B, Ov1);
+    (void)A.umul_ov(B, Ov2);
+    return val(R, Ov1 || Ov2);
+  }},
+  {"UDiv", [](APInt A, APInt B) -> std::optional<APInt> {
+    if (B == 0)
+      return std::nullopt;
+    return A.udiv(B);
+  }},
+  {"URem", [](APInt A, APInt B) -> std::optional<APInt> {
+    if (B == 0)
+      return std::nullopt;
+    return A.urem(B);
+  }},
+  {"Shl", [](APInt A, APInt B) {
+    return val(A.shl(B), B.uge(A.getBitWidth()));
+  }},
+  {"ShlNSW", [](APInt A, APInt B) {
+    bool Ov;
+    auto R = A.sshl_ov(B, Ov);
+    return val(R, Ov);
+  }},
+  {"ShlNUW", [](APInt A, APInt B) {
+    bool Ov;
+    auto R = A.ushl_ov(B, Ov);
+    return val(R, Ov);
+  }},
+  {"ShlNW", [](APInt A, APInt B) {
+    bool Ov1, Ov2;
+    auto R = A.ushl_ov(B, Ov1);
+    (void)A.sshl_ov(B, Ov2);
+    return val(R, Ov1 || Ov2);
+  }},
+  {"LShr", [](APInt A, APInt B) {
+    return val(A.lshr(B), B.uge(A.getBitWidth()));
+  }},
+  {"AShr", [](APInt A, APInt B) {
+    return val(A.ashr(B), B.uge(A.getBitWidth()));
+  }},
+  {"Eq", [](APInt A, APInt B) { return fromBool(A == B); }, true},
+  {"Ne", [](APInt A, APInt B) { return fromBool(A != B); }, true},
+  {"Ult", [](APInt A, APInt B) { return fromBool(A.ult(B)); }, true},
+  {"Slt", [](APInt A, APInt B) { return fromBool(A.slt(B)); }, true},
+  {"Ule", [](APInt A, APInt B) { return fromBool(A.ule(B)); }, true},
+  {"Sle", [](APInt A, APInt B) { return fromBool(A.sle(B)); }, true},
+};
+
+// Concrete values in the concretization of each encoded known bits value
+std::vector<std::vector<unsigned>> concretizations(unsigned Width) {
+  unsigned NumKB = 1;
+  for (unsigned I = 0; I < Width; ++I)
+    NumKB *= 3;
+  std::vector<std::vector<unsigned>> Result(NumKB);
+  for (unsigned V = 0; V < (1u << Width); ++V) {
+    // V belongs to every encoding whose known bits agree with it
+    for (unsigned Idx = 0; Idx < NumKB; ++Idx) {
+      bool Member = true;
+      for (unsigned I = 0, Rest = Idx; I < Width; ++I, Rest /= 3) {
+        unsigned Trit = Rest % 3;
+        bool Bit = (V >> I) & 1;
+        if ((Trit == 1 && Bit) || (Trit == 2 && !Bit))
+          Member = false;
+      }
+      if (Member)
+        Result[Idx].push_back(V);
+    }
+  }
+  return Result;
+}
+
+void emitTable(raw_ostream &OS, const TableOp &Op, unsigned Width) {
+  auto Conc = concretizations(Width);
+  unsigned NumKB = Conc.size();
+
+  // result of every concrete pair, computed once
+  std::vector<std::optional<APInt>> Concrete(1u << (2 * Width));
+  for (unsigned A = 0; A < (1u << Width); ++A)
+    for (unsigned B = 0; B < (1u << Width); ++B)
+      Concrete[(A << Width) | B] =
+        Op.F(APInt(Width, A), APInt(Width, B));
+
+  OS << "KB_TABLE(" << Op.Kind << ", " << Width;
+  for (unsigned L = 0; L < NumKB; ++L) {
+    for (unsigned R = 0; R < NumKB; ++R) {
+      bool Any = false;
+      uint64_t And = ~0ULL, Or = 0;
+      for (auto A : Conc[L]) {
+        for (auto B : Conc[R]) {
+          auto &C = Concrete[(A << Width) | B];
+          if (!C)
+            continue;
+          Any = true;
+          And &= C->getZExtValue();
+          Or |= C->getZExtValue();
+        }
+      }
+      unsigned Entry = 0;
+      if (Any) {
+        unsigned ResultWidth = Op.Predicate ? 1 : Width;
+        uint64_t Mask = (1ULL << ResultWidth) - 1;
+        unsigned Zero = ~Or & Mask;
+        unsigned One = And & Mask;
+        Entry = Zero | (One << 4);
+      }
+      if ((L * NumKB + R) % 12 == 0)
+        OS << ",\n ";
+      else
+        OS << ",";
+      OS << " 0x";
+      OS.write_hex(Entry);
+    }
+  }
+  OS << ")\n";
+}
+
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv);
+
+  if (MaxWidth < 1 || MaxWidth > 4) {
+    llvm::errs() << "-max-width must be between 1 and 4\n";
+    return 1;
+  }
+
+  std::error_code EC;
+  raw_fd_ostream OS(OutputFilename, EC, sys::fs::OF_Text);
+  if (EC) {
+    llvm::errs() << EC.message() << '\n';
+    return 1;
+  }
+
+  OS << "// Generated by gen-kb-tables, do not edit.\n\n";
+  OS << "#ifndef KB_TABLE_MAX_WIDTH\n#define KB_TABLE_MAX_WIDTH "
+     << MaxWidth << "\n#endif\n\n";
+  for (const auto &Op : Ops)
+    for (unsigned W = 1; W <= MaxWidth; ++W)
+      emitTable(OS, Op, W);
+
+  return 0;
+}